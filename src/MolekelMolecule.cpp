@@ -38,7 +38,6 @@
 #include <vtkCommand.h>
 #include <vtkImageData.h>
 #include <vtkProperty.h>
-#include <vtkMarchingCubes.h>
 #include <vtkPolyDataNormals.h>
 #include <vtkPolyDataMapper.h>
 #include <vtkCellArray.h>
@@ -48,6 +47,7 @@
 #include <vtkLookupTable.h>
 #include <vtkPolyData.h>
 #include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
 #include <vtkPointData.h>
 #include <vtkArrowSource.h>
 #include <vtkTransformFilter.h>
@@ -90,6 +90,13 @@
 #include <map>
 #include <functional>
 #include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // Molekel
 #include "utility/vtkSoMapper.h"
@@ -108,6 +115,12 @@
 #include "utility/System.h"
 #include "utility/vtkMSMSReader.h"
 #include "utility/vtkOpenGLGlyphMapper.h"
+#include "utility/OutOfCoreGrid.h"
+#include "utility/SASField.h"
+#include "utility/SolventExcludedSurface.h"
+#include "utility/SurfaceArea.h"
+#include "utility/ParallelMarchingCubes.h"
+#include "utility/GridValuesParser.h"
 
 using namespace std;
 using namespace OpenBabel;
@@ -117,11 +130,6 @@ extern bool GLSLShadersSupported(); // used to check if GLSL shaders are support
                                     // is created to decide if a vtkGLSLShaderActor or
                                     // simple actor should be created
 
-// use old Molekel code to compute electron density
-extern vtkImageData* vtk_process_calc( Molecule *mol, float *dim, int *ncubes, int key,
-                                       void ( *progressCBack )( int, int, void* ) = 0,
-                                       void* cbackData = 0 );
-
 /// Class used to find in a collection a vtkSmartPointer< T > where
 /// vtkSmartPointer< T type >.GetPointer() == T type *
 template < class T > class FindVtkPointer
@@ -159,7 +167,13 @@ MolekelMolecule::MolekelMolecule() : chemData_( 0 ),
                         sesSwitch_( 0 ),
                         stopSASComputation_( false ),
                         stopSESComputation_( false ),
-                        stopSESMSComputation_( false )
+                        stopSESMSComputation_( false ),
+                        isoGridCoarseStep_( 1 ),
+                        doublePrecisionGrids_( false ),
+                        gridMemoryBudget_( 0 ),
+                        sasSphereSplatting_( false ),
+                        inProcessSESMS_( true ),
+                        keepIsoGrids_( false )
 
 {
     // initialize shader program objects to default
@@ -173,6 +187,41 @@ MolekelMolecule::MolekelMolecule() : chemData_( 0 ),
     shaderSurfaceMap_[ ORBITAL_NEGATIVE_SURFACE ] = sp;
     shaderSurfaceMap_[ ORBITAL_NODAL_SURFACE ] = sp;
     shaderSurfaceMap_[ ORBITAL_POSITIVE_SURFACE ] = sp;
+    std::fill( stopCalc_, stopCalc_ + NUM_CALC_TYPES, false );
+}
+
+//--------------------------------------------------------------------------------
+namespace
+{
+    /// Returns the index of a grid data type in the stop flags.
+    int CalcTypeIndex( int type )
+    {
+        switch( type )
+        {
+        case CALC_ORB:  return 0;
+        case EL_DENS:   return 1;
+        case SPIN_DENS: return 2;
+        case MEP:       return 3;
+        default: break;
+        }
+        assert( false && "Invalid data type" );
+        return 0;
+    }
+}
+
+//--------------------------------------------------------------------------------
+void MolekelMolecule::InitCalcContext( ProcessCalcContext& ctx, int type, const volatile bool* stop ) const
+{
+    const int t = CalcTypeIndex( type );
+    ctx.SetScreeningTolerance( calcSettings_.GetScreeningTolerance() );
+    ctx.SetMEPOpeningAngle( calcSettings_.GetMEPOpeningAngle() );
+    ctx.SetDoublePrecision( calcSettings_.GetDoublePrecision() );
+    if( stop == 0 )
+    {
+        stopCalc_[ t ] = false;
+        stop = &stopCalc_[ t ];
+    }
+    ctx.SetStopFlag( stop );
 }
 
 
@@ -197,6 +246,34 @@ namespace
 
 #endif
 
+namespace
+{
+    /// Reports the progress of grid value parsing in grid files as status
+    /// messages while the object is alive; a message is sent only when the
+    /// completed percentage changes.
+    class GridLoadProgress
+    {
+        ILoadMoleculeCallback* cb_;
+        int percent_;
+        static void Callback( int completedStep, int totalSteps, void* cbackData )
+        {
+            GridLoadProgress* p = static_cast< GridLoadProgress* >( cbackData );
+            const int percent = totalSteps ? ( 100 * completedStep ) / totalSteps : 100;
+            if( percent == p->percent_ ) return;
+            p->percent_ = percent;
+            ostringstream msg;
+            msg << "Reading grid values " << percent << '%';
+            p->cb_->StatusMessage( msg.str() );
+        }
+    public:
+        GridLoadProgress( ILoadMoleculeCallback* cb ) : cb_( cb ), percent_( -1 )
+        {
+            if( cb_ ) SetGridLoadProgressCallback( Callback, this );
+        }
+        ~GridLoadProgress() { if( cb_ ) SetGridLoadProgressCallback( 0, 0 ); }
+    };
+}
+
 MolekelMolecule* MolekelMolecule::New( const char* fname,
                                        const char* format,
                                        ILoadMoleculeCallback* cb,
@@ -227,6 +304,7 @@ MolekelMolecule* MolekelMolecule::New( const char* fname,
         Timer< TimerFun > t1( TimerFun( "OpenBabel load time:" ) );
 #endif
         bool ok = false;
+        GridLoadProgress gridLoadProgress( cb );
         // multi-molecule format
         if( obformat == "pdb" || obformat == "xyz" )
         {
@@ -922,22 +1000,12 @@ namespace
     }
 
     //--------------------------------------------------------------------------------
-    /// Free function returning a vtkActor containing an iso-surface generated
-    /// from grid data and value.
-    vtkActor* GenerateIsoSurfaceActor( vtkImageData* data, double value )
+    /// Free function returning a vtkActor containing an already extracted
+    /// iso-surface; value is the isovalue used to extract the surface.
+    vtkActor* GenerateIsoSurfaceActor( vtkPolyData* pd, double value )
     {
-        assert( data );
-        vtkSmartPointer< vtkMarchingCubes > mc( vtkMarchingCubes::New() );
-        mc->SetInput( data );
-        mc->ComputeNormalsOn();
-        mc->GenerateValues( 1, value, value );
-        mc->Update();
-        // Copy poly data and use copy as mapper input:
-        // this is required for further modification of
-        // polydata through vtkActor::GetMapper::GetInput().
-        vtkSmartPointer< vtkPolyData > pd( vtkPolyData::New() );
-        pd->DeepCopy( mc->GetOutput() );
-        if( !pd || pd->GetNumberOfCells() == 0 ) return 0;
+        assert( pd );
+        if( pd->GetNumberOfCells() == 0 ) return 0;
         vtkSmartPointer< vtkPolyDataMapper > mapper( vtkPolyDataMapper::New() );
         mapper->ScalarVisibilityOff();
 
@@ -955,11 +1023,26 @@ namespace
         return actor;
     }
 
+    //--------------------------------------------------------------------------------
+    /// Free function returning a vtkActor containing an iso-surface generated
+    /// from grid data and value.
+    vtkActor* GenerateIsoSurfaceActor( vtkImageData* data, double value )
+    {
+        assert( data );
+        // the extracted poly data is not connected to any pipeline and can
+        // be further modified through vtkActor::GetMapper::GetInput().
+        vtkSmartPointer< vtkPolyData > pd( ExtractIsoSurface( data, value ) );
+        if( pd == 0 ) return 0;
+        pd->Delete();
+        return GenerateIsoSurfaceActor( pd, value );
+    }
 
     //--------------------------------------------------------------------------------
     /// Free function returning an actor containing a molecular orbital surface
-    /// generated form grid data and value.
-    vtkActor* GenerateMOActor( vtkImageData* data, double value )
+    /// generated form grid data (vtkImageData) or extracted surface (vtkPolyData)
+    /// and value.
+    template < class DataT >
+    vtkActor* GenerateMOActor( DataT* data, double value )
     {
         vtkActor* actor = GenerateIsoSurfaceActor( data, value );
         if( !actor ) return 0;
@@ -970,33 +1053,65 @@ namespace
         MakeShinyMaterialType( p );
         return actor;
     }
+
+    //--------------------------------------------------------------------------------
+    /// Returns the isovalues of the orbital surfaces, in the order used to
+    /// create the surface actors: negative or positive value, positive value
+    /// if both signs are requested, zero if the nodal surface is requested.
+    void GetOrbitalIsoValues( double value, bool bothSigns, bool nodalSurface,
+                              std::vector< double >& isoValues )
+    {
+        isoValues.clear();
+        if( bothSigns )
+        {
+            isoValues.push_back( -std::fabs( value ) );
+            isoValues.push_back( std::fabs( value ) );
+        }
+        else isoValues.push_back( value );
+        if( nodalSurface ) isoValues.push_back( 0. );
+    }
+
+    //--------------------------------------------------------------------------------
+    /// Progress of the computation of a tile of slabs of an out of core grid.
+    struct TileProgress
+    {
+        ProgressCallback cb;
+        void* cbData;
+        int firstSlab;
+        int numSlabs;
+        int totalSlabs;
+    };
+
+    //--------------------------------------------------------------------------------
+    /// Maps the progress of the computation of a tile to the progress of the
+    /// whole grid, in thousandths: the number of points of a grid too large
+    /// to fit into memory might not fit into an int.
+    void TileProgressCallback( int step, int totalSteps, void* data )
+    {
+        const TileProgress* p = static_cast< const TileProgress* >( data );
+        const double slabs = p->firstSlab + p->numSlabs * double( step ) / totalSteps;
+        p->cb( int( 1000. * slabs / p->totalSlabs ), 1000, p->cbData );
+    }
 }
 
 //------------------------------------------------------------------------------
-/// Molecular orbital to compute.
-extern  MolecularOrbital* molOrb;
-
 vtkImageData* MolekelMolecule::GenerateMOGridData( int orbitalIndex,
                                                    double bboxSize[ 3 ],
                                                    int steps[ 3 ],
                                                    ProgressCallback cb,
-                                                   void* cbData ) const
+                                                   void* cbData,
+                                                   const volatile bool* stop ) const
 {
     int ftype = CALC_ORB; // use EL_DENS for density matrix
     float dim[6];
 //    int   ncub[3];
-    molOrb = &GetOrbital( orbitalIndex, molekelMol_ );
-    double x, y, z;
-    GetIsoBoundingBoxCenter( x, y, z );
-    dim[ 0 ] =  float( x - bboxSize[ 0 ] * .5 );
-    dim[ 1 ] =  float( x + bboxSize[ 0 ] * .5 );
-    dim[ 2 ] =  float( y - bboxSize[ 1 ] * .5 );
-    dim[ 3 ] =  float( y + bboxSize[ 1 ] * .5 );
-    dim[ 4 ] =  float( z - bboxSize[ 2 ] * .5 );
-    dim[ 5 ] =  float( z + bboxSize[ 2 ] * .5 );
+    ProcessCalcContext ctx;
+    InitCalcContext( ctx, CALC_ORB, stop );
+    ctx.SetOrbital( &GetOrbital( orbitalIndex, molekelMol_ ) );
+    GetIsoGridBounds( bboxSize, dim );
 
     vtkImageData* data =
-        vtk_process_calc( molekelMol_, dim, steps, ftype, cb, cbData );
+        vtk_process_calc( ctx, molekelMol_, dim, steps, ftype, cb, cbData );
     if( data == 0 ) throw MolekelException( "Error computing Molecular Orbital" );
 
     return data;
@@ -1019,10 +1134,266 @@ vtkImageData* MolekelMolecule::GenerateMOGridData( int orbitalIndex,
     steps[ 0 ] = int( dx / step + .5 );
     steps[ 1 ] = int( dy / step + .5 );
     steps[ 2 ] = int( dz / step + .5 );
-    molOrb = &GetOrbital( orbitalIndex, molekelMol_ );
     return GenerateMOGridData( orbitalIndex, bboxSize, steps, cb, cbData );
 }
 
+//------------------------------------------------------------------------------
+void MolekelMolecule::GenerateMOGridData( const std::vector< int >& orbitalIndices,
+                                          double bboxSize[ 3 ],
+                                          int steps[ 3 ],
+                                          std::vector< vtkSmartPointer< vtkImageData > >& data,
+                                          ProgressCallback cb,
+                                          void* cbData ) const
+{
+    data.clear();
+    if( orbitalIndices.empty() ) return;
+    std::vector< const MolecularOrbital* > orbitals;
+    for( std::vector< int >::const_iterator i = orbitalIndices.begin();
+         i != orbitalIndices.end(); ++i )
+    {
+        orbitals.push_back( &GetOrbital( *i, molekelMol_ ) );
+    }
+    float dim[ 6 ];
+    GetIsoGridBounds( bboxSize, dim );
+
+    std::vector< vtkImageData* > images( orbitals.size() );
+    ProcessCalcContext ctx;
+    InitCalcContext( ctx, CALC_ORB, 0 );
+    if( !vtk_process_calc_orbitals( ctx, molekelMol_, &orbitals[ 0 ], int( orbitals.size() ),
+                                    dim, steps, &images[ 0 ], cb, cbData ) )
+    {
+        throw MolekelException( "Error computing Molecular Orbital" );
+    }
+    // images returned by vtk_process_calc_orbitals are owned by the caller:
+    // transfer ownership to the smart pointers
+    data.resize( images.size() );
+    for( std::vector< vtkImageData* >::size_type i = 0; i != images.size(); ++i )
+    {
+        data[ i ] = images[ i ];
+        images[ i ]->Delete();
+    }
+}
+
+//------------------------------------------------------------------------------
+vtkImageData* MolekelMolecule::GenerateMOIsoGridData( int orbitalIndex,
+                                                      double bboxSize[ 3 ],
+                                                      int steps[ 3 ],
+                                                      double value,
+                                                      bool bothSigns,
+                                                      bool nodalSurface,
+                                                      ProgressCallback cb,
+                                                      void* cbData ) const
+{
+    if( isoGridCoarseStep_ < 2 ) return GenerateMOGridData( orbitalIndex, bboxSize, steps, cb, cbData );
+    std::vector< double > isoValues;
+    GetOrbitalIsoValues( value, bothSigns, nodalSurface, isoValues );
+    float dim[ 6 ];
+    ProcessCalcContext ctx;
+    InitCalcContext( ctx, CALC_ORB, 0 );
+    ctx.SetOrbital( &GetOrbital( orbitalIndex, molekelMol_ ) );
+    GetIsoGridBounds( bboxSize, dim );
+    vtkImageData* data =
+        vtk_process_calc_adaptive( ctx, molekelMol_, dim, steps, CALC_ORB,
+                                   &isoValues[ 0 ], int( isoValues.size() ),
+                                   isoGridCoarseStep_, cb, cbData );
+    if( data == 0 ) throw MolekelException( "Error computing Molecular Orbital" );
+    return data;
+}
+
+//------------------------------------------------------------------------------
+void MolekelMolecule::GetIsoGridBounds( double bboxSize[ 3 ], float dim[ 6 ] ) const
+{
+    double x, y, z;
+    GetIsoBoundingBoxCenter( x, y, z );
+    dim[ 0 ] =  float( x - bboxSize[ 0 ] * .5 );
+    dim[ 1 ] =  float( x + bboxSize[ 0 ] * .5 );
+    dim[ 2 ] =  float( y - bboxSize[ 1 ] * .5 );
+    dim[ 3 ] =  float( y + bboxSize[ 1 ] * .5 );
+    dim[ 4 ] =  float( z - bboxSize[ 2 ] * .5 );
+    dim[ 5 ] =  float( z + bboxSize[ 2 ] * .5 );
+}
+
+//------------------------------------------------------------------------------
+MolekelMolecule::IsoGridCache::IsoGridCache() :
+    type( -1 ), orbital( -1 ), stepMultiplier( 0 ), doublePrecision( false ), source( 0 )
+{
+    std::fill( dim, dim + 6, 0.f );
+    std::fill( steps, steps + 3, 0 );
+}
+
+//------------------------------------------------------------------------------
+bool MolekelMolecule::IsoGridCache::SameGrid( const IsoGridCache& c ) const
+{
+    return type == c.type && orbital == c.orbital && label == c.label &&
+           stepMultiplier == c.stepMultiplier &&
+           std::equal( dim, dim + 6, c.dim ) && std::equal( steps, steps + 3, c.steps ) &&
+           doublePrecision == c.doublePrecision && source == c.source;
+}
+
+//------------------------------------------------------------------------------
+MolekelMolecule::IsoGridCache MolekelMolecule::GetIsoGridParameters( int type,
+                                                                     int orbitalIndex,
+                                                                     double bboxSize[ 3 ],
+                                                                     int steps[ 3 ] ) const
+{
+    IsoGridCache grid;
+    grid.type = type;
+    if( type == CALC_ORB ) grid.orbital = orbitalIndex;
+    GetIsoGridBounds( bboxSize, grid.dim );
+    std::copy( steps, steps + 3, grid.steps );
+    grid.doublePrecision = doublePrecisionGrids_;
+    return grid;
+}
+
+//------------------------------------------------------------------------------
+const IsoSurfaceIndex& MolekelMolecule::GetIsoGridIndex( int type,
+                                                         int orbitalIndex,
+                                                         double bboxSize[ 3 ],
+                                                         int steps[ 3 ],
+                                                         ProgressCallback cb,
+                                                         void* cbData )
+{
+    const IsoGridCache grid = GetIsoGridParameters( type, orbitalIndex, bboxSize, steps );
+    if( isoGridCache_.index.GetGrid() != 0 && isoGridCache_.SameGrid( grid ) )
+    {
+        return isoGridCache_.index;
+    }
+    isoGridCache_.index.Clear(); // release memory before computing the new grid
+    vtkSmartPointer< vtkImageData > data( type == CALC_ORB ?
+                                          GenerateMOGridData( orbitalIndex, bboxSize, steps, cb, cbData ) :
+                                          GenerateDensityData( type, bboxSize, steps, cb, cbData ) );
+    data->Delete();
+    // a stopped computation returns a partially computed grid: neither cache
+    // nor index it, the returned index is empty
+    if( stopCalc_[ CalcTypeIndex( type ) ] ) return isoGridCache_.index;
+    isoGridCache_ = grid;
+    isoGridCache_.index.Build( data );
+    return isoGridCache_.index;
+}
+
+//------------------------------------------------------------------------------
+const IsoSurfaceIndex& MolekelMolecule::GetGridDataIndex( const std::string& label,
+                                                          int stepMultiplier,
+                                                          ProgressCallback cb,
+                                                          void* cbData )
+{
+    IsoGridCache grid;
+    grid.label = label;
+    grid.stepMultiplier = stepMultiplier;
+    grid.doublePrecision = doublePrecisionGrids_;
+    if( HasGridData() ) grid.source = obMol_->GetData( format_ != "t41" ? "GridData" : "T41Data" );
+    if( gridDataCache_.index.GetGrid() != 0 && gridDataCache_.SameGrid( grid ) )
+    {
+        return gridDataCache_.index;
+    }
+    gridDataCache_.index.Clear(); // release memory before converting the new grid
+    vtkSmartPointer< vtkImageData > data( GridDataToVtkImageData( label, stepMultiplier, cb, cbData ) );
+    if( data == 0 ) return gridDataCache_.index;
+    data->Delete();
+    gridDataCache_ = grid;
+    gridDataCache_.index.Build( data );
+    return gridDataCache_.index;
+}
+
+//------------------------------------------------------------------------------
+bool MolekelMolecule::HasIsoGrid( int orbitalIndex, double bboxSize[ 3 ], int steps[ 3 ] ) const
+{
+    // adaptive and out of core grids are not kept
+    if( isoGridCoarseStep_ >= 2 || ExceedsGridMemoryBudget( steps ) ) return false;
+    if( isoGridCache_.index.GetGrid() == 0 ) return false;
+    return isoGridCache_.SameGrid(
+        GetIsoGridParameters( orbitalIndex < 0 ? EL_DENS : CALC_ORB, orbitalIndex, bboxSize, steps ) );
+}
+
+//------------------------------------------------------------------------------
+void MolekelMolecule::KeepIsoGrid( int orbitalIndex,
+                                   double bboxSize[ 3 ],
+                                   int steps[ 3 ],
+                                   vtkImageData* data )
+{
+    assert( data );
+    if( !keepIsoGrids_ || isoGridCoarseStep_ >= 2 || ExceedsGridMemoryBudget( steps ) ) return;
+    isoGridCache_ =
+        GetIsoGridParameters( orbitalIndex < 0 ? EL_DENS : CALC_ORB, orbitalIndex, bboxSize, steps );
+    isoGridCache_.index.Build( data );
+}
+
+//------------------------------------------------------------------------------
+void MolekelMolecule::ReleaseIsoGrids()
+{
+    isoGridCache_.index.Clear();
+    gridDataCache_.index.Clear();
+}
+
+//------------------------------------------------------------------------------
+void MolekelMolecule::SetKeepIsoGrids( bool keep )
+{
+    keepIsoGrids_ = keep;
+    if( !keep ) ReleaseIsoGrids();
+}
+
+//------------------------------------------------------------------------------
+bool MolekelMolecule::ExceedsGridMemoryBudget( const int steps[ 3 ] ) const
+{
+    if( gridMemoryBudget_ == 0 ) return false;
+    const double valueSize = doublePrecisionGrids_ ? sizeof( double ) : sizeof( float );
+    return double( steps[ 0 ] ) * steps[ 1 ] * steps[ 2 ] * valueSize > double( gridMemoryBudget_ );
+}
+
+//------------------------------------------------------------------------------
+void MolekelMolecule::GenerateOutOfCoreIsoSurfaces( int ftype,
+                                                    int orbitalIndex,
+                                                    double bboxSize[ 3 ],
+                                                    int steps[ 3 ],
+                                                    const std::vector< double >& values,
+                                                    std::vector< vtkSmartPointer< vtkPolyData > >& surfaces,
+                                                    ProgressCallback cb,
+                                                    void* cbData ) const
+{
+    surfaces.clear();
+    float dim[ 6 ];
+    GetIsoGridBounds( bboxSize, dim );
+    const double origin[ 3 ] = { dim[ 0 ], dim[ 2 ], dim[ 4 ] };
+    // same spacing as the grids returned by vtk_process_calc
+    const double spacing[ 3 ] = { ( dim[ 1 ] - dim[ 0 ] ) / ( steps[ 0 ] - 1 ),
+                                  ( dim[ 3 ] - dim[ 2 ] ) / ( steps[ 1 ] - 1 ),
+                                  ( dim[ 5 ] - dim[ 4 ] ) / ( steps[ 2 ] - 1 ) };
+    OutOfCoreGrid grid( steps, origin, spacing );
+    if( !grid.IsOpen() ) throw MolekelException( "Cannot create temporary grid file" );
+
+    // half of the budget is used to compute the tiles, the other half is left
+    // to the extraction of the surfaces from the tiles
+    const size_t sliceSize = size_t( steps[ 0 ] ) * steps[ 1 ];
+    const size_t budgetSlabs = gridMemoryBudget_ / ( 2 * sliceSize * sizeof( float ) );
+    const int slabsPerTile = int( std::max( size_t( 2 ), std::min( budgetSlabs, size_t( steps[ 2 ] ) ) ) );
+    std::vector< float > tile( slabsPerTile * sliceSize );
+    ProcessCalcContext ctx;
+    InitCalcContext( ctx, ftype, 0 );
+    if( ftype == CALC_ORB ) ctx.SetOrbital( &GetOrbital( orbitalIndex, molekelMol_ ) );
+    TileProgress progress = { cb, cbData, 0, 0, steps[ 2 ] };
+    for( int firstSlab = 0; firstSlab < steps[ 2 ]; firstSlab += slabsPerTile )
+    {
+        const int numSlabs = std::min( slabsPerTile, steps[ 2 ] - firstSlab );
+        progress.firstSlab = firstSlab;
+        progress.numSlabs = numSlabs;
+        if( !vtk_process_calc_slabs( ctx, molekelMol_, dim, steps, ftype, firstSlab, numSlabs,
+                                     &tile[ 0 ], cb ? TileProgressCallback : 0, &progress ) )
+        {
+            if( ctx.Stopped() ) return;
+            throw MolekelException( "Error computing grid data" );
+        }
+        if( !grid.AppendSlabs( &tile[ 0 ], numSlabs ) )
+        {
+            throw MolekelException( "Error writing temporary grid file" );
+        }
+    }
+    std::vector< float >().swap( tile ); // release memory before extracting surfaces
+    if( !grid.ExtractIsoSurfaces( values, slabsPerTile, surfaces ) )
+    {
+        throw MolekelException( "Error reading temporary grid file" );
+    }
+}
+
 //--------------------------------------------------------------------------------
 bool MolekelMolecule::AddOrbitalSurface( int orbitalIndex,
                                          double bboxSize[ 3 ],
@@ -1041,37 +1412,164 @@ bool MolekelMolecule::AddOrbitalSurface( int orbitalIndex,
     SaveTransform(); // push current transform
     ResetTransform(); // set to default (identity)
 
-    // create surface from data
-    vtkSmartPointer< vtkActor > minusActor( 0 );
-    vtkSmartPointer< vtkActor > zeroActor( 0 );
-    vtkSmartPointer< vtkActor > plusActor( 0 );
-
-    vtkSmartPointer< vtkImageData > data(
-                        GenerateMOGridData( orbitalIndex, bboxSize, steps, cb, cbData ) );
+    bool added = false;
+    if( ExceedsGridMemoryBudget( steps ) )
+    {
+        added = AddOutOfCoreOrbitalSurface( orbitalIndex, bboxSize, steps, value,
+                                            bothSigns, nodalSurface, cb, cbData );
+    }
+    else if( isoGridCoarseStep_ < 2 )
+    {
+        // the grid is kept to extract surfaces at different isovalues if enabled
+        const IsoSurfaceIndex& index = GetIsoGridIndex( CALC_ORB, orbitalIndex, bboxSize, steps,
+                                                        cb, cbData );
+        std::vector< double > isoValues;
+        GetOrbitalIsoValues( value, bothSigns, nodalSurface, isoValues );
+        std::vector< vtkSmartPointer< vtkPolyData > > surfaces;
+        const bool extracted = ExtractIsoSurfaces( index, isoValues, surfaces );
+        ReleaseUnusedIsoGrids();
+        if( extracted )
+        {
+            added = AddOrbitalIsoSurfaces( orbitalIndex, surfaces, value, bothSigns, nodalSurface );
+        }
+    }
+    else
+    {
+        vtkSmartPointer< vtkImageData > data(
+                            GenerateMOIsoGridData( orbitalIndex, bboxSize, steps, value,
+                                                   bothSigns, nodalSurface, cb, cbData ) );
+        added = AddOrbitalSurface( orbitalIndex, data, value, bothSigns, nodalSurface );
+    }
+    RestoreTransform();
+    return added;
+}
 
+//--------------------------------------------------------------------------------
+int MolekelMolecule::AddOrbitalSurfaces( const std::vector< int >& orbitalIndices,
+                                         double bboxSize[ 3 ],
+                                         int steps[ 3 ],
+                                         double value,
+                                         bool bothSigns,
+                                         bool nodalSurface,
+                                         ProgressCallback cb,
+                                         void* cbData )
+{
+    // skip orbitals already in map
+    std::vector< int > indices;
+    for( std::vector< int >::const_iterator i = orbitalIndices.begin();
+         i != orbitalIndices.end(); ++i )
+    {
+        if( orbitalActorMap_.find( *i ) == orbitalActorMap_.end() ) indices.push_back( *i );
+    }
+    if( indices.empty() ) return 0;
 
-    if( !bothSigns )
+    // adaptive and out of core grids are computed one orbital at a time
+    if( isoGridCoarseStep_ >= 2 || ExceedsGridMemoryBudget( steps ) )
     {
-        if( value < 0 )
+        int added = 0;
+        for( std::vector< int >::size_type i = 0; i != indices.size(); ++i )
         {
-             minusActor = GenerateMOActor( data, value );
+            if( AddOrbitalSurface( indices[ i ], bboxSize, steps, value,
+                                   bothSigns, nodalSurface, cb, cbData ) ) ++added;
         }
-        else plusActor = GenerateMOActor( data, value );
+        return added;
+    }
+
+    SaveTransform(); // push current transform
+    ResetTransform(); // set to default (identity)
 
+    std::vector< vtkSmartPointer< vtkImageData > > data;
+    GenerateMOGridData( indices, bboxSize, steps, data, cb, cbData );
+    int added = 0;
+    for( std::vector< int >::size_type i = 0; i != indices.size(); ++i )
+    {
+        if( AddOrbitalSurface( indices[ i ], data[ i ], value, bothSigns, nodalSurface ) ) ++added;
     }
-    else
+    RestoreTransform();
+    return added;
+}
+
+//--------------------------------------------------------------------------------
+bool MolekelMolecule::ReplaceOrbitalSurface( int orbitalIndex,
+                                             vtkImageData* data,
+                                             double value,
+                                             bool bothSigns,
+                                             bool nodalSurface )
+{
+    // check if index is valid
+    GetOrbital( orbitalIndex, molekelMol_ );
+    if( HasOrbitalSurface( orbitalIndex ) ) RemoveOrbitalSurface( orbitalIndex );
+    SaveTransform(); // push current transform
+    ResetTransform(); // set to default (identity)
+    const bool added = AddOrbitalSurface( orbitalIndex, data, value, bothSigns, nodalSurface );
+    RestoreTransform();
+    return added;
+}
+
+//--------------------------------------------------------------------------------
+bool MolekelMolecule::AddOrbitalSurface( int orbitalIndex,
+                                         vtkImageData* data,
+                                         double value,
+                                         bool bothSigns,
+                                         bool nodalSurface )
+{
+    // extract the surfaces of all the isovalues with a single pass over the grid
+    std::vector< double > isoValues;
+    GetOrbitalIsoValues( value, bothSigns, nodalSurface, isoValues );
+    std::vector< vtkSmartPointer< vtkPolyData > > surfaces;
+    if( !ExtractIsoSurfaces( data, isoValues, surfaces ) ) return false;
+    return AddOrbitalIsoSurfaces( orbitalIndex, surfaces, value, bothSigns, nodalSurface );
+}
+
+//--------------------------------------------------------------------------------
+bool MolekelMolecule::AddOutOfCoreOrbitalSurface( int orbitalIndex,
+                                                  double bboxSize[ 3 ],
+                                                  int steps[ 3 ],
+                                                  double value,
+                                                  bool bothSigns,
+                                                  bool nodalSurface,
+                                                  ProgressCallback cb,
+                                                  void* cbData )
+{
+    std::vector< double > isoValues;
+    GetOrbitalIsoValues( value, bothSigns, nodalSurface, isoValues );
+    std::vector< vtkSmartPointer< vtkPolyData > > surfaces;
+    GenerateOutOfCoreIsoSurfaces( CALC_ORB, orbitalIndex, bboxSize, steps, isoValues, surfaces, cb, cbData );
+    if( surfaces.empty() ) return false; // stopped
+    return AddOrbitalIsoSurfaces( orbitalIndex, surfaces, value, bothSigns, nodalSurface );
+}
+
+//--------------------------------------------------------------------------------
+bool MolekelMolecule::AddOrbitalIsoSurfaces( int orbitalIndex,
+                                             const std::vector< vtkSmartPointer< vtkPolyData > >& surfaces,
+                                             double value,
+                                             bool bothSigns,
+                                             bool nodalSurface )
+{
+    // one surface per isovalue, in the order returned by GetOrbitalIsoValues
+    vtkSmartPointer< vtkActor > minusActor( 0 );
+    vtkSmartPointer< vtkActor > zeroActor( 0 );
+    vtkSmartPointer< vtkActor > plusActor( 0 );
+    if( !bothSigns )
     {
-        minusActor = GenerateMOActor( data, -abs( value ) );
-        // how do we clone a vtkActor ?
-        plusActor = GenerateMOActor( data, abs( value ) );
+        if( value < 0 ) minusActor = GenerateMOActor( surfaces[ 0 ].GetPointer(), value );
+        else plusActor = GenerateMOActor( surfaces[ 0 ].GetPointer(), value );
     }
-    if( nodalSurface )
+    else
     {
-         zeroActor = GenerateMOActor( data, 0 );
-         // zeroActor = GenerateMOActor( data, value );
-         // how do we clone a vtkActor ?
+        minusActor = GenerateMOActor( surfaces[ 0 ].GetPointer(), -std::fabs( value ) );
+        plusActor = GenerateMOActor( surfaces[ 1 ].GetPointer(), std::fabs( value ) );
     }
+    if( nodalSurface ) zeroActor = GenerateMOActor( surfaces.back().GetPointer(), 0 );
+    return AddOrbitalSurfaceActors( orbitalIndex, minusActor, zeroActor, plusActor );
+}
 
+//--------------------------------------------------------------------------------
+bool MolekelMolecule::AddOrbitalSurfaceActors( int orbitalIndex,
+                                               vtkActor* minusActor,
+                                               vtkActor* zeroActor,
+                                               vtkActor* plusActor )
+{
     vtkSmartPointer< vtkAssembly > assembly( vtkAssembly::New() );
 
     int typeMask = 0;
@@ -1093,9 +1591,9 @@ bool MolekelMolecule::AddOrbitalSurface( int orbitalIndex,
 
     if( GLSLShadersSupported() ) // in this case the actors are vtkGLSLShaderActors
     {
-        vtkGLSLShaderActor* ma = dynamic_cast< vtkGLSLShaderActor* >( minusActor.GetPointer() );
-        vtkGLSLShaderActor* za = dynamic_cast< vtkGLSLShaderActor* >( zeroActor.GetPointer() );
-        vtkGLSLShaderActor* pa = dynamic_cast< vtkGLSLShaderActor* >( plusActor.GetPointer() );
+        vtkGLSLShaderActor* ma = dynamic_cast< vtkGLSLShaderActor* >( minusActor );
+        vtkGLSLShaderActor* za = dynamic_cast< vtkGLSLShaderActor* >( zeroActor );
+        vtkGLSLShaderActor* pa = dynamic_cast< vtkGLSLShaderActor* >( plusActor );
         if( ma )
         {
             shaderSurfaceMap_[ ORBITAL_NEGATIVE_SURFACE ].actors.push_back( ma );
@@ -1123,7 +1621,6 @@ bool MolekelMolecule::AddOrbitalSurface( int orbitalIndex,
         // add assembly to molecule assembly_
         assembly_->AddPart( assembly );
         RecomputeBBox();
-        RestoreTransform();
         return true;
     }
     else
@@ -1258,19 +1755,112 @@ void MolekelMolecule::ResetTransform()
 //--------------------------------------------------------------------------------
 void MolekelMolecule::StopMOGridDataGeneration()
 {
-extern void StopProcessCalc();
-    StopProcessCalc();
+    stopCalc_[ CalcTypeIndex( CALC_ORB ) ] = true;
 }
 
 //--------------------------------------------------------------------------------
 bool MolekelMolecule::MOGridDataGenerationStopped()
 {
-extern bool ProcessCalcStopped();
-extern int 	GetProcessCalcDataType();
-    return ProcessCalcStopped() && GetProcessCalcDataType() == CALC_ORB;
+    return stopCalc_[ CalcTypeIndex( CALC_ORB ) ];
 }
 
 
+//--------------------------------------------------------------------------------
+namespace
+{
+    /// Returns true if called from the thread which started the current
+    /// parallel region (or from outside parallel regions); used to invoke
+    /// progress callbacks which usually update the GUI.
+    inline bool IsMasterThread()
+    {
+#ifdef _OPENMP
+        return omp_get_thread_num() == 0;
+#else
+        return true;
+#endif
+    }
+
+    /// Reads values from the value array of OBGridData or OBT41Data, both
+    /// stored with x varying fastest.
+    class GridDataValue
+    {
+        const double* values_;
+        int npx_;
+        int npy_;
+    public:
+        GridDataValue( vtkDoubleArray* values, int npx, int npy )
+            : values_( values->GetPointer( 0 ) ), npx_( npx ), npy_( npy ) {}
+        double operator()( int i, int j, int k ) const
+        {
+            return values_[ i + size_t( npx_ ) * ( j + size_t( npy_ ) * k ) ];
+        }
+    };
+
+    /// Assigns the values read from file to the scalars of a grid with the
+    /// same number of points: the array is shared, not copied, and stays
+    /// alive as long as either the grid or the molecule data reference it.
+    void ShareGridValues( vtkDoubleArray* values, vtkImageData* grid )
+    {
+        assert( values->GetNumberOfTuples() == grid->GetNumberOfPoints() );
+        grid->SetScalarTypeToDouble();
+        grid->SetNumberOfScalarComponents( 1 );
+        grid->GetPointData()->SetScalars( values );
+    }
+
+    /// Copies the values of grid data read from file into the scalars of
+    /// a vtkImageData, taking one point every stepMultiplier points along each
+    /// axis; the scalars are written through a raw pointer, one z slab per
+    /// iteration of the parallel loop.
+    template < class ScalarT, class ValueT >
+    void CopyGridValues( const ValueT& value, int stepMultiplier, vtkImageData* grid,
+                         ProgressCallback cb, void* cbData )
+    {
+        const int nx = grid->GetDimensions()[ 0 ];
+        const int ny = grid->GetDimensions()[ 1 ];
+        const int nz = grid->GetDimensions()[ 2 ];
+        ScalarT* scalars = static_cast< ScalarT* >( grid->GetScalarPointer() );
+        const int totalSteps = nx * ny * nz;
+        if( cb ) cb( 0, totalSteps, cbData );
+        int completedSlabs = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule( dynamic, 1 )
+#endif
+        for( int k = 0; k < nz; ++k )
+        {
+            ScalarT* slab = scalars + size_t( k ) * nx * ny;
+            for( int j = 0; j != ny; ++j )
+            {
+                for( int i = 0; i != nx; ++i )
+                {
+                    slab[ i + nx * j ] = ScalarT( value( i * stepMultiplier,
+                                                         j * stepMultiplier,
+                                                         k * stepMultiplier ) );
+                }
+            }
+            int completed = 0;
+#ifdef _OPENMP
+#pragma omp critical( grid_values_progress )
+#endif
+            completed = ++completedSlabs;
+            if( cb && IsMasterThread() ) cb( completed * nx * ny, totalSteps, cbData );
+        }
+    }
+
+    /// Allocates the scalars of a grid with float or double precision and
+    /// copies the grid values.
+    template < class ValueT >
+    void CopyGridValues( const ValueT& value, int stepMultiplier, vtkImageData* grid,
+                         bool doublePrecision, ProgressCallback cb, void* cbData )
+    {
+        if( doublePrecision ) grid->SetScalarTypeToDouble();
+        else grid->SetScalarTypeToFloat();
+        grid->SetNumberOfScalarComponents( 1 );
+        grid->AllocateScalars();
+        if( doublePrecision ) CopyGridValues< double >( value, stepMultiplier, grid, cb, cbData );
+        else CopyGridValues< float >( value, stepMultiplier, grid, cb, cbData );
+    }
+}
+
 //--------------------------------------------------------------------------------
 vtkImageData* MolekelMolecule::GridDataToVtkImageData( const std::string& label,
                                                        int stepMultiplier,
@@ -1305,26 +1895,10 @@ vtkImageData* MolekelMolecule::GridDataToVtkImageData( const std::string& label,
         grid->SetDimensions( npx / stepMultiplier, npy / stepMultiplier , npz / stepMultiplier );
         grid->SetOrigin( origin );
         grid->SetSpacing( xStep, yStep, zStep );
-        const int totalSteps = npx * npy * npz;
-        //initialize callback
-        if( cb ) cb( 0, totalSteps, cbData );
-        int i, j, k;
-        for( i = 0; i < npx; i += stepMultiplier )
-        {
-            for( j = 0; j < npy; j += stepMultiplier )
-            {
-                for( k = 0; k < npz; k += stepMultiplier )
-                {
-                    const double s = gd->GetValue( i, j, k );
-                    grid->SetScalarComponentFromDouble( i / stepMultiplier,
-                                                        j / stepMultiplier,
-                                                        k / stepMultiplier, 0, s );
-                }
-            }
-            const int idx = ( i + 1 ) * ( npz * npy );
-            if( cb ) cb( idx, totalSteps, cbData );
-        }
-
+        // 3) share values, or copy one value every stepMultiplier values
+        if( stepMultiplier == 1 ) ShareGridValues( gd->GetValues(), grid );
+        else CopyGridValues( GridDataValue( gd->GetValues(), npx, npy ), stepMultiplier, grid,
+                             doublePrecisionGrids_, cb, cbData );
         return grid;
     }
     else
@@ -1353,26 +1927,10 @@ vtkImageData* MolekelMolecule::GridDataToVtkImageData( const std::string& label,
         grid->SetDimensions( npx / stepMultiplier, npy / stepMultiplier , npz / stepMultiplier );
         grid->SetOrigin( origin );
         grid->SetSpacing( xStep, yStep, zStep );
-        const int totalSteps = npx * npy * npz;
-        //initialize callback
-        if( cb ) cb( 0, totalSteps, cbData );
-        int i, j, k;
-        for( i = 0; i < npx; i += stepMultiplier )
-        {
-            for( j = 0; j < npy; j += stepMultiplier )
-            {
-                for( k = 0; k < npz; k += stepMultiplier )
-                {
-                    const double s = gd->GetValue( label, i, j, k );
-                    grid->SetScalarComponentFromDouble( i / stepMultiplier,
-                                                        j / stepMultiplier,
-                                                        k / stepMultiplier, 0, s );
-                }
-            }
-            const int idx = ( i + 1 ) * ( npz * npy );
-            if( cb ) cb( idx, totalSteps, cbData );
-        }
-
+        // 3) share values, or copy one value every stepMultiplier values
+        if( stepMultiplier == 1 ) ShareGridValues( gd->GetValues( label ), grid );
+        else CopyGridValues( GridDataValue( gd->GetValues( label ), npx, npy ), stepMultiplier, grid,
+                             doublePrecisionGrids_, cb, cbData );
         return grid;
     }
     return 0;
@@ -1390,30 +1948,38 @@ bool MolekelMolecule::GenerateGridDataSurface( const std::string& label,
     SaveTransform(); // push current transform
     ResetTransform(); // set to default (identity)
 
-    vtkSmartPointer< vtkImageData > grid =
-                                GridDataToVtkImageData( label, stepMultiplier, cb, cbData );
+    // the grid is kept to extract surfaces at different isovalues if enabled
+    const IsoSurfaceIndex& index = GetGridDataIndex( label, stepMultiplier, cb, cbData );
 
-    if( grid == 0 ) return false;
+    if( index.GetGrid() == 0 )
+    {
+        RestoreTransform();
+        return false;
+    }
 
     if( cb ) cb( 0, 2, cbData );
 
-    // 3 )use vtkMarchingCubes to generate the iso-surface
-    vtkSmartPointer< vtkMarchingCubes > mc( vtkMarchingCubes::New() );
-    mc->SetInput( grid );
-    mc->GenerateValues( 1, value, value );
-    mc->ComputeNormalsOn();
-    mc->Update();
+    // 3 )use parallel marching cubes on the blocks containing the value
+    std::vector< vtkSmartPointer< vtkPolyData > > surfaces;
+    const bool extracted = ExtractIsoSurfaces( index, std::vector< double >( 1, value ), surfaces );
+    ReleaseUnusedIsoGrids();
+    if( !extracted )
+    {
+        RestoreTransform();
+        return false;
+    }
+    vtkSmartPointer< vtkPolyData > surface = surfaces[ 0 ];
     if( cb ) cb( 1, 2, cbData );
 
     // 4 )create mapper and actor and add to molecule scenegraph
-    if( mc->GetOutput()->GetNumberOfCells() == 0 ) return false;
+    if( surface->GetNumberOfCells() == 0 ) return false;
     vtkSmartPointer< vtkPolyDataMapper > mapper( vtkPolyDataMapper::New() );
     mapper->ScalarVisibilityOff();
     // reverse normals if value < 0
     if( value < 0. )
     {
         vtkSmartPointer< vtkReverseSense > reverse( vtkReverseSense::New() );
-        reverse->SetInputConnection( mc->GetOutputPort() );
+        reverse->SetInput( surface );
         reverse->ReverseNormalsOn();
         // default VTK relaxation factor is 0.01
         if( iterations > 0 )
@@ -1434,7 +2000,7 @@ bool MolekelMolecule::GenerateGridDataSurface( const std::string& label,
         if( iterations > 0 )
         {
             vtkSmartPointer< vtkSmoothPolyDataFilter > pf( vtkSmoothPolyDataFilter::New() );
-            pf->SetInputConnection( mc->GetOutputPort() );
+            pf->SetInput( surface );
             pf->SetNumberOfIterations( iterations );
             pf->SetRelaxationFactor( relaxationFactor );
             vtkSmartPointer< vtkPolyDataNormals > pn( vtkPolyDataNormals::New() );
@@ -1442,7 +2008,7 @@ bool MolekelMolecule::GenerateGridDataSurface( const std::string& label,
             pn->FlipNormalsOn();
             mapper->SetInputConnection( pn->GetOutputPort() );
         }
-        else mapper->SetInputConnection( mc->GetOutputPort() );
+        else mapper->SetInput( surface );
     }
     if( cb ) cb( 2, 2, cbData );
 
@@ -1687,7 +2253,10 @@ vtkImageData* MolekelMolecule::GenerateDensityData( int ftype,
                                                     double bboxSize[ 3 ],
                                                     int steps[ 3 ],
                                                     ProgressCallback cb,
-                                                    void* cbData ) const
+                                                    void* cbData,
+                                                    double* minValue,
+                                                    double* maxValue,
+                                                    const volatile bool* stop ) const
 {
     float dim[6];
 //    int   ncub[3];
@@ -1700,8 +2269,41 @@ vtkImageData* MolekelMolecule::GenerateDensityData( int ftype,
     dim[ 4 ] =  float( z - bboxSize[ 2 ] * .5 );
     dim[ 5 ] =  float( z + bboxSize[ 2 ] * .5 );
 
+    ProcessCalcContext ctx;
+    InitCalcContext( ctx, ftype, stop );
+    vtkImageData* data =
+        vtk_process_calc( ctx, molekelMol_, dim, steps, ftype, cb, cbData );
+    if( data == 0 ) throw MolekelException( "Error computing density data" );
+    if( minValue && maxValue ) ctx.GetMinMax( *minValue, *maxValue );
+    return data;
+}
+
+//------------------------------------------------------------------------------
+vtkImageData* MolekelMolecule::GenerateElectronDensityData( double bboxSize[ 3 ],
+                                                            int steps[ 3 ],
+                                                            ProgressCallback cb,
+                                                            void* cbData,
+                                                            const volatile bool* stop ) const
+{
+    return GenerateDensityData( EL_DENS, bboxSize, steps, cb, cbData, 0, 0, stop );
+}
+
+//------------------------------------------------------------------------------
+vtkImageData* MolekelMolecule::GenerateDensityIsoGridData( int ftype,
+                                                           double bboxSize[ 3 ],
+                                                           int steps[ 3 ],
+                                                           double value,
+                                                           ProgressCallback cb,
+                                                           void* cbData ) const
+{
+    if( isoGridCoarseStep_ < 2 ) return GenerateDensityData( ftype, bboxSize, steps, cb, cbData );
+    float dim[ 6 ];
+    GetIsoGridBounds( bboxSize, dim );
+    ProcessCalcContext ctx;
+    InitCalcContext( ctx, ftype, 0 );
     vtkImageData* data =
-        vtk_process_calc( molekelMol_, dim, steps, ftype, cb, cbData );
+        vtk_process_calc_adaptive( ctx, molekelMol_, dim, steps, ftype,
+                                   &value, 1, isoGridCoarseStep_, cb, cbData );
     if( data == 0 ) throw MolekelException( "Error computing density data" );
     return data;
 }
@@ -1725,10 +2327,7 @@ vtkImageData* MolekelMolecule::GenerateDensityData( int ftype,
     steps[ 0 ] = int( dx / step + .5 );
     steps[ 1 ] = int( dy / step + .5 );
     steps[ 2 ] = int( dz / step + .5 );
-    vtkImageData* data = GenerateDensityData( ftype, bboxSize, steps, cb, cbData );
-extern void GetProcessCalcMinMax( double&, double& );
-    GetProcessCalcMinMax( minValue, maxValue );
-    return data;
+    return GenerateDensityData( ftype, bboxSize, steps, cb, cbData, &minValue, &maxValue );
 }
 
 
@@ -1765,52 +2364,51 @@ vtkImageData* MolekelMolecule::GenerateMEPData( const double& step,
 //--------------------------------------------------------------------------------
 void MolekelMolecule::StopMEPDataGeneration() const
 {
-extern void StopProcessCalc();
-    StopProcessCalc();
+    stopCalc_[ CalcTypeIndex( MEP ) ] = true;
 }
 
 //--------------------------------------------------------------------------------
 bool MolekelMolecule::MEPDataGenerationStopped() const
 {
-extern bool ProcessCalcStopped();
-extern int 	GetProcessCalcDataType();
-    return ProcessCalcStopped() && GetProcessCalcDataType() == MEP;
+    return stopCalc_[ CalcTypeIndex( MEP ) ];
 }
 
 //--------------------------------------------------------------------------------
 void MolekelMolecule::StopElectronDensityDataGeneration() const
 {
-extern void StopProcessCalc();
-    StopProcessCalc();
+    stopCalc_[ CalcTypeIndex( EL_DENS ) ] = true;
 }
 
 //--------------------------------------------------------------------------------
 bool MolekelMolecule::ElectronDensityDataGenerationStopped() const
 {
-extern bool ProcessCalcStopped();
-extern int 	GetProcessCalcDataType();
-    return ProcessCalcStopped() && GetProcessCalcDataType() == EL_DENS;
+    return stopCalc_[ CalcTypeIndex( EL_DENS ) ];
 }
 
 //--------------------------------------------------------------------------------
 void MolekelMolecule::StopSpinDensityDataGeneration() const
 {
-extern void StopProcessCalc();
-    StopProcessCalc();
+    stopCalc_[ CalcTypeIndex( SPIN_DENS ) ] = true;
 }
 
 //--------------------------------------------------------------------------------
 bool MolekelMolecule::SpinDensityDataGenerationStopped() const
 {
-extern bool ProcessCalcStopped();
-extern int 	GetProcessCalcDataType();
-    return ProcessCalcStopped() && GetProcessCalcDataType() == SPIN_DENS;
+    return stopCalc_[ CalcTypeIndex( SPIN_DENS ) ];
+}
+
+//--------------------------------------------------------------------------------
+void MolekelMolecule::SetDoublePrecisionGrids( bool on )
+{
+    doublePrecisionGrids_ = on;
+    calcSettings_.SetDoublePrecision( on );
 }
 
 namespace
 {
     //-----------------------------------------------------------------------------
-    vtkActor* GenerateElDensSurfaceActor( vtkImageData* data, double value )
+    template < class DataT >
+    vtkActor* GenerateElDensSurfaceActor( DataT* data, double value )
     {
         vtkActor* actor = GenerateIsoSurfaceActor( data, value );
         if( !actor ) return 0;
@@ -1819,7 +2417,8 @@ namespace
     }
 
     //-----------------------------------------------------------------------------
-    vtkActor* GenerateSpinDensSurfaceActor( vtkImageData* data, double value )
+    template < class DataT >
+    vtkActor* GenerateSpinDensSurfaceActor( DataT* data, double value )
     {
         vtkActor* actor = GenerateIsoSurfaceActor( data, value );
         if( !actor ) return 0;
@@ -1839,12 +2438,46 @@ bool MolekelMolecule::AddElectronDensitySurface( double bboxSize[ 3 ],
 
     if( !CanComputeElectronDensity() ) return false;
     RemoveElectronDensitySurface();
-    SaveTransform(); // push current transform
-    ResetTransform(); // set to default (identity)
+    if( ExceedsGridMemoryBudget( steps ) )
+    {
+        std::vector< vtkSmartPointer< vtkPolyData > > surfaces;
+        GenerateOutOfCoreIsoSurfaces( EL_DENS, -1, bboxSize, steps, std::vector< double >( 1, value ),
+                                      surfaces, cb, cbData );
+        if( surfaces.empty() ) return false; // stopped
+        return AddElectronDensitySurfaceActor(
+                            GenerateElDensSurfaceActor( surfaces[ 0 ].GetPointer(), value ) );
+    }
+    if( isoGridCoarseStep_ < 2 )
+    {
+        // the grid is kept to extract surfaces at different isovalues if enabled
+        std::vector< vtkSmartPointer< vtkPolyData > > surfaces;
+        const bool extracted =
+            ExtractIsoSurfaces( GetIsoGridIndex( EL_DENS, -1, bboxSize, steps, cb, cbData ),
+                                std::vector< double >( 1, value ), surfaces );
+        ReleaseUnusedIsoGrids();
+        if( !extracted ) return false;
+        return AddElectronDensitySurfaceActor(
+                            GenerateElDensSurfaceActor( surfaces[ 0 ].GetPointer(), value ) );
+    }
     vtkSmartPointer< vtkImageData > data(
-                            GenerateDensityData( EL_DENS, bboxSize, steps, cb, cbData ) );
-    elDensSurfaceActor_ = GenerateElDensSurfaceActor( data, value );
+                            GenerateDensityIsoGridData( EL_DENS, bboxSize, steps, value, cb, cbData ) );
+    return ReplaceElectronDensitySurface( data, value );
+}
+
+//--------------------------------------------------------------------------------
+bool MolekelMolecule::ReplaceElectronDensitySurface( vtkImageData* data, double value )
+{
+    RemoveElectronDensitySurface();
+    return AddElectronDensitySurfaceActor( GenerateElDensSurfaceActor( data, value ) );
+}
+
+//--------------------------------------------------------------------------------
+bool MolekelMolecule::AddElectronDensitySurfaceActor( vtkActor* actor )
+{
+    elDensSurfaceActor_ = actor;
     if( elDensSurfaceActor_ == 0 ) return false;
+    SaveTransform(); // push current transform
+    ResetTransform(); // set to default (identity)
     if( GLSLShadersSupported() )
     {
         vtkGLSLShaderActor* a = dynamic_cast< vtkGLSLShaderActor* >( elDensSurfaceActor_.GetPointer() );
@@ -1872,10 +2505,40 @@ bool MolekelMolecule::AddSpinDensitySurface( double bboxSize[ 3 ],
     RemoveSpinDensitySurface();
     SaveTransform(); // push current transform
     ResetTransform(); // set to default (identity)
-    vtkSmartPointer< vtkImageData > data(
-                            GenerateDensityData( SPIN_DENS, bboxSize, steps, cb, cbData ) );
-    spinDensSurfaceActor_ = GenerateSpinDensSurfaceActor( data, value );
-    if( spinDensSurfaceActor_ == 0 ) return false;
+    if( ExceedsGridMemoryBudget( steps ) )
+    {
+        std::vector< vtkSmartPointer< vtkPolyData > > surfaces;
+        GenerateOutOfCoreIsoSurfaces( SPIN_DENS, -1, bboxSize, steps, std::vector< double >( 1, value ),
+                                      surfaces, cb, cbData );
+        if( !surfaces.empty() )
+        {
+            spinDensSurfaceActor_ = GenerateSpinDensSurfaceActor( surfaces[ 0 ].GetPointer(), value );
+        }
+    }
+    else if( isoGridCoarseStep_ < 2 )
+    {
+        // the grid is kept to extract surfaces at different isovalues if enabled
+        std::vector< vtkSmartPointer< vtkPolyData > > surfaces;
+        const bool extracted =
+            ExtractIsoSurfaces( GetIsoGridIndex( SPIN_DENS, -1, bboxSize, steps, cb, cbData ),
+                                std::vector< double >( 1, value ), surfaces );
+        ReleaseUnusedIsoGrids();
+        if( extracted )
+        {
+            spinDensSurfaceActor_ = GenerateSpinDensSurfaceActor( surfaces[ 0 ].GetPointer(), value );
+        }
+    }
+    else
+    {
+        vtkSmartPointer< vtkImageData > data(
+                            GenerateDensityIsoGridData( SPIN_DENS, bboxSize, steps, value, cb, cbData ) );
+        spinDensSurfaceActor_ = GenerateSpinDensSurfaceActor( data.GetPointer(), value );
+    }
+    if( spinDensSurfaceActor_ == 0 )
+    {
+        RestoreTransform();
+        return false;
+    }
     assembly_->AddPart( spinDensSurfaceActor_ );
     RecomputeBBox();
     RestoreTransform(); // pop transform
@@ -2128,55 +2791,74 @@ void MolekelMolecule::SetDipoleMomentArrowLength( double l )
 }
 
 //--------------------------------------------------------------------------------
-extern double calc_mep( const Mol *mol, const double xyz[ 3 ] );
 namespace
 {
-    /// Free function, maps scalar values from vtkImageData to vtkPolyData.
-    /// @param id [in]  image data whose value will be used to color code the surface
-    /// @param pd [out] surface to be color coded
-    /// @param minValue [out] minimum value of scalar assigned to vertices
-    /// @param maxValue [out] maximum value of scalar assigned to vertices
-    void MapImageDataToPolyDataScalars( vtkImageData* id, vtkPolyData* pd,
-                                        double& minValue, double& maxValue )
+    /// Nearest voxel lookup into vtkImageData.
+    /// @warning vtkImageData methods are called from multiple threads: only
+    /// methods that do not modify the image are used.
+    class ImageDataProbe
     {
-        assert( id && "NULL vtkImageData" );
-        assert( pd && "NULL vtkPolyData" );
-        vtkPoints* points = pd->GetPoints();
-        if( !points ) return;
-        vtkSmartPointer< vtkDoubleArray > scalars( vtkDoubleArray::New() );
-        const int sz = points->GetNumberOfPoints();
-        scalars->Allocate( sz );
-        minValue = std::numeric_limits< double >::max();
-        maxValue = std::numeric_limits< double >::min();
-        const int* dim = id->GetDimensions();
-        for( int i = 0; i != sz; ++i )
+    public:
+        ImageDataProbe( vtkImageData* id ) : id_( id ), dim_( id->GetDimensions() ) {}
+        double operator()( const double point[ 3 ] ) const
         {
-            double* p = points->GetPoint( i );
+            double p[ 3 ] = { point[ 0 ], point[ 1 ], point[ 2 ] };
             int voxel[ 3 ];
             double coord[ 3 ];
-            id->ComputeStructuredCoordinates( p, voxel, coord );
-            voxel[ 0 ] = std::max( 0, std::min( voxel[ 0 ], dim[ 0 ] - 1 ) );
-            voxel[ 1 ] = std::max( 0, std::min( voxel[ 1 ], dim[ 1 ] - 1 ) );
-            voxel[ 2 ] = std::max( 0, std::min( voxel[ 2 ], dim[ 2 ] - 1 ) );
-            const double v = id->GetScalarComponentAsDouble( voxel[ 0 ],
-                                                             voxel[ 1 ],
-                                                             voxel[ 2 ],
-                                                             0 );
-            if( v < minValue ) minValue = v;
-            if( v > maxValue ) maxValue = v;
-            scalars->InsertValue( i, v );
+            id_->ComputeStructuredCoordinates( p, voxel, coord );
+            voxel[ 0 ] = std::max( 0, std::min( voxel[ 0 ], dim_[ 0 ] - 1 ) );
+            voxel[ 1 ] = std::max( 0, std::min( voxel[ 1 ], dim_[ 1 ] - 1 ) );
+            voxel[ 2 ] = std::max( 0, std::min( voxel[ 2 ], dim_[ 2 ] - 1 ) );
+            return id_->GetScalarComponentAsDouble( voxel[ 0 ], voxel[ 1 ], voxel[ 2 ], 0 );
         }
-        pd->GetPointData()->SetScalars( scalars );
-     }
+    private:
+        vtkImageData* id_;
+        const int* dim_;
+    };
 
-    /// Free function, generates per-vertex MEP values.
-    /// @param mol [in]  molecule
+    /// MEP tree evaluation functor.
+    class MEPTreeEvaluator
+    {
+    public:
+        MEPTreeEvaluator( const MEPTree& tree ) : tree_( tree ) {}
+        double operator()( const double point[ 3 ] ) const { return tree_.Evaluate( point ); }
+    private:
+        const MEPTree& tree_;
+    };
+
+    /// Copies vertex coordinates into a contiguous array of 3 * number of points
+    /// doubles; float and double point arrays are read directly from memory.
+    void GetPointCoordinates( vtkPoints* points, std::vector< double >& xyz )
+    {
+        const int sz = points->GetNumberOfPoints();
+        xyz.resize( 3 * sz );
+        vtkDataArray* data = points->GetData();
+        if( vtkFloatArray* fa = vtkFloatArray::SafeDownCast( data ) )
+        {
+            const float* p = fa->GetPointer( 0 );
+            std::copy( p, p + 3 * sz, xyz.begin() );
+        }
+        else if( vtkDoubleArray* da = vtkDoubleArray::SafeDownCast( data ) )
+        {
+            const double* p = da->GetPointer( 0 );
+            std::copy( p, p + 3 * sz, xyz.begin() );
+        }
+        else
+        {
+            for( int i = 0; i != sz; ++i ) points->GetPoint( i, &xyz[ 3 * i ] );
+        }
+    }
+
+    /// Free function, generates per-vertex scalar values; vertices are
+    /// processed in parallel when OpenMP is enabled.
+    /// @param f [in] functor/function evaluated at each vertex
     /// @param pd [in/out] surface whose scalars will be generate through
     ///        usage of FunT functor/function.
     /// @param minValue [out] minimum value of scalar assigned to vertices
     /// @param maxValue [out] maximum value of scalar assigned to vertices
     /// The functor template parameter FunT has to support
-    /// double operator()( const double point[ 3 ] ) const.
+    /// double operator()( const double point[ 3 ] ) const
+    /// and must be safe to call concurrently from multiple threads.
     template < class FunT >
     void GeneratePolyDataScalarValues( const FunT& f, vtkPolyData* pd,
                                        double& minValue, double& maxValue )
@@ -2184,51 +2866,69 @@ namespace
         assert( pd && "NULL vtkPolyData" );
         vtkPoints* points = pd->GetPoints();
         if( !points ) return;
-        vtkSmartPointer< vtkDoubleArray > scalars( vtkDoubleArray::New() );
+        std::vector< double > xyz;
+        GetPointCoordinates( points, xyz );
         const int sz = points->GetNumberOfPoints();
-        scalars->Allocate( sz );
+        vtkSmartPointer< vtkFloatArray > scalars( vtkFloatArray::New() );
+        scalars->SetNumberOfTuples( sz );
+        float* values = scalars->GetPointer( 0 );
         minValue = std::numeric_limits< double >::max();
-        maxValue = std::numeric_limits< double >::min();
-
-        for( int i = 0; i != sz; ++i )
+        maxValue = -std::numeric_limits< double >::max();
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
         {
-            double* p = points->GetPoint( i );
-            const double v = f( p[ 0 ] );
-            if( v < minValue ) minValue = v;
-            if( v > maxValue ) maxValue = v;
-            scalars->InsertValue( i, v );
+            double tmin = std::numeric_limits< double >::max();
+            double tmax = -std::numeric_limits< double >::max();
+#ifdef _OPENMP
+#pragma omp for schedule( dynamic, 256 )
+#endif
+            for( int i = 0; i < sz; ++i )
+            {
+                const double v = f( &xyz[ 3 * i ] );
+                if( v < tmin ) tmin = v;
+                if( v > tmax ) tmax = v;
+                values[ i ] = float( v );
+            }
+#ifdef _OPENMP
+#pragma omp critical( polydata_scalars_minmax )
+#endif
+            {
+                if( tmin < minValue ) minValue = tmin;
+                if( tmax > maxValue ) maxValue = tmax;
+            }
         }
         pd->GetPointData()->SetScalars( scalars );
     }
 
+    /// Free function, maps scalar values from vtkImageData to vtkPolyData.
+    /// @param id [in]  image data whose value will be used to color code the surface
+    /// @param pd [out] surface to be color coded
+    /// @param minValue [out] minimum value of scalar assigned to vertices
+    /// @param maxValue [out] maximum value of scalar assigned to vertices
+    void MapImageDataToPolyDataScalars( vtkImageData* id, vtkPolyData* pd,
+                                        double& minValue, double& maxValue )
+    {
+        assert( id && "NULL vtkImageData" );
+        GeneratePolyDataScalarValues( ImageDataProbe( id ), pd, minValue, maxValue );
+    }
+
     /// Free function, generates per-vertex MEP values.
     /// @param mol [in]  molecule
     /// @param pd [in/out] surface to be color coded
     /// @param minValue [out] minimum value of scalar assigned to vertices
     /// @param maxValue [out] maximum value of scalar assigned to vertices
+    /// @param openingAngle [in] opening angle of the MEP tree code
     void MapMEPToPolyDataScalars( const Molecule* mol, vtkPolyData* pd,
-                                  double& minValue, double& maxValue )
+                                  double& minValue, double& maxValue,
+                                  double openingAngle )
     {
-        assert( pd && "NULL vtkPolyData" );
         assert( mol && "NULL molecule" );
-        vtkPoints* points = pd->GetPoints();
-        if( !points ) return;
-        vtkSmartPointer< vtkDoubleArray > scalars( vtkDoubleArray::New() );
-        const int sz = points->GetNumberOfPoints();
-        scalars->Allocate( sz );
-        minValue = std::numeric_limits< double >::max();
-        maxValue = std::numeric_limits< double >::min();
-
-        for( int i = 0; i != sz; ++i )
-        {
-            double* p = points->GetPoint( i );
-            const double v = calc_mep( mol, &p[ 0 ] );
-            if( v < minValue ) minValue = v;
-            if( v > maxValue ) maxValue = v;
-            scalars->InsertValue( i, v );
-        }
-        pd->GetPointData()->SetScalars( scalars );
-     }
+        if( !pd->GetPoints() ) return;
+        MEPTree tree;
+        tree.Build( *mol, openingAngle );
+        GeneratePolyDataScalarValues( MEPTreeEvaluator( tree ), pd, minValue, maxValue );
+    }
 }
 
 //--------------------------------------------------------------------------------
@@ -2250,7 +2950,8 @@ void MolekelMolecule::MapMEPOnSurface( vtkActor* a,
         vtkSmartPointer< vtkImageData > mep = GridDataToVtkImageData( "", 1, 0, 0 );
         MapImageDataToPolyDataScalars( mep, pdm->GetInput(), minv, maxv );
     }
-    else MapMEPToPolyDataScalars( molekelMol_, pdm->GetInput(), minv, maxv );
+    else MapMEPToPolyDataScalars( molekelMol_, pdm->GetInput(), minv, maxv,
+                                  calcSettings_.GetMEPOpeningAngle() );
     assert( a->GetMapper()->GetLookupTable() && "NULL LUT" );
     a->GetMapper()->SetScalarRange( minv, maxv );
     a->GetMapper()->ScalarVisibilityOn();
@@ -2644,30 +3345,23 @@ void MolekelMolecule::AddSAS( double solventRadius, double step,
     grid->SetDimensions( nx, ny, nz );
     grid->SetSpacing( step, step, step );
     grid->SetOrigin( bounds[ 0 ], bounds[ 2 ], bounds[ 4 ] );
-    const int n = GetNumberOfAtoms();
-    double point[ 3 ];
-    int atomId;
-    const int totalSteps = nx * ny * nz;
-    if( cb ) cb( 0, totalSteps, cbData );
-    double x = bounds[ 0 ];
-    for( int i = 0; i != nx; ++i, x += step )
-    {
-        double y = bounds[ 2 ];
-        for( int j = 0; j != ny ; ++j, y += step )
-        {
-            double z = bounds[ 4 ];
-            for( int k = 0; k != nz; ++k, z += step )
-            {
-                point[ 0 ] = x; point[ 1 ] = y; point[ 2 ] = z;
-                const double s = GetMinDistanceFromAtom( point, atomId, solventRadius );
-                grid->SetScalarComponentFromDouble( i, j, k, 0, s );
-            }
-        }
-        if( stopSASComputation_ ) break;
-        const int currentStep = ( i + 1 ) * ny * nz;
-        if( cb ) cb( currentStep, totalSteps, cbData );
+    grid->SetScalarTypeToFloat();
+    grid->SetNumberOfScalarComponents( 1 );
+    grid->AllocateScalars();
+    float* values = static_cast< float* >( grid->GetScalarPointer() );
 
+    std::vector< double > centers( 3 * GetNumberOfAtoms() );
+    std::vector< double > radii( GetNumberOfAtoms() );
+    for( int a = 0; a != GetNumberOfAtoms(); ++a )
+    {
+        const double* c = obMol_->GetAtom( a + 1 )->GetCoordinate();
+        std::copy( c, c + 3, &centers[ 3 * a ] );
+        radii[ a ] = GetVdWRadius( a ) + solventRadius;
     }
+    const double origin[ 3 ] = { bounds[ 0 ], bounds[ 2 ], bounds[ 4 ] };
+    const int dims[ 3 ] = { nx, ny, nz };
+    ComputeSASField( centers, radii, origin, step, dims, sasSphereSplatting_, values,
+                     &stopSASComputation_, cb, cbData );
     RestoreTransform();
     if( stopSASComputation_ )
     {
@@ -2678,20 +3372,130 @@ void MolekelMolecule::AddSAS( double solventRadius, double step,
     // generate surface at distance <solvent radius> from VdW surface
     // use solventRadius = 0 for VdW
     sasActor_ = GenerateIsoSurfaceActor( grid, 0.  );
+    if( sasActor_ == 0 ) return;
     if( GLSLShadersSupported() )
     {
         vtkGLSLShaderActor* a = dynamic_cast< vtkGLSLShaderActor* >( sasActor_.GetPointer() );
-        if( a ) shaderSurfaceMap_[ SAS_SURFACE ].actors.push_back( a );
-        a->SetShaderProgramId( shaderSurfaceMap_[ SAS_SURFACE ].program );
+        if( a )
+        {
+            shaderSurfaceMap_[ SAS_SURFACE ].actors.push_back( a );
+            a->SetShaderProgramId( shaderSurfaceMap_[ SAS_SURFACE ].program );
+        }
     }
 
-    if( sasActor_ == 0 ) return;
     sasActor_->GetProperty()->SetColor( 0.1, 0.92, 0.92 ); // cyan
     MakeShinyMaterialType( sasActor_->GetProperty() );
     assembly_->AddPart( sasActor_ );
     RecomputeBBox();
 }
 
+//--------------------------------------------------------------------------------
+namespace
+{
+    /// Computes the SAS measures of one OBMol; residues are taken from the
+    /// OBMol residue information, available for PDB files.
+    void ComputeOBMolSASMeasures( OBMol* mol,
+                                  double solventRadius,
+                                  int dotsPerAtom,
+                                  MolekelMolecule::SASMeasures& m,
+                                  const volatile bool* stop,
+                                  ProgressCallback cb,
+                                  void* cbData )
+    {
+        const int numAtoms = mol->NumAtoms();
+        std::vector< double > centers( 3 * numAtoms );
+        std::vector< double > radii( numAtoms );
+        for( int a = 0; a != numAtoms; ++a )
+        {
+            OBAtom* atom = mol->GetAtom( a + 1 );
+            const double* c = atom->GetCoordinate();
+            std::copy( c, c + 3, centers.begin() + 3 * a );
+            radii[ a ] = GetElementTable()[ atom->GetAtomicNum() ].vdwRadius;
+        }
+        m.volume = ComputeAccessibleSurfaceAreas( centers, radii, solventRadius, dotsPerAtom,
+                                                  m.atomAreas, stop, cb, cbData );
+        m.area = std::accumulate( m.atomAreas.begin(), m.atomAreas.end(), 0. );
+        m.residueLabels.clear();
+        m.residueAreas.clear();
+        for( int r = 0; r != int( mol->NumResidues() ); ++r )
+        {
+            OBResidue* res = mol->GetResidue( r );
+            std::vector< OBAtom* > atoms = res->GetAtoms();
+            double area = 0.;
+            for( std::vector< OBAtom* >::const_iterator a = atoms.begin(); a != atoms.end(); ++a )
+            {
+                area += m.atomAreas[ ( *a )->GetIdx() - 1 ];
+            }
+            ostringstream label;
+            label << res->GetName() << ' ' << res->GetNum() << ' ' << res->GetChain();
+            m.residueLabels.push_back( label.str() );
+            m.residueAreas.push_back( area );
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------
+void MolekelMolecule::ComputeSASMeasures( double solventRadius, int dotsPerAtom,
+                                          SASMeasures& m,
+                                          ProgressCallback cb, void* cbData ) const
+{
+    stopSASComputation_ = false;
+    ComputeOBMolSASMeasures( obMol_, solventRadius, dotsPerAtom, m,
+                             &stopSASComputation_, cb, cbData );
+}
+
+//--------------------------------------------------------------------------------
+void MolekelMolecule::ComputeSASMeasuresAtFrames( double solventRadius, int dotsPerAtom,
+                                                  std::vector< SASMeasures >& m,
+                                                  ProgressCallback cb, void* cbData ) const
+{
+    stopSASComputation_ = false;
+    m.clear();
+    if( cb ) cb( 0, GetNumberOfFrames(), cbData );
+    for( int f = 0; f != GetNumberOfFrames() && !stopSASComputation_; ++f )
+    {
+        m.push_back( SASMeasures() );
+        ComputeOBMolSASMeasures( GetOBMolAtFrame( f ), solventRadius, dotsPerAtom, m.back(),
+                                 &stopSASComputation_, 0, 0 );
+        if( cb ) cb( f + 1, GetNumberOfFrames(), cbData );
+    }
+}
+
+//--------------------------------------------------------------------------------
+void MolekelMolecule::SaveSASMeasures( const std::string& fileName,
+                                       double solventRadius,
+                                       int dotsPerAtom,
+                                       const std::vector< SASMeasures >& m ) const
+{
+    ofstream os( fileName.c_str() );
+    if( !os ) throw MolekelException( "Cannot open file " + fileName );
+    os << "# Solvent accessible surface (Shrake-Rupley)\n";
+    os << "# solvent radius: " << solventRadius << " dots per atom: " << dotsPerAtom << '\n';
+    for( std::vector< SASMeasures >::size_type f = 0; f != m.size(); ++f )
+    {
+        // a single element holds the measures of the current frame
+        OBMol* mol = m.size() == 1 ? obMol_ : GetOBMolAtFrame( int( f ) );
+        if( m.size() > 1 ) os << "\n# frame " << f + 1 << '\n';
+        os << "# area " << m[ f ].area << " volume " << m[ f ].volume << '\n';
+        if( !m[ f ].residueLabels.empty() )
+        {
+            os << "# residue name, number, chain, area\n";
+            for( std::vector< std::string >::size_type r = 0; r != m[ f ].residueLabels.size(); ++r )
+            {
+                os << m[ f ].residueLabels[ r ] << ' ' << m[ f ].residueAreas[ r ] << '\n';
+            }
+        }
+        os << "# atom index, element, area\n";
+        for( std::vector< double >::size_type a = 0; a != m[ f ].atomAreas.size(); ++a )
+        {
+            os << a + 1 << ' '
+               << etab.GetSymbol( mol->GetAtom( int( a ) + 1 )->GetAtomicNum() ) << ' '
+               << m[ f ].atomAreas[ a ] << '\n';
+        }
+    }
+    if( !os ) throw MolekelException( "Error writing to file " + fileName );
+}
+
 //--------------------------------------------------------------------------------
 void MolekelMolecule::RemoveSAS()
 {
@@ -2901,6 +3705,64 @@ void MolekelMolecule::AddSESMS( double probeRadius,
 {
 
     stopSESMSComputation_ = false;
+    vtkSmartPointer< vtkPolyData > pd;
+    if( inProcessSESMS_ || msmsExecutable.size() == 0 )
+    {
+        // MSMS density is the number of vertices per square Angstrom: use a grid
+        // step giving about the same number of vertices, capped to keep the
+        // surface accurate at low densities
+        const double step = density > 0. ? std::min( 1. / std::sqrt( density ), 0.5 ) : 0.5;
+        std::vector< double > centers( 3 * GetNumberOfAtoms() );
+        std::vector< double > radii( GetNumberOfAtoms() );
+        for( int a = 0; a != GetNumberOfAtoms(); ++a )
+        {
+            const double* c = obMol_->GetAtom( a + 1 )->GetCoordinate();
+            std::copy( c, c + 3, centers.begin() + 3 * a );
+            radii[ a ] = GetVdWRadius( a );
+        }
+        pd = ComputeSolventExcludedSurface( centers, radii, probeRadius, step,
+                                            &stopSESMSComputation_, cb, cbData );
+        if( pd == 0 ) return;
+        pd->Delete(); // ownership transferred to smart pointer
+    }
+    else
+    {
+        pd = RunMSMS( probeRadius, density, msmsExecutable, inputFileName, outputFileName );
+        if( pd == 0 ) return;
+        pd->Delete(); // ownership transferred to smart pointer
+    }
+    RemoveSESMS();
+    if( pd->GetNumberOfCells() == 0 ) return;
+    vtkSmartPointer< vtkPolyDataMapper > mapper( vtkPolyDataMapper::New() );
+    mapper->SetInput( pd );
+    mapper->ScalarVisibilityOff();
+    sesmsActor_ = vtkActor::New();
+    if( !GLSLShadersSupported() ) sesmsActor_ = vtkActor::New();
+    else
+    {
+       shaderSurfaceMap_[ SESMS_SURFACE ].actors.push_back( vtkGLSLShaderActor::New() );
+       sesmsActor_ =  shaderSurfaceMap_[ SESMS_SURFACE ].actors.back();
+       shaderSurfaceMap_[ SESMS_SURFACE ].actors.back()
+        ->SetShaderProgramId( shaderSurfaceMap_[ SESMS_SURFACE ].program );
+    }
+
+    sesmsActor_->SetMapper( mapper );
+    sesmsActor_->GetProperty()->BackfaceCullingOn();
+
+    sesmsActor_->GetProperty()->SetColor( 0.8, 0.8, 0.8 );
+    MakeShinyMaterialType( sesmsActor_->GetProperty() );
+
+    assembly_->AddPart( sesmsActor_ );
+    RecomputeBBox();
+}
+
+//--------------------------------------------------------------------------------
+vtkPolyData* MolekelMolecule::RunMSMS( double probeRadius,
+                                       double density,
+                                       const std::string& msmsExecutable,
+                                       const std::string& inputFileName,
+                                       const std::string& outputFileName )
+{
     // get temporary file name, used for
     // @warning the same filename with different extensions is going to be used
     // for input and output files.
@@ -2928,13 +3790,12 @@ void MolekelMolecule::AddSESMS( double probeRadius,
     if( r != 0 )
     {
         stopSESMSComputation_ = true;
-        return;
+        return 0;
     }
-    RemoveSESMS();
     vtkSmartPointer< vtkMSMSReader > msmsReader( vtkMSMSReader::New() );
     msmsReader->SetFileName( msmsOut );
     msmsReader->Update();
-    vtkSmartPointer< vtkPolyData > pd( vtkPolyData::New() );
+    vtkPolyData* pd = vtkPolyData::New();
     pd->DeepCopy( msmsReader->GetOutput() );
     if( inputFileName.size() == 0 ) DeleteFile( msmsIn );
     if( outputFileName.size() == 0 )
@@ -2942,28 +3803,7 @@ void MolekelMolecule::AddSESMS( double probeRadius,
         DeleteFile( msmsOut + ".vert" );
         DeleteFile( msmsOut + ".face" );
     }
-    if( pd->GetNumberOfCells() == 0 ) return;
-    vtkSmartPointer< vtkPolyDataMapper > mapper( vtkPolyDataMapper::New() );
-    mapper->SetInput( pd );
-    mapper->ScalarVisibilityOff();
-    sesmsActor_ = vtkActor::New();
-    if( !GLSLShadersSupported() ) sesmsActor_ = vtkActor::New();
-    else
-    {
-       shaderSurfaceMap_[ SESMS_SURFACE ].actors.push_back( vtkGLSLShaderActor::New() );
-       sesmsActor_ =  shaderSurfaceMap_[ SESMS_SURFACE ].actors.back();
-       shaderSurfaceMap_[ SESMS_SURFACE ].actors.back()
-        ->SetShaderProgramId( shaderSurfaceMap_[ SESMS_SURFACE ].program );
-    }
-
-    sesmsActor_->SetMapper( mapper );
-    sesmsActor_->GetProperty()->BackfaceCullingOn();
-
-    sesmsActor_->GetProperty()->SetColor( 0.8, 0.8, 0.8 );
-    MakeShinyMaterialType( sesmsActor_->GetProperty() );
-
-    assembly_->AddPart( sesmsActor_ );
-    RecomputeBBox();
+    return pd;
 }
 
 //--------------------------------------------------------------------------------
@@ -3086,6 +3926,9 @@ void MolekelMolecule::RecomputeSurfaces( double bboxFactor,
 
     // recomputes el dens, orbitals, SAS and connolly surface using up to date atom positions
 
+    // the kept grids were computed from the previous atom positions
+    ReleaseIsoGrids();
+
     // recompute connolly surface if visible --> bounding box will be reset to new values
     if( GetSESMSVisibility() )
     {
@@ -3122,14 +3965,17 @@ void MolekelMolecule::RecomputeSurfaces( double bboxFactor,
         }
     }
 
-    // remove and add orbital surfaces (computed from updated coordinates)
+    // remove and add orbital surfaces (computed from updated coordinates);
+    // the grids of all the orbitals are computed in a single pass
+    std::vector< int > orbitals;
     RSMap::const_iterator rsi = rsmap.begin();
     const RSMap::const_iterator rse = rsmap.end();
     for( ; rsi != rse; ++rsi )
     {
         RemoveOrbitalSurface( rsi->first );
-        AddOrbitalSurface( rsi->first, bbs, steps, 0.05, bothSigns, nodalSurface );
+        orbitals.push_back( rsi->first );
     }
+    AddOrbitalSurfaces( orbitals, bbs, steps, 0.05, bothSigns, nodalSurface );
 
     // recompute density matrix surface if visible
     if( GetElDensSurfaceVisibility() )
@@ -3454,6 +4300,8 @@ void MolekelMolecule::SetAtomColors( const std::string& fileName )
 void MolekelMolecule::SetOBMolToFrame( int frame )
 {
     assert( frame >=0 && frame < frames_.size() );
+    // the kept grids were computed from the atom positions of the previous frame
+    if( obMol_ != frames_[ frame ] ) ReleaseIsoGrids();
     obMol_ = frames_[ frame ];
 }
 
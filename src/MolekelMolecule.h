@@ -35,6 +35,10 @@
 #include <map>
 #include <vector>
 
+// Grid data computation
+#include "old/calcdens.h"
+#include "utility/ParallelMarchingCubes.h"
+
 // Forward declaration
 class ChemData;
 class ChemAssociatedData;
@@ -45,6 +49,7 @@ class ChemColor;
 class ChemSelection;
 class vtkCommand;
 class vtkImageData;
+class vtkPolyData;
 class vtkArrowSource;
 class vtkLookupTable;
 
@@ -374,24 +379,36 @@ public:
     /// Returns orbital type.
     const char* GetOrbitalType( int orbitalIndex ) const;
     /// Computes 3D grid for specific orbital; each grid node
-    /// is an electron density value.
+    /// is an electron density value. If not null, the computation stops when
+    /// *stop is set to true instead of through StopMOGridDataGeneration().
     vtkImageData* GenerateMOGridData( int orbitalIndex,
                                       double bboxSize[ 3 ],
                                       int steps[ 3 ],
                                       ProgressCallback cb = 0,
-                                      void* cbData = 0 ) const;
+                                      void* cbData = 0,
+                                      const volatile bool* stop = 0 ) const;
     /// Computes 3D grid for specific orbital; each grid node
     /// is an electron density value.
     vtkImageData* GenerateMOGridData( int orbitalIndex,
                                       double step,
                                       ProgressCallback cb = 0,
                                       void* cbData = 0 ) const;
+    /// Computes 3D grids for a set of orbitals in a single pass: basis functions
+    /// are evaluated only once per grid point for all the orbitals.
+    /// One grid per orbital is returned in the data vector, in the same order
+    /// as the orbital indices.
+    void GenerateMOGridData( const std::vector< int >& orbitalIndices,
+                             double bboxSize[ 3 ],
+                             int steps[ 3 ],
+                             std::vector< vtkSmartPointer< vtkImageData > >& data,
+                             ProgressCallback cb = 0,
+                             void* cbData = 0 ) const;
     /// Stops orbital grid data generation, must be called from a thread
     /// different from the one that calls GenerateMOGridData().
     /// @note current MolekelMolecule operations are all synchronous
     /// mainly due to a lack of portable threading libraries in the used
-    /// frameworks. This method currently simply calls the StopProcessCalc()
-    /// function added into calcdens.cpp.
+    /// frameworks. This method stops all the orbital computations running
+    /// on the molecule.
     void StopMOGridDataGeneration();
     /// Returns true if last grid data generation was interrupted.
     bool MOGridDataGenerationStopped();
@@ -409,6 +426,26 @@ public:
                             bool nodalSurface = false,
                             ProgressCallback cb = 0,
                             void* cbData = 0 );
+    /// Adds the surfaces of a set of orbitals into VTK renderer; the grids
+    /// of all the orbitals are computed in a single pass.
+    /// Orbitals whose surface already exists are skipped.
+    /// @return number of surfaces added
+    int AddOrbitalSurfaces( const std::vector< int >& orbitalIndices,
+                            double bboxSize[ 3 ],
+                            int steps[ 3 ],
+                            double value = 0.05,
+                            bool bothSigns = true,
+                            bool nodalSurface = false,
+                            ProgressCallback cb = 0,
+                            void* cbData = 0 );
+    /// Replaces the surface of an orbital, if any, with the one extracted
+    /// from already computed grid data; used to swap in place the surfaces
+    /// generated from grids of increasing resolution.
+    bool ReplaceOrbitalSurface( int orbitalIndex,
+                                vtkImageData* data,
+                                double value = 0.05,
+                                bool bothSigns = true,
+                                bool nodalSurface = false );
     /// Adds surface computed from density matrix into VTK renderer.
     ///void AddDensityMatrixSurface( int orbitalIndex, double value = 0.05 );
     /// Removes orbital surface.
@@ -478,7 +515,9 @@ public:
                                   double relaxationFactor = 0.01,
                                   ProgressCallback cb = 0,
                                   void* cbData = 0  );
-    /// Generates a vtkImageData object from OBGridData.
+    /// Generates a vtkImageData object from OBGridData or OBT41Data.
+    /// With stepMultiplier equal to one the scalars of the returned object
+    /// share the values loaded from file, which must not be modified.
     vtkImageData* GridDataToVtkImageData( const std::string& label,
                                           int stepMultiplier = 1,
                                           ProgressCallback cb = 0,
@@ -539,6 +578,15 @@ public:
                                                double& maxValue,
                                                ProgressCallback cb = 0,
                                                void* cbData = 0 ) const;
+    /// Generates vtkImageData from electron density on a grid of size bboxSize
+    /// centered on the iso-surface bounding box. If not null, the computation
+    /// stops when *stop is set to true instead of through
+    /// StopElectronDensityDataGeneration().
+    vtkImageData* GenerateElectronDensityData( double bboxSize[ 3 ],
+                                               int steps[ 3 ],
+                                               ProgressCallback cb = 0,
+                                               void* cbData = 0,
+                                               const volatile bool* stop = 0 ) const;
     /// Generates vtkImageData from spin density. Returns NULL if spin density cannot
     /// be computed.
     /// @param minValue method returns min electron density value in this parameter
@@ -562,6 +610,9 @@ public:
     /// Adds iso-surface generated from spin density data.
     bool AddSpinDensitySurface( double bboxSize[ 3 ], int steps[ 3 ], double value,
                                 ProgressCallback cb = 0, void* cbData = 0 );
+    /// Replaces the electron density surface, if any, with the one extracted
+    /// from already computed grid data.
+    bool ReplaceElectronDensitySurface( vtkImageData* data, double value );
     /// Removes electron density surface if present.
     void RemoveElectronDensitySurface();
     /// Removes spin density surface if present.
@@ -600,6 +651,52 @@ public:
     void StopMEPDataGeneration() const;
     /// Returns true if last MEP data generation stopped.
     bool MEPDataGenerationStopped() const;
+    /// Sets the opening angle of the tree code used to compute MEP values on
+    /// grids and surfaces; lower values give more accurate results, zero
+    /// computes the exact sum over all atom charges.
+    void SetMEPOpeningAngle( double a ) { calcSettings_.SetMEPOpeningAngle( a ); }
+    /// Returns the MEP opening angle.
+    double GetMEPOpeningAngle() const { return calcSettings_.GetMEPOpeningAngle(); }
+    /// Sets the initial step, in number of grid steps, of the adaptive
+    /// evaluation of the grids used to generate orbital and density
+    /// isosurfaces: values are computed exactly only near the isovalues, see
+    /// vtk_process_calc_adaptive. Values lower than 2 compute the full grid
+    /// (default): features smaller than half a coarse cell can be missed by
+    /// the adaptive evaluation.
+    void SetIsoGridCoarseStep( int s ) { isoGridCoarseStep_ = s; }
+    /// Returns the initial step of the adaptive isosurface grid evaluation.
+    int GetIsoGridCoarseStep() const { return isoGridCoarseStep_; }
+    /// Selects the scalar type of the generated grids: float (default) or
+    /// double; double precision grids take twice the memory.
+    void SetDoublePrecisionGrids( bool on );
+    /// Returns true if grids are generated with double precision scalars.
+    bool GetDoublePrecisionGrids() const { return doublePrecisionGrids_; }
+    /// Sets the maximum size in bytes of the grids used to generate orbital
+    /// and density isosurfaces; larger grids are computed in tiles of z slabs
+    /// stored in a temporary file and the isosurfaces are extracted one tile
+    /// at a time. Zero (default) means no limit.
+    void SetGridMemoryBudget( size_t bytes ) { gridMemoryBudget_ = bytes; }
+    /// Returns the grid memory budget, zero if unlimited.
+    size_t GetGridMemoryBudget() const { return gridMemoryBudget_; }
+    /// Returns true if a grid with the specified number of points does not
+    /// fit into the grid memory budget.
+    bool ExceedsGridMemoryBudget( const int steps[ 3 ] ) const;
+    /// Returns true if the grid of an orbital, or of the electron density if
+    /// orbitalIndex is negative, with the given size and number of steps was
+    /// kept from the last surface generation (see SetKeepIsoGrids): surfaces
+    /// at a different isovalue are then extracted from it without recomputing
+    /// the grid.
+    bool HasIsoGrid( int orbitalIndex, double bboxSize[ 3 ], int steps[ 3 ] ) const;
+    /// Keeps a grid computed by the caller with GenerateMOGridData or
+    /// GenerateElectronDensityData (orbitalIndex negative), see HasIsoGrid.
+    void KeepIsoGrid( int orbitalIndex, double bboxSize[ 3 ], int steps[ 3 ], vtkImageData* data );
+    /// Releases the grids kept to extract surfaces at different isovalues.
+    void ReleaseIsoGrids();
+    /// Enables keeping the last orbital, density or grid data grid after a
+    /// surface generation, to be enabled only while a dialog allows changing
+    /// the isovalue; disabling releases the grids. Default is false: the grid
+    /// is released as soon as the surface has been extracted.
+    void SetKeepIsoGrids( bool keep );
     /// Returns true if MEP can be computed, false otherwise.
     /// @todo use OpenBabel to retrieve atom charge.
     bool CanComputeMEP() const;
@@ -682,6 +779,51 @@ public:
     /// Add Solvent Accessible Surface.
     /// Web reference: http://www.netsci.org/Science/Compchem/feature14e.html
     void AddSAS( double solventRadius, double step, ProgressCallback cb = 0, void* cbData = 0 );
+    /// Selects how AddSAS computes the distance field: by splatting each
+    /// atom sphere into the grid points around its surface (faster on large
+    /// grids) or, by default, from the closest atoms of each grid point.
+    /// Both methods generate the same surface.
+    void SetSASSphereSplatting( bool on ) { sasSphereSplatting_ = on; }
+    /// Returns true if the SAS distance field is computed by splatting spheres.
+    bool GetSASSphereSplatting() const { return sasSphereSplatting_; }
+    /// Solvent accessible area and volume of a molecule.
+    struct SASMeasures
+    {
+        /// Total accessible area.
+        double area;
+        /// Volume enclosed by the solvent accessible surface.
+        double volume;
+        /// Accessible area of each atom.
+        std::vector< double > atomAreas;
+        /// Residue labels: <residue name> <residue number> <chain>; empty if the
+        /// molecule has no residue information.
+        std::vector< std::string > residueLabels;
+        /// Accessible area of each residue.
+        std::vector< double > residueAreas;
+        SASMeasures() : area( 0. ), volume( 0. ) {}
+    };
+    /// Computes the solvent accessible area of each atom and residue and the volume
+    /// enclosed by the SAS with the Shrake-Rupley dot method, using Van der Waals radii
+    /// increased by solventRadius; the surface doesn't need to be generated.
+    /// The computation can be stopped with StopSASComputation().
+    /// @param solventRadius solvent radius; zero computes Van der Waals areas
+    /// @param dotsPerAtom number of dots sampling each atom sphere
+    /// @param m returned measures
+    void ComputeSASMeasures( double solventRadius, int dotsPerAtom, SASMeasures& m,
+                             ProgressCallback cb = 0, void* cbData = 0 ) const;
+    /// Computes SAS measures for each frame of a multi-molecule (e.g. trajectory) file;
+    /// progress is reported per frame.
+    void ComputeSASMeasuresAtFrames( double solventRadius, int dotsPerAtom,
+                                     std::vector< SASMeasures >& m,
+                                     ProgressCallback cb = 0, void* cbData = 0 ) const;
+    /// Writes SAS measures, one block per frame, to a text file: totals followed by
+    /// a table of residue areas and a table of atom areas; a single element is
+    /// written as the measures of the current frame.
+    /// Throws a MolekelException if the file cannot be written.
+    void SaveSASMeasures( const std::string& fileName,
+                          double solventRadius,
+                          int dotsPerAtom,
+                          const std::vector< SASMeasures >& m ) const;
     /// Issues a request to stop computation of SAS.
     /// @see SASComputationStopped().
     void StopSASComputation() { stopSASComputation_ = true; }
@@ -764,6 +906,10 @@ public:
     /// Add Solvent Excluded Surface aka Connolly Surface using M.F. Sanner's MSMS.
     /// Web reference: http://www.netsci.org/Science/Compchem/feature14e.html
     /// Web reference: http://www.scripps.edu/~sanner/
+    /// If the in-process SES engine is enabled (default) or msmsExecutable is
+    /// empty the surface is computed by ComputeSolventExcludedSurface instead,
+    /// on a grid whose step is derived from the point density; MSMS file names
+    /// are ignored in this case.
     void AddSESMS( double solventRadius,
                    double density,
                    const std::string& msmsExecutable,
@@ -786,6 +932,10 @@ public:
     ///   - if thread is still running AND SESMSComputationStopped() returns
     ///     true it means that a client has requested for termination.
     bool SESMSComputationStopped() const { return stopSESMSComputation_; }
+    /// Enables/disables computation of the SES in process instead of running MSMS.
+    void SetInProcessSESMS( bool on ) { inProcessSESMS_ = on; }
+    /// Returns true if the SES is computed in process instead of running MSMS.
+    bool GetInProcessSESMS() const { return inProcessSESMS_; }
     /// Returns true if SES in scenegraph; false otherwise.
     bool HasSESMS() const;
     /// Remove SES;
@@ -971,12 +1121,135 @@ private:
     /// Constructor.
     MolekelMolecule();
 
-    /// Generates grid data.
+    /// Computes the bounds of a grid of size bboxSize centered on the
+    /// iso-surface bounding box.
+    void GetIsoGridBounds( double bboxSize[ 3 ], float dim[ 6 ] ) const;
+    /// Runs MSMS and returns the generated surface; returns NULL if MSMS fails.
+    vtkPolyData* RunMSMS( double probeRadius,
+                          double density,
+                          const std::string& msmsExecutable,
+                          const std::string& msmsInFileName,
+                          const std::string& msmsOutFileName );
+    /// Adds orbital surface computed from grid data.
+    bool AddOrbitalSurface( int orbitalIndex,
+                            vtkImageData* data,
+                            double value,
+                            bool bothSigns,
+                            bool nodalSurface );
+    /// Adds orbital surface computed out of core, see SetGridMemoryBudget.
+    bool AddOutOfCoreOrbitalSurface( int orbitalIndex,
+                                     double bboxSize[ 3 ],
+                                     int steps[ 3 ],
+                                     double value,
+                                     bool bothSigns,
+                                     bool nodalSurface,
+                                     ProgressCallback cb,
+                                     void* cbData );
+    /// Adds the surfaces of an orbital extracted at the isovalues returned by
+    /// GetOrbitalIsoValues, in the same order.
+    bool AddOrbitalIsoSurfaces( int orbitalIndex,
+                                const std::vector< vtkSmartPointer< vtkPolyData > >& surfaces,
+                                double value,
+                                bool bothSigns,
+                                bool nodalSurface );
+    /// Adds the negative, nodal and positive surface actors of an orbital;
+    /// null actors are skipped.
+    bool AddOrbitalSurfaceActors( int orbitalIndex,
+                                  vtkActor* minusActor,
+                                  vtkActor* zeroActor,
+                                  vtkActor* plusActor );
+    /// Sets and adds the electron density surface actor.
+    bool AddElectronDensitySurfaceActor( vtkActor* actor );
+    /// Computes a grid in tiles of z slabs stored in a temporary file and
+    /// extracts one isosurface per value; orbitalIndex is the orbital
+    /// computed with CALC_ORB and is ignored with the other data types.
+    /// The surfaces vector is empty if the computation was stopped.
+    void GenerateOutOfCoreIsoSurfaces( int type,
+                                       int orbitalIndex,
+                                       double bboxSize[ 3 ],
+                                       int steps[ 3 ],
+                                       const std::vector< double >& values,
+                                       std::vector< vtkSmartPointer< vtkPolyData > >& surfaces,
+                                       ProgressCallback cb,
+                                       void* cbData ) const;
+    /// Computes the grid used to extract the isosurfaces of an orbital,
+    /// adaptively if enabled (see SetIsoGridCoarseStep).
+    vtkImageData* GenerateMOIsoGridData( int orbitalIndex,
+                                         double bboxSize[ 3 ],
+                                         int steps[ 3 ],
+                                         double value,
+                                         bool bothSigns,
+                                         bool nodalSurface,
+                                         ProgressCallback cb,
+                                         void* cbData ) const;
+    /// Grid kept with its min/max block index to extract surfaces at
+    /// different isovalues without recomputing the grid.
+    struct IsoGridCache
+    {
+        /// Constructor: no grid.
+        IsoGridCache();
+        /// Returns true if the two grids are computed with the same parameters.
+        bool SameGrid( const IsoGridCache& c ) const;
+        /// Data type: CALC_ORB, EL_DENS, SPIN_DENS or -1 for grid data read from file.
+        int type;
+        /// Orbital index.
+        int orbital;
+        /// Label of grid data read from file.
+        std::string label;
+        /// Step multiplier of grid data read from file.
+        int stepMultiplier;
+        /// Grid bounds.
+        float dim[ 6 ];
+        /// Number of grid points along x, y and z.
+        int steps[ 3 ];
+        /// True if the grid has double precision scalars.
+        bool doublePrecision;
+        /// Grid data read from file.
+        const void* source;
+        /// Grid and index.
+        IsoSurfaceIndex index;
+    };
+    /// Returns the parameters of the grid of an orbital (CALC_ORB) or of a
+    /// density, without grid.
+    IsoGridCache GetIsoGridParameters( int type,
+                                       int orbitalIndex,
+                                       double bboxSize[ 3 ],
+                                       int steps[ 3 ] ) const;
+    /// Returns the min/max block index of the grid of an orbital (CALC_ORB)
+    /// or of a density; the grid is computed only if different from the last
+    /// one requested.
+    const IsoSurfaceIndex& GetIsoGridIndex( int type,
+                                            int orbitalIndex,
+                                            double bboxSize[ 3 ],
+                                            int steps[ 3 ],
+                                            ProgressCallback cb,
+                                            void* cbData );
+    /// Returns the min/max block index of grid data read from file; the
+    /// grid is converted only if different from the last one requested.
+    /// No grid is indexed if the conversion fails.
+    const IsoSurfaceIndex& GetGridDataIndex( const std::string& label,
+                                             int stepMultiplier,
+                                             ProgressCallback cb,
+                                             void* cbData );
+    /// Computes the grid used to extract a density isosurface, adaptively
+    /// if enabled (see SetIsoGridCoarseStep).
+    vtkImageData* GenerateDensityIsoGridData( int type,
+                                              double bboxSize[ 3 ],
+                                              int steps[ 3 ],
+                                              double value,
+                                              ProgressCallback cb,
+                                              void* cbData ) const;
+
+    /// Generates grid data; if not null, minValue and maxValue receive the
+    /// value range and stop is the caller's stop flag.
     vtkImageData* GenerateDensityData( int type,
                                        double bboxSize[ 3 ],
                                        int steps[ 3 ],
                                        ProgressCallback cb = 0,
-                                       void* cbData = 0 ) const;
+                                       void* cbData = 0,
+                                       double* minValue = 0,
+                                       double* maxValue = 0,
+                                       const volatile bool* stop = 0 ) const;
     /// Generates density data usind the current molecule's bounding box.
     /// Value range is returned in minValue, maxValue parameters.
     vtkImageData* GenerateDensityData( int type, const double& step,
@@ -1146,12 +1419,50 @@ private:
     /// (the one carried on within MolekelMolecule methods ) can actually be stopped:
     /// Most of VTK and all OpenInventor methods do not have any support for stop operations.
     /// SAS.
-    mutable bool stopSASComputation_;
+    mutable volatile bool stopSASComputation_;
     /// Connolly. Not Implemented yet as an interruptible operation.
     mutable bool stopSESComputation_;
     /// Connolly surface computed through M.F. Sanner's MSMS.
-    mutable bool stopSESMSComputation_;
+    mutable volatile bool stopSESMSComputation_;
+    // @}
+
+    // @{ Grid data computations: each computation runs on its own context,
+    // created by the generating method for the duration of the call; this
+    // allows to compute any data, including different orbitals, at the same
+    // time. A computation stops when the stop flag passed by its caller is
+    // set or, if the caller does not pass a flag, when the stop flag of its
+    // data type is set through the StopXXXGeneration methods.
+    /// Number of grid data types: orbital, electron density, spin density, MEP.
+    enum { NUM_CALC_TYPES = 4 };
+    /// Settings copied into each new context: screening tolerance, MEP
+    /// opening angle and scalar type.
+    ProcessCalcContext calcSettings_;
+    /// Stop flags by data type.
+    mutable volatile bool stopCalc_[ NUM_CALC_TYPES ];
+    /// Initializes a computation context with the calculation settings and
+    /// the caller's stop flag; if null, the stop flag of the data type is
+    /// reset and used instead.
+    void InitCalcContext( ProcessCalcContext& ctx, int type, const volatile bool* stop ) const;
     // @}
+    /// Initial step of the adaptive isosurface grid evaluation.
+    int isoGridCoarseStep_;
+    /// If true grids are generated with double instead of float scalars.
+    bool doublePrecisionGrids_;
+    /// Max size in bytes of in-memory isosurface grids, zero if unlimited.
+    size_t gridMemoryBudget_;
+    /// If true the SAS distance field is computed by splatting atom spheres.
+    bool sasSphereSplatting_;
+    /// If true AddSESMS computes the surface in process instead of running MSMS.
+    bool inProcessSESMS_;
+
+    /// Releases the grids unless enabled with SetKeepIsoGrids.
+    void ReleaseUnusedIsoGrids() { if( !keepIsoGrids_ ) ReleaseIsoGrids(); }
+    /// If true the last grids are kept after a surface generation.
+    bool keepIsoGrids_;
+    /// Last orbital or density grid.
+    IsoGridCache isoGridCache_;
+    /// Last grid generated from grid data read from file.
+    IsoGridCache gridDataCache_;
 
     /// Frames: OBMol* sequence read from multi-molecule data formats.
     /// Pointers are freed in @code ~MolekelMolecule().
@@ -24,6 +24,14 @@
 // $Revision$
 //
 
+// STD
+#include <algorithm>
+#include <exception>
+
+// VTK
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+
 // QT
 #include <QDialog>
 #include <QVBoxLayout>
@@ -33,6 +41,7 @@
 #include <QCheckBox>
 #include <QLabel>
 #include <QColor>
+#include <QThread>
 
 #include "../MainWindow.h"
 #include "../MolekelMolecule.h"
@@ -68,6 +77,7 @@ private slots:
     /// Called when density matrix checkbox toggled.
     void DensityMatrixToggledSlot( bool v )
     {
+        CancelPreview();
         useDensityMatrix_ = v;
         if( mol_->HasElectronDensitySurface() ) removeButton_->setEnabled( true );
         else removeButton_->setEnabled( false );
@@ -127,6 +137,7 @@ private slots:
     /// Called whenever an orbital has been selected.
     void OrbitalSelectedSlot( int orbitalIndex )
     {
+        if( orbitalIndex != selectedOrbital_ ) CancelPreview();
     	selectedOrbital_ = orbitalIndex;
         if( selectedOrbital_ < 0 )
         {
@@ -164,6 +175,7 @@ private slots:
     /// Called when remove button pressed.
     void RemoveSlot()
     {
+        CancelPreview();
     	StopProcessing();
         if( !useDensityMatrix_ )
         {
@@ -189,7 +201,10 @@ private slots:
     /// Called when generate button pressed.
     void GenerateSlot()
     {
+        CancelPreview();
     	StopProcessing();
+        ApplyGridOptions();
+        if( progressiveCheckBox_->checkState() == Qt::Checked && StartPreview() ) return;
         ProgressCallback pcb = MainWindow::ProgressCallback;
         if( !useDensityMatrix_ )
         {
@@ -218,27 +233,13 @@ private slots:
                                          pcb,
                                          mw_ ) )
             {
-                mol_->SetOrbitalRenderingStyle( selectedOrbital_, rs );
-                mol_->SetOrbitalOpacity( selectedOrbital_, 1.0 - nTr, MolekelMolecule::ORBITAL_MINUS );
-                mol_->SetOrbitalOpacity( selectedOrbital_, 1.0 - noTr, MolekelMolecule::ORBITAL_NODAL );
-                mol_->SetOrbitalOpacity( selectedOrbital_, 1.0 - pTr, MolekelMolecule::ORBITAL_PLUS );
+                SetOrbitalSurfaceProperties( rs, nTr, noTr, pTr );
                 if( mapMEP_ )
                 {
                     MapMEPOnOrbitalSurface( steps, bboxSize );
                     mw_->SetMEPScalarBarLUT( mol_->GetOrbitalSurfaceLUT( selectedOrbital_ ) );
                 }
                 removeButton_->setEnabled( true );
-                double color[ 3 ];
-                QColor c;
-                c = ow_->GetNegativeOrbitalColor();
-                QColorToRgb( c, color );
-                mol_->SetOrbitalColor( selectedOrbital_, MolekelMolecule::ORBITAL_MINUS, color );
-                c = ow_->GetNodalSurfaceColor();
-                QColorToRgb( c, color );
-                mol_->SetOrbitalColor( selectedOrbital_, MolekelMolecule::ORBITAL_NODAL, color );
-                c = ow_->GetPositiveOrbitalColor(); 
-                QColorToRgb( c, color );
-                mol_->SetOrbitalColor( selectedOrbital_, MolekelMolecule::ORBITAL_PLUS, color ); 
             }
             else
             {
@@ -266,18 +267,13 @@ private slots:
                                                  pcb,
                                                  mw_ ) )
             {
-                mol_->SetElDensSurfaceRenderingStyle( rs );
-                mol_->SetElDensSurfaceOpacity( 1.0 - dmTr );
+                SetElDensSurfaceProperties( rs, dmTr );
                 if( mapMEP_ )
                 {
                     MapMEPOnElDensSurface( steps, bboxSize );
                     mw_->SetMEPScalarBarLUT( mol_->GetElectronDensitySurfaceLUT() );
                 }
                 removeButton_->setEnabled( true );
-                double color[ 3 ];
-                const QColor c = ow_->GetDensityMatrixColor();
-                QColorToRgb( c, color );
-                mol_->SetElDensSurfaceColor( color );
             }
             else
             {
@@ -288,9 +284,61 @@ private slots:
         mw_->Refresh();
 
     }
+    /// Called when the grid data of a preview level have been computed:
+    /// replaces the current surface and starts the computation of the next level.
+    void PreviewLevelComputedSlot()
+    {
+        // notification from a computation cancelled or restarted in the meantime
+        if( previewThread_->isRunning() || previewData_ == 0 || cancelPreview_ ) return;
+        vtkSmartPointer< vtkImageData > data = previewData_;
+        previewData_ = 0;
+        const bool lastLevel = previewLevel_ == PREVIEW_LEVELS - 1;
+        PreviewParameters& p = preview_;
+        // the full resolution grid is kept to change the isovalue without
+        // recomputing the grid
+        if( lastLevel ) mol_->KeepIsoGrid( p.useDensityMatrix ? -1 : p.orbital, p.bboxSize, p.steps, data );
+        if( p.useDensityMatrix )
+        {
+            if( mol_->ReplaceElectronDensitySurface( data, p.value ) )
+            {
+                SetElDensSurfaceProperties( p.rs, p.dmTr );
+                if( lastLevel && mapMEP_ )
+                {
+                    MapMEPOnElDensSurface( preview_.steps, preview_.bboxSize );
+                    mw_->SetMEPScalarBarLUT( mol_->GetElectronDensitySurfaceLUT() );
+                }
+                removeButton_->setEnabled( true );
+            }
+        }
+        else
+        {
+            if( mol_->ReplaceOrbitalSurface( p.orbital, data, p.value, p.bothSigns, p.nodalSurface ) )
+            {
+                SetOrbitalSurfaceProperties( p.rs, p.nTr, p.noTr, p.pTr );
+                if( lastLevel && mapMEP_ )
+                {
+                    MapMEPOnOrbitalSurface( preview_.steps, preview_.bboxSize );
+                    mw_->SetMEPScalarBarLUT( mol_->GetOrbitalSurfaceLUT( selectedOrbital_ ) );
+                }
+                removeButton_->setEnabled( true );
+            }
+            ow_->UpdateGUI( true, false );
+        }
+        if( !lastLevel )
+        {
+            ++previewLevel_;
+            mw_->DisplayStatusMessage( tr( "Refining surface: level %1 of %2" )
+                                       .arg( previewLevel_ + 1 ).arg( PREVIEW_LEVELS ) );
+            previewThread_->start();
+        }
+        else mw_->DisplayStatusMessage( tr( "Surface generated" ) );
+        mw_->Refresh();
+    }
+
     /// Called whenever a parameter value changes.
     void ValuesChangedSlot()
     {
+        CancelPreview();
         if( realTimeCheckBox_->checkState() == Qt::Checked ) GenerateSlot();
         else mw_->Refresh();
     }
@@ -389,6 +437,7 @@ private slots:
     /// Called when ok button pressed.
     void AcceptSlot()
     {
+        CancelPreview();
     	StopProcessing();
         selectedOrbital_ = -1;
         removeButton_->setEnabled( false );
@@ -406,7 +455,9 @@ public:
                           : QDialog( parent ),
                               ow_( 0 ), mw_( mw ), mol_( mol ),
                             generateButton_( 0 ), removeButton_( 0 ), selectedOrbital_( -1 ),
-                            mapMEP_( false ), useDensityMatrix_( false ), mepLUT_( mepLUT )
+                            mapMEP_( false ), useDensityMatrix_( false ), mepLUT_( mepLUT ),
+                            progressiveCheckBox_( 0 ), previewThread_( 0 ), previewLevel_( 0 ),
+                            cancelPreview_( false )
     {
         assert( mol && "NULL Molecule" );
         assert( mw &&  "NULL Main Window" );
@@ -426,6 +477,10 @@ public:
         realTimeLayout->addWidget( new QLabel( tr( "Real-time Update" ) ) );
         realTimeCheckBox_ = new QCheckBox;
         realTimeLayout->addWidget( realTimeCheckBox_ );
+        // Progressive checkbox: coarse surface first, refined in the background.
+        realTimeLayout->addWidget( new QLabel( tr( "Progressive" ) ) );
+        progressiveCheckBox_ = new QCheckBox;
+        realTimeLayout->addWidget( progressiveCheckBox_ );
         mainLayout->addItem( realTimeLayout );
         // Separator
         mainLayout->addWidget( line );
@@ -471,11 +526,180 @@ public:
         {
             ow_->setEnabled( false );
             realTimeCheckBox_->setEnabled( false );
+            progressiveCheckBox_->setEnabled( false );
         }
+        previewThread_ = new PreviewThread( this );
+        connect( previewThread_, SIGNAL( finished() ), this, SLOT( PreviewLevelComputedSlot() ) );
         mol->SetIsoBBoxVisible( true );
+        // keep the grids to change the isovalue while the dialog is open
+        mol_->SetKeepIsoGrids( true );
+    }
+
+    /// Destructor: waits for preview computation and deletes thread.
+    ~ComputeElDensSurfaceDialog()
+    {
+        CancelPreview();
+        delete previewThread_;
     }
+
+    /// Computes the grid data of the current preview level; invoked from
+    /// the preview thread.
+    void ComputePreviewData()
+    {
+        if( cancelPreview_ ) return;
+        int steps[ 3 ];
+        GetPreviewSteps( previewLevel_, steps );
+        vtkImageData* data = 0;
+        try
+        {
+            if( preview_.useDensityMatrix )
+            {
+                data = mol_->GenerateElectronDensityData( preview_.bboxSize, steps,
+                                                          0, 0, &cancelPreview_ );
+            }
+            else
+            {
+                data = mol_->GenerateMOGridData( preview_.orbital, preview_.bboxSize, steps,
+                                                 0, 0, &cancelPreview_ );
+            }
+        }
+        catch( const std::exception& )
+        {
+            data = 0;
+        }
+        if( data == 0 ) return;
+        // a stopped computation returns a partially computed grid
+        if( cancelPreview_ )
+        {
+            data->Delete();
+            return;
+        }
+        previewData_ = data;
+        data->Delete();
+    }
+
 private:
 
+    /// Number of preview levels; the grid step of level i is
+    /// 2^(PREVIEW_LEVELS - 1 - i) times the requested step.
+    enum { PREVIEW_LEVELS = 3 };
+
+    /// Parameters of the surface generated progressively, read from the
+    /// widget when the computation starts.
+    struct PreviewParameters
+    {
+        bool useDensityMatrix;
+        int orbital;
+        double value;
+        double bboxSize[ 3 ];
+        int steps[ 3 ];
+        bool bothSigns;
+        bool nodalSurface;
+        MolekelMolecule::RenderingStyle rs;
+        double dmTr;
+        double nTr;
+        double noTr;
+        double pTr;
+    };
+
+    /// Overridden method: waits for preview computation, releases the grids
+    /// kept to change the isovalue and exits.
+    void done( int r )
+    {
+        CancelPreview();
+        mol_->SetKeepIsoGrids( false );
+        QDialog::done( r );
+    }
+
+    /// Passes the grid computation options read from the widget to the molecule.
+    void ApplyGridOptions()
+    {
+        mol_->SetIsoGridCoarseStep( ow_->GetIsoGridCoarseStep() );
+        mol_->SetDoublePrecisionGrids( ow_->GetDoublePrecisionGrids() );
+        mol_->SetGridMemoryBudget( ow_->GetGridMemoryBudget() );
+    }
+
+    /// Returns the number of grid steps of a preview level.
+    void GetPreviewSteps( int level, int steps[ 3 ] ) const
+    {
+        const int f = 1 << ( PREVIEW_LEVELS - 1 - level );
+        for( int i = 0; i != 3; ++i ) steps[ i ] = std::max( 2, preview_.steps[ i ] / f );
+    }
+
+    /// Reads the surface parameters from the widget and starts the computation
+    /// of the coarsest preview level.
+    /// Returns false if no preview is needed because the grid of the surface
+    /// was kept from the last generation (e.g. only the isovalue changed) or
+    /// does not fit into the grid memory budget: the surface is then generated
+    /// directly.
+    bool StartPreview()
+    {
+        PreviewParameters& p = preview_;
+        p.useDensityMatrix = useDensityMatrix_;
+        p.orbital = selectedOrbital_;
+        if( p.useDensityMatrix && !mol_->CanComputeElectronDensity() ) return true;
+        if( !p.useDensityMatrix && p.orbital < 0 ) return true;
+        p.dmTr = p.nTr = p.noTr = p.pTr = 0.;
+        if( !ow_->GetData( p.value, p.bboxSize, p.steps, p.bothSigns, p.nodalSurface,
+                           p.rs, p.dmTr, p.nTr, p.noTr, p.pTr ) ) return true;
+        if( mol_->HasIsoGrid( p.useDensityMatrix ? -1 : p.orbital, p.bboxSize, p.steps ) ) return false;
+        // the preview computes the full grid in memory
+        if( mol_->ExceedsGridMemoryBudget( p.steps ) ) return false;
+        previewLevel_ = 0;
+        previewData_ = 0;
+        cancelPreview_ = false;
+        mw_->DisplayStatusMessage( tr( "Computing preview..." ) );
+        previewThread_->start();
+        return true;
+    }
+
+    /// Stops the preview computation if running and waits for its completion;
+    /// the current surface is left unchanged.
+    void CancelPreview()
+    {
+        if( previewThread_ == 0 ) return;
+        if( previewThread_->isRunning() )
+        {
+            cancelPreview_ = true;
+            previewThread_->wait();
+        }
+        previewData_ = 0;
+    }
+
+    /// Applies rendering style, transparency and colors to the surface
+    /// of the selected orbital.
+    void SetOrbitalSurfaceProperties( MolekelMolecule::RenderingStyle rs,
+                                      double nTr, double noTr, double pTr )
+    {
+        mol_->SetOrbitalRenderingStyle( selectedOrbital_, rs );
+        mol_->SetOrbitalOpacity( selectedOrbital_, 1.0 - nTr, MolekelMolecule::ORBITAL_MINUS );
+        mol_->SetOrbitalOpacity( selectedOrbital_, 1.0 - noTr, MolekelMolecule::ORBITAL_NODAL );
+        mol_->SetOrbitalOpacity( selectedOrbital_, 1.0 - pTr, MolekelMolecule::ORBITAL_PLUS );
+        double color[ 3 ];
+        QColor c;
+        c = ow_->GetNegativeOrbitalColor();
+        QColorToRgb( c, color );
+        mol_->SetOrbitalColor( selectedOrbital_, MolekelMolecule::ORBITAL_MINUS, color );
+        c = ow_->GetNodalSurfaceColor();
+        QColorToRgb( c, color );
+        mol_->SetOrbitalColor( selectedOrbital_, MolekelMolecule::ORBITAL_NODAL, color );
+        c = ow_->GetPositiveOrbitalColor();
+        QColorToRgb( c, color );
+        mol_->SetOrbitalColor( selectedOrbital_, MolekelMolecule::ORBITAL_PLUS, color );
+    }
+
+    /// Applies rendering style, transparency and color to the electron
+    /// density surface.
+    void SetElDensSurfaceProperties( MolekelMolecule::RenderingStyle rs, double dmTr )
+    {
+        mol_->SetElDensSurfaceRenderingStyle( rs );
+        mol_->SetElDensSurfaceOpacity( 1.0 - dmTr );
+        double color[ 3 ];
+        const QColor c = ow_->GetDensityMatrixColor();
+        QColorToRgb( c, color );
+        mol_->SetElDensSurfaceColor( color );
+    }
+
     /// Maps MEP onto electron density surface computed from density matrix.
     void MapMEPOnElDensSurface( int steps[ 3 ], double bboxSize[ 3 ] )
     {
@@ -514,6 +738,35 @@ private:
     bool mapMEP_;
     /// Lookup table used to map MEP values to colors.
     vtkLookupTable* mepLUT_;
+    /// Progressive check box: if selected a surface is first generated from a
+    /// coarse grid and then replaced by surfaces generated from finer grids
+    /// computed in a separate thread.
+    QCheckBox* progressiveCheckBox_;
+
+    /// Thread used to compute the grid data of the preview levels; surfaces are
+    /// generated from the computed data in the GUI thread.
+    class PreviewThread : public QThread
+    {
+    public:
+        PreviewThread( ComputeElDensSurfaceDialog* parent ) : QThread( parent ) {}
+        void run()
+        {
+            ComputeElDensSurfaceDialog* pd = dynamic_cast< ComputeElDensSurfaceDialog* >( parent() );
+            assert( pd );
+            pd->ComputePreviewData();
+        }
+    };
+    /// Preview thread; created in constructor and deleted in destructor.
+    PreviewThread* previewThread_;
+    /// Parameters of the surface being generated progressively.
+    PreviewParameters preview_;
+    /// Preview level currently computed.
+    int previewLevel_;
+    /// Grid data computed by the preview thread.
+    vtkSmartPointer< vtkImageData > previewData_;
+    /// Set to true to interrupt the preview computation: passed as stop flag
+    /// to the grid computation; volatile: read by the preview thread.
+    volatile bool cancelPreview_;
 };
 
 
@@ -179,9 +179,18 @@ public:
             realTimeCheckBox_->setEnabled( false );
         }
         sw_->SetRenderingStyle( mol_->GetGridDataSurfaceRenderingStyle() ) ;
+        // keep the grid to change the isovalue while the dialog is open
+        mol_->SetKeepIsoGrids( true );
     }
 
 private:
+    /// Overridden method: releases the grid kept to change the isovalue and exits.
+    void done( int r )
+    {
+        mol_->SetKeepIsoGrids( false );
+        QDialog::done( r );
+    }
+
     /// GridDataSurfaceWidget istance: ownned by this object.
     GridDataSurfaceWidget* sw_;
     /// Reference to main window.
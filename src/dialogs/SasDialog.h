@@ -30,8 +30,16 @@
 #include <QHBoxLayout>
 #include <QPushButton>
 #include <QThread>
+#include <QMessageBox>
+#include <QSettings>
+#include <QCoreApplication>
+
+// STD
+#include <vector>
+#include <exception>
 
 #include "../MainWindow.h"
+#include "../utility/qtfileutils.h"
 #include "../widgets/SasWidget.h"
 #include "../MolekelMolecule.h"
 
@@ -90,6 +98,54 @@ public slots:
         mw_->Refresh();
         removeButton_->setEnabled( false );
     }
+    /// Compute solvent accessible areas and volume of the current frame or,
+    /// if requested, of all the frames and display them in the SAS widget.
+    void MeasureSlot()
+    {
+        mw_->DisplayStatusMessage( "Computing surface areas..." );
+        measureRadius_ = sasWidget_->GetRadius();
+        measureDots_ = sasWidget_->GetDotsPerAtom();
+        measures_.clear();
+        if( sasWidget_->AllFrames() )
+        {
+            mol_->ComputeSASMeasuresAtFrames( measureRadius_, measureDots_, measures_,
+                                              MainWindow::ProgressCallback, mw_ );
+        }
+        else
+        {
+            measures_.push_back( MolekelMolecule::SASMeasures() );
+            mol_->ComputeSASMeasures( measureRadius_, measureDots_, measures_.back(),
+                                      MainWindow::ProgressCallback, mw_ );
+        }
+        if( mol_->SASComputationStopped() )
+        {
+            measures_.clear();
+            mw_->DisplayStatusMessage( "Stopped" );
+        }
+        else mw_->DisplayStatusMessage( "Surface areas computed" );
+        sasWidget_->SetMeasures( measures_ );
+        exportButton_->setEnabled( !measures_.empty() );
+    }
+    /// Save computed areas and volumes to text file.
+    void ExportSlot()
+    {
+        if( measures_.empty() ) return;
+        QSettings settings;
+        QString dir = settings.value( MainWindow::OUT_DATA_DIR_KEY.c_str(),
+                                      QCoreApplication::applicationDirPath() ).toString();
+        const QString fileName = GetSaveFileName( this, "Export surface areas", dir );
+        if( fileName.isEmpty() ) return;
+        try
+        {
+            mol_->SaveSASMeasures( fileName.toStdString(), measureRadius_, measureDots_, measures_ );
+            settings.setValue( MainWindow::OUT_DATA_DIR_KEY.c_str(), DirPath( fileName ) );
+            mw_->DisplayStatusMessage( QString( "Exported surface areas to file %1" ).arg( fileName ) );
+        }
+        catch( const std::exception& ex )
+        {
+            QMessageBox::critical( this, "I/O Error", ex.what() );
+        }
+    }
     /// Close dialog.
     void CloseSlot()
     {
@@ -106,7 +162,8 @@ public slots:
 
 public:
     /// Constructor.
-    SasDialog( MainWindow* mw, MolekelMolecule* m, QWidget* parent = 0 ) : QDialog( parent ), mw_( mw ), mol_( m )
+    SasDialog( MainWindow* mw, MolekelMolecule* m, QWidget* parent = 0 ) : QDialog( parent ), mw_( mw ), mol_( m ),
+        measureRadius_( 0. ), measureDots_( 0 )
     {
         QVBoxLayout* mainLayout = new QVBoxLayout;
         sasWidget_ = new SasWidget( mol_ );
@@ -114,12 +171,19 @@ public:
         QHBoxLayout* buttonLayout = new QHBoxLayout;
         generateButton_ = new QPushButton( "Compute" );
         removeButton_ = new QPushButton( "Remove" );
+        measureButton_ = new QPushButton( "Measure" );
+        exportButton_ = new QPushButton( "Export..." );
+        exportButton_->setEnabled( false );
         closeButton_ = new QPushButton( "Close" );
         connect( generateButton_, SIGNAL( released() ), this, SLOT( GenerateSlot() ) );
         connect( removeButton_,   SIGNAL( released() ), this, SLOT( RemoveSlot()   ) );
+        connect( measureButton_,  SIGNAL( released() ), this, SLOT( MeasureSlot()  ) );
+        connect( exportButton_,   SIGNAL( released() ), this, SLOT( ExportSlot()   ) );
         connect( closeButton_,   SIGNAL( released() ), this, SLOT( CloseSlot()   ) );
         buttonLayout->addWidget( generateButton_ );
         buttonLayout->addWidget( removeButton_ );
+        buttonLayout->addWidget( measureButton_ );
+        buttonLayout->addWidget( exportButton_ );
         buttonLayout->addWidget( closeButton_ );
         mainLayout->addItem( buttonLayout );
         this->setLayout( mainLayout );
@@ -141,6 +205,7 @@ public:
     {
         /// @warning progress report currently disabled: updating the status bar from a separate
         /// thread causes Qt to (sometimes) crash.
+        mol_->SetSASSphereSplatting( sasWidget_->SphereSplatting() );
         mol_->AddSAS( sasWidget_->GetRadius(), sasWidget_->GetStep(),
                       MainWindow::ProgressCallback, mw_ );
 
@@ -185,6 +250,16 @@ private:
     QPushButton* generateButton_;
     /// Remove button: remove surface upon release.
     QPushButton* removeButton_;
+    /// Measure button: compute areas and volume upon release.
+    QPushButton* measureButton_;
+    /// Export button: save areas and volume upon release.
+    QPushButton* exportButton_;
+    /// Last computed areas and volumes, one element per frame.
+    std::vector< MolekelMolecule::SASMeasures > measures_;
+    /// Solvent radius used to compute measures_.
+    double measureRadius_;
+    /// Dots per atom used to compute measures_.
+    int measureDots_;
     /// Close button: close dialog upon release.
     QPushButton* closeButton_;
 
@@ -187,8 +187,9 @@ public:
         }
         else // use MSMS
         {
-
-            if( !CheckExecutable( mw_->GetMSMSExecutablePath() ) )
+            mol_->SetInProcessSESMS( !sesWidget_->RunMSMSExecutable() );
+            if( sesWidget_->RunMSMSExecutable() &&
+                !CheckExecutable( mw_->GetMSMSExecutablePath() ) )
             {
                 QMessageBox::critical( this, "SES Generation Error",
                                        "Cannot execute file " +
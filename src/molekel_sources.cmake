@@ -49,6 +49,14 @@ SET ( SRCS
       utility/vtkOpenGLGlyphMapper.h
       utility/vtkSoMapper.h
       utility/UniformGrid.h
+      utility/SASField.h
+      utility/OutOfCoreGrid.h
+      utility/SolventExcludedSurface.h
+      utility/SurfaceArea.h
+      utility/ParallelMarchingCubes.h
+      utility/MappedFile.h
+      utility/TextScanner.h
+      utility/GridValuesParser.h
       utility/vtkMSMSReader.h
       utility/System.h
       utility/events/EventFilter.h
@@ -76,6 +84,13 @@ SET ( SRCS
       dialogs/ViewPropertiesDialog.h
       dialogs/ShadersDialog.h
       old/constant.h
+      old/calcdens.h
+      old/gaussbasis.h
+      old/densitymatrix.h
+      old/meptree.h
+      old/slaterbasis.h
+      old/gausskernels.h
+      old/gausskernels_impl.h
       old/molekeltypes.h
       widgets/DisplayPropertyWidget.h
       widgets/MoleculeAnimationModeWidget.h
@@ -101,6 +116,13 @@ SET ( SRCS
       old/readgauss.cpp
       old/readgamess.cpp
       old/calcdens.cpp
+      old/gaussbasis.cpp
+      old/densitymatrix.cpp
+      old/meptree.cpp
+      old/slaterbasis.cpp
+      old/gausskernels.cpp
+      old/gausskernels_avx2.cpp
+      old/gausskernels_avx512.cpp
       old/utilities.cpp
       old/readmolden.cpp
       resources/icon.cpp
@@ -118,6 +140,13 @@ SET ( SRCS
       utility/OBMoldenFormat.cpp
       utility/OBZmatrixFormat.cpp
       utility/OBT41Format.cpp
+      utility/OutOfCoreGrid.cpp
+      utility/SolventExcludedSurface.cpp
+      utility/SurfaceArea.cpp
+      utility/ParallelMarchingCubes.cpp
+      utility/MappedFile.cpp
+      utility/GridValuesParser.cpp
+      utility/SASField.cpp
       utility/events/ObjectName.cpp
       utility/events/EventPlayer.cpp
       utility/events/EventRecorderWidget.cpp
@@ -75,11 +75,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits>
+#include <new>
+#include <cstring>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <vtkImageData.h>
 #include <vtkSmartPointer.h>
 
 #include "constant.h"
+#include "calcdens.h"
+#include "gaussbasis.h"
+#include "gausskernels.h"
 ////////////////////////////////////////////////
 extern void logprint( const char* );
 extern void showinfobox( const char* );
@@ -182,19 +191,42 @@ int order(float *small_, float *big_)
 ////////////////////////////////////////////////
 
 
-void calc_chi(Mol *mol, float x, float y, float z);
+// All the functions computing a value at a given point receive the computation
+// context and a scratch area whose chi buffer is large enough to hold
+// mol->nBasisFunctions values: this allows each computing thread to use its
+// own scratch area and separate computations to run concurrently.
+typedef double (*ProcessCalcFunction)(const ProcessCalcContext *ctx, Mol *mol,
+                                      ProcessCalcScratch *scratch, float x, float y, float z);
+void calc_chi(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z);
+double calc_mep(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z);
 double calc_mep(Mol *mol, float x, float y, float z);
-double calc_point(Mol *mol, float x, float y, float z);
-double calc_prddo_density(Mol *mol, float x, float y, float z);
-double calc_prddo_spindensity(Mol *mol, float x, float y, float z);
-double calc_sltr_point(Mol *mol, float x, float y, float z);
-double calc_sltr_spindensity(Mol *mol, float x, float y, float z);
-double calc_sltr_density(Mol *mol, float x, float y, float z);
-double calc_prddo_point(Mol *mol, float x, float y, float z);
-double calculate_density(Mol *mol, float x, float y, float z);
-int generate_density_matrix(Mol *mol, int key);
-double calculateSomo(Mol *mol, float x, float y, float z);
-extern void *alloc_trimat(int n, size_t size);
+double calc_point(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z);
+double calc_prddo_density(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z);
+double calc_sltr_point(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z);
+double calc_sltr_density(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z);
+double calc_prddo_point(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z);
+double calculate_density(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z);
+int generate_density_matrix(ProcessCalcContext *ctx, Mol *mol, int key);
+
+// Functions computing values along a line of n grid points parallel to the x axis
+// (gaussian basis sets only): x coordinates are read from scratch->xLine and
+// all coordinates are in bohr; results are written into values[0..n-1].
+typedef void (*ProcessCalcLineFunction)(const ProcessCalcContext *ctx, Mol *mol,
+                                        ProcessCalcScratch *scratch, int n,
+                                        double y, double z, double *values);
+void calc_point_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, int n, double y, double z, double *values);
+void calculate_density_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, int n, double y, double z, double *values);
+double calculate_orbital_density(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z);
+void calculate_orbital_density_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, int n, double y, double z, double *values);
+static int generate_occupied_orbitals(ProcessCalcContext *ctx, Mol *mol, int key);
+static bool use_orbital_density(const Mol *mol, int key);
+static void calc_chi_line(const ProcessCalcContext *ctx, ProcessCalcScratch *scratch, int n, double y, double z);
+static void find_active_functions(ProcessCalcScratch *scratch, int nbf, int n);
+static void contract_lines(const double *c, int nrows, int ldc, const int *f, int nf, const double *chi, int stride, int n, double *out);
+void calc_sltr_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, int n, double y, double z, double *values);
+void calc_sltr_density_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, int n, double y, double z, double *values);
+static int setup_slater_basis(ProcessCalcContext *ctx, Mol *mol);
+static int generate_weighted_orbitals(ProcessCalcContext *ctx, Mol *mol, int key);
 extern Element element[ 105 ];
 // from chooseinterf
 int datasource = USE_COEFFS;
@@ -211,88 +243,61 @@ int datasource = USE_COEFFS;
 
 int did_sigset = 0, pipein = 0, pipeout = 0;
 int child_action_key = 0;
-float **density;
-double *chi;
+/// Orbital computed by the legacy vtk_process_calc( Mol*, ... ) and process_calc functions.
 MolecularOrbital *molOrb;
 char timestring[300];
 
 
 //-----------------------------------------------------------------------------
-/// Set this variable to false from a separate thread to stop computation.
-static bool stop = false;
+void ProcessCalcContext::FreeDensityMatrix()
+{
+  // the density matrix is owned by the molecule
+  density = NULL;
+  std::vector< double >().swap(occupied);
+  std::vector< double >().swap(occupiedWeights);
+}
+
+namespace
+{
+    /// Context used by the functions which do not receive a context as a parameter.
+    ProcessCalcContext globalContext;
+}
 
 /// Called from a thread different from the one that started vtk_process_calc
 /// to interrrupt computation.
-void StopProcessCalc() { stop = true; }
+void StopProcessCalc() { globalContext.Stop(); }
 
 /// Returns value of stop variable.
-bool ProcessCalcStopped() { return stop; }
-
-namespace
-{
-    double minValue = double();
-    double maxValue = double();
-    int type = -1;
-}
+bool ProcessCalcStopped() { return globalContext.Stopped(); }
 
 /// Returns min, max value in dataset computed by vtk_process_calc.
-void GetProcessCalcMinMax( double& minVal, double& maxVal ) { minVal = minValue; maxVal = maxValue; }
+void GetProcessCalcMinMax( double& minVal, double& maxVal ) { globalContext.GetMinMax( minVal, maxVal ); }
 
 /// Returns type of data generated by last call to vtk_process_calc.
-int GetProcessCalcDataType() { return type; }
+int GetProcessCalcDataType() { return globalContext.GetDataType(); }
 
-/// returns vtk image data instead of writing to macu file.
-/// @param progressCBack pointer to function that will be called to notify
-///        observer of completed step; steps go from 0 to ncubes[ 2 ] - 1.
-/// @param cbackData data provided by calling function that will be returned
-///        in a call to progressCBack function.
-vtkImageData* vtk_process_calc( Mol *mol,
-                                float *dim,
-                                int *ncubes,
-                                int key,
-                                void ( *progressCBack )( int completedStep,
-                                                         int totalSteps,
-                                                         void* cbackData ) = 0,
-                                void* cbackData = 0 )
+/// Returns the number of threads used to compute grid data: equal to the number
+/// of available processors if OpenMP is enabled, 1 otherwise.
+int GetProcessCalcNumThreads()
 {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
 
-  stop = false;
-  float x, y, z, dx, dy, dz;
-  short i, j, k;
-  int len, ncub[3];
-
-  type = -1;
-
-  double (*funct)(Mol *mol, float x, float y, float z);
-
-  minValue = std::numeric_limits< double >::max();
-  maxValue = std::numeric_limits< double >::min();
-
-  ncub[0] = *ncubes++;
-  ncub[1] = *ncubes++;
-  ncub[2] = *ncubes++;
-
-
-  // UV why do we need alha/beta orbital information when key == MEP ?
-  if( key != MEP )
-  {
-  if((mol->alphaOrbital[0].flag == ADF_ORB_A ||
-   mol->alphaOrbital[0].flag == ADF_ORB_B ) &&
-   mol->alphaOrbital[0].coefficient == NULL) {
-   //executeAdfUtilities(mol, s, dim, ncub, key);
-   return 0;
-  }
+//-----------------------------------------------------------------------------
+/// Returns the function computing the requested data type for the molecule's
+/// orbital type; generates the density matrix into the context if needed.
+/// Returns NULL if the data type is not supported or in case of error.
+static ProcessCalcFunction select_function(ProcessCalcContext *ctx, Mol *mol, int key)
+{
+  ProcessCalcFunction funct = 0;
 
-  chi = (double *)calloc(mol->nBasisFunctions, sizeof(double));
-  // UV following commented code is executed in calc_chi
-  //memset( chi, 0, mol->nBasisFunctions * sizeof( double ) );
-  if (!chi && !(mol->alphaOrbital[0].flag == EHT_ORB)) {
-   fprintf(stderr, "can't allocate chi\n");
-   return 0;
-  }
-  } // if( key != MEP )
   switch(key) {
    case CALC_ORB  :
+    if(!ctx->orbital) return 0;
     switch(mol->alphaOrbital[0].flag) {
       case GAMESS_ORB :
       case HONDO_ORB  :
@@ -306,7 +311,9 @@ vtkImageData* vtk_process_calc( Mol *mol,
       case MOS_ORB   :
       case ZINDO_ORB  :
       case PRDDO_ORB  : funct = calc_prddo_point; break;
-      case MLD_SLATER_ORB  : funct = calc_sltr_point; break;
+      case MLD_SLATER_ORB  :
+       if (setup_slater_basis(ctx, mol)) funct = calc_sltr_point;
+       break;
     }
     break;
 
@@ -315,9 +322,12 @@ vtkImageData* vtk_process_calc( Mol *mol,
       case GAMESS_ORB :
       case HONDO_ORB  :
       case GAUSS_ORB  :
-       if (!generate_density_matrix(mol, key)) {
+       if (use_orbital_density(mol, key)) {
+        if (!generate_occupied_orbitals(ctx, mol, key)) return 0;
+        funct = calculate_orbital_density;
+       }
+       else if (!generate_density_matrix(ctx, mol, key)) {
         fprintf(stderr, "Can't generate the density matrix!\n");
-        strcpy(timestring, "Can't generate the density matrix!");
         return 0;
        }
        else {
@@ -334,8 +344,13 @@ vtkImageData* vtk_process_calc( Mol *mol,
   */
       case MOS_ORB   :
       case ZINDO_ORB  :
-      case PRDDO_ORB  : funct = calc_prddo_density; break;
-      case MLD_SLATER_ORB  : funct = calc_sltr_density; break;
+      case PRDDO_ORB  :
+       if (generate_weighted_orbitals(ctx, mol, key)) funct = calc_prddo_density;
+       break;
+      case MLD_SLATER_ORB  :
+       if (setup_slater_basis(ctx, mol) && generate_weighted_orbitals(ctx, mol, key))
+        funct = calc_sltr_density;
+       break;
     }
     break;
 
@@ -344,12 +359,12 @@ vtkImageData* vtk_process_calc( Mol *mol,
       case GAMESS_ORB :
       case HONDO_ORB  :
       case GAUSS_ORB  :
-       if (!mol->alphaBeta) {
-        funct = calculateSomo;
+       if (!mol->alphaBeta || use_orbital_density(mol, key)) {
+        if (!generate_occupied_orbitals(ctx, mol, key)) return 0;
+        funct = calculate_orbital_density;
        }
-       else if(!generate_density_matrix(mol, key)) {
+       else if(!generate_density_matrix(ctx, mol, key)) {
         fprintf(stderr, "Can't generate the density matrix!\n");
-        strcpy(timestring, "Can't generate the density matrix!");
         return 0;
        }
        else {
@@ -363,62 +378,890 @@ vtkImageData* vtk_process_calc( Mol *mol,
   */
       case MOS_ORB   :
       case ZINDO_ORB  :
-      case PRDDO_ORB  : funct = calc_prddo_spindensity; break;
-      case MLD_SLATER_ORB  : funct = calc_sltr_spindensity; break;
+      case PRDDO_ORB  :
+       if (generate_weighted_orbitals(ctx, mol, key)) funct = calc_prddo_density;
+       break;
+      case MLD_SLATER_ORB  :
+       if (setup_slater_basis(ctx, mol) && generate_weighted_orbitals(ctx, mol, key))
+        funct = calc_sltr_density;
+       break;
     }
     break;
 
    case MEP :
+    ctx->mepTree.Build(*mol, ctx->GetMEPOpeningAngle());
     funct = calc_mep;
     break;
   }
 
+  return funct;
+}
 
-  dx = (dim[1]-dim[0])/(ncub[0]-1);
-  dy = (dim[3]-dim[2])/(ncub[1]-1);
-  dz = (dim[5]-dim[4])/(ncub[2]-1);
-  len = 4*ncub[0]*ncub[1];
+//-----------------------------------------------------------------------------
+/// Returns the line version of a function returned by select_function, NULL
+/// if the function can only be evaluated point by point.
+static ProcessCalcLineFunction select_line_function(ProcessCalcFunction funct)
+{
+  if(funct == calc_point) return calc_point_line;
+  if(funct == calculate_density) return calculate_density_line;
+  if(funct == calculate_orbital_density) return calculate_orbital_density_line;
+  if(funct == calc_sltr_point) return calc_sltr_line;
+  if(funct == calc_sltr_density) return calc_sltr_density_line;
+  return 0;
+}
 
-  vtkSmartPointer< vtkImageData > image( vtkImageData::New() );
+//-----------------------------------------------------------------------------
+/// Returns a new image with float or double scalars allocated: the scalars
+/// must be allocated before threads start writing into the image.
+static vtkImageData* new_grid_image( const float *dim, const int *ncub, float dx, float dy, float dz,
+                                     bool doublePrecision )
+{
+  vtkImageData* image = vtkImageData::New();
   image->SetDimensions( ncub[ 0 ], ncub[ 1 ], ncub[ 2 ] );
   image->SetOrigin( dim[0],
                     dim[2],
                     dim[4] );
   image->SetSpacing( dx, dy, dz );
+  if( doublePrecision ) image->SetScalarTypeToDouble();
+  else image->SetScalarTypeToFloat();
+  image->SetNumberOfScalarComponents( 1 );
+  image->AllocateScalars();
+  return image;
+}
 
-  const int totalSteps = ncub[ 0 ] * ncub[ 1 ] * ncub[ 2 ];
+//-----------------------------------------------------------------------------
+/// Contiguous scalars of an image created by new_grid_image, accessed through
+/// raw pointers: the value of point (i, j, k) is stored at index
+/// i + nx * ( j + ny * k ). Threads must write to disjoint ranges.
+class GridScalars
+{
+public:
+  explicit GridScalars( vtkImageData* image ) : f_( 0 ), d_( 0 ) {
+    if( image->GetScalarType() == VTK_DOUBLE ) d_ = static_cast< double* >( image->GetScalarPointer() );
+    else f_ = static_cast< float* >( image->GetScalarPointer() );
+  }
+  explicit GridScalars( float* values ) : f_( values ), d_( 0 ) {}
+  double Get( size_t i ) const { return d_ ? d_[ i ] : f_[ i ]; }
+  void Set( size_t i, double s ) {
+    if( d_ ) d_[ i ] = s;
+    else f_[ i ] = float( s );
+  }
+  /// Stores n values starting at index i.
+  void SetLine( size_t i, const double* s, int n ) {
+    if( d_ ) std::copy( s, s + n, d_ + i );
+    else for( int k = 0; k < n; k++ ) f_[ i + k ] = float( s[ k ] );
+  }
+private:
+  float* f_;
+  double* d_;
+};
+
+//-----------------------------------------------------------------------------
+/// Allocates the line buffers of a scratch area for lines of n points starting
+/// at x0 with step dx; lineValues and lineTemp hold nValueLines and
+/// nTempLines lines.
+/// Throws std::bad_alloc.
+static void setup_line_scratch( ProcessCalcScratch *scratch, int nBasisFunctions,
+                                int nValueLines, int nTempLines, int n, float x0, float dx )
+{
+  const int stride = GaussKernelStride( n );
+  scratch->chiLine.resize(size_t(nBasisFunctions) * stride);
+  scratch->xLine.resize(stride);
+  scratch->lineValues.resize(size_t(nValueLines) * stride);
+  scratch->lineTemp.resize(size_t(nTempLines) * stride);
+  scratch->activeFunctions.reserve(nBasisFunctions);
+  // same single precision coordinates as the point by point
+  // computation; padding filled with valid coordinates
+  for (int k=0; k<stride; k++) {
+    const float x = x0 + k * dx;
+    scratch->xLine[k] = x * _1_BOHR;
+  }
+}
+
+//-----------------------------------------------------------------------------
+/// Computes the z slabs [firstSlab, firstSlab + numSlabs) of a grid and stores
+/// them into scalars, starting at index 0; min/max values are merged into the
+/// context's min/max values.
+/// The slabs are computed in parallel (if OpenMP is enabled): z slabs are distributed
+/// among threads, each thread uses a separate chi buffer owned by the context
+/// and computes min/max values of its own slabs which are then merged into the
+/// context's min/max values.
+/// With gaussian basis sets whole grid lines along x are computed at once by
+/// the vectorized kernels in gausskernels.cpp.
+/// Returns false in case of error; a stopped computation is not an error.
+bool process_calc_slabs( ProcessCalcContext& ctx,
+                                Mol *mol,
+                                const float *dim,
+                                const int *ncub,
+                                int key,
+                                int firstSlab,
+                                int numSlabs,
+                                GridScalars& scalars,
+                                void ( *progressCBack )( int completedStep,
+                                                         int totalSteps,
+                                                         void* cbackData ),
+                                void* cbackData )
+{
+  float dx, dy, dz;
+
+
+  // UV why do we need alha/beta orbital information when key == MEP ?
+  if( key != MEP )
+  {
+  if((mol->alphaOrbital[0].flag == ADF_ORB_A ||
+   mol->alphaOrbital[0].flag == ADF_ORB_B ) &&
+   mol->alphaOrbital[0].coefficient == NULL) {
+   //executeAdfUtilities(mol, s, dim, ncub, key);
+   return false;
+  }
+  } // if( key != MEP )
+
+  const ProcessCalcFunction funct = select_function(&ctx, mol, key);
+  if( !funct ) return false;
+  const ProcessCalcLineFunction lineFunct = select_line_function( funct );
+
+  dx = (dim[1]-dim[0])/(ncub[0]-1);
+  dy = (dim[3]-dim[2])/(ncub[1]-1);
+  dz = (dim[5]-dim[4])/(ncub[2]-1);
+
+  const int sliceSize = ncub[ 0 ] * ncub[ 1 ];
+  const int totalSteps = sliceSize * numSlabs;
+  const int nBasisFunctions = key != MEP ? mol->nBasisFunctions : 0;
+  int completedSlabs = 0;
+  bool allocError = false;
+  // one scratch area per thread, resized by the owning thread
+  ctx.scratch.resize( GetProcessCalcNumThreads() );
+  if( nBasisFunctions > 0 ) ctx.Setup( mol );
   if( progressCBack ) progressCBack( 0, totalSteps, cbackData );
-  for (i=0, z=dim[4]; i<ncub[2]; i++, z += dz) {
-   for (j=0, y=dim[2]; j<ncub[1]; j++, y += dy) {
-	for (k=0, x=dim[0]; k<ncub[0]; k++, x += dx) {
-      const double s = (*funct)(mol, x, y, z);
-      if( s < minValue ) minValue = s;
-      if( s > maxValue ) maxValue = s;
-      image->SetScalarComponentFromDouble( k, j, i, 0, s );
-      if( stop == true ) goto stopped; // forward jump to stopped label
+
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    // per-thread scratch area and value range
+#ifdef _OPENMP
+    ProcessCalcScratch *threadScratch = &ctx.scratch[ omp_get_thread_num() ];
+#else
+    ProcessCalcScratch *threadScratch = &ctx.scratch[ 0 ];
+#endif
+    threadScratch->chiEvaluations = 0.;
+    threadScratch->evaluatedPrimitives = 0.;
+    if( nBasisFunctions > 0 ) {
+      try {
+        threadScratch->chi.resize(nBasisFunctions);
+        threadScratch->atomDistances.resize(4 * mol->Atoms.size() + 1);
+        if( lineFunct ) setup_line_scratch( threadScratch, nBasisFunctions, 1,
+                                            std::max( 1, int( ctx.occupiedWeights.size() ) ),
+                                            ncub[0], dim[0], dx );
+        if( lineFunct && mol->alphaOrbital[0].flag == MLD_SLATER_ORB )
+          threadScratch->basisWork.resize( ctx.slater.LineWorkSize( ncub[0] ) );
+      }
+      catch( const std::bad_alloc& ) {
+        fprintf(stderr, "can't allocate chi\n");
+#ifdef _OPENMP
+        #pragma omp critical( process_calc_minmax )
+#endif
+        allocError = true;
+        ctx.stop_ = true;
+      }
     }
-   }
- 
-// Execution will jump to this label iff stop requested   
-stopped: 
+    double threadMin = std::numeric_limits< double >::max();
+    double threadMax = -std::numeric_limits< double >::max();
 
-   const int idx = ncub[ 0 ] * ncub[ 1 ] * ( i + 1 );
-   // invoke progress callback function.
-   if( progressCBack ) progressCBack( idx, totalSteps, cbackData );
+#ifdef _OPENMP
+    #pragma omp for schedule( dynamic, 1 )
+#endif
+    for (int i=firstSlab; i<firstSlab+numSlabs; i++) {
+      // OpenMP does not allow to break out of a parallel loop: skip
+      // the remaining slabs instead
+      if( ctx.Stopped() ) continue;
+      const float z = dim[4] + i * dz;
+      for (int j=0; j<ncub[1] && !ctx.Stopped(); j++) {
+        const float y = dim[2] + j * dy;
+        const size_t row = size_t(i - firstSlab) * sliceSize + size_t(j) * ncub[0];
+        if( lineFunct ) {
+          double *values = &threadScratch->lineValues[0];
+          (*lineFunct)(&ctx, mol, threadScratch, ncub[0], y * _1_BOHR, z * _1_BOHR, values);
+          for (int k=0; k<ncub[0]; k++) {
+            const double s = values[k];
+            if( s < threadMin ) threadMin = s;
+            if( s > threadMax ) threadMax = s;
+          }
+          scalars.SetLine( row, values, ncub[0] );
+          continue;
+        }
+        for (int k=0; k<ncub[0]; k++) {
+          const float x = dim[0] + k * dx;
+          const double s = (*funct)(&ctx, mol, threadScratch, x, y, z);
+          if( s < threadMin ) threadMin = s;
+          if( s > threadMax ) threadMax = s;
+          scalars.Set( row + k, s );
+        }
+      }
+      int completed = 0;
+#ifdef _OPENMP
+      #pragma omp critical( process_calc_progress )
+#endif
+      completed = ++completedSlabs;
+      // invoke progress callback function; only from the calling thread since
+      // the callback is usually updating the GUI.
+#ifdef _OPENMP
+      if( progressCBack && omp_get_thread_num() == 0 )
+#else
+      if( progressCBack )
+#endif
+      {
+        progressCBack( completed * sliceSize, totalSteps, cbackData );
+      }
+    }
+
+#ifdef _OPENMP
+    #pragma omp critical( process_calc_minmax )
+#endif
+    {
+      if( threadMin < ctx.minValue_ ) ctx.minValue_ = threadMin;
+      if( threadMax > ctx.maxValue_ ) ctx.maxValue_ = threadMax;
+    }
   }
   printf("\n");
+  if( progressCBack && !ctx.Stopped() ) progressCBack( totalSteps, totalSteps, cbackData );
+
+  // screening statistics
+  double chiEvaluations = 0.;
+  ctx.evaluatedPrimitives_ = 0.;
+  for( int t = 0; t != int( ctx.scratch.size() ); ++t ) {
+    chiEvaluations += ctx.scratch[ t ].chiEvaluations;
+    ctx.evaluatedPrimitives_ += ctx.scratch[ t ].evaluatedPrimitives;
+  }
+  ctx.skippedPrimitives_ = chiEvaluations * ctx.primitives_ - ctx.evaluatedPrimitives_;
 
-  if(density){
-   free(density[0]);
-   free(density);
+  ctx.FreeDensityMatrix();
+  return !allocError;
+}
+
+//-----------------------------------------------------------------------------
+/// returns vtk image data instead of writing to macu file.
+vtkImageData* vtk_process_calc( ProcessCalcContext& ctx,
+                                Mol *mol,
+                                float *dim,
+                                int *ncubes,
+                                int key,
+                                void ( *progressCBack )( int completedStep,
+                                                         int totalSteps,
+                                                         void* cbackData ),
+                                void* cbackData )
+{
+  ctx.stop_ = false;
+  ctx.type_ = -1;
+  ctx.minValue_ = std::numeric_limits< double >::max();
+  ctx.maxValue_ = -std::numeric_limits< double >::max();
+
+  const int ncub[3] = { ncubes[0], ncubes[1], ncubes[2] };
+  const float dx = (dim[1]-dim[0])/(ncub[0]-1);
+  const float dy = (dim[3]-dim[2])/(ncub[1]-1);
+  const float dz = (dim[5]-dim[4])/(ncub[2]-1);
+
+  vtkSmartPointer< vtkImageData > image( new_grid_image( dim, ncub, dx, dy, dz,
+                                                         ctx.GetDoublePrecision() ) );
+  GridScalars scalars( image );
+  if( !process_calc_slabs( ctx, mol, dim, ncub, key, 0, ncub[2], scalars,
+                           progressCBack, cbackData ) ) {
+    image->Delete();
+    return 0;
   }
-  density = NULL;
-  if(chi)
+  ctx.type_ = key;
+  return image;
+}
+
+//-----------------------------------------------------------------------------
+bool vtk_process_calc_slabs( ProcessCalcContext& ctx,
+                             Mol *mol,
+                             float *dim,
+                             int *ncubes,
+                             int key,
+                             int firstSlab,
+                             int numSlabs,
+                             float *values,
+                             void ( *progressCBack )( int completedStep,
+                                                      int totalSteps,
+                                                      void* cbackData ),
+                             void* cbackData )
+{
+  if( firstSlab == 0 ) {
+    ctx.stop_ = false;
+    ctx.minValue_ = std::numeric_limits< double >::max();
+    ctx.maxValue_ = -std::numeric_limits< double >::max();
+  }
+  ctx.type_ = -1;
+  if( ctx.Stopped() ) return false;
+  const int ncub[3] = { ncubes[0], ncubes[1], ncubes[2] };
+  if( firstSlab < 0 || numSlabs <= 0 || firstSlab + numSlabs > ncub[2] ) return false;
+  GridScalars scalars( values );
+  if( !process_calc_slabs( ctx, mol, dim, ncub, key, firstSlab, numSlabs, scalars,
+                           progressCBack, cbackData ) ) return false;
+  if( ctx.Stopped() ) return false;
+  ctx.type_ = key;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+vtkImageData* vtk_process_calc( Mol *mol,
+                                float *dim,
+                                int *ncubes,
+                                int key,
+                                void ( *progressCBack )( int completedStep,
+                                                         int totalSteps,
+                                                         void* cbackData ),
+                                void* cbackData )
+{
+  globalContext.SetOrbital( molOrb );
+  return vtk_process_calc( globalContext, mol, dim, ncubes, key, progressCBack, cbackData );
+}
+
+namespace
+{
+  /// Maps the progress of one grid computation into the progress of a
+  /// sequence of computations.
+  struct ProcessCalcProgressOffset
+  {
+    void ( *progressCBack )( int, int, void* );
+    void* cbackData;
+    int offset;
+    int totalSteps;
+  };
+
+  void process_calc_progress_offset( int completedStep, int, void* data )
+  {
+    const ProcessCalcProgressOffset* p = reinterpret_cast< ProcessCalcProgressOffset* >( data );
+    p->progressCBack( p->offset + completedStep, p->totalSteps, p->cbackData );
+  }
+}
+
+//-----------------------------------------------------------------------------
+/// With gaussian basis sets the basis functions are evaluated once per grid
+/// line, the values of all the orbitals are then obtained with a single
+/// matrix product between the orbital coefficients and the basis function
+/// values. With other orbital types the orbitals are computed one at a time.
+bool vtk_process_calc_orbitals( ProcessCalcContext& ctx,
+                                Mol *mol,
+                                const MolecularOrbital* const* orbitals,
+                                int nOrbitals,
+                                float *dim,
+                                int *ncubes,
+                                vtkImageData** images,
+                                void ( *progressCBack )( int completedStep,
+                                                         int totalSteps,
+                                                         void* cbackData ),
+                                void* cbackData )
+{
+  int o;
+  for(o=0; o<nOrbitals; o++) images[o] = 0;
+  if( nOrbitals <= 0 ) return true;
+
+  const int flag = mol->alphaOrbital[0].flag;
+  if( flag != GAUSS_ORB && flag != GAMESS_ORB && flag != HONDO_ORB ) {
+    // one orbital at a time; progress reported over the whole sequence
+    const int steps = ncubes[0] * ncubes[1] * ncubes[2];
+    ProcessCalcProgressOffset p = { progressCBack, cbackData, 0, steps * nOrbitals };
+    double minValue = std::numeric_limits< double >::max();
+    double maxValue = -std::numeric_limits< double >::max();
+    for(o=0; o<nOrbitals; o++, p.offset += steps) {
+      ctx.SetOrbital( orbitals[o] );
+      images[o] = vtk_process_calc( ctx, mol, dim, ncubes, CALC_ORB,
+                                    progressCBack ? process_calc_progress_offset : 0, &p );
+      if( !images[o] || ctx.Stopped() ) break;
+      minValue = std::min( minValue, ctx.minValue_ );
+      maxValue = std::max( maxValue, ctx.maxValue_ );
+    }
+    if( o == nOrbitals ) {
+      ctx.minValue_ = minValue;
+      ctx.maxValue_ = maxValue;
+      return true;
+    }
+    for(o=0; o<nOrbitals; o++) {
+      if( images[o] ) images[o]->Delete();
+      images[o] = 0;
+    }
+    return false;
+  }
+
+  ctx.stop_ = false;
+  ctx.type_ = -1;
+  ctx.minValue_ = std::numeric_limits< double >::max();
+  ctx.maxValue_ = -std::numeric_limits< double >::max();
+
+  const int ncub[3] = { ncubes[0], ncubes[1], ncubes[2] };
+  const float dx = (dim[1]-dim[0])/(ncub[0]-1);
+  const float dy = (dim[3]-dim[2])/(ncub[1]-1);
+  const float dz = (dim[5]-dim[4])/(ncub[2]-1);
+  const int nBasisFunctions = mol->nBasisFunctions;
+  const int stride = GaussKernelStride( ncub[0] );
+  const int sliceSize = ncub[ 0 ] * ncub[ 1 ];
+  const int totalSteps = sliceSize * ncub[ 2 ];
+  int completedSlabs = 0;
+  bool allocError = false;
+
+  // coefficient sub-matrix: one row per orbital
+  std::vector< double > coeffs;
+  try {
+    coeffs.resize(size_t(nOrbitals) * nBasisFunctions);
+    for(o=0; o<nOrbitals; o++) {
+      std::copy( orbitals[o]->coefficient, orbitals[o]->coefficient + nBasisFunctions,
+                 coeffs.begin() + size_t(o) * nBasisFunctions );
+      images[o] = new_grid_image( dim, ncub, dx, dy, dz, ctx.GetDoublePrecision() );
+    }
+  }
+  catch( const std::bad_alloc& ) {
+    fprintf(stderr, "can't allocate orbital grids\n");
+    for(o=0; o<nOrbitals; o++) {
+      if( images[o] ) images[o]->Delete();
+      images[o] = 0;
+    }
+    return false;
+  }
+
+  std::vector< GridScalars > scalars;
+  scalars.reserve( nOrbitals );
+  for(o=0; o<nOrbitals; o++) scalars.push_back( GridScalars( images[o] ) );
+
+  ctx.scratch.resize( GetProcessCalcNumThreads() );
+  ctx.Setup( mol );
+  if( progressCBack ) progressCBack( 0, totalSteps, cbackData );
+
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+#ifdef _OPENMP
+    ProcessCalcScratch *threadScratch = &ctx.scratch[ omp_get_thread_num() ];
+#else
+    ProcessCalcScratch *threadScratch = &ctx.scratch[ 0 ];
+#endif
+    threadScratch->chiEvaluations = 0.;
+    threadScratch->evaluatedPrimitives = 0.;
+    try {
+      setup_line_scratch( threadScratch, nBasisFunctions, nOrbitals, 1, ncub[0], dim[0], dx );
+    }
+    catch( const std::bad_alloc& ) {
+      fprintf(stderr, "can't allocate chi\n");
+#ifdef _OPENMP
+      #pragma omp critical( process_calc_minmax )
+#endif
+      allocError = true;
+      ctx.stop_ = true;
+    }
+    double threadMin = std::numeric_limits< double >::max();
+    double threadMax = -std::numeric_limits< double >::max();
+
+#ifdef _OPENMP
+    #pragma omp for schedule( dynamic, 1 )
+#endif
+    for (int i=0; i<ncub[2]; i++) {
+      if( ctx.Stopped() ) continue;
+      const float z = dim[4] + i * dz;
+      for (int j=0; j<ncub[1] && !ctx.Stopped(); j++) {
+        const float y = dim[2] + j * dy;
+        double *values = &threadScratch->lineValues[0];
+        calc_chi_line(&ctx, threadScratch, ncub[0], y * _1_BOHR, z * _1_BOHR);
+        const std::vector< int > &active = threadScratch->activeFunctions;
+        contract_lines(&coeffs[0], nOrbitals, nBasisFunctions,
+                       active.empty() ? 0 : &active[0], int(active.size()),
+                       &threadScratch->chiLine[0], stride, ncub[0], values);
+        const size_t row = size_t(i) * sliceSize + size_t(j) * ncub[0];
+        for (int p=0; p<nOrbitals; p++, values += stride) {
+          for (int k=0; k<ncub[0]; k++) {
+            const double s = values[k];
+            if( s < threadMin ) threadMin = s;
+            if( s > threadMax ) threadMax = s;
+          }
+          scalars[p].SetLine( row, values, ncub[0] );
+        }
+      }
+      int completed = 0;
+#ifdef _OPENMP
+      #pragma omp critical( process_calc_progress )
+#endif
+      completed = ++completedSlabs;
+#ifdef _OPENMP
+      if( progressCBack && omp_get_thread_num() == 0 )
+#else
+      if( progressCBack )
+#endif
+      {
+        progressCBack( completed * sliceSize, totalSteps, cbackData );
+      }
+    }
+
+#ifdef _OPENMP
+    #pragma omp critical( process_calc_minmax )
+#endif
+    {
+      if( threadMin < ctx.minValue_ ) ctx.minValue_ = threadMin;
+      if( threadMax > ctx.maxValue_ ) ctx.maxValue_ = threadMax;
+    }
+  }
+  if( progressCBack && !ctx.Stopped() ) progressCBack( totalSteps, totalSteps, cbackData );
+
+  if( allocError || ctx.Stopped() ) {
+    for(o=0; o<nOrbitals; o++) {
+      if( images[o] ) images[o]->Delete();
+      images[o] = 0;
+    }
+    return false;
+  }
+  ctx.type_ = CALC_ORB;
+  return true;
+}
+
+namespace
+{
+  /// Factor applied to the value range of a cell's corners and centre to
+  /// estimate the range of values inside the cell: the deviation of a smooth
+  /// function from its trilinear interpolation is of the same order as the
+  /// variation observed at the sampled points.
+  /// The estimate is not a bound: a feature smaller than half a cell which
+  /// does not include the centre (e.g. a small lobe in a corner of a coarse
+  /// cell) is not detected and is lost; this is why the adaptive evaluation
+  /// is disabled by default, see MolekelMolecule::SetIsoGridCoarseStep.
+  const double ADAPTIVE_RANGE_MARGIN = 1.0;
+
+  /// Grid traversed by the adaptive evaluation: cells of a level have an edge
+  /// of h grid steps and are identified by the index of their lower corner;
+  /// the last cell along each axis is clipped to the grid.
+  struct AdaptiveGrid
+  {
+    int n[ 3 ];
+    GridScalars* values;
+    /// 1 for points whose value was computed.
+    std::vector< unsigned char > evaluated;
+    /// Atom positions in grid index units.
+    std::vector< double > atoms;
+    int Index( int i, int j, int k ) const { return i + n[ 0 ] * ( j + n[ 1 ] * k ); }
+    void Split( int c, int& i, int& j, int& k ) const
+    {
+      i = c % n[ 0 ];
+      j = ( c / n[ 0 ] ) % n[ 1 ];
+      k = c / ( n[ 0 ] * n[ 1 ] );
+    }
+  };
+
+  /// Computes the values at the listed grid points in parallel, returns
+  /// false if the computation was stopped.
+  bool evaluate_grid_points( ProcessCalcContext& ctx, Mol* mol, ProcessCalcFunction funct,
+                             const std::vector< int >& points, AdaptiveGrid& g,
+                             const float* dim, float dx, float dy, float dz,
+                             double& minValue, double& maxValue )
   {
-     free(chi);
-     chi = NULL;
+    const int np = int( points.size() );
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+#ifdef _OPENMP
+      ProcessCalcScratch* scratch = &ctx.scratch[ omp_get_thread_num() ];
+#else
+      ProcessCalcScratch* scratch = &ctx.scratch[ 0 ];
+#endif
+      double threadMin = std::numeric_limits< double >::max();
+      double threadMax = -std::numeric_limits< double >::max();
+#ifdef _OPENMP
+      #pragma omp for schedule( dynamic, 256 )
+#endif
+      for( int p = 0; p < np; ++p ) {
+        if( ctx.Stopped() ) continue;
+        int i, j, k;
+        g.Split( points[ p ], i, j, k );
+        // same single precision coordinates as vtk_process_calc
+        const float x = dim[ 0 ] + i * dx;
+        const float y = dim[ 2 ] + j * dy;
+        const float z = dim[ 4 ] + k * dz;
+        const double s = (*funct)( &ctx, mol, scratch, x, y, z );
+        if( s < threadMin ) threadMin = s;
+        if( s > threadMax ) threadMax = s;
+        g.values->Set( points[ p ], s );
+        g.evaluated[ points[ p ] ] = 1;
+      }
+#ifdef _OPENMP
+      #pragma omp critical( process_calc_minmax )
+#endif
+      {
+        if( threadMin < minValue ) minValue = threadMin;
+        if( threadMax > maxValue ) maxValue = threadMax;
+      }
+    }
+    return !ctx.Stopped();
   }
-  type = key;
+
+  /// Returns the index of the centre point of cell c of edge h, clipped to
+  /// the grid.
+  int cell_centre( const AdaptiveGrid& g, int c, int h )
+  {
+    int c0[ 3 ];
+    g.Split( c, c0[ 0 ], c0[ 1 ], c0[ 2 ] );
+    for( int a = 0; a != 3; ++a ) c0[ a ] = ( c0[ a ] + std::min( c0[ a ] + h, g.n[ a ] - 1 ) ) / 2;
+    return g.Index( c0[ 0 ], c0[ 1 ], c0[ 2 ] );
+  }
+
+  /// Queues grid point p if it has not been computed yet.
+  void queue_point( AdaptiveGrid& g, int p,
+                    std::vector< unsigned char >& queued, std::vector< int >& points )
+  {
+    if( g.evaluated[ p ] || queued[ p ] ) return;
+    queued[ p ] = 1;
+    points.push_back( p );
+  }
+
+  /// Queues the points of the lattice of step h inside cell c of the given
+  /// edge which have not been computed yet.
+  void queue_cell_points( AdaptiveGrid& g, int c, int edge, int h,
+                          std::vector< unsigned char >& queued, std::vector< int >& points )
+  {
+    int c0[ 3 ], c1[ 3 ];
+    g.Split( c, c0[ 0 ], c0[ 1 ], c0[ 2 ] );
+    for( int a = 0; a != 3; ++a ) c1[ a ] = std::min( c0[ a ] + edge, g.n[ a ] - 1 );
+    for( int k = c0[ 2 ]; k <= c1[ 2 ]; k = k == c1[ 2 ] ? k + 1 : std::min( k + h, c1[ 2 ] ) )
+      for( int j = c0[ 1 ]; j <= c1[ 1 ]; j = j == c1[ 1 ] ? j + 1 : std::min( j + h, c1[ 1 ] ) )
+        for( int i = c0[ 0 ]; i <= c1[ 0 ]; i = i == c1[ 0 ] ? i + 1 : std::min( i + h, c1[ 0 ] ) )
+          queue_point( g, g.Index( i, j, k ), queued, points );
+  }
+
+  /// Queues the centres of the children of edge h of cell c of edge 2 * h:
+  /// the centres are sampled together with the corners to detect features
+  /// lying inside a child, see cell_needs_refinement.
+  void queue_child_centres( AdaptiveGrid& g, int c, int h,
+                            std::vector< unsigned char >& queued, std::vector< int >& points )
+  {
+    int c0[ 3 ];
+    g.Split( c, c0[ 0 ], c0[ 1 ], c0[ 2 ] );
+    for( int v = 0; v != 8; ++v ) {
+      const int i = c0[ 0 ] + ( v & 1 ? h : 0 );
+      const int j = c0[ 1 ] + ( v & 2 ? h : 0 );
+      const int k = c0[ 2 ] + ( v & 4 ? h : 0 );
+      // children outside the clipped cell
+      if( i >= g.n[0] - 1 || j >= g.n[1] - 1 || k >= g.n[2] - 1 ) continue;
+      queue_point( g, cell_centre( g, g.Index( i, j, k ), h ), queued, points );
+    }
+  }
+
+  /// Returns true if the values inside cell c of edge h can reach one of the
+  /// isovalues or if the cell contains an atom, where values vary too fast
+  /// for the sampled values to be meaningful. The range of values inside the
+  /// cell is estimated from the values at the corners and, if computed, at
+  /// the centre, see ADAPTIVE_RANGE_MARGIN.
+  bool cell_needs_refinement( const AdaptiveGrid& g, int c, int h,
+                              const double* isoValues, int nIsoValues )
+  {
+    int c0[ 3 ], c1[ 3 ];
+    g.Split( c, c0[ 0 ], c0[ 1 ], c0[ 2 ] );
+    for( int a = 0; a != 3; ++a ) c1[ a ] = std::min( c0[ a ] + h, g.n[ a ] - 1 );
+    for( int a = 0; a < int( g.atoms.size() ); a += 3 ) {
+      if( g.atoms[ a ] >= c0[ 0 ] && g.atoms[ a ] <= c1[ 0 ] &&
+          g.atoms[ a + 1 ] >= c0[ 1 ] && g.atoms[ a + 1 ] <= c1[ 1 ] &&
+          g.atoms[ a + 2 ] >= c0[ 2 ] && g.atoms[ a + 2 ] <= c1[ 2 ] ) return true;
+    }
+    double lo = std::numeric_limits< double >::max();
+    double hi = -std::numeric_limits< double >::max();
+    for( int v = 0; v != 8; ++v ) {
+      const double s = g.values->Get( g.Index( v & 1 ? c1[ 0 ] : c0[ 0 ],
+                                               v & 2 ? c1[ 1 ] : c0[ 1 ],
+                                               v & 4 ? c1[ 2 ] : c0[ 2 ] ) );
+      lo = std::min( lo, s );
+      hi = std::max( hi, s );
+    }
+    const int centre = cell_centre( g, c, h );
+    if( g.evaluated[ centre ] ) {
+      const double s = g.values->Get( centre );
+      lo = std::min( lo, s );
+      hi = std::max( hi, s );
+    }
+    const double margin = ADAPTIVE_RANGE_MARGIN * ( hi - lo );
+    for( int i = 0; i != nIsoValues; ++i ) {
+      if( isoValues[ i ] >= lo - margin && isoValues[ i ] <= hi + margin ) return true;
+    }
+    return false;
+  }
+
+  /// Fills the points of cell c of edge h which were not computed with the
+  /// trilinear interpolation of the corner values: the sign of value - isovalue
+  /// is preserved, no surface is generated inside the cell.
+  void interpolate_cell( AdaptiveGrid& g, int c, int h )
+  {
+    int c0[ 3 ], c1[ 3 ];
+    g.Split( c, c0[ 0 ], c0[ 1 ], c0[ 2 ] );
+    for( int a = 0; a != 3; ++a ) c1[ a ] = std::min( c0[ a ] + h, g.n[ a ] - 1 );
+    double v[ 8 ];
+    for( int i = 0; i != 8; ++i ) {
+      v[ i ] = g.values->Get( g.Index( i & 1 ? c1[ 0 ] : c0[ 0 ],
+                                       i & 2 ? c1[ 1 ] : c0[ 1 ],
+                                       i & 4 ? c1[ 2 ] : c0[ 2 ] ) );
+    }
+    const double sx = c1[ 0 ] > c0[ 0 ] ? 1. / ( c1[ 0 ] - c0[ 0 ] ) : 0.;
+    const double sy = c1[ 1 ] > c0[ 1 ] ? 1. / ( c1[ 1 ] - c0[ 1 ] ) : 0.;
+    const double sz = c1[ 2 ] > c0[ 2 ] ? 1. / ( c1[ 2 ] - c0[ 2 ] ) : 0.;
+    for( int k = c0[ 2 ]; k <= c1[ 2 ]; ++k ) {
+      const double tz = ( k - c0[ 2 ] ) * sz;
+      for( int j = c0[ 1 ]; j <= c1[ 1 ]; ++j ) {
+        const double ty = ( j - c0[ 1 ] ) * sy;
+        const double v0 = ( v[ 0 ] * ( 1. - ty ) + v[ 2 ] * ty ) * ( 1. - tz ) +
+                          ( v[ 4 ] * ( 1. - ty ) + v[ 6 ] * ty ) * tz;
+        const double v1 = ( v[ 1 ] * ( 1. - ty ) + v[ 3 ] * ty ) * ( 1. - tz ) +
+                          ( v[ 5 ] * ( 1. - ty ) + v[ 7 ] * ty ) * tz;
+        for( int i = c0[ 0 ]; i <= c1[ 0 ]; ++i ) {
+          const int p = g.Index( i, j, k );
+          if( g.evaluated[ p ] ) continue;
+          const double tx = ( i - c0[ 0 ] ) * sx;
+          g.values->Set( p, v0 * ( 1. - tx ) + v1 * tx );
+        }
+      }
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+/// Octree refinement: the grid is computed at the coarse step, cells which
+/// may contain an isosurface (see cell_needs_refinement) and their neighbours
+/// are split into eight children whose corners are computed, down to single
+/// voxels; all the other cells are filled by interpolation.
+vtkImageData* vtk_process_calc_adaptive( ProcessCalcContext& ctx,
+                                         Mol *mol,
+                                         float *dim,
+                                         int *ncubes,
+                                         int key,
+                                         const double* isoValues,
+                                         int nIsoValues,
+                                         int coarseStep,
+                                         void ( *progressCBack )( int completedStep,
+                                                                  int totalSteps,
+                                                                  void* cbackData ),
+                                         void* cbackData )
+{
+  int h = 1;
+  while( 2 * h <= coarseStep ) h *= 2;
+  if( h < 2 || nIsoValues <= 0 || ncubes[0] < 2 || ncubes[1] < 2 || ncubes[2] < 2 ) {
+    return vtk_process_calc( ctx, mol, dim, ncubes, key, progressCBack, cbackData );
+  }
+
+  ctx.stop_ = false;
+  ctx.type_ = -1;
+  ctx.minValue_ = std::numeric_limits< double >::max();
+  ctx.maxValue_ = -std::numeric_limits< double >::max();
+
+  if( key != MEP && ( mol->alphaOrbital[0].flag == ADF_ORB_A ||
+                      mol->alphaOrbital[0].flag == ADF_ORB_B ) &&
+      mol->alphaOrbital[0].coefficient == NULL ) return 0;
+
+  const ProcessCalcFunction funct = select_function(&ctx, mol, key);
+  if( !funct ) return 0;
+
+  AdaptiveGrid g;
+  g.n[ 0 ] = ncubes[ 0 ];
+  g.n[ 1 ] = ncubes[ 1 ];
+  g.n[ 2 ] = ncubes[ 2 ];
+  const float dx = (dim[1]-dim[0])/(g.n[0]-1);
+  const float dy = (dim[3]-dim[2])/(g.n[1]-1);
+  const float dz = (dim[5]-dim[4])/(g.n[2]-1);
+  vtkSmartPointer< vtkImageData > image( new_grid_image( dim, g.n, dx, dy, dz,
+                                                         ctx.GetDoublePrecision() ) );
+  GridScalars scalars( image );
+  g.values = &scalars;
+  const int totalSteps = g.n[ 0 ] * g.n[ 1 ] * g.n[ 2 ];
+  std::vector< unsigned char > queued;
+  std::vector< int > points, active, next;
+  try {
+    g.evaluated.resize( totalSteps, 0 );
+    queued.resize( totalSteps, 0 );
+    ctx.scratch.resize( GetProcessCalcNumThreads() );
+    if( key != MEP && mol->nBasisFunctions > 0 ) {
+      ctx.Setup( mol );
+      for( int t = 0; t != int( ctx.scratch.size() ); ++t ) {
+        ctx.scratch[ t ].chi.resize( mol->nBasisFunctions );
+        ctx.scratch[ t ].atomDistances.resize( 4 * mol->Atoms.size() + 1 );
+      }
+    }
+  }
+  catch( const std::bad_alloc& ) {
+    fprintf(stderr, "can't allocate adaptive grid\n");
+    ctx.FreeDensityMatrix();
+    image->Delete();
+    return 0;
+  }
+  for (MolekelAtomList::const_iterator ap=mol->Atoms.begin(); ap!=mol->Atoms.end(); ++ap) {
+    g.atoms.push_back( ( ap->coord[0] - dim[0] ) / dx );
+    g.atoms.push_back( ( ap->coord[1] - dim[2] ) / dy );
+    g.atoms.push_back( ( ap->coord[2] - dim[4] ) / dz );
+  }
+  if( progressCBack ) progressCBack( 0, totalSteps, cbackData );
+
+  // coarse level: all the cells
+  int i, j, k;
+  for( k = 0; k < g.n[2] - 1; k += h )
+    for( j = 0; j < g.n[1] - 1; j += h )
+      for( i = 0; i < g.n[0] - 1; i += h ) {
+        active.push_back( g.Index( i, j, k ) );
+        queue_cell_points( g, active.back(), h, h, queued, points );
+        queue_point( g, cell_centre( g, active.back(), h ), queued, points );
+      }
+  bool ok = evaluate_grid_points( ctx, mol, funct, points, g, dim, dx, dy, dz,
+                                  ctx.minValue_, ctx.maxValue_ );
+  double computed = double( points.size() );
+  // coarse cells to refine, dilated by one cell to catch features lying
+  // between the coarse grid points
+  std::vector< unsigned char > refine( active.size(), 0 );
+  const int cells[ 3 ] = { ( g.n[0] - 2 ) / h + 1, ( g.n[1] - 2 ) / h + 1, ( g.n[2] - 2 ) / h + 1 };
+  for( size_t c = 0; ok && c != active.size(); ++c ) {
+    if( !cell_needs_refinement( g, active[ c ], h, isoValues, nIsoValues ) ) continue;
+    g.Split( active[ c ], i, j, k );
+    i /= h; j /= h; k /= h;
+    for( int nk = std::max( 0, k - 1 ); nk <= std::min( cells[2] - 1, k + 1 ); ++nk )
+      for( int nj = std::max( 0, j - 1 ); nj <= std::min( cells[1] - 1, j + 1 ); ++nj )
+        for( int ni = std::max( 0, i - 1 ); ni <= std::min( cells[0] - 1, i + 1 ); ++ni )
+          refine[ ni + cells[0] * ( nj + cells[1] * nk ) ] = 1;
+  }
+  for( size_t c = 0; ok && c != active.size(); ++c ) {
+    if( refine[ c ] ) next.push_back( active[ c ] );
+    else interpolate_cell( g, active[ c ], h );
+  }
+  active.swap( next );
+
+  // refinement levels
+  for( ; ok && h > 1 && !active.empty(); h /= 2 ) {
+    if( progressCBack ) progressCBack( int( computed ), totalSteps, cbackData );
+    const int h2 = h / 2;
+    points.clear();
+    for( size_t c = 0; c != active.size(); ++c ) {
+      queue_cell_points( g, active[ c ], h, h2, queued, points );
+      // children of edge 1 are not tested
+      if( h2 > 1 ) queue_child_centres( g, active[ c ], h2, queued, points );
+    }
+    ok = evaluate_grid_points( ctx, mol, funct, points, g, dim, dx, dy, dz,
+                               ctx.minValue_, ctx.maxValue_ );
+    computed += double( points.size() );
+    next.clear();
+    // with h2 == 1 all the points of the active cells have been computed
+    for( size_t c = 0; ok && h2 > 1 && c != active.size(); ++c ) {
+      int c0[ 3 ];
+      g.Split( active[ c ], c0[ 0 ], c0[ 1 ], c0[ 2 ] );
+      for( int v = 0; v != 8; ++v ) {
+        i = c0[ 0 ] + ( v & 1 ? h2 : 0 );
+        j = c0[ 1 ] + ( v & 2 ? h2 : 0 );
+        k = c0[ 2 ] + ( v & 4 ? h2 : 0 );
+        // children outside the clipped cell
+        if( i >= g.n[0] - 1 || j >= g.n[1] - 1 || k >= g.n[2] - 1 ) continue;
+        const int child = g.Index( i, j, k );
+        if( cell_needs_refinement( g, child, h2, isoValues, nIsoValues ) ) next.push_back( child );
+        else interpolate_cell( g, child, h2 );
+      }
+    }
+    active.swap( next );
+  }
+  if( progressCBack && ok ) progressCBack( totalSteps, totalSteps, cbackData );
+
+  ctx.FreeDensityMatrix();
+  if( !ok ) {
+    image->Delete();
+    return 0;
+  }
+  ctx.type_ = key;
   return image;
 }
 
@@ -434,120 +1277,44 @@ void process_calc(Mol *mol, const char *s, float *dim, int *ncubes, int key)
   struct tms starttime, endtime;
   float systime, cputime;
   #endif
-  double (*funct)(Mol *mol, float x, float y, float z);
+  ProcessCalcFunction funct;
+  ProcessCalcScratch scratch;
 
   ncub[0] = *ncubes++;
   ncub[1] = *ncubes++;
-  ncub[2] = *ncubes++;
-
-  if((mol->alphaOrbital[0].flag == ADF_ORB_A ||
-   mol->alphaOrbital[0].flag == ADF_ORB_B ) &&
-   mol->alphaOrbital[0].coefficient == NULL) {
-   //executeAdfUtilities(mol, s, dim, ncub, key); UV XXX REMOVED
-   return;
-  }
-
-  if((fp = fopen(s, "wb")) == NULL){
-   fprintf(stderr, "can't open .macu file\n");
-   return;
-  }
-
-  if ((array = (float *)malloc(ncub[0]*ncub[1]*sizeof(float))) == NULL){
-   fprintf(stderr, "can't allocate slice\n");
-   exit(-1);
-  }
-  if ((slice = (float **)malloc(ncub[1]*sizeof(float *))) == NULL){
-   fprintf(stderr, "can't allocate slice\n");
-   exit(-1);
-  }
-  for (i=0; i<ncub[1]; i++) slice[i] = array + (i * ncub[0]);
-
-  chi = (double *)calloc(mol->nBasisFunctions, sizeof(double));
-  if (!chi && !(mol->alphaOrbital[0].flag == EHT_ORB)) {
-   fprintf(stderr, "can't allocate chi\n");
-   return;
-  }
-
-  switch(key) {
-   case CALC_ORB  :
-    switch(mol->alphaOrbital[0].flag) {
-      case GAMESS_ORB :
-      case HONDO_ORB  :
-      case GAUSS_ORB  : funct = calc_point; break;
-  /* to be fixed
-          case ADF_ORB_A  :
-  case ADF_ORB_B  : funct = calc_adf_point; break;
-
-  case EHT_ORB   : funct = calc_eht_point; break;
-  */
-      case MOS_ORB   :
-      case ZINDO_ORB  :
-      case PRDDO_ORB  : funct = calc_prddo_point; break;
-      case MLD_SLATER_ORB  : funct = calc_sltr_point; break;
-    }
-    break;
+  ncub[2] = *ncubes++;
 
-   case EL_DENS :
-    switch(mol->alphaOrbital[0].flag) {
-      case GAMESS_ORB :
-      case HONDO_ORB  :
-      case GAUSS_ORB  :
-       if (!generate_density_matrix(mol, key)) {
-        fprintf(stderr, "Can't generate the density matrix!\n");
-        strcpy(timestring, "Can't generate the density matrix!");
-        return;
-       }
-       else {
-        printf("density matrix generated...\n");
-        funct = calculate_density;
-       }
-       break;
+  if((mol->alphaOrbital[0].flag == ADF_ORB_A ||
+   mol->alphaOrbital[0].flag == ADF_ORB_B ) &&
+   mol->alphaOrbital[0].coefficient == NULL) {
+   //executeAdfUtilities(mol, s, dim, ncub, key); UV XXX REMOVED
+   return;
+  }
 
-  /* to be fixed
-          case ADF_ORB_A  :
-  case ADF_ORB_B  : funct = calc_adf_density; break;
+  if((fp = fopen(s, "wb")) == NULL){
+   fprintf(stderr, "can't open .macu file\n");
+   return;
+  }
 
-  case EHT_ORB   : funct = calc_eht_density; break;
-  */
-      case MOS_ORB   :
-      case ZINDO_ORB  :
-      case PRDDO_ORB  : funct = calc_prddo_density; break;
-      case MLD_SLATER_ORB  : funct = calc_sltr_density; break;
-    }
-    break;
+  if ((array = (float *)malloc(ncub[0]*ncub[1]*sizeof(float))) == NULL){
+   fprintf(stderr, "can't allocate slice\n");
+   exit(-1);
+  }
+  if ((slice = (float **)malloc(ncub[1]*sizeof(float *))) == NULL){
+   fprintf(stderr, "can't allocate slice\n");
+   exit(-1);
+  }
+  for (i=0; i<ncub[1]; i++) slice[i] = array + (i * ncub[0]);
 
-   case SPIN_DENS :
-    switch(mol->alphaOrbital[0].flag) {
-      case GAMESS_ORB :
-      case HONDO_ORB  :
-      case GAUSS_ORB  :
-       if (!mol->alphaBeta) {
-        funct = calculateSomo;
-       }
-       else if(!generate_density_matrix(mol, key)) {
-        fprintf(stderr, "Can't generate the density matrix!\n");
-        strcpy(timestring, "Can't generate the density matrix!");
-        return;
-       }
-       else {
-        printf("density matrix generated...\n");
-        funct = calculate_density;
-       }
-       break;
-  /* to be fixed
-  case ADF_ORB_A  :
-          case ADF_ORB_B  :
-  */
-      case MOS_ORB   :
-      case ZINDO_ORB  :
-      case PRDDO_ORB  : funct = calc_prddo_spindensity; break;
-      case MLD_SLATER_ORB  : funct = calc_sltr_spindensity; break;
-    }
-    break;
+  scratch.chi.resize(mol->nBasisFunctions);
+  scratch.atomDistances.resize(4 * mol->Atoms.size() + 1);
 
-   case MEP :
-    funct = calc_mep;
-    break;
+  globalContext.SetOrbital( molOrb );
+  globalContext.Setup( mol );
+  funct = select_function(&globalContext, mol, key);
+  if(!funct) {
+   strcpy(timestring, "Can't generate the density matrix!");
+   return;
   }
 
   len = 36;
@@ -567,7 +1334,7 @@ void process_calc(Mol *mol, const char *s, float *dim, int *ncubes, int key)
   for (i=0, z=dim[4]; i<ncub[2]; i++, z += dz) {
    for (j=0, y=dim[2]; j<ncub[1]; j++, y += dy) {
     for (k=0, x=dim[0]; k<ncub[0]; k++, x += dx) {
-      slice[j][k] = (*funct)(mol, x, y, z);
+      slice[j][k] = (*funct)(&globalContext, mol, &scratch, x, y, z);
     }
    }
    fwrite(&len, sizeof(int), 1, fp);
@@ -593,26 +1360,22 @@ void process_calc(Mol *mol, const char *s, float *dim, int *ncubes, int key)
   fclose(fp);
   free(slice);
   free(array);
-  if(density){
-   free(density[0]);
-   free(density);
-  }
-  density = NULL;
-  if(chi) free(chi);
+  globalContext.FreeDensityMatrix();
 }
 
 
 
 
-double calc_point(Mol *mol, float x, float y, float z)
-/* calculate the MO-value at given point */
-/* no functions for speed */
+/* calculate the value of the MO with the given coefficients at given point */
+static double calc_orbital_point(const ProcessCalcContext *ctx, Mol *mol,
+                                 const double *ao_coeff, ProcessCalcScratch *scratch,
+                                 float x, float y, float z)
 {
    register int i;
-   double value, *ao_coeff;
+   double value;
+   const double *chi = &scratch->chi[0];
 
-   ao_coeff = molOrb->coefficient;
-   calc_chi(mol, x, y, z);
+   calc_chi(ctx, mol, scratch, x, y, z);
 
    value = 0;
    for(i=0; i<mol->nBasisFunctions; i++) {
@@ -623,22 +1386,35 @@ double calc_point(Mol *mol, float x, float y, float z)
 }
 
 
+double calc_point(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z)
+/* calculate the MO-value at given point */
+/* no functions for speed */
+{
+   return calc_orbital_point(ctx, mol, ctx->orbital->coefficient, scratch, x, y, z);
+}
+
+
 
 
 
 
-double calculateSomo(Mol *mol, float x, float y, float z)
-/* calculate the spin density of the singly occ. orbitals */
+double calculate_density(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z)
+/* calculate the electron or spin density at given point */
 {
-  register short i;
-  double value, point;
+  register int i, j;
+  double value;
+  const int nbf = mol->nBasisFunctions;
+  const double *density = ctx->density;
+  const double *chi = &scratch->chi[0];
 
   value = 0;
+  calc_chi(ctx, mol, scratch, x, y, z);
 
-  for(i=mol->nBeta; i<mol->nAlpha; i++){
-    molOrb = mol->alphaOrbital + i - mol->firstOrbital + 1;
-    point = calc_point(mol, x, y, z);
-    value += point*point;;
+  /* lower triangle of the density matrix, stored row by row */
+  for(i=0; i<nbf; density += ++i){
+    value += density[i] * chi[i] * chi[i];
+    for(j=0; j<i; j++)
+      value += density[j] * chi[i] * chi[j] * 2.0;
   }
 
   return value;
@@ -646,83 +1422,257 @@ double calculateSomo(Mol *mol, float x, float y, float z)
 
 
 
+/* evaluate all the basis functions along a line of grid points; values
+ * of basis function i are stored at scratch->chiLine + i * stride; the
+ * indices of the functions which are not zero over the whole line
+ * (i.e. not screened out) are stored into scratch->activeFunctions */
+static void calc_chi_line(const ProcessCalcContext *ctx, ProcessCalcScratch *scratch,
+                          int n, double y, double z)
+{
+  const int nbf = ctx->basis->NumBasisFunctions();
+
+  scratch->chiEvaluations += n;
+  scratch->evaluatedPrimitives +=
+    EvaluateBasisLine(*ctx->basis, &ctx->centres[0], &ctx->shellCutoff2[0],
+                      &ctx->primitiveCutoff2[0], &scratch->xLine[0], n, y, z,
+                      &scratch->chiLine[0]);
+  find_active_functions(scratch, nbf, n);
+}
 
 
+/* store into scratch->activeFunctions the indices of the basis functions
+ * which are not zero over the whole line */
+static void find_active_functions(ProcessCalcScratch *scratch, int nbf, int n)
+{
+  const int stride = GaussKernelStride(n);
+  const double *chi = &scratch->chiLine[0];
+  int f, k;
+
+  scratch->activeFunctions.clear();
+  for(f=0; f<nbf; f++, chi += stride) {
+    for(k=0; k<n && chi[k] == 0.; k++);
+    if(k < n) scratch->activeFunctions.push_back(f);
+  }
+}
+
 
-double calculate_density(Mol *mol, float x, float y, float z)
-/* calculate the electron or spin density at given point */
+/* matrix product out = c * chi: c is a nrows x ldc row major matrix, chi
+ * and out hold one line of values per basis function and per row of c, with
+ * stride values per line; only the nf basis functions listed in f (the
+ * active functions returned by calc_chi_line) are used. Functions are
+ * processed in blocks so that the chi lines of a block stay in cache while
+ * all the rows of c are computed */
+static void contract_lines(const double *c, int nrows, int ldc,
+                           const int *f, int nf,
+                           const double *chi, int stride, int n, double *out)
 {
-  register short i, j;
-  double value;
+  const int BLOCK = 32;
+  int b0, b1, b, r, k;
+
+  memset(out, 0, size_t(nrows) * stride * sizeof(double));
+  for(b0=0; b0<nf; b0=b1) {
+    b1 = std::min(b0 + BLOCK, nf);
+    for(r=0; r<nrows; r++) {
+      const double *cr = c + size_t(r) * ldc;
+      double *o = out + size_t(r) * stride;
+      for(b=b0; b<b1; b++) {
+        const double cf = cr[f[b]];
+        const double *ch = chi + size_t(f[b]) * stride;
+        if(cf == 0.) continue;
+        for(k=0; k<n; k++) o[k] += cf * ch[k];
+      }
+    }
+  }
+}
 
-  value = 0;
-  calc_chi(mol, x, y, z);
 
-  for(i=0; i<mol->nBasisFunctions; i++){
-    value += density[i][i] * chi[i] * chi[i];
-    for(j=0; j<i; j++)
-      value += density[i][j] * chi[i] * chi[j] * 2.0;
+/* values of the MO with the given coefficients along a line, chi already computed */
+static void orbital_line(const ProcessCalcScratch *scratch, int nbf, const double *ao_coeff,
+                         int n, double *values)
+{
+  const std::vector< int > &active = scratch->activeFunctions;
+  contract_lines(ao_coeff, 1, nbf, active.empty() ? 0 : &active[0], int(active.size()),
+                 &scratch->chiLine[0], GaussKernelStride(n), n, values);
+}
+
+
+void calc_point_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch,
+                     int n, double y, double z, double *values)
+/* line version of calc_point */
+{
+  calc_chi_line(ctx, scratch, n, y, z);
+  orbital_line(scratch, mol->nBasisFunctions, ctx->orbital->coefficient, n, values);
+}
+
+
+void calculate_density_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch,
+                            int n, double y, double z, double *values)
+/* line version of calculate_density, restricted to the active functions:
+ * value = sum_i chi_i * ( D_ii * chi_i + 2 * sum_j<i D_ij * chi_j ) */
+{
+  const int stride = GaussKernelStride(n);
+  const double *chi = &scratch->chiLine[0];
+  double *acc = &scratch->lineTemp[0];
+  int a, b, i, j, k;
+
+  calc_chi_line(ctx, scratch, n, y, z);
+  const int *active = scratch->activeFunctions.empty() ? 0 : &scratch->activeFunctions[0];
+  const int nactive = int(scratch->activeFunctions.size());
+  memset(values, 0, n * sizeof(double));
+  for(a=0; a<nactive; a++){
+    i = active[a];
+    const double *chi_i = chi + size_t(i) * stride;
+    const double *density = ctx->density + DensityMatrices::RowOffset(i);
+    const double d_ii = density[i];
+    for(k=0; k<n; k++) acc[k] = 0.5 * d_ii * chi_i[k];
+    for(b=0; b<a; b++){
+      j = active[b];
+      const double d_ij = density[j];
+      const double *chi_j = chi + size_t(j) * stride;
+      if(d_ij == 0.) continue;
+      for(k=0; k<n; k++) acc[k] += d_ij * chi_j[k];
+    }
+    for(k=0; k<n; k++) values[k] += 2.0 * chi_i[k] * acc[k];
   }
+}
+
 
+/* density at a point from the occupied orbitals stored into the context,
+ * chi already computed: value = sum_o w_o * ( sum_i C_oi * chi_i )^2 */
+static double orbital_density(const ProcessCalcContext *ctx, int nbf, const double *chi)
+{
+  const int nocc = int(ctx->occupiedWeights.size());
+  const double *c = ctx->occupied.empty() ? 0 : &ctx->occupied[0];
+  double value = 0., point;
+  int o, i;
+
+  for(o=0; o<nocc; o++, c += nbf){
+    point = 0.;
+    for(i=0; i<nbf; i++) point += c[i] * chi[i];
+    value += ctx->occupiedWeights[o] * point * point;
+  }
   return value;
 }
 
 
+double calculate_orbital_density(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z)
+/* calculate the electron or spin density at given point from the occupied
+ * orbitals */
+{
+  calc_chi(ctx, mol, scratch, x, y, z);
+  return orbital_density(ctx, mol->nBasisFunctions, &scratch->chi[0]);
+}
+
+
+/* line version of orbital_density, chi already computed: the values of all
+ * the occupied orbitals are computed with a single matrix product */
+static void orbital_density_line(const ProcessCalcContext *ctx, ProcessCalcScratch *scratch,
+                                 int nbf, int n, double *values)
+{
+  const int stride = GaussKernelStride(n);
+  const int nocc = int(ctx->occupiedWeights.size());
+  const double *point = &scratch->lineTemp[0];
+  int o, k;
+
+  const std::vector< int > &active = scratch->activeFunctions;
+  contract_lines(ctx->occupied.empty() ? 0 : &ctx->occupied[0], nocc, nbf,
+                 active.empty() ? 0 : &active[0], int(active.size()),
+                 &scratch->chiLine[0], stride, n, &scratch->lineTemp[0]);
+  memset(values, 0, n * sizeof(double));
+  for(o=0; o<nocc; o++, point += stride){
+    const double w = ctx->occupiedWeights[o];
+    for(k=0; k<n; k++) values[k] += w * point[k] * point[k];
+  }
+}
+
 
+void calculate_orbital_density_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch,
+                                    int n, double y, double z, double *values)
+/* line version of calculate_orbital_density */
+{
+  calc_chi_line(ctx, scratch, n, y, z);
+  orbital_density_line(ctx, scratch, mol->nBasisFunctions, n, values);
+}
 
-void calc_chi(Mol *mol, float x, float y, float z)
+
+void calc_chi(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch,
+              float x, float y, float z)
 /* calculate sum of AO-contributions chi for each MO at given point */
-/* no functions for speed */
+/* reads the compiled basis set: one loop per shell type over all the shells
+ * of that type; shells and primitives farther than their cutoff radius
+ * (see ProcessCalcContext::Setup) are skipped */
 {
-//  MolekelAtom *ap;
-//  register Shell    *sp;
-//  register Gauss    *gp;
-  double radial_part, *cp;
-  float xa, ya, za, ra2;  /* atomic units !! */
+  const GaussianBasis &basis = *ctx->basis;
+  const double *exps = basis.Exponents();
+  const double *coeffs = basis.Coefficients();
+  const double *coeffs2 = basis.PCoefficients();
+  const double *shell_r2 = &ctx->shellCutoff2[0];
+  const double *pr2 = &ctx->primitiveCutoff2[0];
+  double *chi = &scratch->chi[0];
+  double *ad = &scratch->atomDistances[0];
+  const double *c = &ctx->centres[0];
+  double radial_part, *cp, xa, ya, za, ra2;  /* atomic units !! */
+  int a, s, p, p1, t, evaluated = 0;
 
   memset(chi, 0, mol->nBasisFunctions * sizeof(double));
-  cp = chi;
-  for (MolekelAtomList::iterator ap=mol->Atoms.begin(); ap!=mol->Atoms.end(); ++ap) {
-    xa = (x - ap->coord[0]) * _1_BOHR;
-    ya = (y - ap->coord[1]) * _1_BOHR;
-    za = (z - ap->coord[2]) * _1_BOHR;
-
-    ra2 = xa*xa + ya*ya + za*za;    /* cutoff-distance ? */
 
-    for (ShellList::iterator sp=ap->Shells.begin(); sp!=ap->Shells.end(); ++sp) {
-      switch(sp->n_base){
-        case 1  :        /*** S-orbital ***/
-          for (GaussList::iterator it=sp->gaussians.begin(); it!=sp->gaussians.end(); ++it) {
-            radial_part = exp(-ra2*it->exponent);
-            *cp += it->coeff * radial_part;
+  /* distances from all the atoms */
+  for (a=0; a<basis.NumAtoms(); a++, ad += 4, c += 3) {
+    ad[0] = x * _1_BOHR - c[0];
+    ad[1] = y * _1_BOHR - c[1];
+    ad[2] = z * _1_BOHR - c[2];
+    ad[3] = ad[0]*ad[0] + ad[1]*ad[1] + ad[2]*ad[2];
+  }
+  ad = &scratch->atomDistances[0];
+
+  for (t=0; t<GaussianBasis::NUM_SHELL_TYPES; t++) {
+    const GaussianBasis::ShellGroup &g = basis.Group(GaussianBasis::ShellType(t));
+    for (s=0; s<g.Size(); s++) {
+      const double *d = ad + 4 * g.atom[s];
+      const int u = g.shell[s];
+      ra2 = d[3];
+      if(ra2 > shell_r2[u]) continue;
+      xa = d[0]; ya = d[1]; za = d[2];
+      cp = chi + g.firstFunction[s];
+      p1 = basis.FirstPrimitive(u) + basis.NumPrimitives(u);
+      switch(t){
+        case GaussianBasis::S :        /*** S-orbital ***/
+          for (p=basis.FirstPrimitive(u); p<p1; p++) {
+            if(ra2 > pr2[p]) continue;
+            ++evaluated;
+            radial_part = exp(-ra2*exps[p]);
+            *cp += coeffs[p] * radial_part;
           }
-          cp++;
           break;
 
-        case 4 :        /*** SP-orbital ***/
-          for (GaussList::iterator it=sp->gaussians.begin(); it!=sp->gaussians.end(); ++it) {
-            radial_part = exp(-ra2*it->exponent);
-            *cp     += it->coeff * radial_part;
-            *(cp+1) += it->coeff2 * xa * radial_part;
-            *(cp+2) += it->coeff2 * ya * radial_part;
-            *(cp+3) += it->coeff2 * za * radial_part;
+        case GaussianBasis::SP :        /*** SP-orbital ***/
+          for (p=basis.FirstPrimitive(u); p<p1; p++) {
+            if(ra2 > pr2[p]) continue;
+            ++evaluated;
+            radial_part = exp(-ra2*exps[p]);
+            *cp     += coeffs[p] * radial_part;
+            *(cp+1) += coeffs2[p] * xa * radial_part;
+            *(cp+2) += coeffs2[p] * ya * radial_part;
+            *(cp+3) += coeffs2[p] * za * radial_part;
           }
-          cp += 4;
           break;
 
-        case 3  :        /*** P-orbital ***/
-          for (GaussList::iterator it=sp->gaussians.begin(); it!=sp->gaussians.end(); ++it) {
-            radial_part = it->coeff * exp(-ra2*it->exponent);
+        case GaussianBasis::P :        /*** P-orbital ***/
+          for (p=basis.FirstPrimitive(u); p<p1; p++) {
+            if(ra2 > pr2[p]) continue;
+            ++evaluated;
+            radial_part = coeffs[p] * exp(-ra2*exps[p]);
             *cp     += xa * radial_part;
             *(cp+1) += ya * radial_part;
             *(cp+2) += za * radial_part;
           }
-          cp += 3;
           break;
 
-        case 5  :        /*** D-orbital (5) ***/
-          for (GaussList::iterator it=sp->gaussians.begin(); it!=sp->gaussians.end(); ++it) {
-            radial_part = it->coeff * exp(-ra2*it->exponent);
+        case GaussianBasis::D5 :        /*** D-orbital (5) ***/
+          for (p=basis.FirstPrimitive(u); p<p1; p++) {
+            if(ra2 > pr2[p]) continue;
+            ++evaluated;
+            radial_part = coeffs[p] * exp(-ra2*exps[p]);
             *cp    += 0.288675135 *
                    (2*za*za - xa*xa - ya*ya) * radial_part;
             *(cp+3) += 0.5 * (xa*xa - ya*ya) * radial_part;
@@ -730,12 +1680,13 @@ void calc_chi(Mol *mol, float x, float y, float z)
             *(cp+1) += xa * za * radial_part;
             *(cp+2) += ya * za * radial_part;
           }
-          cp += 5;
           break;
 
-        case 6  :        /*** D-orbital (6) ***/
-          for (GaussList::iterator it=sp->gaussians.begin(); it!=sp->gaussians.end(); ++it) {
-            radial_part = it->coeff * exp(-ra2*it->exponent);
+        case GaussianBasis::D6 :        /*** D-orbital (6) ***/
+          for (p=basis.FirstPrimitive(u); p<p1; p++) {
+            if(ra2 > pr2[p]) continue;
+            ++evaluated;
+            radial_part = coeffs[p] * exp(-ra2*exps[p]);
             *cp     += radial_part * xa * xa * 0.57735027;
             *(cp+1) += radial_part * ya * ya * 0.57735027;
             *(cp+2) += radial_part * za * za * 0.57735027;
@@ -743,12 +1694,13 @@ void calc_chi(Mol *mol, float x, float y, float z)
             *(cp+4) += radial_part * xa * za;
             *(cp+5) += radial_part * ya * za;
           }
-          cp += 6;
           break;
 
-        case 7  :        /*** F-orbital (7) ***/
-          for (GaussList::iterator it=sp->gaussians.begin(); it!=sp->gaussians.end(); ++it) {
-            radial_part = exp(-ra2*it->exponent) * it->coeff;
+        case GaussianBasis::F7 :        /*** F-orbital (7) ***/
+          for (p=basis.FirstPrimitive(u); p<p1; p++) {
+            if(ra2 > pr2[p]) continue;
+            ++evaluated;
+            radial_part = exp(-ra2*exps[p]) * coeffs[p];
             *cp     += radial_part * za * (5. * za * za - 3. * ra2)/* * k */;
             *(cp+1) += radial_part * xa * (5. * za * za - ra2)/* * k */;
             *(cp+2) += radial_part * ya * (5. * za * za - ra2)/* * k */;
@@ -757,13 +1709,14 @@ void calc_chi(Mol *mol, float x, float y, float z)
             *(cp+5) += radial_part * (xa * xa * xa - 3. * xa * ya * ya)/* * k */;
             *(cp+6) += radial_part * (3. * xa * xa * ya - ya * ya * ya)/* * k */;
           }
-          cp += 7;
           break;
 
-        case 10 :        /*** F-orbital (10) ***/
+        case GaussianBasis::F10 :        /*** F-orbital (10) ***/
                /* correct order ??? */
-          for (GaussList::iterator it=sp->gaussians.begin(); it!=sp->gaussians.end(); ++it) {
-            radial_part = it->coeff * exp(-ra2*it->exponent);
+          for (p=basis.FirstPrimitive(u); p<p1; p++) {
+            if(ra2 > pr2[p]) continue;
+            ++evaluated;
+            radial_part = coeffs[p] * exp(-ra2*exps[p]);
             *cp     += radial_part * xa * xa * xa * .25819889;
             *(cp+1) += radial_part * ya * ya * ya * .25819889;
             *(cp+2) += radial_part * za * za * za * .25819889;
@@ -775,111 +1728,172 @@ void calc_chi(Mol *mol, float x, float y, float z)
             *(cp+8) += radial_part * ya * za * za * .57735027;
             *(cp+9) += radial_part * xa * ya * za;
           }
-          cp += 10;
           break;
 
       } /* end of switch */
-    } /* end of loop over the shells (for(sp...) */
-  } /* end of loop over the atoms (for(ap...)*/
+    } /* end of loop over the shells (for(s...) */
+  } /* end of loop over the shell types (for(t...)*/
 
+  scratch->chiEvaluations += 1.;
+  scratch->evaluatedPrimitives += evaluated;
   return;
 }
 
 
+/* returns the squared distance (atomic units) beyond which the absolute value of
+ * k * c * r^l * exp(-a * r^2) is smaller than tol; -1 if it is always smaller */
+static double cutoff_radius2(double k, double c, double a, int l, double tol)
+{
+  double r, rprev, c_tol;
+  int it;
+
+  c = fabs(k * c);
+  if(c == 0.) return -1.;
+  c_tol = log(c / tol);
+
+  if(l == 0) return c_tol > 0. ? c_tol / a : -1.;
+
+  /* maximum of r^l * exp(-a * r^2) is at r = sqrt(l / 2a) */
+  r = sqrt(l / (2. * a));
+  if(c_tol + l * log(r) < a * r * r) return -1.;
+  /* fixed point iteration from the maximum: r^2 = (log(c/tol) + l*log(r)) / a,
+     converges monotonically to the outer solution */
+  for(it=0; it<100; it++) {
+    rprev = r;
+    r = sqrt((c_tol + l * log(r)) / a);
+    if(fabs(r - rprev) < 1.0E-6 * r) break;
+  }
+  r *= 1.01; /* safety margin */
+  return r * r;
+}
 
 
-int generate_density_matrix(Mol *mol, int key)
+void ProcessCalcContext::Setup(Mol *mol)
+/* retrieves the compiled basis, copies the atom centres in atomic units
+ * and computes the squared cutoff radii of unique shells and primitives */
 {
-  register short i, j, k;
-  float adder;
-
-  if(!mol->alphaDensity && datasource == USE_MATRICES) return 0;
+  const double no_cutoff = std::numeric_limits< double >::max();
+  double shell_r2, r2, k;
+  int s, p, l;
 
-  if(density){
-    free(density[0]);
-    free(density);
-    density = NULL;
-  }
+  basis = &mol->gaussian_basis();
 
-  if((density = (float **)alloc_trimat(mol->nBasisFunctions, sizeof(float))) == NULL){
-    fprintf(stderr, "can't allocate density-matrix\n");
-    return 0;
+  centres.clear();
+  for (MolekelAtomList::const_iterator ap=mol->Atoms.begin(); ap!=mol->Atoms.end(); ++ap) {
+    centres.push_back(ap->coord[0] * _1_BOHR);
+    centres.push_back(ap->coord[1] * _1_BOHR);
+    centres.push_back(ap->coord[2] * _1_BOHR);
   }
 
-/* use the alpha (and beta) density matrices from the gaussian output file */
-  if(datasource == USE_MATRICES){
-    if(key == EL_DENS){
-      if(mol->betaDensity){
-        for(i=0; i<mol->nBasisFunctions; i++){
-          for(j=0; j<=i; j++)
-            density[i][j] = mol->alphaDensity[i][j] + mol->betaDensity[i][j];
-        }
-      }
-      else {
-        for(i=0; i<mol->nBasisFunctions; i++){
-          for(j=0; j<=i; j++) density[i][j] = mol->alphaDensity[i][j];
-        }
-      }
-    }
-    if(key == SPIN_DENS){
-      if(!mol->betaDensity) return 0;
-      for(i=0; i<mol->nBasisFunctions; i++){
-        for(j=0; j<=i; j++)
-          density[i][j]  = mol->alphaDensity[i][j] - mol->betaDensity[i][j];
+  shellCutoff2.clear();
+  primitiveCutoff2.resize(basis->NumUniquePrimitives());
+  primitives_ = basis->NumPrimitiveInstances();
+
+  for (s=0; s<basis->NumUniqueShells(); s++) {
+    const GaussianBasis::ShellType t = basis->Type(s);
+    /* angular momentum and upper bound of the angular factor
+       over the unit sphere */
+    l = GaussianBasis::AngularMomentum(t);
+    k = t == GaussianBasis::F7 ? 2. : 1.;
+    shell_r2 = -1.;
+    for (p=basis->FirstPrimitive(s); p<basis->FirstPrimitive(s)+basis->NumPrimitives(s); p++) {
+      if(screeningTolerance_ <= 0.) r2 = no_cutoff;
+      else if(t == GaussianBasis::SP) {
+        r2 = std::max(cutoff_radius2(1., basis->Coefficients()[p], basis->Exponents()[p], 0, screeningTolerance_),
+                      cutoff_radius2(1., basis->PCoefficients()[p], basis->Exponents()[p], 1, screeningTolerance_));
       }
+      else r2 = cutoff_radius2(k, basis->Coefficients()[p], basis->Exponents()[p], l, screeningTolerance_);
+      primitiveCutoff2[p] = r2;
+      shell_r2 = std::max(shell_r2, r2);
     }
+    shellCutoff2.push_back(shell_r2);
   }
+  /* avoid taking the address of the first element of empty vectors */
+  centres.push_back(0.);
+  shellCutoff2.push_back(no_cutoff);
+  primitiveCutoff2.push_back(no_cutoff);
+}
 
-/* generate the density matrices with the coefficients */
-  else if(datasource == USE_COEFFS) {
-    if(key == EL_DENS){
-      for(i=0; i<mol->nBasisFunctions; i++){
-        for(j=0; j<=i; j++){
-          density[i][j] = 0;
-          for(k=0; k<mol->nBeta; k++){
-            adder = mol->alphaOrbital[k].coefficient[i] *
-                  mol->alphaOrbital[k].coefficient[j];
-            if(mol->alphaBeta)
-              adder += mol->betaOrbital[k].coefficient[i] *
-                    mol->betaOrbital[k].coefficient[j];
-            else adder *= 2.0;
-            density[i][j] += adder;
-          }
-          for(; k<mol->nAlpha; k++)
-            density[i][j] += mol->alphaOrbital[k].coefficient[i] *
-                        mol->alphaOrbital[k].coefficient[j];
-        }
+
+
+
+/* the density can be computed either from the density matrix, with
+ * nbf * (nbf + 1) / 2 products per point, or from the occupied orbitals,
+ * with nocc * nbf products per point: returns true if the orbital form is
+ * cheaper; density matrices read from file can only be used directly */
+static bool use_orbital_density(const Mol *mol, int key)
+{
+  int nocc;
+
+  if(datasource != USE_COEFFS) return false;
+  if(key == EL_DENS && !mol->alphaBeta) nocc = mol->nAlpha;
+  else nocc = mol->nAlpha + mol->nBeta;
+  return 2.0 * nocc < mol->nBasisFunctions + 1.0;
+}
+
+
+/* copy the coefficients of the occupied orbitals into the context, together
+ * with their weight in the electron or spin density; same orbitals and
+ * occupations as generate_density_matrix. The spin density of closed shell
+ * calculations is the density of the singly occupied orbitals */
+static int generate_occupied_orbitals(ProcessCalcContext *ctx, Mol *mol, int key)
+{
+  const int nbf = mol->nBasisFunctions;
+  int k;
+
+  ctx->FreeDensityMatrix();
+  try {
+    if(key == SPIN_DENS && !mol->alphaBeta){
+      for(k=mol->nBeta; k<mol->nAlpha; k++){
+        const MolecularOrbital *orb = mol->alphaOrbital + k - mol->firstOrbital + 1;
+        ctx->occupied.insert(ctx->occupied.end(), orb->coefficient, orb->coefficient + nbf);
+        ctx->occupiedWeights.push_back(1.0);
       }
+      return 1;
     }
-    if(key == SPIN_DENS){
-      if(!mol->alphaBeta) {
-        for(i=0; i<mol->nBasisFunctions; i++){
-          for(j=0; j<=i; j++){
-            density[i][j] = 0;
-            for(k=mol->nBeta; k<mol->nAlpha; k++)
-              density[i][j] += mol->alphaOrbital[k].coefficient[i] *
-                          mol->alphaOrbital[k].coefficient[j];
-          }
-        }
-      }
-      else {
-        for(i=0; i<mol->nBasisFunctions; i++){
-          for(j=0; j<=i; j++){
-            density[i][j] = 0;
-            for(k=0; k<mol->nAlpha; k++)
-              density[i][j] += mol->alphaOrbital[k].coefficient[i] *
-                          mol->alphaOrbital[k].coefficient[j];
-            for(k=0; k<mol->nBeta; k++)
-              density[i][j] -= mol->betaOrbital[k].coefficient[i] *
-                          mol->betaOrbital[k].coefficient[j];
-          }
-        }
+    for(k=0; k<mol->nAlpha; k++){
+      const double w = (key == EL_DENS && !mol->alphaBeta && k < mol->nBeta) ? 2.0 : 1.0;
+      ctx->occupied.insert(ctx->occupied.end(), mol->alphaOrbital[k].coefficient,
+                           mol->alphaOrbital[k].coefficient + nbf);
+      ctx->occupiedWeights.push_back(w);
+    }
+    if(mol->alphaBeta){
+      for(k=0; k<mol->nBeta; k++){
+        ctx->occupied.insert(ctx->occupied.end(), mol->betaOrbital[k].coefficient,
+                             mol->betaOrbital[k].coefficient + nbf);
+        ctx->occupiedWeights.push_back(key == SPIN_DENS ? -1.0 : 1.0);
       }
     }
   }
+  catch( const std::bad_alloc& ) {
+    fprintf(stderr, "can't allocate occupied orbitals\n");
+    ctx->FreeDensityMatrix();
+    return 0;
+  }
+  return 1;
+}
+
+
+int generate_density_matrix(ProcessCalcContext *ctx, Mol *mol, int key)
+/* the density matrices are built only once per molecule and cached by the
+ * molecule itself (see Molecule::density_matrix): the context only keeps a
+ * reference to the matrix */
+{
+  DensityMatrices::Source source;
+  DensityMatrices::Type type;
+
+  ctx->FreeDensityMatrix();
+
+  if(datasource == USE_MATRICES) source = DensityMatrices::FROM_FILE;
+  else if(datasource == USE_COEFFS) source = DensityMatrices::FROM_COEFFICIENTS;
   else return 0;
 
-  return 1;
+  if(key == EL_DENS) type = DensityMatrices::TOTAL_MATRIX;
+  else if(key == SPIN_DENS) type = DensityMatrices::SPIN_MATRIX;
+  else return 0;
+
+  ctx->density = mol->density_matrix(type, source);
+  return ctx->density != NULL;
 }
 
 void mep_dot_surface(Mol *mol, Surface *surf)
@@ -964,6 +1978,16 @@ void mep_dot_surface_no_pick(Mol *mol)
   update_logs();
 }
 
+double calc_mep(const ProcessCalcContext *ctx, Mol * /*mol*/, ProcessCalcScratch * /*scratch*/, float x, float y, float z)
+/* same as calc_mep( Mol*, float, float, float ) computed with the tree code
+ * built by select_function; signature matches the one of the other functions
+ * called from vtk_process_calc
+ */
+{
+  const double p[3] = { x, y, z };
+  return ctx->mepTree.Evaluate(p);
+}
+
 double calc_mep(Mol *mol, float x, float y, float z)
 /* calculate the MEP at given point based on the point charges
  * of the atoms
@@ -1019,19 +2043,22 @@ void spin_on_atoms(Mol *mol)
 {
   register short i;
   char str[40];
+  ProcessCalcScratch scratch;
+  ProcessCalcContext ctx;
 
-  if(!generate_density_matrix(mol, SPIN_DENS)){
+  if(!generate_density_matrix(&ctx, mol, SPIN_DENS)){
     showinfobox("Can't generate the density matrix!");
     return;
   }
 
-  chi = (double *)calloc(mol->nBasisFunctions, sizeof(double));
-  if(!chi) { showinfobox("Can't allocate chi"); }
+  scratch.chi.resize(mol->nBasisFunctions);
+  scratch.atomDistances.resize(4 * mol->Atoms.size() + 1);
+  ctx.Setup(mol);
 
   printf("Spin-densities on the atoms :\n");
   i=0;
   for (MolekelAtomList::iterator ap=mol->Atoms.begin(); ap!=mol->Atoms.end(); ++ap, i++) {
-      ap->spin = calculate_density(mol, ap->coord[0], ap->coord[1], ap->coord[2]);
+      ap->spin = calculate_density(&ctx, mol, &scratch, ap->coord[0], ap->coord[1], ap->coord[2]);
       sprintf(str, "   %2s%-3d  %12.6f", element[ap->ord].symbol, i+1,
             ap->spin);
       printf("%s\n", str);
@@ -1039,20 +2066,18 @@ void spin_on_atoms(Mol *mol)
   mol->atm_spin = 1;
   // UV XXX REMOVED
   //update_interface_flags();
-
-  free(chi);
 }
 
 
-double calc_prddo_point(Mol *mol, float x, float y, float z)
-/* calculate the MO-value at given point */
+/* calculate the value of the MO with the given coefficients at given point */
+static double calc_prddo_orbital_point(Mol *mol, const double *ao_coeff,
+                                       float x, float y, float z)
 {
 //  Slater *vp;
-  double value, *ao_coeff, angular_part;
+  double value, angular_part;
   float xa, ya, za, ra2, ra;  /* atomic units !! */
 
   value = 0;
-  ao_coeff = molOrb->coefficient;
 
   for (MolekelAtomList::iterator ap=mol->Atoms.begin(); ap!=mol->Atoms.end(); ++ap) {
     xa = (x - ap->coord[0]) * _1_BOHR;
@@ -1095,146 +2120,177 @@ double calc_prddo_point(Mol *mol, float x, float y, float z)
 }
 
 
+double calc_prddo_point(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch * /*scratch*/, float x, float y, float z)
+/* calculate the MO-value at given point */
+{
+  return calc_prddo_orbital_point(mol, ctx->orbital->coefficient, x, y, z);
+}
 
 
-double calc_prddo_density(Mol *mol, float x, float y, float z)
+/* evaluate all the PRDDO/ZINDO basis functions at given point; same
+ * ordering as the MO coefficients: one S, three P (z, x, y) and five D
+ * functions per Slater shell */
+static void calc_prddo_chi(Mol *mol, float x, float y, float z, double *chi)
 {
-  int i/*, norbs*/;
-  double value, contr;
+  float xa, ya, za, ra2, ra;  /* atomic units !! */
+  double e;
 
-  value = 0;
-  for(i=0; i<mol->nMolecularOrbitals; i++){
-    if(mol->alphaOrbital[i].occ > 0){
-      molOrb = mol->alphaOrbital + i;
-      contr = calc_prddo_point(mol, x, y, z);
-      value += mol->alphaOrbital[i].occ*contr*contr;
-    }
-    if(mol->betaOrbital && mol->betaOrbital[i].occ > 0){
-      molOrb = mol->betaOrbital + i;
-      contr = calc_prddo_point(mol, x, y, z);
-      value += mol->betaOrbital[i].occ*contr*contr;
+  for (MolekelAtomList::iterator ap=mol->Atoms.begin(); ap!=mol->Atoms.end(); ++ap) {
+    xa = (x - ap->coord[0]) * _1_BOHR;
+    ya = (y - ap->coord[1]) * _1_BOHR;
+    za = (z - ap->coord[2]) * _1_BOHR;
+
+    ra2 = xa*xa + ya*ya + za*za;
+    ra = sqrt(ra2);
+
+    for (SlaterList::iterator vp=ap->Slaters.begin(); vp!=ap->Slaters.end(); ++vp) {
+      e = exp(-vp->exponent * ra);
+      switch(vp->type[0]) {
+        case 'S' :
+          *chi++ = POW(ra, vp->n - 1) * e * vp->norm[0];
+          break;
+        case 'P' :
+          e *= POW(ra, vp->n - 2) * vp->norm[1];
+          *chi++ = za * e;
+          *chi++ = xa * e;
+          *chi++ = ya * e;
+          break;
+        case 'D' :
+          e *= POW(ra, vp->n - 3);
+          *chi++ = (3.*za*za - ra2) * vp->norm[3] * e;
+          *chi++ = xa*za * vp->norm[4] * e;
+          *chi++ = (xa*xa - ya*ya) * vp->norm[2] * e;
+          *chi++ = ya*za * vp->norm[4] * e;
+          *chi++ = xa*ya * vp->norm[4] * e;
+          break;
+      }
     }
-  }
+  } /* end of loop over the atoms (for(ap...)*/
+}
 
-  return value;
+
+double calc_prddo_density(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z)
+/* electron or spin density, depending on the orbital weights stored into the
+ * context by generate_weighted_orbitals: the basis functions are evaluated
+ * once per point for all the occupied orbitals */
+{
+  calc_prddo_chi(mol, x, y, z, &scratch->chi[0]);
+  return orbital_density(ctx, mol->nBasisFunctions, &scratch->chi[0]);
 }
 
 
+/* compile the Slater basis set into the context; the basis functions must
+ * match the orbital coefficients */
+static int setup_slater_basis(ProcessCalcContext *ctx, Mol *mol)
+{
+  ctx->slater.Build(*mol);
+  if(ctx->slater.NumBasisFunctions() != mol->nBasisFunctions) {
+    fprintf(stderr, "Slater basis functions do not match the orbital coefficients\n");
+    return 0;
+  }
+  return 1;
+}
 
 
-double calc_prddo_spindensity(Mol *mol, float x, float y, float z)
+/* copy the coefficients of the occupied orbitals into the context together
+ * with their weight, read from the orbital occupations: electron density
+ * is the sum of alpha and beta contributions, spin density their difference
+ * or, without beta orbitals, the density of the singly occupied orbitals */
+static int generate_weighted_orbitals(ProcessCalcContext *ctx, Mol *mol, int key)
 {
-  int i/*, norbs*/;
-  double value, contr;
+  const int nbf = mol->nBasisFunctions;
+  const MolecularOrbital *alpha = mol->alphaOrbital;
+  const MolecularOrbital *beta = mol->betaOrbital;
+  int i;
 
-  value = 0;
-  if(mol->betaOrbital) {
+  ctx->FreeDensityMatrix();
+  try {
     for(i=0; i<mol->nMolecularOrbitals; i++){
-      if(mol->alphaOrbital[i].occ > 0){
-        molOrb = mol->alphaOrbital + i;
-        contr = calc_prddo_point(mol, x, y, z);
-        value += mol->alphaOrbital[i].occ*contr*contr;
+      double wa = 0., wb = 0.;
+      if(key == EL_DENS) {
+        wa = alpha[i].occ;
+        if(beta) wb = beta[i].occ;
       }
-      if(mol->betaOrbital[i].occ > 0){
-        molOrb = mol->betaOrbital + i;
-        contr = calc_prddo_point(mol, x, y, z);
-        value -= mol->betaOrbital[i].occ*contr*contr;
+      else if(beta) {
+        wa = alpha[i].occ;
+        wb = -beta[i].occ;
       }
-    }
-  }
-  else if (mol->nAlpha != mol->nBeta) {
-    for(i=0; i<mol->nMolecularOrbitals; i++){
-      if(mol->alphaOrbital[i].occ == 1){
-        molOrb = mol->alphaOrbital + i;
-        contr = calc_prddo_point(mol, x, y, z);
-        value += contr*contr;
+      else if(mol->nAlpha != mol->nBeta && alpha[i].occ == 1) wa = 1.;
+      if(wa > 0.) {
+        ctx->occupied.insert(ctx->occupied.end(), alpha[i].coefficient, alpha[i].coefficient + nbf);
+        ctx->occupiedWeights.push_back(wa);
+      }
+      if(wb != 0. && beta[i].occ > 0) {
+        ctx->occupied.insert(ctx->occupied.end(), beta[i].coefficient, beta[i].coefficient + nbf);
+        ctx->occupiedWeights.push_back(wb);
       }
     }
   }
-
-  return value;
+  catch( const std::bad_alloc& ) {
+    fprintf(stderr, "can't allocate occupied orbitals\n");
+    ctx->FreeDensityMatrix();
+    return 0;
+  }
+  return 1;
 }
 
 
-double calc_sltr_point(Mol *mol, float x, float y, float z)
+/* evaluate all the Slater basis functions at given point */
+static void calc_sltr_chi(const ProcessCalcContext *ctx, ProcessCalcScratch *scratch,
+                          float x, float y, float z)
 {
-  float xa, ya, za, ra2, ra;
-  double value = 0, exponent = 0, *ao_coeff;
+  const double p[3] = { x * _1_BOHR, y * _1_BOHR, z * _1_BOHR };
+  ctx->slater.EvaluatePoint(p, &scratch->chi[0]);
+}
 
-  ao_coeff = molOrb->coefficient;
 
-  for (MolekelAtomList::iterator ap=mol->Atoms.begin(); ap!=mol->Atoms.end(); ++ap) {
-    xa = (x - ap->coord[0]) * _1_BOHR;
-    ya = (y - ap->coord[1]) * _1_BOHR;
-    za = (z - ap->coord[2]) * _1_BOHR;
-    ra2 = xa*xa + ya*ya + za*za;
-    ra = sqrt(ra2);
+/* evaluate all the Slater basis functions along a line of grid points, same
+ * layout as calc_chi_line */
+static void calc_sltr_chi_line(const ProcessCalcContext *ctx, ProcessCalcScratch *scratch,
+                               int n, double y, double z)
+{
+  ctx->slater.EvaluateLine(&scratch->xLine[0], n, y, z, &scratch->chiLine[0],
+                           &scratch->basisWork[0]);
+  find_active_functions(scratch, ctx->slater.NumBasisFunctions(), n);
+}
 
-    for (SlaterList::iterator vp=ap->Slaters.begin(); vp!=ap->Slaters.end(); ++vp) {
-      if(*ao_coeff) {
-        exponent = exp(-(vp->exponent*ra));
-        value += *ao_coeff * vp->norm[0] * POW(xa,vp->a) *
-          POW(ya,vp->b) * POW(za,vp->c) * POW(ra,vp->d) * exponent;
-      }
-      ao_coeff++;
-    }
 
-  }
+double calc_sltr_point(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z)
+{
+  const double *ao_coeff = ctx->orbital->coefficient;
+  const double *chi = &scratch->chi[0];
+  double value = 0.;
+  int i;
+
+  calc_sltr_chi(ctx, scratch, x, y, z);
+  for(i=0; i<mol->nBasisFunctions; i++) value += ao_coeff[i] * chi[i];
   return value;
 }
 
 
-double calc_sltr_density(Mol *mol, float x, float y, float z)
+double calc_sltr_density(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch, float x, float y, float z)
+/* electron or spin density, depending on the orbital weights stored into the
+ * context by generate_weighted_orbitals */
 {
-  int i/*, norbs*/;
-  double value, contr;
-
-  value = 0;
-  for(i=0; i<mol->nMolecularOrbitals; i++){
-    if(mol->alphaOrbital[i].occ > 0){
-      molOrb = mol->alphaOrbital + i;
-      contr = calc_sltr_point(mol, x, y, z);
-      value += mol->alphaOrbital[i].occ*contr*contr;
-    }
-    if(mol->betaOrbital && mol->betaOrbital[i].occ > 0){
-      molOrb = mol->betaOrbital + i;
-      contr = calc_sltr_point(mol, x, y, z);
-      value += mol->betaOrbital[i].occ*contr*contr;
-    }
-  }
-
-  return value;
+  calc_sltr_chi(ctx, scratch, x, y, z);
+  return orbital_density(ctx, mol->nBasisFunctions, &scratch->chi[0]);
 }
 
-double calc_sltr_spindensity(Mol *mol, float x, float y, float z)
+
+void calc_sltr_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch,
+                    int n, double y, double z, double *values)
+/* line version of calc_sltr_point */
 {
-  int i/*, norbs*/;
-  double value, contr;
+  calc_sltr_chi_line(ctx, scratch, n, y, z);
+  orbital_line(scratch, mol->nBasisFunctions, ctx->orbital->coefficient, n, values);
+}
 
-  value = 0;
-  if(mol->betaOrbital) {
-    for(i=0; i<mol->nMolecularOrbitals; i++){
-      if(mol->alphaOrbital[i].occ > 0){
-        molOrb = mol->alphaOrbital + i;
-        contr = calc_sltr_point(mol, x, y, z);
-        value += mol->alphaOrbital[i].occ*contr*contr;
-      }
-      if(mol->betaOrbital[i].occ > 0){
-        molOrb = mol->betaOrbital + i;
-        contr = calc_sltr_point(mol, x, y, z);
-        value -= mol->betaOrbital[i].occ*contr*contr;
-      }
-    }
-  }
-  else if (mol->nAlpha != mol->nBeta) {
-    for(i=0; i<mol->nMolecularOrbitals; i++){
-      if(mol->alphaOrbital[i].occ == 1){
-        molOrb = mol->alphaOrbital + i;
-        contr = calc_sltr_point(mol, x, y, z);
-        value += contr*contr;
-      }
-    }
-  }
 
-  return value;
+void calc_sltr_density_line(const ProcessCalcContext *ctx, Mol *mol, ProcessCalcScratch *scratch,
+                            int n, double y, double z, double *values)
+/* line version of calc_sltr_density: the Slater functions are evaluated once
+ * per line for all the occupied orbitals */
+{
+  calc_sltr_chi_line(ctx, scratch, n, y, z);
+  orbital_density_line(ctx, scratch, mol->nBasisFunctions, n, values);
 }
@@ -0,0 +1,363 @@
+#ifndef CALCDENS_H_
+#define CALCDENS_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// Interface to the grid computation functions implemented in calcdens.cpp.
+
+#include <vector>
+
+#include "meptree.h"
+#include "slaterbasis.h"
+
+struct Molecule;
+struct MolecularOrbital;
+class GaussianBasis;
+class vtkImageData;
+class GridScalars;
+
+//------------------------------------------------------------------------------
+/// Per-thread scratch data used by the functions computing values at grid points.
+struct ProcessCalcScratch
+{
+    ProcessCalcScratch() : chiEvaluations( 0. ), evaluatedPrimitives( 0. ) {}
+    /// Basis function values at current point.
+    std::vector< double > chi;
+    /// Per-atom distance vector and squared distance from current point.
+    std::vector< double > atomDistances;
+    /// Basis function values along a line of grid points, see EvaluateBasisLine.
+    std::vector< double > chiLine;
+    /// x coordinates in bohr of the points of a grid line.
+    std::vector< double > xLine;
+    /// Values computed along a grid line and temporary line buffer.
+    std::vector< double > lineValues;
+    std::vector< double > lineTemp;
+    /// Indices of the basis functions not screened out on the current line.
+    std::vector< int > activeFunctions;
+    /// Work area of SlaterBasis::EvaluateLine.
+    std::vector< double > basisWork;
+    /// Number of times basis function values were computed;
+    /// double: counters can exceed the 32 bit integer range on large grids.
+    double chiEvaluations;
+    /// Number of primitive gaussians actually evaluated, i.e. not screened out.
+    double evaluatedPrimitives;
+};
+
+//------------------------------------------------------------------------------
+/// State of a grid computation performed by vtk_process_calc.
+/// All the data which used to be stored into global variables (basis function
+/// scratch buffers, density matrix, orbital, stop flag, value range) is kept
+/// into an instance of this class: grid computations performed on separate
+/// contexts are independent from each other and can be run concurrently
+/// from different threads.
+/// A context can be used by one computation at a time only.
+class ProcessCalcContext
+{
+public:
+    /// Constructor.
+    ProcessCalcContext() : orbital( 0 ), density( 0 ), basis( 0 ), stop_( false ),
+                           stopFlag_( 0 ), minValue_( 0. ), maxValue_( 0. ), type_( -1 ),
+                           screeningTolerance_( 1.0E-10 ), mepOpeningAngle_( 0.3 ),
+                           doublePrecision_( false ), primitives_( 0 ),
+                           evaluatedPrimitives_( 0. ), skippedPrimitives_( 0. ) {}
+    /// Destructor: releases occupied orbitals.
+    ~ProcessCalcContext() { FreeDensityMatrix(); }
+    /// Sets the orbital computed when data type is CALC_ORB.
+    void SetOrbital( const MolecularOrbital* orb ) { orbital = orb; }
+    /// Called from a thread different from the one that started vtk_process_calc
+    /// to interrupt computation.
+    void Stop() { stop_ = true; }
+    /// Sets a flag owned by the caller and polled together with the stop
+    /// flag: computation is interrupted as soon as it is true. Null to
+    /// use the stop flag only.
+    void SetStopFlag( const volatile bool* flag ) { stopFlag_ = flag; }
+    /// Returns true if computation was stopped.
+    bool Stopped() const { return stop_ || ( stopFlag_ && *stopFlag_ ); }
+    /// Returns min, max value in dataset computed by last vtk_process_calc.
+    void GetMinMax( double& minVal, double& maxVal ) const
+    {
+        minVal = minValue_;
+        maxVal = maxValue_;
+    }
+    /// Returns type of data generated by last call to vtk_process_calc;
+    /// -1 if computation failed or was never performed.
+    int GetDataType() const { return type_; }
+    /// Releases the occupied orbitals and the reference to the density matrix.
+    void FreeDensityMatrix();
+    /// Sets the tolerance used to screen out gaussian primitives: a primitive
+    /// is not evaluated at points where its absolute value is guaranteed to be
+    /// smaller than the tolerance. Zero disables screening.
+    void SetScreeningTolerance( double t ) { screeningTolerance_ = t; }
+    /// Returns screening tolerance.
+    double GetScreeningTolerance() const { return screeningTolerance_; }
+    /// Sets the opening angle of the tree code used to compute the MEP: ratio
+    /// between the size of a group of atoms and its distance from the point
+    /// below which the group is replaced by its multipole expansion.
+    /// Zero computes the exact sum over all the atoms.
+    void SetMEPOpeningAngle( double a ) { mepOpeningAngle_ = a; }
+    /// Returns the MEP opening angle.
+    double GetMEPOpeningAngle() const { return mepOpeningAngle_; }
+    /// Selects the scalar type of the generated images: float (default) or
+    /// double. Values are always computed in double precision.
+    void SetDoublePrecision( bool on ) { doublePrecision_ = on; }
+    /// Returns true if the generated images have double scalars.
+    bool GetDoublePrecision() const { return doublePrecision_; }
+    /// Returns the number of primitive gaussian evaluations performed and skipped
+    /// by the screening during the last call to vtk_process_calc.
+    void GetScreeningStatistics( double& evaluated, double& skipped ) const
+    {
+        evaluated = evaluatedPrimitives_;
+        skipped = skippedPrimitives_;
+    }
+    /// Prepares the context for a computation on a molecule: retrieves the
+    /// compiled gaussian basis set, copies the atom centres and computes the
+    /// screening cutoff radii.
+    void Setup( Molecule* mol );
+
+    /// Orbital computed when data type is CALC_ORB.
+    const MolecularOrbital* orbital;
+    /// Density matrix: lower triangle of the nBasisFunctions x nBasisFunctions
+    /// matrix stored row by row (see DensityMatrices), owned and cached by
+    /// the molecule, see Molecule::density_matrix.
+    const double* density;
+    /// Coefficients of the occupied orbitals, one row of nBasisFunctions
+    /// values per orbital, and orbital weights (occupation, negative for
+    /// beta orbitals in spin densities): used instead of the density matrix
+    /// when there are few occupied orbitals.
+    std::vector< double > occupied;
+    std::vector< double > occupiedWeights;
+    /// Per-thread scratch data.
+    std::vector< ProcessCalcScratch > scratch;
+    /// Compiled gaussian basis set of the molecule.
+    const GaussianBasis* basis;
+    /// Atom centres in bohr.
+    std::vector< double > centres;
+    /// @{ Squared cutoff radii in bohr^2 of unique shells and primitives;
+    /// beyond these distances the contribution of a shell or primitive is
+    /// smaller than the screening tolerance.
+    std::vector< double > shellCutoff2;
+    std::vector< double > primitiveCutoff2;
+    /// @}
+    /// Tree of atom charges used to compute the MEP.
+    MEPTree mepTree;
+    /// Compiled Slater basis set, used with MLD_SLATER_ORB orbitals.
+    SlaterBasis slater;
+
+private:
+    friend vtkImageData* vtk_process_calc( ProcessCalcContext&, Molecule*,
+                                           float*, int*, int,
+                                           void ( * )( int, int, void* ),
+                                           void* );
+    friend bool vtk_process_calc_orbitals( ProcessCalcContext&, Molecule*,
+                                           const MolecularOrbital* const*, int,
+                                           float*, int*, vtkImageData**,
+                                           void ( * )( int, int, void* ),
+                                           void* );
+    friend bool vtk_process_calc_slabs( ProcessCalcContext&, Molecule*,
+                                        float*, int*, int, int, int, float*,
+                                        void ( * )( int, int, void* ),
+                                        void* );
+    friend bool process_calc_slabs( ProcessCalcContext&, Molecule*,
+                                    const float*, const int*, int, int, int,
+                                    GridScalars&,
+                                    void ( * )( int, int, void* ),
+                                    void* );
+    friend vtkImageData* vtk_process_calc_adaptive( ProcessCalcContext&, Molecule*,
+                                                    float*, int*, int,
+                                                    const double*, int, int,
+                                                    void ( * )( int, int, void* ),
+                                                    void* );
+    /// Stop flag; volatile: read by all the threads computing grid data.
+    volatile bool stop_;
+    /// Stop flag owned by the caller, see SetStopFlag.
+    const volatile bool* stopFlag_;
+    /// Min value computed by last vtk_process_calc.
+    double minValue_;
+    /// Max value computed by last vtk_process_calc.
+    double maxValue_;
+    /// Data type computed by last vtk_process_calc.
+    int type_;
+    /// Screening tolerance.
+    double screeningTolerance_;
+    /// MEP opening angle.
+    double mepOpeningAngle_;
+    /// If true images are generated with double instead of float scalars.
+    bool doublePrecision_;
+    /// Number of primitive gaussians in the basis set.
+    int primitives_;
+    /// Number of primitive evaluations performed by last vtk_process_calc.
+    double evaluatedPrimitives_;
+    /// Number of primitive evaluations skipped by last vtk_process_calc.
+    double skippedPrimitives_;
+    /// Copy forbidden.
+    ProcessCalcContext( const ProcessCalcContext& );
+    /// Assignment forbidden.
+    ProcessCalcContext& operator=( const ProcessCalcContext& );
+};
+
+/// Computes a grid of values of type key ( CALC_ORB, EL_DENS, SPIN_DENS, MEP )
+/// storing all the intermediate data and the results into the passed context.
+/// @param ctx computation context
+/// @param mol molecule
+/// @param dim grid bounds: x min, x max, y min, y max, z min, z max
+/// @param ncubes number of grid points along x, y and z
+/// @param key data type
+/// @param progressCBack pointer to function that will be called to notify
+///        observer of completed step; steps go from 0 to ncubes[ 0 ] * ncubes[ 1 ] * ncubes[ 2 ];
+///        the function is always invoked from the thread that called vtk_process_calc.
+/// @param cbackData data provided by calling function that will be returned
+///        in a call to progressCBack function.
+/// @return new vtkImageData instance or NULL in case of error or if computation
+///         is not supported for the orbital type.
+vtkImageData* vtk_process_calc( ProcessCalcContext& ctx,
+                                Molecule* mol,
+                                float* dim,
+                                int* ncubes,
+                                int key,
+                                void ( *progressCBack )( int completedStep,
+                                                         int totalSteps,
+                                                         void* cbackData ) = 0,
+                                void* cbackData = 0 );
+
+/// Same as above, computation performed on a global context;
+/// orbital is read from the global molOrb variable.
+vtkImageData* vtk_process_calc( Molecule* mol,
+                                float* dim,
+                                int* ncubes,
+                                int key,
+                                void ( *progressCBack )( int completedStep,
+                                                         int totalSteps,
+                                                         void* cbackData ) = 0,
+                                void* cbackData = 0 );
+
+/// Computes a range of z slabs of the grid that vtk_process_calc would compute
+/// with the same parameters, and stores them as float values into a caller
+/// provided buffer; used to generate grids too large to fit in memory one
+/// tile at a time.
+/// Min/max values are reset when firstSlab is zero and accumulated over the
+/// following calls; the stop flag is reset when firstSlab is zero as well,
+/// a stopped computation makes all the following calls fail.
+/// @param ctx computation context
+/// @param mol molecule
+/// @param dim grid bounds: x min, x max, y min, y max, z min, z max
+/// @param ncubes number of grid points along x, y and z
+/// @param key data type
+/// @param firstSlab index of first z slab
+/// @param numSlabs number of z slabs
+/// @param values output: numSlabs * ncubes[ 0 ] * ncubes[ 1 ] values, x varying fastest
+/// @param progressCBack progress callback; steps go from 0 to
+///        numSlabs * ncubes[ 0 ] * ncubes[ 1 ]
+/// @param cbackData data passed to progressCBack
+/// @return true on success, false in case of error or if computation was stopped.
+bool vtk_process_calc_slabs( ProcessCalcContext& ctx,
+                             Molecule* mol,
+                             float* dim,
+                             int* ncubes,
+                             int key,
+                             int firstSlab,
+                             int numSlabs,
+                             float* values,
+                             void ( *progressCBack )( int completedStep,
+                                                      int totalSteps,
+                                                      void* cbackData ) = 0,
+                             void* cbackData = 0 );
+
+/// Computes the grids of several molecular orbitals in a single pass over the
+/// grid: with gaussian basis sets the basis functions are evaluated only once
+/// per grid point for all the orbitals.
+/// @param ctx computation context; min/max values are computed over all the orbitals
+/// @param mol molecule
+/// @param orbitals orbitals to compute
+/// @param nOrbitals number of orbitals
+/// @param dim grid bounds: x min, x max, y min, y max, z min, z max
+/// @param ncubes number of grid points along x, y and z
+/// @param images output: one new vtkImageData per orbital, all NULL in case of error
+/// @param progressCBack progress callback, same as vtk_process_calc
+/// @param cbackData data passed to progressCBack
+/// @return true on success, false in case of error or if computation was stopped.
+bool vtk_process_calc_orbitals( ProcessCalcContext& ctx,
+                                Molecule* mol,
+                                const MolecularOrbital* const* orbitals,
+                                int nOrbitals,
+                                float* dim,
+                                int* ncubes,
+                                vtkImageData** images,
+                                void ( *progressCBack )( int completedStep,
+                                                         int totalSteps,
+                                                         void* cbackData ) = 0,
+                                void* cbackData = 0 );
+
+/// Same as vtk_process_calc, values are computed exactly only in a narrow band
+/// around the isosurfaces: the grid is first computed with a coarse step, then
+/// the cells that may contain one of the isovalues are recursively split in
+/// eight down to single voxels (octree refinement); the remaining voxels are
+/// filled by trilinear interpolation of the coarse values, which preserves
+/// the side of the isovalue they lie on.
+/// Use the returned grid for isosurface extraction only.
+/// @param ctx computation context; min/max values are computed over the
+///        computed points only
+/// @param mol molecule
+/// @param dim grid bounds: x min, x max, y min, y max, z min, z max
+/// @param ncubes number of grid points along x, y and z
+/// @param key data type
+/// @param isoValues isovalues of the surfaces that will be extracted
+/// @param nIsoValues number of isovalues
+/// @param coarseStep initial step in number of grid steps, rounded down to a
+///        power of two; values lower than 2 compute the full grid
+/// @param progressCBack progress callback, same as vtk_process_calc
+/// @param cbackData data passed to progressCBack
+/// @return new vtkImageData instance or NULL in case of error.
+vtkImageData* vtk_process_calc_adaptive( ProcessCalcContext& ctx,
+                                         Molecule* mol,
+                                         float* dim,
+                                         int* ncubes,
+                                         int key,
+                                         const double* isoValues,
+                                         int nIsoValues,
+                                         int coarseStep = 8,
+                                         void ( *progressCBack )( int completedStep,
+                                                                  int totalSteps,
+                                                                  void* cbackData ) = 0,
+                                         void* cbackData = 0 );
+
+/// Stops computation performed on the global context.
+void StopProcessCalc();
+
+/// Returns true if computation performed on the global context was stopped.
+bool ProcessCalcStopped();
+
+/// Returns min, max value in dataset computed on the global context.
+void GetProcessCalcMinMax( double& minVal, double& maxVal );
+
+/// Returns type of data generated by last computation on the global context.
+int GetProcessCalcDataType();
+
+/// Returns the number of threads used to compute grid data: equal to the number
+/// of available processors if OpenMP is enabled, 1 otherwise.
+int GetProcessCalcNumThreads();
+
+/// Computes the molecular electrostatic potential at a given point.
+double calc_mep( const Molecule* mol, const double xyz[ 3 ] );
+
+#endif /*CALCDENS_H_*/
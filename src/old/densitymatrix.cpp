@@ -0,0 +1,152 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+#include <algorithm>
+
+#include "molekeltypes.h"
+#include "densitymatrix.h"
+
+//------------------------------------------------------------------------------
+const double* DensityMatrices::Matrix( Type t, Source s )
+{
+    std::vector< double >& m = matrices_[ s ][ t ];
+    if( !m.empty() ) return &m[ 0 ];
+
+    const int n = mol_.nBasisFunctions;
+    if( n <= 0 ) return 0;
+    if( s == FROM_FILE )
+    {
+        if( !mol_.alphaDensity ) return 0;
+        if( t == SPIN_MATRIX && !mol_.betaDensity ) return 0;
+        m.assign( Size( n ), 0. );
+        switch( t )
+        {
+        case ALPHA_MATRIX: AddTriangularMatrix( mol_.alphaDensity, 1., m ); break;
+        case BETA_MATRIX:  if( mol_.betaDensity ) AddTriangularMatrix( mol_.betaDensity, 1., m ); break;
+        case TOTAL_MATRIX:
+            AddTriangularMatrix( mol_.alphaDensity, 1., m );
+            if( mol_.betaDensity ) AddTriangularMatrix( mol_.betaDensity, 1., m );
+            break;
+        case SPIN_MATRIX:
+            AddTriangularMatrix( mol_.alphaDensity, 1., m );
+            AddTriangularMatrix( mol_.betaDensity, -1., m );
+            break;
+        default: break;
+        }
+        return &m[ 0 ];
+    }
+
+    if( !mol_.alphaOrbital ) return 0;
+    if( mol_.alphaBeta && !mol_.betaOrbital ) return 0;
+    // closed shell molecules: beta electrons occupy the first alpha orbitals
+    const MolecularOrbital* beta = mol_.alphaBeta ? mol_.betaOrbital : mol_.alphaOrbital;
+    switch( t )
+    {
+    case ALPHA_MATRIX:
+        m.assign( Size( n ), 0. );
+        AddOrbitalProducts( mol_.alphaOrbital, mol_.nAlpha, 1., m );
+        break;
+    case BETA_MATRIX:
+        m.assign( Size( n ), 0. );
+        AddOrbitalProducts( beta, mol_.nBeta, 1., m );
+        break;
+    case TOTAL_MATRIX:
+    case SPIN_MATRIX:
+        {
+            const double* a = Matrix( ALPHA_MATRIX, s );
+            const double* b = Matrix( BETA_MATRIX, s );
+            const double w = t == TOTAL_MATRIX ? 1. : -1.;
+            m.resize( Size( n ) );
+            for( size_t i = 0; i != m.size(); ++i ) m[ i ] = a[ i ] + w * b[ i ];
+        }
+        break;
+    default: return 0;
+    }
+    return &m[ 0 ];
+}
+
+//------------------------------------------------------------------------------
+void DensityMatrices::Clear()
+{
+    for( int s = 0; s != NUM_SOURCES; ++s )
+    {
+        for( int t = 0; t != NUM_TYPES; ++t ) std::vector< double >().swap( matrices_[ s ][ t ] );
+    }
+}
+
+//------------------------------------------------------------------------------
+void DensityMatrices::AddOrbitalProducts( const MolecularOrbital* orbitals,
+                                          int nOrbitals, double w,
+                                          std::vector< double >& m ) const
+{
+    const int n = mol_.nBasisFunctions;
+    if( nOrbitals <= 0 ) return;
+    // occupied coefficients packed into a nOrbitals x n matrix
+    std::vector< double > c( size_t( nOrbitals ) * n );
+    for( int k = 0; k != nOrbitals; ++k )
+    {
+        const double* ck = orbitals[ k ].coefficient;
+        std::copy( ck, ck + n, c.begin() + size_t( k ) * n );
+    }
+    // lower triangle of m += w * C^T C, computed by blocks of rows and orbitals:
+    // a block of orbitals fits into the cache while all the rows of a block
+    // of m are updated
+    const int ROWS = 32;
+    const int ORBITALS = 64;
+    const int nBlocks = ( n + ROWS - 1 ) / ROWS;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic, 1 )
+#endif
+    for( int b = 0; b < nBlocks; ++b )
+    {
+        const int i0 = b * ROWS;
+        const int i1 = i0 + ROWS < n ? i0 + ROWS : n;
+        for( int k0 = 0; k0 < nOrbitals; k0 += ORBITALS )
+        {
+            const int k1 = k0 + ORBITALS < nOrbitals ? k0 + ORBITALS : nOrbitals;
+            for( int i = i0; i < i1; ++i )
+            {
+                double* mi = &m[ RowOffset( i ) ];
+                for( int k = k0; k < k1; ++k )
+                {
+                    const double* ck = &c[ size_t( k ) * n ];
+                    const double a = w * ck[ i ];
+                    if( a == 0. ) continue;
+                    for( int j = 0; j <= i; ++j ) mi[ j ] += a * ck[ j ];
+                }
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void DensityMatrices::AddTriangularMatrix( float** t, double w, std::vector< double >& m ) const
+{
+    const int n = mol_.nBasisFunctions;
+    for( int i = 0; i < n; ++i )
+    {
+        double* mi = &m[ RowOffset( i ) ];
+        for( int j = 0; j <= i; ++j ) mi[ j ] += w * t[ i ][ j ];
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef DENSITYMATRIX_H_
+#define DENSITYMATRIX_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+#include <vector>
+
+struct Molecule;
+struct MolecularOrbital;
+
+//------------------------------------------------------------------------------
+/// Density matrices of a molecule in double precision, built on first request
+/// and kept until the orbital coefficients change.
+/// Matrices are symmetric: only the lower triangle is stored, row by row,
+/// element ( i, j ), j <= i, at index RowOffset( i ) + j. The products of orbital coefficients are computed as
+/// blocked matrix products distributed among threads (if OpenMP is enabled).
+class DensityMatrices
+{
+public:
+    /// Matrix types.
+    enum Type { ALPHA_MATRIX = 0, BETA_MATRIX, TOTAL_MATRIX, SPIN_MATRIX, NUM_TYPES };
+    /// Source of the matrix elements.
+    enum Source
+    {
+        /// Computed from the coefficients of the occupied orbitals.
+        FROM_COEFFICIENTS = 0,
+        /// Copied from the density matrices read from file.
+        FROM_FILE,
+        NUM_SOURCES
+    };
+
+    /// Constructor; no matrix is built until requested.
+    DensityMatrices( const Molecule& mol ) : mol_( mol ) {}
+
+    /// Returns a density matrix, building it on first request; returns NULL
+    /// if the matrix cannot be computed from the requested source.
+    /// Throws std::bad_alloc.
+    const double* Matrix( Type t, Source s );
+
+    /// Releases all the matrices: must be called when the orbital coefficients
+    /// or density matrices of the molecule change.
+    void Clear();
+
+    /// Returns the index of the first element of row i in a matrix.
+    static size_t RowOffset( int i ) { return size_t( i ) * ( i + 1 ) / 2; }
+
+    /// Returns the number of elements stored for a matrix of order n.
+    static size_t Size( int n ) { return RowOffset( n ); }
+
+private:
+    /// Computes sum_k w * C_k C_k^T over orbitals [ 0, n ) into m.
+    void AddOrbitalProducts( const MolecularOrbital* orbitals,
+                             int n, double w, std::vector< double >& m ) const;
+    /// Adds w times the lower triangular matrix read from file to m.
+    void AddTriangularMatrix( float** t, double w, std::vector< double >& m ) const;
+    /// Molecule.
+    const Molecule& mol_;
+    /// Matrices indexed by source and type; empty if not built.
+    std::vector< double > matrices_[ NUM_SOURCES ][ NUM_TYPES ];
+};
+
+#endif /*DENSITYMATRIX_H_*/
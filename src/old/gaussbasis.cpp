@@ -0,0 +1,148 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+#include <map>
+
+#include "molekeltypes.h"
+#include "gaussbasis.h"
+
+namespace
+{
+    /// Shell instance collected in the first pass of the GaussianBasis
+    /// constructor.
+    struct ShellInstance
+    {
+        const Shell* shell;
+        int atom;
+        int firstFunction;
+    };
+}
+
+//------------------------------------------------------------------------------
+int GaussianBasis::NumFunctions( ShellType t )
+{
+    static const int n[ NUM_SHELL_TYPES ] = { 1, 4, 3, 5, 6, 7, 10 };
+    return n[ t ];
+}
+
+//------------------------------------------------------------------------------
+int GaussianBasis::AngularMomentum( ShellType t )
+{
+    static const int l[ NUM_SHELL_TYPES ] = { 0, 1, 1, 2, 2, 3, 3 };
+    return l[ t ];
+}
+
+//------------------------------------------------------------------------------
+GaussianBasis::ShellType GaussianBasis::TypeFromNumFunctions( int n )
+{
+    switch( n )
+    {
+    case 1:  return S;
+    case 4:  return SP;
+    case 3:  return P;
+    case 5:  return D5;
+    case 6:  return D6;
+    case 7:  return F7;
+    case 10: return F10;
+    default: break;
+    }
+    return NUM_SHELL_TYPES;
+}
+
+//------------------------------------------------------------------------------
+GaussianBasis::GaussianBasis( const Molecule& mol ) :
+    numAtoms_( int( mol.Atoms.size() ) ),
+    numBasisFunctions_( 0 ),
+    numPrimitiveInstances_( 0 )
+{
+    std::vector< ShellInstance > instances[ NUM_SHELL_TYPES ];
+
+    // first pass: compute basis function offsets and group shells by type
+    int atom = 0;
+    for( MolekelAtomList::const_iterator ap = mol.Atoms.begin();
+         ap != mol.Atoms.end(); ++ap, ++atom )
+    {
+        for( ShellList::const_iterator sp = ap->Shells.begin();
+             sp != ap->Shells.end(); ++sp )
+        {
+            const ShellType t = TypeFromNumFunctions( sp->n_base );
+            if( t != NUM_SHELL_TYPES )
+            {
+                ShellInstance si;
+                si.shell = &( *sp );
+                si.atom = atom;
+                si.firstFunction = numBasisFunctions_;
+                instances[ t ].push_back( si );
+            }
+            numBasisFunctions_ += sp->n_base;
+        }
+    }
+
+    // second pass: store unique shells; a shell is identified by its type
+    // followed by exponents and coefficients of all its primitives
+    typedef std::map< std::vector< double >, int > ShellMap;
+    ShellMap uniqueShells;
+    firstPrimitive_.push_back( 0 );
+    for( int t = 0; t != NUM_SHELL_TYPES; ++t )
+    {
+        ShellGroup& g = groups_[ t ];
+        g.atom.reserve( instances[ t ].size() );
+        g.shell.reserve( instances[ t ].size() );
+        g.firstFunction.reserve( instances[ t ].size() );
+        for( std::vector< ShellInstance >::const_iterator i = instances[ t ].begin();
+             i != instances[ t ].end(); ++i )
+        {
+            const GaussList& gl = i->shell->gaussians;
+            std::vector< double > key;
+            key.reserve( 1 + 3 * gl.size() );
+            key.push_back( t );
+            for( GaussList::const_iterator gp = gl.begin(); gp != gl.end(); ++gp )
+            {
+                key.push_back( gp->exponent );
+                key.push_back( gp->coeff );
+                key.push_back( t == SP ? gp->coeff2 : 0. );
+            }
+            ShellMap::const_iterator u = uniqueShells.find( key );
+            int shell = 0;
+            if( u != uniqueShells.end() ) shell = u->second;
+            else
+            {
+                shell = int( shellType_.size() );
+                uniqueShells[ key ] = shell;
+                shellType_.push_back( t );
+                for( GaussList::const_iterator gp = gl.begin(); gp != gl.end(); ++gp )
+                {
+                    exponent_.push_back( gp->exponent );
+                    coeff_.push_back( gp->coeff );
+                    coeff2_.push_back( t == SP ? gp->coeff2 : 0. );
+                }
+                firstPrimitive_.push_back( int( exponent_.size() ) );
+            }
+            g.atom.push_back( i->atom );
+            g.shell.push_back( shell );
+            g.firstFunction.push_back( i->firstFunction );
+            numPrimitiveInstances_ += int( gl.size() );
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef GAUSSBASIS_H_
+#define GAUSSBASIS_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+#include <vector>
+
+struct Molecule;
+
+//------------------------------------------------------------------------------
+/// Gaussian basis set compiled into flat arrays.
+/// The basis set read from file is stored as a list of shells per atom, each
+/// shell holding its own list of primitives; this class stores the same
+/// information in contiguous arrays:
+/// - contracted shells which are identical on different atoms (same type,
+///   exponents and coefficients) are stored only once (unique shells);
+/// - shell instances (i.e. a unique shell centered on a specific atom) are
+///   grouped by shell type, to allow for one evaluation loop per type.
+/// Basis function indices (FirstFunction) follow the order of the original
+/// basis set, i.e. the order of MO coefficients and density matrix elements.
+class GaussianBasis
+{
+public:
+    /// Shell types, ordered by number of basis functions.
+    enum ShellType { S = 0, SP, P, D5, D6, F7, F10, NUM_SHELL_TYPES };
+
+    /// Shell instances of one type.
+    struct ShellGroup
+    {
+        /// Index of the atom the shell is centered on.
+        std::vector< int > atom;
+        /// Index of the unique shell.
+        std::vector< int > shell;
+        /// Index of first basis function of the shell.
+        std::vector< int > firstFunction;
+        /// Returns number of shells.
+        int Size() const { return int( atom.size() ); }
+    };
+
+    /// Constructor: compiles the basis set of a molecule.
+    GaussianBasis( const Molecule& mol );
+
+    /// Returns number of basis functions in a shell of a specific type.
+    static int NumFunctions( ShellType t );
+    /// Returns angular momentum of a specific shell type; 1 for SP shells.
+    static int AngularMomentum( ShellType t );
+    /// Returns shell type from the number of basis functions in a shell;
+    /// NUM_SHELL_TYPES if not a valid number.
+    static ShellType TypeFromNumFunctions( int n );
+
+    /// Returns the shell instances of a specific type.
+    const ShellGroup& Group( ShellType t ) const { return groups_[ t ]; }
+    /// Returns number of unique shells.
+    int NumUniqueShells() const { return int( shellType_.size() ); }
+    /// Returns the type of a unique shell.
+    ShellType Type( int shell ) const { return ShellType( shellType_[ shell ] ); }
+    /// Returns the index of the first primitive of a unique shell.
+    int FirstPrimitive( int shell ) const { return firstPrimitive_[ shell ]; }
+    /// Returns the number of primitives of a unique shell.
+    int NumPrimitives( int shell ) const { return firstPrimitive_[ shell + 1 ] - firstPrimitive_[ shell ]; }
+    /// Returns number of unique primitives.
+    int NumUniquePrimitives() const { return int( exponent_.size() ); }
+    /// Returns pointer to primitive exponents.
+    const double* Exponents() const { return exponent_.empty() ? 0 : &exponent_[ 0 ]; }
+    /// Returns pointer to primitive contraction coefficients.
+    const double* Coefficients() const { return coeff_.empty() ? 0 : &coeff_[ 0 ]; }
+    /// Returns pointer to the P coefficients of SP shells' primitives,
+    /// equal to zero for other shell types.
+    const double* PCoefficients() const { return coeff2_.empty() ? 0 : &coeff2_[ 0 ]; }
+    /// Returns number of atoms.
+    int NumAtoms() const { return numAtoms_; }
+    /// Returns number of basis functions.
+    int NumBasisFunctions() const { return numBasisFunctions_; }
+    /// Returns total number of primitives in all the shell instances.
+    int NumPrimitiveInstances() const { return numPrimitiveInstances_; }
+
+private:
+    /// Shell instances grouped by type.
+    ShellGroup groups_[ NUM_SHELL_TYPES ];
+    /// Type of unique shells.
+    std::vector< int > shellType_;
+    /// Index of first primitive of each unique shell, last element is
+    /// equal to the total number of unique primitives.
+    std::vector< int > firstPrimitive_;
+    /// Primitive exponents.
+    std::vector< double > exponent_;
+    /// Primitive coefficients.
+    std::vector< double > coeff_;
+    /// Primitive P coefficients (SP shells only).
+    std::vector< double > coeff2_;
+    /// Number of atoms.
+    int numAtoms_;
+    /// Number of basis functions.
+    int numBasisFunctions_;
+    /// Number of primitives in all the shell instances.
+    int numPrimitiveInstances_;
+};
+
+#endif /*GAUSSBASIS_H_*/
@@ -0,0 +1,217 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// Scalar shell kernels, run time instruction set selection and line evaluation.
+
+#include <cstring>
+
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <intrin.h>
+#define MOLEKEL_X86_CPUID
+#elif defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#include <cpuid.h>
+#define MOLEKEL_X86_CPUID
+#endif
+
+#include "gausskernels_impl.h"
+
+#ifdef MOLEKEL_SIMD_AVX2
+extern void GetAVX2ShellKernels( ShellLineKernel* kernels, ExpLineKernel& expKernel );
+#endif
+#ifdef MOLEKEL_SIMD_AVX512
+extern void GetAVX512ShellKernels( ShellLineKernel* kernels, ExpLineKernel& expKernel );
+#endif
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/// One double: reference implementation, uses the standard library exp.
+struct VecScalar
+{
+    static const int WIDTH = 1;
+    double v;
+    VecScalar() {}
+    VecScalar( double x ) : v( x ) {}
+    static VecScalar Set1( double x ) { return x; }
+    static VecScalar Load( const double* p ) { return *p; }
+    void Store( double* p ) const { *p = v; }
+    friend VecScalar operator+( const VecScalar& a, const VecScalar& b ) { return a.v + b.v; }
+    friend VecScalar operator-( const VecScalar& a, const VecScalar& b ) { return a.v - b.v; }
+    friend VecScalar operator*( const VecScalar& a, const VecScalar& b ) { return a.v * b.v; }
+    friend VecScalar Exp( const VecScalar& x ) { return std::exp( x.v ); }
+};
+
+#ifdef MOLEKEL_X86_CPUID
+//------------------------------------------------------------------------------
+/// Executes cpuid instruction.
+void CpuId( int leaf, int subLeaf, unsigned int r[ 4 ] )
+{
+#ifdef _MSC_VER
+    int regs[ 4 ];
+    __cpuidex( regs, leaf, subLeaf );
+    for( int i = 0; i != 4; ++i ) r[ i ] = regs[ i ];
+#else
+    __cpuid_count( leaf, subLeaf, r[ 0 ], r[ 1 ], r[ 2 ], r[ 3 ] );
+#endif
+}
+
+//------------------------------------------------------------------------------
+/// Returns the extended control register 0: tells which register
+/// states are saved by the operating system.
+unsigned long long XCR0()
+{
+#ifdef _MSC_VER
+    return _xgetbv( 0 );
+#else
+    unsigned int eax = 0, edx = 0;
+    __asm__ __volatile__( "xgetbv" : "=a"( eax ), "=d"( edx ) : "c"( 0 ) );
+    return ( ( unsigned long long )( edx ) << 32 ) | eax;
+#endif
+}
+#endif
+
+//------------------------------------------------------------------------------
+/// Checks which instruction sets are supported by both CPU and operating system.
+GaussKernelSet DetectGaussKernelSet()
+{
+    GaussKernelSet s = GAUSS_KERNELS_SCALAR;
+#ifdef MOLEKEL_X86_CPUID
+    unsigned int r[ 4 ];
+    CpuId( 0, 0, r );
+    if( r[ 0 ] < 7 ) return s;
+    CpuId( 1, 0, r );
+    const bool osxsave = ( r[ 2 ] & ( 1u << 27 ) ) != 0;
+    const bool fma = ( r[ 2 ] & ( 1u << 12 ) ) != 0;
+    if( !osxsave ) return s;
+    const unsigned long long xcr0 = XCR0();
+    const bool ymmState = ( xcr0 & 0x6 ) == 0x6;
+    const bool zmmState = ( xcr0 & 0xe6 ) == 0xe6;
+    CpuId( 7, 0, r );
+    const bool avx2 = ( r[ 1 ] & ( 1u << 5 ) ) != 0;
+    const bool avx512f = ( r[ 1 ] & ( 1u << 16 ) ) != 0;
+#ifdef MOLEKEL_SIMD_AVX2
+    if( avx2 && fma && ymmState ) s = GAUSS_KERNELS_AVX2;
+#endif
+#ifdef MOLEKEL_SIMD_AVX512
+    if( avx512f && zmmState ) s = GAUSS_KERNELS_AVX512;
+#endif
+    // avoid warnings about unused variables when SIMD kernels are not built
+    ( void ) avx2; ( void ) avx512f; ( void ) fma; ( void ) ymmState; ( void ) zmmState;
+#endif
+    return s;
+}
+
+/// Widest instruction set available.
+const GaussKernelSet availableSet = DetectGaussKernelSet();
+/// Selected instruction set.
+GaussKernelSet activeSet = GAUSS_KERNELS_SCALAR;
+/// Kernels of the selected instruction set.
+ShellLineKernel activeKernels[ GaussianBasis::NUM_SHELL_TYPES ];
+/// Exponential kernel of the selected instruction set.
+ExpLineKernel activeExpKernel = 0;
+/// Initializes kernels with the widest instruction set.
+const GaussKernelSet initialSet = SelectGaussKernelSet( GAUSS_KERNELS_AVX512 );
+
+} // namespace
+
+//------------------------------------------------------------------------------
+GaussKernelSet GetAvailableGaussKernelSet() { return availableSet; }
+
+//------------------------------------------------------------------------------
+GaussKernelSet GetGaussKernelSet() { return activeSet; }
+
+//------------------------------------------------------------------------------
+GaussKernelSet SelectGaussKernelSet( GaussKernelSet requested )
+{
+    activeSet = requested < availableSet ? requested : availableSet;
+    switch( activeSet )
+    {
+#ifdef MOLEKEL_SIMD_AVX512
+    case GAUSS_KERNELS_AVX512: GetAVX512ShellKernels( activeKernels, activeExpKernel ); break;
+#endif
+#ifdef MOLEKEL_SIMD_AVX2
+    case GAUSS_KERNELS_AVX2: GetAVX2ShellKernels( activeKernels, activeExpKernel ); break;
+#endif
+    default:
+        activeSet = GAUSS_KERNELS_SCALAR;
+        FillShellKernels< VecScalar >( activeKernels, activeExpKernel );
+        break;
+    }
+    return activeSet;
+}
+
+//------------------------------------------------------------------------------
+void ExpLine( double* values, int n )
+{
+    activeExpKernel( values, n );
+}
+
+//------------------------------------------------------------------------------
+double EvaluateBasisLine( const GaussianBasis& basis,
+                          const double* centres,
+                          const double* shellCutoff2,
+                          const double* primitiveCutoff2,
+                          const double* x,
+                          int n,
+                          double y,
+                          double z,
+                          double* chi )
+{
+    const int stride = GaussKernelStride( n );
+    std::memset( chi, 0, sizeof( double ) * stride * basis.NumBasisFunctions() );
+    ShellLineArgs a;
+    a.exps = basis.Exponents();
+    a.coeffs = basis.Coefficients();
+    a.coeffs2 = basis.PCoefficients();
+    a.cutoff2 = primitiveCutoff2;
+    a.x = x;
+    a.x0 = x[ 0 ];
+    a.dx = n > 1 ? x[ 1 ] - x[ 0 ] : 0.;
+    a.stride = stride;
+    double evaluated = 0.;
+    for( int t = 0; t != GaussianBasis::NUM_SHELL_TYPES; ++t )
+    {
+        const GaussianBasis::ShellGroup& g = basis.Group( GaussianBasis::ShellType( t ) );
+        const ShellLineKernel kernel = activeKernels[ t ];
+        for( int s = 0; s != g.Size(); ++s )
+        {
+            const double* c = centres + 3 * g.atom[ s ];
+            const int u = g.shell[ s ];
+            a.ya = y - c[ 1 ];
+            a.za = z - c[ 2 ];
+            a.yz2 = a.ya * a.ya + a.za * a.za;
+            // the whole line is out of reach
+            if( a.yz2 > shellCutoff2[ u ] ) continue;
+            a.cx = c[ 0 ];
+            a.k0 = 0;
+            a.k1 = n;
+            a.p0 = basis.FirstPrimitive( u );
+            a.p1 = a.p0 + basis.NumPrimitives( u );
+            a.chi = chi + g.firstFunction[ s ] * stride;
+            evaluated += kernel( a );
+        }
+    }
+    return evaluated;
+}
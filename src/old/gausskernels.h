@@ -0,0 +1,128 @@
+#ifndef GAUSSKERNELS_H_
+#define GAUSSKERNELS_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// Gaussian basis function evaluation over lines of grid points.
+// Each shell type has its own kernel, compiled once for each supported
+// instruction set (scalar, AVX2, AVX-512); the widest instruction set
+// supported by the CPU is selected at run time.
+
+class GaussianBasis;
+
+/// Instruction sets used by the basis function kernels.
+enum GaussKernelSet
+{
+    GAUSS_KERNELS_SCALAR = 0,
+    GAUSS_KERNELS_AVX2,
+    GAUSS_KERNELS_AVX512
+};
+
+/// Arguments passed to shell kernels: one shell evaluated over a line
+/// of points parallel to the x axis.
+struct ShellLineArgs
+{
+    /// Primitive exponents, coefficients and SP coefficients.
+    const double* exps;
+    const double* coeffs;
+    const double* coeffs2;
+    /// Primitive squared cutoff radii.
+    const double* cutoff2;
+    /// Range of the shell's primitives.
+    int p0, p1;
+    /// x coordinates of the points in bohr, padded to a multiple of the
+    /// widest vector size.
+    const double* x;
+    /// x of first point and x step in bohr.
+    double x0, dx;
+    /// Shell centre x coordinate in bohr.
+    double cx;
+    /// y and z distance from shell centre in bohr and squared distance
+    /// between line and shell centre.
+    double ya, za, yz2;
+    /// Range of points to evaluate.
+    int k0, k1;
+    /// Number of points in the padded line.
+    int stride;
+    /// Output: values of the shell's first basis function, the values of
+    /// basis function i are stored at chi + i * stride.
+    double* chi;
+};
+
+/// Shell kernel: accumulates the shell's basis function values into
+/// args.chi; returns the number of primitive evaluations.
+typedef double ( *ShellLineKernel )( const ShellLineArgs& args );
+
+/// Exponential kernel: replaces values[ 0 ... n - 1 ] with their exponential;
+/// values must be non positive and n a multiple of GaussKernelPadding().
+typedef void ( *ExpLineKernel )( double* values, int n );
+
+/// Returns the widest instruction set supported by both the CPU and the build.
+GaussKernelSet GetAvailableGaussKernelSet();
+
+/// Selects the instruction set used by the kernels; if the requested set is
+/// not available the widest available one is used. Returns selected set.
+/// @note not thread safe: call when no computation is running.
+GaussKernelSet SelectGaussKernelSet( GaussKernelSet requested );
+
+/// Returns the currently selected instruction set.
+GaussKernelSet GetGaussKernelSet();
+
+/// Returns the required alignment (in number of doubles) of line lengths.
+inline int GaussKernelPadding() { return 8; }
+
+/// Rounds a number of points up to the kernel padding.
+inline int GaussKernelStride( int n )
+{
+    return ( n + GaussKernelPadding() - 1 ) / GaussKernelPadding() * GaussKernelPadding();
+}
+
+/// Computes the exponential of non positive values in place with the selected
+/// instruction set; n must be a multiple of GaussKernelPadding().
+void ExpLine( double* values, int n );
+
+/// Evaluates all the basis functions over a line of points parallel to the x
+/// axis: x = x0 + k * dx, k in [0, n); all coordinates in bohr.
+/// @param basis compiled basis set
+/// @param centres atom centres in bohr
+/// @param shellCutoff2 squared cutoff radii of unique shells
+/// @param primitiveCutoff2 squared cutoff radii of unique primitives
+/// @param x point x coordinates, GaussKernelStride( n ) elements
+/// @param n number of points
+/// @param y line y coordinate
+/// @param z line z coordinate
+/// @param chi output: basis function values, GaussKernelStride( n ) values
+///        per basis function
+/// @return number of primitive evaluations
+double EvaluateBasisLine( const GaussianBasis& basis,
+                          const double* centres,
+                          const double* shellCutoff2,
+                          const double* primitiveCutoff2,
+                          const double* x,
+                          int n,
+                          double y,
+                          double z,
+                          double* chi );
+
+#endif /*GAUSSKERNELS_H_*/
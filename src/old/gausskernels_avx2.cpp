@@ -0,0 +1,85 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// AVX2 shell kernels; this file must be compiled with AVX2 and FMA code
+// generation enabled (see CMakeLists.txt) and is empty otherwise.
+
+#ifdef MOLEKEL_SIMD_AVX2
+
+#include <immintrin.h>
+
+#include "gausskernels_impl.h"
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/// Four doubles.
+struct VecAVX2
+{
+    static const int WIDTH = 4;
+    __m256d v;
+    VecAVX2() {}
+    VecAVX2( __m256d x ) : v( x ) {}
+    static VecAVX2 Set1( double x ) { return _mm256_set1_pd( x ); }
+    static VecAVX2 Load( const double* p ) { return _mm256_loadu_pd( p ); }
+    void Store( double* p ) const { _mm256_storeu_pd( p, v ); }
+    friend VecAVX2 operator+( const VecAVX2& a, const VecAVX2& b ) { return _mm256_add_pd( a.v, b.v ); }
+    friend VecAVX2 operator-( const VecAVX2& a, const VecAVX2& b ) { return _mm256_sub_pd( a.v, b.v ); }
+    friend VecAVX2 operator*( const VecAVX2& a, const VecAVX2& b ) { return _mm256_mul_pd( a.v, b.v ); }
+    friend VecAVX2 Exp( const VecAVX2& x );
+};
+
+//------------------------------------------------------------------------------
+VecAVX2 Exp( const VecAVX2& a )
+{
+    const __m256d x = _mm256_max_pd( a.v, _mm256_set1_pd( EXP_MIN ) );
+    const __m256d n = _mm256_round_pd( _mm256_mul_pd( x, _mm256_set1_pd( EXP_LOG2E ) ),
+                                       _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+    __m256d r = _mm256_fnmadd_pd( n, _mm256_set1_pd( EXP_C1 ), x );
+    r = _mm256_fnmadd_pd( n, _mm256_set1_pd( EXP_C2 ), r );
+    const __m256d rr = _mm256_mul_pd( r, r );
+    __m256d p = _mm256_fmadd_pd( _mm256_set1_pd( EXP_P0 ), rr, _mm256_set1_pd( EXP_P1 ) );
+    p = _mm256_fmadd_pd( p, rr, _mm256_set1_pd( EXP_P2 ) );
+    p = _mm256_mul_pd( p, r );
+    __m256d q = _mm256_fmadd_pd( _mm256_set1_pd( EXP_Q0 ), rr, _mm256_set1_pd( EXP_Q1 ) );
+    q = _mm256_fmadd_pd( q, rr, _mm256_set1_pd( EXP_Q2 ) );
+    q = _mm256_fmadd_pd( q, rr, _mm256_set1_pd( EXP_Q3 ) );
+    __m256d e = _mm256_div_pd( p, _mm256_sub_pd( q, p ) );
+    e = _mm256_fmadd_pd( e, _mm256_set1_pd( 2. ), _mm256_set1_pd( 1. ) );
+    // 2^n built from the exponent bits
+    __m256i ni = _mm256_cvtepi32_epi64( _mm256_cvtpd_epi32( n ) );
+    ni = _mm256_slli_epi64( _mm256_add_epi64( ni, _mm256_set1_epi64x( 1023 ) ), 52 );
+    return _mm256_mul_pd( e, _mm256_castsi256_pd( ni ) );
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+void GetAVX2ShellKernels( ShellLineKernel* kernels, ExpLineKernel& expKernel )
+{
+    FillShellKernels< VecAVX2 >( kernels, expKernel );
+}
+
+#endif // MOLEKEL_SIMD_AVX2
@@ -0,0 +1,85 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// AVX-512 shell kernels; this file must be compiled with AVX-512F code
+// generation enabled (see CMakeLists.txt) and is empty otherwise.
+
+#ifdef MOLEKEL_SIMD_AVX512
+
+#include <immintrin.h>
+
+#include "gausskernels_impl.h"
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/// Eight doubles.
+struct VecAVX512
+{
+    static const int WIDTH = 8;
+    __m512d v;
+    VecAVX512() {}
+    VecAVX512( __m512d x ) : v( x ) {}
+    static VecAVX512 Set1( double x ) { return _mm512_set1_pd( x ); }
+    static VecAVX512 Load( const double* p ) { return _mm512_loadu_pd( p ); }
+    void Store( double* p ) const { _mm512_storeu_pd( p, v ); }
+    friend VecAVX512 operator+( const VecAVX512& a, const VecAVX512& b ) { return _mm512_add_pd( a.v, b.v ); }
+    friend VecAVX512 operator-( const VecAVX512& a, const VecAVX512& b ) { return _mm512_sub_pd( a.v, b.v ); }
+    friend VecAVX512 operator*( const VecAVX512& a, const VecAVX512& b ) { return _mm512_mul_pd( a.v, b.v ); }
+    friend VecAVX512 Exp( const VecAVX512& x );
+};
+
+//------------------------------------------------------------------------------
+VecAVX512 Exp( const VecAVX512& a )
+{
+    const __m512d x = _mm512_max_pd( a.v, _mm512_set1_pd( EXP_MIN ) );
+    const __m512d n = _mm512_roundscale_pd( _mm512_mul_pd( x, _mm512_set1_pd( EXP_LOG2E ) ),
+                                            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+    __m512d r = _mm512_fnmadd_pd( n, _mm512_set1_pd( EXP_C1 ), x );
+    r = _mm512_fnmadd_pd( n, _mm512_set1_pd( EXP_C2 ), r );
+    const __m512d rr = _mm512_mul_pd( r, r );
+    __m512d p = _mm512_fmadd_pd( _mm512_set1_pd( EXP_P0 ), rr, _mm512_set1_pd( EXP_P1 ) );
+    p = _mm512_fmadd_pd( p, rr, _mm512_set1_pd( EXP_P2 ) );
+    p = _mm512_mul_pd( p, r );
+    __m512d q = _mm512_fmadd_pd( _mm512_set1_pd( EXP_Q0 ), rr, _mm512_set1_pd( EXP_Q1 ) );
+    q = _mm512_fmadd_pd( q, rr, _mm512_set1_pd( EXP_Q2 ) );
+    q = _mm512_fmadd_pd( q, rr, _mm512_set1_pd( EXP_Q3 ) );
+    __m512d e = _mm512_div_pd( p, _mm512_sub_pd( q, p ) );
+    e = _mm512_fmadd_pd( e, _mm512_set1_pd( 2. ), _mm512_set1_pd( 1. ) );
+    // 2^n built from the exponent bits
+    __m512i ni = _mm512_cvtepi32_epi64( _mm512_cvtpd_epi32( n ) );
+    ni = _mm512_slli_epi64( _mm512_add_epi64( ni, _mm512_set1_epi64( 1023 ) ), 52 );
+    return _mm512_mul_pd( e, _mm512_castsi512_pd( ni ) );
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+void GetAVX512ShellKernels( ShellLineKernel* kernels, ExpLineKernel& expKernel )
+{
+    FillShellKernels< VecAVX512 >( kernels, expKernel );
+}
+
+#endif // MOLEKEL_SIMD_AVX512
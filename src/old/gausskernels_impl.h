@@ -0,0 +1,230 @@
+#ifndef GAUSSKERNELS_IMPL_H_
+#define GAUSSKERNELS_IMPL_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// Shell kernels templated on the vector type; included by each of the source
+// files compiled for a specific instruction set.
+// A vector type V must provide:
+// - static const int WIDTH
+// - static V Set1( double ), static V Load( const double* ), void Store( double* ) const
+// - operators +, -, *
+// - friend V Exp( const V& ) computing exp of non positive values.
+// ExpLineV, used by the Slater basis, requires a WIDTH dividing GaussKernelPadding().
+// @warning everything is declared inside an anonymous namespace: functions
+// compiled with different instruction sets must never be merged by the linker.
+
+#include <cmath>
+
+#include "gaussbasis.h"
+#include "gausskernels.h"
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/// Computes the range of points reached by a primitive; returns false if
+/// the range is empty.
+inline bool PrimitiveRange( const ShellLineArgs& a, int p, int& k0, int& k1 )
+{
+    const double r2 = a.cutoff2[ p ];
+    if( a.yz2 > r2 ) return false;
+    k0 = a.k0;
+    k1 = a.k1;
+    if( a.dx > 0. )
+    {
+        const double h = std::sqrt( r2 - a.yz2 );
+        const double lo = ( a.cx - h - a.x0 ) / a.dx;
+        const double hi = ( a.cx + h - a.x0 ) / a.dx;
+        if( lo > k1 || hi < k0 ) return false;
+        if( lo > k0 ) k0 = int( std::ceil( lo ) );
+        if( hi < k1 - 1 ) k1 = int( std::floor( hi ) ) + 1;
+    }
+    return k0 < k1;
+}
+
+//------------------------------------------------------------------------------
+/// Adds v to row[ k ... k + V::WIDTH - 1 ].
+template < class V > inline void Accumulate( double* row, int k, const V& v )
+{
+    ( V::Load( row + k ) + v ).Store( row + k );
+}
+
+//------------------------------------------------------------------------------
+/// Evaluates the basis functions of one shell of type T over a line of points;
+/// same formulas and basis function ordering as calc_chi.
+template < class V, int T > double ShellLine( const ShellLineArgs& a )
+{
+    double evaluated = 0.;
+    const int s = a.stride;
+    double* const c = a.chi;
+    const V cx = V::Set1( a.cx );
+    const V ya = V::Set1( a.ya );
+    const V za = V::Set1( a.za );
+    const V yz2 = V::Set1( a.yz2 );
+    for( int p = a.p0; p != a.p1; ++p )
+    {
+        int k0 = 0, k1 = 0;
+        if( !PrimitiveRange( a, p, k0, k1 ) ) continue;
+        evaluated += k1 - k0;
+        // round to multiples of the vector width: values computed at the
+        // additional points are valid (or fall into the padding area)
+        k0 = k0 / V::WIDTH * V::WIDTH;
+        k1 = ( k1 + V::WIDTH - 1 ) / V::WIDTH * V::WIDTH;
+        const V ma = V::Set1( -a.exps[ p ] );
+        const V cf = V::Set1( a.coeffs[ p ] );
+        const V cf2 = V::Set1( a.coeffs2[ p ] );
+        for( int k = k0; k < k1; k += V::WIDTH )
+        {
+            const V xa = V::Load( a.x + k ) - cx;
+            const V ra2 = xa * xa + yz2;
+            const V e = Exp( ma * ra2 );
+            switch( T )
+            {
+            case GaussianBasis::S:
+                Accumulate( c, k, cf * e );
+                break;
+            case GaussianBasis::SP:
+                {
+                    const V r = cf2 * e;
+                    Accumulate( c, k, cf * e );
+                    Accumulate( c + s, k, xa * r );
+                    Accumulate( c + 2 * s, k, ya * r );
+                    Accumulate( c + 3 * s, k, za * r );
+                }
+                break;
+            case GaussianBasis::P:
+                {
+                    const V r = cf * e;
+                    Accumulate( c, k, xa * r );
+                    Accumulate( c + s, k, ya * r );
+                    Accumulate( c + 2 * s, k, za * r );
+                }
+                break;
+            case GaussianBasis::D5:
+                {
+                    const V r = cf * e;
+                    const V xx = xa * xa;
+                    const V yy = ya * ya;
+                    const V zz = za * za;
+                    Accumulate( c, k, V::Set1( 0.288675135 ) * ( zz + zz - xx - yy ) * r );
+                    Accumulate( c + 3 * s, k, V::Set1( 0.5 ) * ( xx - yy ) * r );
+                    Accumulate( c + 4 * s, k, xa * ya * r );
+                    Accumulate( c + s, k, xa * za * r );
+                    Accumulate( c + 2 * s, k, ya * za * r );
+                }
+                break;
+            case GaussianBasis::D6:
+                {
+                    const V r = cf * e;
+                    const V rn = r * V::Set1( 0.57735027 );
+                    Accumulate( c, k, rn * xa * xa );
+                    Accumulate( c + s, k, rn * ya * ya );
+                    Accumulate( c + 2 * s, k, rn * za * za );
+                    Accumulate( c + 3 * s, k, r * xa * ya );
+                    Accumulate( c + 4 * s, k, r * xa * za );
+                    Accumulate( c + 5 * s, k, r * ya * za );
+                }
+                break;
+            case GaussianBasis::F7:
+                {
+                    const V r = e * cf;
+                    const V xx = xa * xa;
+                    const V yy = ya * ya;
+                    const V zz5 = V::Set1( 5. ) * za * za;
+                    const V three = V::Set1( 3. );
+                    Accumulate( c, k, r * za * ( zz5 - three * ra2 ) );
+                    Accumulate( c + s, k, r * xa * ( zz5 - ra2 ) );
+                    Accumulate( c + 2 * s, k, r * ya * ( zz5 - ra2 ) );
+                    Accumulate( c + 3 * s, k, r * za * ( xx - yy ) );
+                    Accumulate( c + 4 * s, k, r * xa * ya * za );
+                    Accumulate( c + 5 * s, k, r * ( xx * xa - three * xa * yy ) );
+                    Accumulate( c + 6 * s, k, r * ( three * xx * ya - yy * ya ) );
+                }
+                break;
+            case GaussianBasis::F10:
+                {
+                    const V r = cf * e;
+                    const V r1 = r * V::Set1( .25819889 );
+                    const V r2 = r * V::Set1( .57735027 );
+                    Accumulate( c, k, r1 * xa * xa * xa );
+                    Accumulate( c + s, k, r1 * ya * ya * ya );
+                    Accumulate( c + 2 * s, k, r1 * za * za * za );
+                    Accumulate( c + 3 * s, k, r2 * xa * xa * ya );
+                    Accumulate( c + 4 * s, k, r2 * xa * xa * za );
+                    Accumulate( c + 5 * s, k, r2 * xa * ya * ya );
+                    Accumulate( c + 6 * s, k, r2 * ya * ya * za );
+                    Accumulate( c + 7 * s, k, r2 * xa * za * za );
+                    Accumulate( c + 8 * s, k, r2 * ya * za * za );
+                    Accumulate( c + 9 * s, k, r * xa * ya * za );
+                }
+                break;
+            default: break;
+            }
+        }
+    }
+    return evaluated;
+}
+
+//------------------------------------------------------------------------------
+/// Exponential of a line of non positive values.
+template < class V > void ExpLineV( double* values, int n )
+{
+    for( int k = 0; k < n; k += V::WIDTH ) Exp( V::Load( values + k ) ).Store( values + k );
+}
+
+//------------------------------------------------------------------------------
+/// Fills kernel table with one kernel per shell type and selects the
+/// matching exponential kernel.
+template < class V > void FillShellKernels( ShellLineKernel* kernels, ExpLineKernel& expKernel )
+{
+    expKernel = ExpLineV< V >;
+    kernels[ GaussianBasis::S ]   = ShellLine< V, GaussianBasis::S >;
+    kernels[ GaussianBasis::SP ]  = ShellLine< V, GaussianBasis::SP >;
+    kernels[ GaussianBasis::P ]   = ShellLine< V, GaussianBasis::P >;
+    kernels[ GaussianBasis::D5 ]  = ShellLine< V, GaussianBasis::D5 >;
+    kernels[ GaussianBasis::D6 ]  = ShellLine< V, GaussianBasis::D6 >;
+    kernels[ GaussianBasis::F7 ]  = ShellLine< V, GaussianBasis::F7 >;
+    kernels[ GaussianBasis::F10 ] = ShellLine< V, GaussianBasis::F10 >;
+}
+
+//------------------------------------------------------------------------------
+/// @{ Constants used by the vector exp implementations (Cephes library):
+/// exp(x) = 2^n * exp(r), r = x - n * ln(2), exp(r) = 1 + 2r P(r^2) / (Q(r^2) - r P(r^2))
+const double EXP_MIN = -708.;
+const double EXP_LOG2E = 1.4426950408889634073599;
+const double EXP_C1 = 6.93145751953125E-1;
+const double EXP_C2 = 1.42860682030941723212E-6;
+const double EXP_P0 = 1.26177193074810590878E-4;
+const double EXP_P1 = 3.02994407707441961300E-2;
+const double EXP_P2 = 9.99999999999999999910E-1;
+const double EXP_Q0 = 3.00198505138664455042E-6;
+const double EXP_Q1 = 2.52448340349684104192E-3;
+const double EXP_Q2 = 2.27265548208155028766E-1;
+const double EXP_Q3 = 2.00000000000000000009E0;
+/// @}
+
+} // namespace
+
+#endif /*GAUSSKERNELS_IMPL_H_*/
@@ -0,0 +1,221 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+#include <cmath>
+#include <algorithm>
+
+#include "constant.h"
+#include "molekeltypes.h"
+#include "meptree.h"
+
+namespace
+{
+    /// Maximum number of atoms in a leaf node.
+    const int LEAF_SIZE = 8;
+
+    /// Compares atoms by coordinate along one axis.
+    struct AtomCoordinateLess
+    {
+        const std::vector< double >& c;
+        AtomCoordinateLess( const std::vector< double >& coord ) : c( coord ) {}
+        bool operator()( int a, int b ) const { return c[ a ] < c[ b ]; }
+    };
+}
+
+//------------------------------------------------------------------------------
+void MEPTree::Build( const Molecule& mol, double openingAngle )
+{
+    openingAngle_ = openingAngle;
+    nodes_.clear();
+    x_.clear();
+    y_.clear();
+    z_.clear();
+    charges_.clear();
+    for( MolekelAtomList::const_iterator ap = mol.Atoms.begin(); ap != mol.Atoms.end(); ++ap )
+    {
+        x_.push_back( ap->coord[ 0 ] * _1_BOHR );
+        y_.push_back( ap->coord[ 1 ] * _1_BOHR );
+        z_.push_back( ap->coord[ 2 ] * _1_BOHR );
+        charges_.push_back( ap->charge );
+    }
+    if( charges_.empty() ) return;
+    nodes_.reserve( 2 * ( charges_.size() / LEAF_SIZE + 1 ) );
+    BuildNode( 0, int( charges_.size() ) );
+}
+
+//------------------------------------------------------------------------------
+int MEPTree::BuildNode( int first, int count )
+{
+    const int id = int( nodes_.size() );
+    nodes_.push_back( Node() );
+    Node n;
+    n.first = first;
+    n.count = count;
+    n.child[ 0 ] = n.child[ 1 ] = -1;
+
+    // centre and bounding box
+    std::vector< double >* const coord[ 3 ] = { &x_, &y_, &z_ };
+    double lo[ 3 ], hi[ 3 ];
+    int i, k;
+    for( k = 0; k != 3; ++k )
+    {
+        n.centre[ k ] = 0.;
+        lo[ k ] = hi[ k ] = ( *coord[ k ] )[ first ];
+    }
+    for( i = first; i != first + count; ++i )
+    {
+        for( k = 0; k != 3; ++k )
+        {
+            const double c = ( *coord[ k ] )[ i ];
+            n.centre[ k ] += c;
+            lo[ k ] = std::min( lo[ k ], c );
+            hi[ k ] = std::max( hi[ k ], c );
+        }
+    }
+    for( k = 0; k != 3; ++k ) n.centre[ k ] /= count;
+
+    // radius and multipole moments about centre
+    n.radius = 0.;
+    n.charge = 0.;
+    for( k = 0; k != 3; ++k ) n.dipole[ k ] = 0.;
+    for( k = 0; k != 6; ++k ) n.quadrupole[ k ] = 0.;
+    for( i = first; i != first + count; ++i )
+    {
+        const double q = charges_[ i ];
+        const double dx = x_[ i ] - n.centre[ 0 ];
+        const double dy = y_[ i ] - n.centre[ 1 ];
+        const double dz = z_[ i ] - n.centre[ 2 ];
+        const double d2 = dx * dx + dy * dy + dz * dz;
+        n.radius = std::max( n.radius, std::sqrt( d2 ) );
+        n.charge += q;
+        n.dipole[ 0 ] += q * dx;
+        n.dipole[ 1 ] += q * dy;
+        n.dipole[ 2 ] += q * dz;
+        n.quadrupole[ 0 ] += q * ( 3. * dx * dx - d2 );
+        n.quadrupole[ 1 ] += q * ( 3. * dy * dy - d2 );
+        n.quadrupole[ 2 ] += q * ( 3. * dz * dz - d2 );
+        n.quadrupole[ 3 ] += q * 3. * dx * dy;
+        n.quadrupole[ 4 ] += q * 3. * dx * dz;
+        n.quadrupole[ 5 ] += q * 3. * dy * dz;
+    }
+
+    if( count > LEAF_SIZE )
+    {
+        // split at the median along the longest axis: sort atom indices then
+        // permute coordinates and charges
+        int axis = 0;
+        for( k = 1; k != 3; ++k ) if( hi[ k ] - lo[ k ] > hi[ axis ] - lo[ axis ] ) axis = k;
+        std::vector< int > order( count );
+        for( i = 0; i != count; ++i ) order[ i ] = first + i;
+        const int half = count / 2;
+        std::nth_element( order.begin(), order.begin() + half, order.end(),
+                          AtomCoordinateLess( *coord[ axis ] ) );
+        std::vector< double >* const data[ 4 ] = { &x_, &y_, &z_, &charges_ };
+        std::vector< double > tmp( count );
+        for( k = 0; k != 4; ++k )
+        {
+            for( i = 0; i != count; ++i ) tmp[ i ] = ( *data[ k ] )[ order[ i ] ];
+            std::copy( tmp.begin(), tmp.end(), data[ k ]->begin() + first );
+        }
+        n.child[ 0 ] = BuildNode( first, half );
+        n.child[ 1 ] = BuildNode( first + half, count - half );
+    }
+    nodes_[ id ] = n;
+    return id;
+}
+
+//------------------------------------------------------------------------------
+double MEPTree::Evaluate( const double p[ 3 ] ) const
+{
+    if( nodes_.empty() ) return 0.;
+    const double x = p[ 0 ] * _1_BOHR;
+    const double y = p[ 1 ] * _1_BOHR;
+    const double z = p[ 2 ] * _1_BOHR;
+    const double theta2 = openingAngle_ * openingAngle_;
+    // tree depth is at most log2( atoms ) + 1: a fixed size stack is enough
+    int stack[ 128 ];
+    int top = 0;
+    stack[ top++ ] = 0;
+    double v = 0.;
+    while( top )
+    {
+        const Node& n = nodes_[ stack[ --top ] ];
+        const double rx = x - n.centre[ 0 ];
+        const double ry = y - n.centre[ 1 ];
+        const double rz = z - n.centre[ 2 ];
+        const double r2 = rx * rx + ry * ry + rz * rz;
+        if( n.radius * n.radius < theta2 * r2 )
+        {
+            // far node: multipole expansion
+            const double r = std::sqrt( r2 );
+            const double ir = 1. / r;
+            const double ir3 = ir * ir * ir;
+            const double* d = n.dipole;
+            const double* qd = n.quadrupole;
+            const double qrr = qd[ 0 ] * rx * rx + qd[ 1 ] * ry * ry + qd[ 2 ] * rz * rz
+                               + 2. * ( qd[ 3 ] * rx * ry + qd[ 4 ] * rx * rz + qd[ 5 ] * ry * rz );
+            v += n.charge * ir + ( d[ 0 ] * rx + d[ 1 ] * ry + d[ 2 ] * rz ) * ir3
+                 + 0.5 * qrr * ir3 * ir * ir;
+        }
+        else if( n.child[ 0 ] < 0 )
+        {
+            // leaf: direct sum; branch free loop to allow vectorization,
+            // points coinciding with an atom are handled afterwards
+            const double* ax = &x_[ n.first ];
+            const double* ay = &y_[ n.first ];
+            const double* az = &z_[ n.first ];
+            const double* q = &charges_[ n.first ];
+            double s = 0.;
+            int hit = 0;
+            for( int i = 0; i < n.count; ++i )
+            {
+                const double xa = x - ax[ i ];
+                const double ya = y - ay[ i ];
+                const double za = z - az[ i ];
+                const double ra2 = xa * xa + ya * ya + za * za;
+                hit |= ra2 == 0.;
+                s += ra2 > 0. ? q[ i ] / std::sqrt( ra2 ) : 0.;
+            }
+            if( hit )
+            {
+                for( int i = 0; i < n.count; ++i )
+                {
+                    const double xa = x - ax[ i ];
+                    const double ya = y - ay[ i ];
+                    const double za = z - az[ i ];
+                    if( xa * xa + ya * ya + za * za != 0. ) continue;
+                    if( q[ i ] > 0 ) return 10000;
+                    else if( q[ i ] < 0 ) return -10000;
+                }
+            }
+            v += s;
+        }
+        else
+        {
+            stack[ top++ ] = n.child[ 1 ];
+            stack[ top++ ] = n.child[ 0 ];
+        }
+    }
+    return v;
+}
@@ -0,0 +1,92 @@
+#ifndef MEPTREE_H_
+#define MEPTREE_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+#include <vector>
+
+struct Molecule;
+
+//------------------------------------------------------------------------------
+/// Tree code (Barnes-Hut) evaluation of the molecular electrostatic potential
+/// generated by the atom point charges.
+/// Atoms are stored into a binary tree built by recursively splitting the atom
+/// set along the longest axis of its bounding box; each node stores the
+/// monopole, dipole and quadrupole moments of its charges about the node
+/// centre. When evaluating the potential at a point, a node whose radius seen
+/// from the point is smaller than the opening angle is replaced by its multipole
+/// expansion, otherwise its children are visited; atoms in leaf nodes are summed
+/// directly. Evaluation cost is O(log N) per point instead of O(N).
+/// An opening angle of zero gives the same result as the direct sum.
+class MEPTree
+{
+public:
+    /// Constructor: empty tree.
+    MEPTree() : openingAngle_( 0. ) {}
+    /// Builds the tree from the atoms of a molecule.
+    /// @param mol molecule
+    /// @param openingAngle ratio between node radius and node distance
+    ///        below which the multipole expansion of a node is used.
+    void Build( const Molecule& mol, double openingAngle );
+    /// Returns the potential in atomic units at a point given in angstrom;
+    /// returns +/- 10000 at points coinciding with a charged atom, as calc_mep.
+    double Evaluate( const double p[ 3 ] ) const;
+    /// Returns the number of atoms in the tree.
+    int NumAtoms() const { return int( charges_.size() ); }
+    /// Returns the opening angle.
+    double GetOpeningAngle() const { return openingAngle_; }
+
+private:
+    /// Tree node.
+    struct Node
+    {
+        /// Centre in bohr and radius of the sphere containing the node's atoms.
+        double centre[ 3 ];
+        double radius;
+        /// Total charge.
+        double charge;
+        /// Dipole moment about centre.
+        double dipole[ 3 ];
+        /// Traceless quadrupole moment about centre: xx, yy, zz, xy, xz, yz.
+        double quadrupole[ 6 ];
+        /// Range of atoms in the node.
+        int first, count;
+        /// Children indices, -1 for leaf nodes.
+        int child[ 2 ];
+    };
+    /// Builds the node containing atoms [ first, first + count ) and its
+    /// children; returns node index.
+    int BuildNode( int first, int count );
+    /// Nodes, root is node 0.
+    std::vector< Node > nodes_;
+    /// Atom coordinates in bohr, sorted in tree order; stored as separate
+    /// x, y, z arrays to allow vectorization of the direct sums in leaf nodes.
+    std::vector< double > x_, y_, z_;
+    /// Atom charges, sorted in tree order.
+    std::vector< double > charges_;
+    /// Opening angle.
+    double openingAngle_;
+};
+
+#endif /*MEPTREE_H_*/
@@ -35,7 +35,9 @@
 // MO computation.
 
 #include <cstring>
+#include <new>
 #include "molekeltypes.h"
+#include "gaussbasis.h"
 #include <cmath>
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -176,7 +178,7 @@ Vibration::Vibration() : frequency(0.0f), ir_intensity(0.0f),
   memcpy(this->type, "\0\0\0\0\0", 5);
 }
 //----------------------------------------------------------------------------
-Molecule::Molecule()
+Molecule::Molecule() : densityMatrices(*this)
 {
 
   //
@@ -226,6 +228,8 @@ Molecule::Molecule()
   //
   this->cube_value     = NULL;
   this->cubemin = this->cubemax = this->cutoff = 0;
+
+  this->compiledBasis  = NULL;
 }
 
 
@@ -236,6 +240,49 @@ extern void FreeDynamics( Dynamics& );
     FreeDynamics( dynamics );
 extern void FreeDipole( Dipole* d );
     FreeDipole( dipole );
+    delete compiledBasis;
+}
+
+//----------------------------------------------------------------------------
+const GaussianBasis& Molecule::gaussian_basis()
+{
+  // the basis set can be requested at the same time by computations
+  // running in separate threads
+#ifdef _OPENMP
+  #pragma omp critical( molekel_gaussian_basis )
+#endif
+  {
+    if(!this->compiledBasis) this->compiledBasis = new GaussianBasis(*this);
+  }
+  return *this->compiledBasis;
+}
+
+//----------------------------------------------------------------------------
+const double* Molecule::density_matrix(DensityMatrices::Type type, DensityMatrices::Source source)
+{
+  const double* m = NULL;
+#ifdef _OPENMP
+  #pragma omp critical( molekel_density_matrix )
+#endif
+  {
+    try {
+      m = this->densityMatrices.Matrix(type, source);
+    }
+    catch( const std::bad_alloc& ) {
+      this->densityMatrices.Clear();
+      m = NULL;
+    }
+  }
+  return m;
+}
+
+//----------------------------------------------------------------------------
+void Molecule::invalidate_density_matrices()
+{
+#ifdef _OPENMP
+  #pragma omp critical( molekel_density_matrix )
+#endif
+  this->densityMatrices.Clear();
 }
 
 //----------------------------------------------------------------------------
@@ -43,6 +43,8 @@
 #include <string>
 #include <fstream>
 
+#include "densitymatrix.h"
+
 
 //----------------------------------------------------------------------------
 // Some of the structs present have been converted to classes
@@ -51,6 +53,7 @@
 //----------------------------------------------------------------------------
 
 struct Molecule;
+class GaussianBasis;
 
 typedef Molecule Mol;
 
@@ -323,6 +326,16 @@ struct Molecule  {
     ~Molecule();
     MolekelAtom* AddNewAtom(int ord, float x, float y, float z);
     void normalize_gaussians();
+    /// Returns the gaussian basis set compiled into flat arrays; compiled
+    /// on first access, thread safe.
+    const GaussianBasis& gaussian_basis();
+    /// Returns a density matrix in double precision, full nBasisFunctions x
+    /// nBasisFunctions array; built on first access and cached, thread safe.
+    /// Returns NULL if the matrix is not available.
+    const double* density_matrix(DensityMatrices::Type type, DensityMatrices::Source source);
+    /// Releases the cached density matrices: must be called whenever orbital
+    /// coefficients or density matrices are modified.
+    void invalidate_density_matrices();
     std::string fname; /// @todo UV remove this and use filename instead
     Amoss_basis *add_amoss();
     ShellList   *get_Amossbasis(char *basis);
@@ -378,6 +391,10 @@ struct Molecule  {
     int cubeplanes     ;
     int charges        ;
     int show_freq_arrow;
+    /// Compiled gaussian basis set, created by gaussian_basis().
+    GaussianBasis *compiledBasis;
+    /// Cached density matrices, see density_matrix().
+    DensityMatrices densityMatrices;
 };
 
 // GLOBAL ATTRIBUTES
@@ -824,6 +824,7 @@ int read_density_matrix(Mol *mol)
       free(mol->betaDensity);
    }
    mol->alphaDensity = mol->betaDensity = NULL;
+   mol->invalidate_density_matrices();
 
    if(!strstr(line, "ALPHA")){                 /* only one matrix */
       if((mol->alphaDensity = read_trimat(mol)) == NULL){
@@ -0,0 +1,185 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+#include <cmath>
+#include <algorithm>
+
+#include "constant.h"
+#include "molekeltypes.h"
+#include "gausskernels.h"
+#include "slaterbasis.h"
+
+namespace
+{
+    /// Integer power, 0^0 = 1.
+    inline double IntPow( double x, int n )
+    {
+        double r = 1.;
+        for( int i = 0; i < n; ++i ) r *= x;
+        return r;
+    }
+}
+
+//------------------------------------------------------------------------------
+void SlaterBasis::Build( const Molecule& mol )
+{
+    centres_.clear();
+    atomGroups_.clear();
+    atomMaxX_.clear();
+    atomMaxR_.clear();
+    groups_.clear();
+    function_.clear();
+    a_.clear();
+    b_.clear();
+    c_.clear();
+    d_.clear();
+    norm_.clear();
+    numBasisFunctions_ = 0;
+    maxPower_ = 0;
+
+    for( MolekelAtomList::const_iterator ap = mol.Atoms.begin(); ap != mol.Atoms.end(); ++ap )
+    {
+        centres_.push_back( ap->coord[ 0 ] * _1_BOHR );
+        centres_.push_back( ap->coord[ 1 ] * _1_BOHR );
+        centres_.push_back( ap->coord[ 2 ] * _1_BOHR );
+        atomGroups_.push_back( int( groups_.size() ) );
+        // group the atom's functions by exponent, keeping the order of
+        // first appearance
+        const SlaterList& sl = ap->Slaters;
+        std::vector< bool > done( sl.size(), false );
+        int maxX = 0, maxR = 0;
+        for( int i = 0; i != int( sl.size() ); ++i )
+        {
+            if( done[ i ] ) continue;
+            Group g;
+            g.exponent = sl[ i ].exponent;
+            g.first = int( function_.size() );
+            for( int j = i; j != int( sl.size() ); ++j )
+            {
+                if( done[ j ] || sl[ j ].exponent != sl[ i ].exponent ) continue;
+                done[ j ] = true;
+                function_.push_back( numBasisFunctions_ + j );
+                a_.push_back( sl[ j ].a );
+                b_.push_back( sl[ j ].b );
+                c_.push_back( sl[ j ].c );
+                d_.push_back( sl[ j ].d );
+                norm_.push_back( sl[ j ].norm[ 0 ] );
+                maxX = std::max( maxX, int( sl[ j ].a ) );
+                maxR = std::max( maxR, int( sl[ j ].d ) );
+            }
+            g.end = int( function_.size() );
+            groups_.push_back( g );
+        }
+        atomMaxX_.push_back( maxX );
+        atomMaxR_.push_back( maxR );
+        maxPower_ = std::max( maxPower_, std::max( maxX, maxR ) );
+        numBasisFunctions_ += int( sl.size() );
+    }
+    atomGroups_.push_back( int( groups_.size() ) );
+}
+
+//------------------------------------------------------------------------------
+void SlaterBasis::EvaluatePoint( const double p[ 3 ], double* chi ) const
+{
+    const int numAtoms = int( atomMaxX_.size() );
+    for( int atom = 0; atom != numAtoms; ++atom )
+    {
+        const double* c = &centres_[ 3 * atom ];
+        const double xa = p[ 0 ] - c[ 0 ];
+        const double ya = p[ 1 ] - c[ 1 ];
+        const double za = p[ 2 ] - c[ 2 ];
+        const double ra = std::sqrt( xa * xa + ya * ya + za * za );
+        for( int g = atomGroups_[ atom ]; g != atomGroups_[ atom + 1 ]; ++g )
+        {
+            const double e = std::exp( -groups_[ g ].exponent * ra );
+            for( int f = groups_[ g ].first; f != groups_[ g ].end; ++f )
+            {
+                chi[ function_[ f ] ] = norm_[ f ] * IntPow( xa, a_[ f ] ) * IntPow( ya, b_[ f ] ) *
+                                        IntPow( za, c_[ f ] ) * IntPow( ra, d_[ f ] ) * e;
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+int SlaterBasis::LineWorkSize( int n ) const
+{
+    // distances, exponentials and powers of xa and ra
+    return ( 2 + 2 * ( maxPower_ + 1 ) ) * GaussKernelStride( n );
+}
+
+//------------------------------------------------------------------------------
+void SlaterBasis::EvaluateLine( const double* x, int n, double y, double z,
+                                double* chi, double* work ) const
+{
+    const int stride = GaussKernelStride( n );
+    double* const ra = work;
+    double* const e = ra + stride;
+    // xp + i * stride: xa^i, rp + i * stride: ra^i
+    double* const xp = e + stride;
+    double* const rp = xp + ( maxPower_ + 1 ) * stride;
+    const int numAtoms = int( atomMaxX_.size() );
+    int k;
+    for( int atom = 0; atom != numAtoms; ++atom )
+    {
+        const double* c = &centres_[ 3 * atom ];
+        const double ya = y - c[ 1 ];
+        const double za = z - c[ 2 ];
+        const double yz2 = ya * ya + za * za;
+        for( k = 0; k < stride; ++k )
+        {
+            const double xa = x[ k ] - c[ 0 ];
+            ra[ k ] = std::sqrt( xa * xa + yz2 );
+            xp[ k ] = 1.;
+            rp[ k ] = 1.;
+        }
+        // precomputed monomials
+        for( int i = 1; i <= atomMaxX_[ atom ]; ++i )
+        {
+            const double* prev = xp + ( i - 1 ) * stride;
+            double* cur = xp + i * stride;
+            for( k = 0; k < stride; ++k ) cur[ k ] = prev[ k ] * ( x[ k ] - c[ 0 ] );
+        }
+        for( int i = 1; i <= atomMaxR_[ atom ]; ++i )
+        {
+            const double* prev = rp + ( i - 1 ) * stride;
+            double* cur = rp + i * stride;
+            for( k = 0; k < stride; ++k ) cur[ k ] = prev[ k ] * ra[ k ];
+        }
+        for( int g = atomGroups_[ atom ]; g != atomGroups_[ atom + 1 ]; ++g )
+        {
+            const double ma = -groups_[ g ].exponent;
+            for( k = 0; k < stride; ++k ) e[ k ] = ma * ra[ k ];
+            ExpLine( e, stride );
+            for( int f = groups_[ g ].first; f != groups_[ g ].end; ++f )
+            {
+                const double s = norm_[ f ] * IntPow( ya, b_[ f ] ) * IntPow( za, c_[ f ] );
+                const double* xf = xp + a_[ f ] * stride;
+                const double* rf = rp + d_[ f ] * stride;
+                double* out = chi + size_t( function_[ f ] ) * stride;
+                for( k = 0; k < stride; ++k ) out[ k ] = s * xf[ k ] * rf[ k ] * e[ k ];
+            }
+        }
+    }
+}
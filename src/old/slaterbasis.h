@@ -0,0 +1,98 @@
+#ifndef SLATERBASIS_H_
+#define SLATERBASIS_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+
+#include <vector>
+
+struct Molecule;
+
+//------------------------------------------------------------------------------
+/// Slater type basis set compiled into flat arrays.
+/// Basis functions are grouped by atom and exponent: the radial exponential
+/// is evaluated once per group and the powers of the coordinates are computed
+/// once per atom, each basis function then only costs a few products.
+/// Basis function value:
+/// norm * xa^a * ya^b * za^c * ra^d * exp( -exponent * ra )
+/// where xa, ya, za, ra are the distance components and the distance in bohr
+/// between the point and the atom.
+/// Basis function indices follow the order of the MO coefficients.
+class SlaterBasis
+{
+public:
+    /// Constructor: empty basis set.
+    SlaterBasis() : numBasisFunctions_( 0 ), maxPower_( 0 ) {}
+    /// Compiles the Slater basis set of a molecule.
+    void Build( const Molecule& mol );
+    /// Returns number of basis functions.
+    int NumBasisFunctions() const { return numBasisFunctions_; }
+    /// Evaluates all the basis functions at a point; coordinates in bohr.
+    /// @param p point
+    /// @param chi output: NumBasisFunctions() values
+    void EvaluatePoint( const double p[ 3 ], double* chi ) const;
+    /// Returns the size (in number of doubles) of the work area required by
+    /// EvaluateLine for lines of n points.
+    int LineWorkSize( int n ) const;
+    /// Evaluates all the basis functions over a line of points parallel to the
+    /// x axis; same layout as EvaluateBasisLine in gausskernels.h.
+    /// @param x point x coordinates in bohr, GaussKernelStride( n ) elements
+    /// @param n number of points
+    /// @param y line y coordinate in bohr
+    /// @param z line z coordinate in bohr
+    /// @param chi output: GaussKernelStride( n ) values per basis function
+    /// @param work work area of LineWorkSize( n ) doubles
+    void EvaluateLine( const double* x, int n, double y, double z,
+                       double* chi, double* work ) const;
+
+private:
+    /// Basis functions sharing atom and exponent.
+    struct Group
+    {
+        double exponent;
+        /// Range of the group's functions.
+        int first, end;
+    };
+    /// Atom centres in bohr.
+    std::vector< double > centres_;
+    /// Index of first group of each atom, last element is the number of groups.
+    std::vector< int > atomGroups_;
+    /// Highest power of xa and ra used by each atom's functions.
+    std::vector< int > atomMaxX_;
+    std::vector< int > atomMaxR_;
+    /// Groups sorted by atom.
+    std::vector< Group > groups_;
+    /// @{ Basis functions sorted by group: index in the original basis set,
+    /// powers and normalization factor.
+    std::vector< int > function_;
+    std::vector< int > a_, b_, c_, d_;
+    std::vector< double > norm_;
+    /// @}
+    /// Number of basis functions.
+    int numBasisFunctions_;
+    /// Highest power of xa and ra.
+    int maxPower_;
+};
+
+#endif /*SLATERBASIS_H_*/
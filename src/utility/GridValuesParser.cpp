@@ -0,0 +1,224 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "GridValuesParser.h"
+#include "TextScanner.h"
+
+namespace
+{
+    /// Block of text parsed by a single thread; begins and ends at whitespace
+    /// boundaries.
+    struct Chunk
+    {
+        /// First character.
+        const char* begin;
+        /// One past the last character.
+        const char* end;
+        /// Index, in text order, of the first number in chunk.
+        size_t firstValue;
+        /// Number of whitespace separated tokens in chunk.
+        size_t numValues;
+        /// True if a token is not a number.
+        bool error;
+        Chunk() : begin( 0 ), end( 0 ), firstValue( 0 ), numValues( 0 ), error( false ) {}
+    };
+
+    /// Minimum number of bytes per chunk; chunks are also the progress steps.
+    const size_t MIN_CHUNK_SIZE = 1 << 18;
+
+    /// Progress callback used by the grid file readers.
+    GridValuesProgressCallback loadProgressCBack = 0;
+    /// Data passed to loadProgressCBack.
+    void* loadProgressCBackData = 0;
+
+    inline bool IsWhitespace( char c )
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    /// Returns the number of whitespace separated tokens in [p, end).
+    size_t CountTokens( const char* p, const char* end )
+    {
+        size_t n = 0;
+        bool inToken = false;
+        for( ; p != end; ++p )
+        {
+            const bool whitespace = IsWhitespace( *p );
+            if( !whitespace && !inToken ) ++n;
+            inToken = !whitespace;
+        }
+        return n;
+    }
+
+    /// Parses the numbers of a chunk with index lower than numValues.
+    void ParseChunk( Chunk& chunk, const int dims[ 3 ], bool zFastest, double* values )
+    {
+        const size_t nx = dims[ 0 ];
+        const size_t ny = dims[ 1 ];
+        const size_t nz = dims[ 2 ];
+        const size_t numValues = nx * ny * nz;
+        if( chunk.firstValue >= numValues ) return;
+        const size_t last = std::min( numValues, chunk.firstValue + chunk.numValues );
+        // grid coordinates of the first value when z varies fastest in text
+        size_t k = chunk.firstValue % nz;
+        size_t j = ( chunk.firstValue / nz ) % ny;
+        size_t i = chunk.firstValue / ( nz * ny );
+        const char* p = chunk.begin;
+        for( size_t v = chunk.firstValue; v != last; ++v )
+        {
+            double value = 0.;
+            p = ScanDouble( SkipWhitespace( p, chunk.end ), chunk.end, value );
+            if( p == 0 || ( p != chunk.end && !IsWhitespace( *p ) ) )
+            {
+                chunk.error = true;
+                return;
+            }
+            if( !zFastest )
+            {
+                values[ v ] = value;
+                continue;
+            }
+            values[ i + nx * ( j + ny * k ) ] = value;
+            if( ++k == nz )
+            {
+                k = 0;
+                if( ++j == ny )
+                {
+                    j = 0;
+                    ++i;
+                }
+            }
+        }
+    }
+
+    /// Returns true if called from the thread which started the current
+    /// parallel region (or from outside parallel regions).
+    inline bool IsMasterThread()
+    {
+#ifdef _OPENMP
+        return omp_get_thread_num() == 0;
+#else
+        return true;
+#endif
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ParseGridValues( const char* begin,
+                      const char* end,
+                      const int dims[ 3 ],
+                      bool zFastest,
+                      double* values,
+                      GridValuesProgressCallback progressCBack,
+                      void* cbackData,
+                      size_t* numParsed )
+{
+    if( dims[ 0 ] <= 0 || dims[ 1 ] <= 0 || dims[ 2 ] <= 0 ) return false;
+    const size_t numValues = size_t( dims[ 0 ] ) * dims[ 1 ] * dims[ 2 ];
+
+    // split text at whitespace boundaries
+    const int numChunks = int( size_t( end - begin ) / MIN_CHUNK_SIZE + 1 );
+    std::vector< Chunk > chunks( numChunks );
+    const size_t chunkSize = ( end - begin ) / numChunks + 1;
+    const char* p = begin;
+    for( int c = 0; c != numChunks; ++c )
+    {
+        chunks[ c ].begin = p;
+        if( size_t( end - p ) > chunkSize )
+        {
+            p += chunkSize;
+            while( p != end && !IsWhitespace( *p ) ) ++p;
+        }
+        else p = end;
+        chunks[ c ].end = p;
+    }
+
+    // count numbers in each chunk to compute the index of the first number
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic )
+#endif
+    for( int c = 0; c < numChunks; ++c )
+    {
+        chunks[ c ].numValues = CountTokens( chunks[ c ].begin, chunks[ c ].end );
+    }
+    size_t count = 0;
+    for( int c = 0; c != numChunks; ++c )
+    {
+        chunks[ c ].firstValue = count;
+        count += chunks[ c ].numValues;
+    }
+    if( count < numValues )
+    {
+        if( numParsed == 0 ) return false;
+        std::fill( values, values + numValues, 0. );
+    }
+    if( numParsed ) *numParsed = std::min( count, numValues );
+
+    // parse
+    if( progressCBack ) progressCBack( 0, numChunks, cbackData );
+    int completedChunks = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic )
+#endif
+    for( int c = 0; c < numChunks; ++c )
+    {
+        ParseChunk( chunks[ c ], dims, zFastest, values );
+        int completed = 0;
+#ifdef _OPENMP
+        #pragma omp critical( grid_values_parser_progress )
+#endif
+        completed = ++completedChunks;
+        if( progressCBack && IsMasterThread() ) progressCBack( completed, numChunks, cbackData );
+    }
+    for( int c = 0; c != numChunks; ++c ) if( chunks[ c ].error ) return false;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void SetGridLoadProgressCallback( GridValuesProgressCallback cb, void* cbackData )
+{
+    loadProgressCBack = cb;
+    loadProgressCBackData = cbackData;
+}
+
+//------------------------------------------------------------------------------
+GridValuesProgressCallback GetGridLoadProgressCallback()
+{
+    return loadProgressCBack;
+}
+
+//------------------------------------------------------------------------------
+void* GetGridLoadProgressCallbackData()
+{
+    return loadProgressCBackData;
+}
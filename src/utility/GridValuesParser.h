@@ -0,0 +1,71 @@
+#ifndef GRIDVALUESPARSER_H_
+#define GRIDVALUESPARSER_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <cstddef>
+
+/// Progress callback invoked while parsing grid values.
+typedef void ( *GridValuesProgressCallback )( int completedStep, int totalSteps, void* cbackData );
+
+/// Parses the values of a grid of dims[ 0 ] x dims[ 1 ] x dims[ 2 ] points
+/// from the whitespace separated numbers in [begin, end), e.g. the value
+/// section of a memory mapped file.
+/// The text is split into chunks at whitespace boundaries; the numbers in
+/// each chunk are first counted and then parsed in parallel with OpenMP,
+/// each chunk starting at the value index following the previous chunks.
+/// Values are stored with x varying fastest; numbers following the last
+/// grid value are ignored.
+/// @param zFastest true if numbers in the text have z varying fastest, as in
+///        Gaussian cube files, false if they have x varying fastest
+/// @param values output array of dims[ 0 ] * dims[ 1 ] * dims[ 2 ] values
+/// @param progressCBack progress callback, invoked from the calling thread only
+/// @param cbackData data passed to progressCBack
+/// @param numParsed if not null, fewer numbers than grid points are accepted:
+///        the missing values are set to zero and numParsed receives the
+///        number of values found
+/// @return false if fewer numbers than grid points are found and numParsed
+/// is null or if text other than numbers precedes the last grid value.
+bool ParseGridValues( const char* begin,
+                      const char* end,
+                      const int dims[ 3 ],
+                      bool zFastest,
+                      double* values,
+                      GridValuesProgressCallback progressCBack = 0,
+                      void* cbackData = 0,
+                      size_t* numParsed = 0 );
+
+/// Sets the progress callback used by the grid file readers: the readers
+/// are invoked through OpenBabel and cannot receive the callback as a
+/// parameter. Pass null to remove the callback.
+void SetGridLoadProgressCallback( GridValuesProgressCallback cb, void* cbackData );
+
+/// Returns the progress callback used by the grid file readers.
+GridValuesProgressCallback GetGridLoadProgressCallback();
+
+/// Returns the data passed to the progress callback of the grid file readers.
+void* GetGridLoadProgressCallbackData();
+
+#endif /*GRIDVALUESPARSER_H_*/
@@ -0,0 +1,84 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+#ifdef WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+#ifdef WIN32
+//------------------------------------------------------------------------------
+MappedFile::MappedFile( const std::string& fileName ) :
+    begin_( 0 ), size_( 0 ), file_( INVALID_HANDLE_VALUE ), mapping_( 0 )
+{
+    file_ = CreateFileA( fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0 );
+    if( file_ == INVALID_HANDLE_VALUE ) return;
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx( file_, &size ) || size.QuadPart == 0 ) return;
+    mapping_ = CreateFileMapping( file_, 0, PAGE_READONLY, 0, 0, 0 );
+    if( mapping_ == 0 ) return;
+    begin_ = static_cast< const char* >( MapViewOfFile( mapping_, FILE_MAP_READ, 0, 0, 0 ) );
+    if( begin_ ) size_ = size_t( size.QuadPart );
+}
+
+//------------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+    if( begin_ ) UnmapViewOfFile( begin_ );
+    if( mapping_ ) CloseHandle( mapping_ );
+    if( file_ != INVALID_HANDLE_VALUE ) CloseHandle( file_ );
+}
+#else
+//------------------------------------------------------------------------------
+MappedFile::MappedFile( const std::string& fileName ) : begin_( 0 ), size_( 0 )
+{
+    const int fd = open( fileName.c_str(), O_RDONLY );
+    if( fd == -1 ) return;
+    struct stat s;
+    if( fstat( fd, &s ) == 0 && s.st_size > 0 )
+    {
+        void* p = mmap( 0, size_t( s.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( p != MAP_FAILED )
+        {
+            begin_ = static_cast< const char* >( p );
+            size_ = size_t( s.st_size );
+        }
+    }
+    // the mapping stays valid after the descriptor is closed
+    close( fd );
+}
+
+//------------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+    if( begin_ ) munmap( const_cast< char* >( begin_ ), size_ );
+}
+#endif
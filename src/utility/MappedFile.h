@@ -0,0 +1,68 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <cstddef>
+#include <string>
+
+/// Read-only memory mapping of a whole file.
+/// The file content is accessible through the [Begin(), End()) range until
+/// the object is destroyed; no terminating null character is available
+/// after the last byte.
+class MappedFile
+{
+public:
+    /// Constructor: maps the file; use IsMapped() to check for errors.
+    MappedFile( const std::string& fileName );
+    /// Destructor: unmaps the file.
+    ~MappedFile();
+    /// Returns true if the file was successfully mapped; empty files are
+    /// never mapped.
+    bool IsMapped() const { return begin_ != 0; }
+    /// Returns pointer to first byte.
+    const char* Begin() const { return begin_; }
+    /// Returns pointer to one past the last byte.
+    const char* End() const { return begin_ + size_; }
+    /// Returns file size in bytes.
+    size_t Size() const { return size_; }
+private:
+    /// Mapped file content.
+    const char* begin_;
+    /// File size.
+    size_t size_;
+#ifdef WIN32
+    /// File handle.
+    void* file_;
+    /// File mapping handle.
+    void* mapping_;
+#endif
+    /// Disable copy constructor.
+    MappedFile( const MappedFile& );
+    /// Disable assignment.
+    MappedFile& operator=( const MappedFile& );
+};
+
+#endif /*MAPPEDFILE_H_*/
@@ -24,11 +24,15 @@
 #include <vector>
 #include <sstream>
 #include <cstring>
+#include <iterator>
 // reference: http://www.gaussian.com/g_ur/u_cubegen.htm
 
 #include <openbabel/obconversion.h>
 
 #include "OBGridData.h"
+#include "MappedFile.h"
+#include "TextScanner.h"
+#include "GridValuesParser.h"
 
 using namespace std;
 using namespace OpenBabel;
@@ -65,23 +69,54 @@ namespace
         double yAxis[ 3 ];
         double zAxis[ 3 ];
         std::vector< AtomPosition > atomPositions;
-        std::vector< double > values;
+        vtkSmartPointer< vtkDoubleArray > values;
         Unit unit;
     };
 
-    bool ReadGaussianCube( GaussianCube& gc, istream& in )
+    /// Returns true if [begin, end) starts with the gzip magic number.
+    inline bool IsGzipped( const char* begin, const char* end )
+    {
+        return end - begin >= 2 && begin[ 0 ] == '\x1f' && begin[ 1 ] == '\x8b';
+    }
+
+    /// Returns the line starting at p, without line terminators.
+    string GetLine( const char* p, const char* end )
+    {
+        const char* lineEnd = FindLineEnd( p, end );
+        if( lineEnd != p && lineEnd[ -1 ] == '\r' ) --lineEnd;
+        return string( p, lineEnd );
+    }
+
+    /// Parses the next integer, skipping whitespace and newlines.
+    inline const char* NextInt( const char* p, const char* end, int& v )
+    {
+        return p ? ScanInt( SkipWhitespace( p, end ), end, v ) : 0;
+    }
+
+    /// Parses the next floating point number, skipping whitespace and newlines.
+    inline const char* NextDouble( const char* p, const char* end, double& v )
+    {
+        return p ? ScanDouble( SkipWhitespace( p, end ), end, v ) : 0;
+    }
+
+    /// Parses a Gaussian cube file held in memory. The grid values are parsed in
+    /// parallel, see ParseGridValues, and stored with x varying fastest.
+    bool ReadGaussianCube( GaussianCube& gc, const char* p, const char* end )
     {
         try
         {
-            static const int MAX_LINE_SIZE = 512;
-            char buffer[ MAX_LINE_SIZE ];
             // read title
-            in.getline( buffer, MAX_LINE_SIZE );
-            gc.firstLine = string( buffer );
-            in.getline( buffer, MAX_LINE_SIZE );
-            gc.secondLine = string( buffer );
+            gc.firstLine = GetLine( p, end );
+            p = SkipLine( p, end );
+            gc.secondLine = GetLine( p, end );
+            p = SkipLine( p, end );
             // number of atoms and center
-            in >> gc.numberOfAtoms >> gc.origin[ 0 ] >> gc.origin[ 1 ] >> gc.origin[ 2 ];
+            p = NextInt( p, end, gc.numberOfAtoms );
+            p = NextDouble( p, end, gc.origin[ 0 ] );
+            p = NextDouble( p, end, gc.origin[ 1 ] );
+            p = NextDouble( p, end, gc.origin[ 2 ] );
+            if( !p ) return false;
+            p = SkipLine( p, end );
 
             gc.origin[ 0 ] *= BOHR_TO_ANGSTROM;
             gc.origin[ 1 ] *= BOHR_TO_ANGSTROM;
@@ -95,9 +130,16 @@ namespace
                                           // between atom positions and grid values.
             }
             // point number and axis
-            in >> gc.numPoints[ 0 ] >> gc.xAxis[ 0 ] >> gc.xAxis[ 1 ] >> gc.xAxis[ 2 ];
-            in >> gc.numPoints[ 1 ] >> gc.yAxis[ 0 ] >> gc.yAxis[ 1 ] >> gc.yAxis[ 2 ];
-            in >> gc.numPoints[ 2 ] >> gc.zAxis[ 0 ] >> gc.zAxis[ 1 ] >> gc.zAxis[ 2 ];
+            double* axes[ 3 ] = { gc.xAxis, gc.yAxis, gc.zAxis };
+            for( int a = 0; a != 3; ++a )
+            {
+                p = NextInt( p, end, gc.numPoints[ a ] );
+                p = NextDouble( p, end, axes[ a ][ 0 ] );
+                p = NextDouble( p, end, axes[ a ][ 1 ] );
+                p = NextDouble( p, end, axes[ a ][ 2 ] );
+                if( !p ) return false;
+                p = SkipLine( p, end );
+            }
 
             gc.xAxis[ 0 ] *= BOHR_TO_ANGSTROM; gc.xAxis[ 1 ] *= BOHR_TO_ANGSTROM; gc.xAxis[ 2 ] *= BOHR_TO_ANGSTROM;
             gc.yAxis[ 0 ] *= BOHR_TO_ANGSTROM; gc.yAxis[ 1 ] *= BOHR_TO_ANGSTROM; gc.yAxis[ 2 ] *= BOHR_TO_ANGSTROM;
@@ -106,13 +148,19 @@ namespace
             // set unit
             gc.unit = gc.numPoints[ 0 ] < 0 ? GaussianCube::BOHR : GaussianCube::ANGSTROM;
             gc.numPoints[ 0 ] = abs( gc.numPoints[ 0 ] );
+            if( gc.numPoints[ 0 ] <= 0 || gc.numPoints[ 1 ] <= 0 || gc.numPoints[ 2 ] <= 0 ) return false;
             gc.atomPositions.reserve( gc.numberOfAtoms  );
             // read atoms
             for( int i = 0; i < gc.numberOfAtoms; ++i )
             {
                 AtomPosition ap;
-                in >> ap.atomicNumber >> ap.value >> ap.position[ 0 ]
-                   >> ap.position[ 1 ] >> ap.position[ 2 ];
+                p = NextInt( p, end, ap.atomicNumber );
+                p = NextDouble( p, end, ap.value );
+                p = NextDouble( p, end, ap.position[ 0 ] );
+                p = NextDouble( p, end, ap.position[ 1 ] );
+                p = NextDouble( p, end, ap.position[ 2 ] );
+                if( !p ) return false;
+                p = SkipLine( p, end );
 
                 ap.position[ 0 ] *= BOHR_TO_ANGSTROM;
                 ap.position[ 1 ] *= BOHR_TO_ANGSTROM;
@@ -125,21 +173,31 @@ namespace
             if( negativeNumAtoms )
             {
                 int n = 0;
-                in >> n;
+                p = NextInt( p, end, n );
                 int dummy;
-                for( int j = 0; j < n; ++j ) in >> dummy;
+                for( int j = 0; j < n; ++j ) p = NextInt( p, end, dummy );
+                if( !p ) return false;
+                p = SkipLine( p, end );
             }
 
             // read values
-            gc.values.reserve( gc.numPoints[ 0 ] *
-                               gc.numPoints[ 1 ] *
-                               gc.numPoints[ 2 ] );
-            while( in )
+            gc.values = vtkDoubleArray::New();
+            gc.values->Delete();
+            const size_t numValues = size_t( gc.numPoints[ 0 ] ) *
+                                     gc.numPoints[ 1 ] *
+                                     gc.numPoints[ 2 ];
+            gc.values->SetNumberOfValues( vtkIdType( numValues ) );
+            // truncated files are accepted: missing values are set to zero
+            size_t numParsed = 0;
+            if( !ParseGridValues( p, end, gc.numPoints, true, gc.values->GetPointer( 0 ),
+                                  GetGridLoadProgressCallback(),
+                                  GetGridLoadProgressCallbackData(), &numParsed ) ) return false;
+            if( numParsed < numValues )
             {
-                double v;
-                in >> v;
-                gc.values.push_back( v );
+                obErrorLog.ThrowError( __FUNCTION__, "Missing grid values in Gaussian cube file: "
+                                       "set to zero.", obWarning );
             }
+            return true;
         }
         catch( const exception& )
         {
@@ -203,7 +261,8 @@ namespace
 ///	cout << "Z AXIS:          " << zAxis[ 0 ] << ' '
 ///								<< zAxis[ 1 ] << ' '
 ///								<< zAxis[ 2 ] << '\n';
-///	copy( gd->GetValues().begin(), gd->GetValues().end(), ostream_iterator< double >( cout, "\n" ) );
+///	const double* values = gd->GetValues()->GetPointer( 0 );
+///	copy( values, values + nx * ny * nz, ostream_iterator< double >( cout, "\n" ) );
 ///
 ///}
 ///
@@ -283,8 +342,21 @@ bool OBGaussianCubeFormat::ReadMolecule( OBBase* pOb, OBConversion* pConv )
 
     /** Parse the input stream and use the OpenBabel API to populate the OBMol **/
 
+    // memory map the input file; read the stream into memory if the input is
+    // not an uncompressed file read from the beginning
     GaussianCube gc;
-    if( !ReadGaussianCube( gc, ifs ) )
+    bool ok = false;
+    const MappedFile file( pConv->GetInFilename() );
+    if( file.IsMapped() && ifs.tellg() == streampos( 0 ) && !IsGzipped( file.Begin(), file.End() ) )
+    {
+        ok = ReadGaussianCube( gc, file.Begin(), file.End() );
+    }
+    else
+    {
+        const string text( ( istreambuf_iterator< char >( ifs ) ), istreambuf_iterator< char >() );
+        ok = ReadGaussianCube( gc, text.data(), text.data() + text.size() );
+    }
+    if( !ok )
     {
         obErrorLog.ThrowError( __FUNCTION__, "Problems reading a Gaussian cube file.", obWarning);
         return false;
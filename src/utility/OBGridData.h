@@ -23,6 +23,8 @@
 
 #include <openbabel/obmolecformat.h>
 #include <openbabel/generic.h>
+#include <vtkDoubleArray.h>
+#include <vtkSmartPointer.h>
 #include <vector>
 #include <algorithm>
 #include <limits>
@@ -31,12 +33,15 @@
 
 /// Class to store values for generic (non axis aligned) grids like
 /// those read from Gaussian cube files.
+/// Values are stored with x varying fastest, the layout of vtkImageData
+/// scalars, so that the value array can be shared with vtkImageData
+/// objects without copying.
 class OBGridData : public OpenBabel::OBGenericData
 {
 public:
     /// Constructor assigns the values of type and attr protected data
     /// This values will be accessed through the GetDataType, HasData methods.
-    OBGridData() : OpenBabel::OBGenericData()
+    OBGridData() : OpenBabel::OBGenericData(), nx_( 0 ), ny_( 0 ), nz_( 0 )
     {
         _type = OpenBabel::OBGenericDataType::CustomData0;
         _attr = "GridData";
@@ -72,16 +77,17 @@ public:
         steps[ 2 ] = nz_ - 1;
     }
 
-    /// Return grid values as an array of doubles.
-    const std::vector< double >& GetValues() const
+    /// Return grid values, x varying fastest; the array is reference counted
+    /// and can be assigned to vtkImageData scalars but must not be modified.
+    vtkDoubleArray* GetValues() const
     {
         return values_;
     }
     /// Returns point at position i, j, k in the grid.
     double GetValue( int i, int j, int k ) const
     {
-        const int idx = ComputeIndex( i, j, k );
-        return values_[ idx ];
+        const size_t idx = ComputeIndex( i, j, k );
+        return values_->GetValue( idx );
     }
 
     /// Returns unit.
@@ -111,12 +117,18 @@ public:
     }
 
     /// Reserve data in value vector.
-    void Reserve( int size ) { values_.reserve( size ); }
+    void Reserve( int size )
+    {
+        if( values_ == 0 ) NewValues();
+        values_->Allocate( size );
+    }
 
-    /// Append value to value vector.
+    /// Append value to value vector; values are appended with x varying
+    /// fastest.
     void AddValue( double v )
     {
-        values_.push_back( v );
+        if( values_ == 0 ) NewValues();
+        values_->InsertNextValue( v );
         if( v < min_ ) min_ = v;
         if( v > max_ ) max_ = v;
     }
@@ -137,12 +149,41 @@ public:
         zAxis_[ 0 ] = z[ 0 ]; zAxis_[ 1 ] = z[ 1 ]; zAxis_[ 2 ] = z[ 2 ];
     }
 
-    /// Set value vector.
+    /// Set values from a vector with z varying fastest, the order of
+    /// Gaussian cube files; values are transposed once to x varying fastest.
+    /// SetNumberOfPoints must be called first; missing values are set to zero.
     void SetValues( const std::vector< double >& v )
     {
+        const int nx = nx_;
+        const int ny = ny_;
+        const int nz = nz_;
+        NewValues();
+        values_->SetNumberOfValues( vtkIdType( nx ) * ny * nz );
+        double* values = values_->GetPointer( 0 );
+        const size_t size = v.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule( static )
+#endif
+        for( int i = 0; i < nx; ++i )
+        {
+            for( int j = 0; j != ny; ++j )
+            {
+                const size_t src = size_t( nz ) * ( j + size_t( ny ) * i );
+                for( int k = 0; k != nz; ++k )
+                {
+                    values[ i + nx * ( j + size_t( ny ) * k ) ] = src + k < size ? v[ src + k ] : 0.;
+                }
+            }
+        }
+        ComputeRange();
+    }
+
+    /// Set values with x varying fastest; the array is shared, not copied.
+    void SetValues( vtkDoubleArray* v )
+    {
+        assert( v && v->GetNumberOfTuples() == vtkIdType( nx_ ) * ny_ * nz_ );
         values_ = v;
-        min_ = *std::min_element( values_.begin(), values_.end() );
-        max_ = *std::max_element( values_.begin(), values_.end() );
+        ComputeRange();
     }
 
     /// Set unit.
@@ -175,8 +216,8 @@ private:
     int ny_;
     int nz_;
     // @}
-    /// Grid values.
-    std::vector< double > values_;
+    /// Grid values, x varying fastest.
+    vtkSmartPointer< vtkDoubleArray > values_;
     /// Unit of length.
     Unit unit_;
     /// Origin.
@@ -186,13 +227,30 @@ private:
     /// Max value.
     double max_;
     /// Return vector index given i, j, k grid coordinates.
-    int ComputeIndex( int i, int j, int k ) const
+    size_t ComputeIndex( int i, int j, int k ) const
     {
         assert( i >= 0 && i < nx_ &&
                 j >= 0 && j < ny_ &&
                 k >= 0 && k < nz_ &&
                 "Grid index out of bounds" );
-        return  k + nz_ *( j +  ny_ * i );
+        return  i + nx_ *( j +  size_t( ny_ ) * k );
+    }
+    /// Replaces the value array with a new empty array.
+    void NewValues()
+    {
+        values_ = vtkDoubleArray::New();
+        values_->Delete();
+    }
+    /// Computes min and max values.
+    void ComputeRange()
+    {
+        min_ = std::numeric_limits< double >::max();
+        max_ = -std::numeric_limits< double >::max();
+        const double* v = values_->GetPointer( 0 );
+        const double* end = v + values_->GetNumberOfTuples();
+        if( v == end ) return;
+        min_ = *std::min_element( v, end );
+        max_ = *std::max_element( v, end );
     }
 };
 
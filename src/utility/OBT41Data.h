@@ -22,26 +22,41 @@
 
 #include <openbabel/obmolecformat.h>
 #include <openbabel/generic.h>
+#include <vtkDoubleArray.h>
+#include <vtkSmartPointer.h>
+#include "MappedFile.h"
+#include "GridValuesParser.h"
 #include <vector>
 #include <algorithm>
 #include <limits>
 #include <cassert>
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 
 /// Class to store values read from t41 files.
+/// Values are stored with x varying fastest, the layout of vtkImageData
+/// scalars, so that the value arrays can be shared with vtkImageData
+/// objects without copying.
+/// Grids can be added as sections of a memory mapped file: the values of
+/// a section are decoded the first time they are requested and only the
+/// most recently used decoded grids are kept in memory.
 class OBT41Data : public OpenBabel::OBGenericData
 {
 public:
     /// Constructor assigns the values of type and attr protected data
     /// This values will be accessed through the GetDataType, HasData methods.
-    OBT41Data() : OpenBabel::OBGenericData()
+    OBT41Data() : OpenBabel::OBGenericData(), nx_( 0 ), ny_( 0 ), nz_( 0 ),
+                  file_( 0 ), maxCachedGrids_( DEFAULT_MAX_CACHED_GRIDS ), useCount_( 0 )
     {
         _type = OpenBabel::OBGenericDataType::CustomData1;
         _attr = "T41Data";
     }
 
+    /// Destructor: unmaps the file grid sections are decoded from.
+    ~OBT41Data() { delete file_; }
+
     /// Returns the three axes parallel to the grid edges the
     /// length of the returned vector is the step along that
     /// direction.
@@ -77,31 +92,36 @@ public:
         steps[ 2 ] = nz_ - 1;
     }
 
-    /// Return grid values as an array of doubles.
-    const std::vector< double >& GetValues( const std::string& key ) const
+    /// Return grid values, x varying fastest; the array is reference counted
+    /// and can be assigned to vtkImageData scalars but must not be modified.
+    /// Grids added as file sections are decoded here on first access.
+    vtkDoubleArray* GetValues( const std::string& key ) const
     {
-        assert( values_.find( key ) != values_.end() );
-        return values_.find( key )->second;
+        Grid::const_iterator i = values_.find( key );
+        if( i == values_.end() ) return DecodeSection( key );
+        if( lastUse_.find( key ) != lastUse_.end() ) lastUse_[ key ] = ++useCount_;
+        return i->second;
     }
 
     /// Returns point at position i, j, k in the grid.
     double GetValue( const std::string& key, int i, int j, int k ) const
     {
-        assert( values_.find( key ) != values_.end() );
-        const int idx = ComputeIndex( i, j, k );
-        return values_.find( key )->second[ idx ];
+        const size_t idx = ComputeIndex( i, j, k );
+        return GetValues( key )->GetValue( idx );
     }
 
-    /// Returns min value.
+    /// Returns min value; decodes the grid if never decoded.
     double GetMinValue( const std::string& key ) const
     {
+        if( min_.find( key ) == min_.end() ) GetValues( key );
         assert( min_.find( key ) != min_.end() );
         return min_.find( key )->second;
     }
 
-    /// Returns max value.
+    /// Returns max value; decodes the grid if never decoded.
     double GetMaxValue( const std::string& key ) const
     {
+        if( max_.find( key ) == max_.end() ) GetValues( key );
         assert( max_.find( key ) != max_.end() );
         return max_.find( key )->second;
     }
@@ -128,23 +148,46 @@ public:
     typedef std::vector< std::string > GridLabels;
     GridLabels GetGridLabels() const
     {
-        GridLabels labels;
-        labels.reserve( values_.size() );
-        typedef std::map< std::string, std::vector< double > > Grid;
+        std::set< std::string > labels;
         Grid::const_iterator i = values_.begin();
         const Grid::const_iterator end = values_.end();
-        for( ; i != end; ++i ) labels.push_back( i->first );
-        return labels;
+        for( ; i != end; ++i ) labels.insert( i->first );
+        Sections::const_iterator s = sections_.begin();
+        const Sections::const_iterator send = sections_.end();
+        for( ; s != send; ++s ) labels.insert( s->first );
+        return GridLabels( labels.begin(), labels.end() );
+    }
+
+    /// Sets the memory mapped file grid sections are decoded from; the
+    /// object takes ownership of the file.
+    void SetFile( MappedFile* file )
+    {
+        if( file == file_ ) return;
+        delete file_;
+        file_ = file;
+    }
+
+    /// Adds a grid whose values, x varying fastest, are the whitespace
+    /// separated numbers in [begin, end), a range of the mapped file.
+    void AddSection( const std::string& key, const char* begin, const char* end )
+    {
+        Section& s = sections_[ key ];
+        s.begin = begin;
+        s.end = end;
     }
 
+    /// Sets the maximum number of grids decoded from file sections kept in
+    /// memory; least recently used grids are released first.
+    void SetMaxCachedGrids( int n ) { maxCachedGrids_ = std::max( n, 1 ); }
+
 
     /// Reserve data in value vector.
-    void Reserve( const std::string& key, int size ) { values_[ key ].reserve( size ); }
+    void Reserve( const std::string& key, int size ) { GetArray( key )->Allocate( size ); }
 
     /// Append value to value vector.
     void AddValue( const std::string& key, double v )
     {
-        values_[ key ].push_back( v );
+        GetArray( key )->InsertNextValue( v );
         if( v < min_[ key ] ) min_[ key ] = v;
         if( v > max_[ key ] ) max_[ key ] = v;
     }
@@ -168,9 +211,17 @@ public:
     /// Set value vector.
     void SetValues( const std::string& key, const std::vector< double >& v )
     {
-        values_[ key ] = v;
-        min_[ key ] = *std::min_element( values_[ key ].begin(), values_[ key ].end() );
-        max_[ key ] = *std::max_element( values_[ key ].begin(), values_[ key ].end() );
+        vtkSmartPointer< vtkDoubleArray > a( vtkDoubleArray::New() );
+        a->Delete();
+        a->SetNumberOfValues( v.size() );
+        std::copy( v.begin(), v.end(), a->GetPointer( 0 ) );
+        SetValues( key, a );
+    }
+
+    /// Set values, x varying fastest; the array is shared, not copied.
+    void SetValues( const std::string& key, vtkDoubleArray* v )
+    {
+        AddGrid( key, v );
     }
 
     /// Set start point.
@@ -204,22 +255,98 @@ private:
     /// Number of symmetries.
     int numSymmetries_;
     /// Grid values.
-    std::map< std::string, std::vector< double > > values_;
+    typedef std::map< std::string, vtkSmartPointer< vtkDoubleArray > > Grid;
+    mutable Grid values_;
+    /// Location of grid values in the mapped file.
+    struct Section
+    {
+        const char* begin;
+        const char* end;
+        Section() : begin( 0 ), end( 0 ) {}
+    };
+    typedef std::map< std::string, Section > Sections;
+    /// Grids decoded on first access.
+    Sections sections_;
+    /// Mapped file sections are decoded from.
+    MappedFile* file_;
+    /// Default maximum number of grids decoded from file kept in memory.
+    enum { DEFAULT_MAX_CACHED_GRIDS = 16 };
+    /// Maximum number of grids decoded from file kept in memory.
+    int maxCachedGrids_;
+    /// Last access of each grid decoded from file and kept in memory.
+    mutable std::map< std::string, unsigned > lastUse_;
+    /// Access counter used to update lastUse_.
+    mutable unsigned useCount_;
     /// Start point.
     double startPoint_[ 3 ];
     /// Min value.
-    std::map< std::string, double > min_;
+    mutable std::map< std::string, double > min_;
     /// Max value.
-    std::map< std::string, double > max_;
+    mutable std::map< std::string, double > max_;
     /// Return vector index given i, j, k grid coordinates.
-    int ComputeIndex( int i, int j, int k ) const
+    size_t ComputeIndex( int i, int j, int k ) const
     {
         assert( i >= 0 && i < nx_ &&
                 j >= 0 && j < ny_ &&
                 k >= 0 && k < nz_ &&
                 "Grid index out of bounds" );
-        return  i + nx_ *( j +  ny_ * k );
+        return  i + nx_ *( j +  size_t( ny_ ) * k );
+    }
+    /// Stores grid values and computes min and max values.
+    void AddGrid( const std::string& key, vtkDoubleArray* v ) const
+    {
+        assert( v );
+        values_[ key ] = v;
+        const double* b = v->GetPointer( 0 );
+        const double* e = b + v->GetNumberOfTuples();
+        if( b == e ) return;
+        min_[ key ] = *std::min_element( b, e );
+        max_[ key ] = *std::max_element( b, e );
+    }
+    /// Decodes the values of a file section and releases the least recently
+    /// used decoded grids in excess of maxCachedGrids_; grids still
+    /// referenced by vtkImageData objects are released by the last user.
+    vtkDoubleArray* DecodeSection( const std::string& key ) const
+    {
+        Sections::const_iterator s = sections_.find( key );
+        assert( s != sections_.end() && file_ );
+        vtkSmartPointer< vtkDoubleArray > v( vtkDoubleArray::New() );
+        v->Delete();
+        v->SetNumberOfValues( GetNumberOfPoints() );
+        const int dims[ 3 ] = { nx_, ny_, nz_ };
+        if( !ParseGridValues( s->second.begin, s->second.end, dims, false, v->GetPointer( 0 ) ) )
+        {
+            OpenBabel::obErrorLog.ThrowError( __FUNCTION__, "Invalid values in grid " + key,
+                                              OpenBabel::obWarning );
+            std::fill( v->GetPointer( 0 ), v->GetPointer( 0 ) + GetNumberOfPoints(), 0. );
+        }
+        while( int( lastUse_.size() ) >= maxCachedGrids_ )
+        {
+            std::map< std::string, unsigned >::iterator lru = lastUse_.begin();
+            std::map< std::string, unsigned >::iterator i = lastUse_.begin();
+            for( ; i != lastUse_.end(); ++i ) if( i->second < lru->second ) lru = i;
+            values_.erase( lru->first );
+            lastUse_.erase( lru );
+        }
+        AddGrid( key, v );
+        lastUse_[ key ] = ++useCount_;
+        return v;
+    }
+    /// Returns the value array of a grid, created if not present.
+    vtkDoubleArray* GetArray( const std::string& key )
+    {
+        vtkSmartPointer< vtkDoubleArray >& a = values_[ key ];
+        if( a == 0 )
+        {
+            a = vtkDoubleArray::New();
+            a->Delete();
+        }
+        return a;
     }
+    /// Disable copy constructor: the mapped file is owned.
+    OBT41Data( const OBT41Data& );
+    /// Disable assignment.
+    OBT41Data& operator=( const OBT41Data& );
 };
 
 
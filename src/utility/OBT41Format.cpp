@@ -30,6 +30,8 @@
 #include <openbabel/obmolecformat.h>
 
 #include "OBT41Data.h"
+#include "MappedFile.h"
+#include "TextScanner.h"
 
 using namespace std;
 using namespace OpenBabel;
@@ -171,6 +173,10 @@ private:
     ///Read SumFrag grids.
     bool ReadSumFragGrid( istream& is, OBT41Data& t41Data ) const;
 
+    ///Index the SCF orbital, SCF and SumFrag grids of a memory mapped file:
+    ///grid values are decoded only when first requested.
+    void IndexGridSections( const char* begin, const char* end, OBT41Data& t41Data ) const;
+
 };
 
 //------------------------------------------------------------------------------
@@ -208,17 +214,33 @@ bool OBT41Format::ReadMolecule( OBBase* pOb, OBConversion* pConv )
        t41Data->SetStartPoint( gd.startPoint );
        t41Data->SetUnrestricted( gd.unrestricted );
        t41Data->SetNumSymmetries( gd.numSymmetries );
-       streampos current = ifs.tellg();
-       while( ReadSCFOrbitalGrid( ifs, *t41Data ) );
-       ifs.clear();
-       ifs.seekg( current, ios::beg );
-       while( ReadSCFGrid( ifs, *t41Data ) );
-       ifs.clear();
-       ifs.seekg( current, ios::beg );
-       while( ReadSumFragGrid( ifs, *t41Data ) );
+       // index the grids of the memory mapped file starting from the current
+       // stream position, as the stream readers below do; read all the grids
+       // from the stream if the input is not a file
+       MappedFile* file = new MappedFile( pConv->GetInFilename() );
+       if( file->IsMapped() )
+       {
+           const streamoff size = file->End() - file->Begin();
+           streamoff offset = ifs.tellg();
+           if( offset < 0 || offset > size ) offset = 0;
+           IndexGridSections( file->Begin() + offset, file->End(), *t41Data );
+           t41Data->SetFile( file );
+       }
+       else
+       {
+           delete file;
+           streampos current = ifs.tellg();
+           while( ReadSCFOrbitalGrid( ifs, *t41Data ) );
+           ifs.clear();
+           ifs.seekg( current, ios::beg );
+           while( ReadSCFGrid( ifs, *t41Data ) );
+           ifs.clear();
+           ifs.seekg( current, ios::beg );
+           while( ReadSumFragGrid( ifs, *t41Data ) );
+           ifs.clear();
+           ifs.seekg( current, ios::beg );
+       }
        pmol->SetData( t41Data );
-       ifs.clear();
-       ifs.seekg( current, ios::beg );
     }
 
     string buf;
@@ -443,6 +465,18 @@ OBT41Format::GridData OBT41Format::ReadGridData( istream& is ) const
     return gd;
 }
 
+//------------------------------------------------------------------------------
+/// Returns a new array of numPoints grid values, referenced by the returned
+/// smart pointer only; values are read directly into the array, which is then
+/// shared by OBT41Data and by the vtkImageData objects created from it.
+inline vtkSmartPointer< vtkDoubleArray > NewGridArray( int numPoints )
+{
+    vtkSmartPointer< vtkDoubleArray > a( vtkDoubleArray::New() );
+    a->Delete();
+    a->SetNumberOfValues( numPoints );
+    return a;
+}
+
 //------------------------------------------------------------------------------
 inline bool IsNum( const string& s )
 {
@@ -458,6 +492,52 @@ inline bool IsNum( const string& s )
     return isnum;
 }
 
+//------------------------------------------------------------------------------
+/// Finds the next whitespace separated token in [p, end) and stores a
+/// pointer to its first character into token.
+/// Returns pointer to the character following the token or null if no token
+/// is found.
+inline const char* NextToken( const char* p, const char* end, const char*& token )
+{
+    p = SkipWhitespace( p, end );
+    if( p == end ) return 0;
+    token = p;
+    while( p != end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' ) ++p;
+    return p;
+}
+
+//------------------------------------------------------------------------------
+void OBT41Format::IndexGridSections( const char* begin, const char* end, OBT41Data& t41Data ) const
+{
+    // same sections as ReadSCFOrbitalGrid, ReadSCFGrid and ReadSumFragGrid:
+    // - 'SCF_*' followed by the orbital number
+    // - 'SCF' followed by the grid name
+    // - 'SumFrag' followed by the grid name
+    // the line after the label is skipped and the grid values follow
+    const int numPoints = t41Data.GetNumberOfPoints();
+    const char* token = 0;
+    const char* p = begin;
+    string tag;
+    while( ( p = NextToken( p, end, token ) ) != 0 )
+    {
+        if( *token != 'S' ) continue;
+        tag.assign( token, p );
+        const bool scf = tag == "SCF";
+        const bool scfOrbital = tag.size() > 3 && tag.compare( 0, 3, "SCF" ) == 0;
+        if( !scf && !scfOrbital && tag != "SumFrag" ) continue;
+        const char* next = NextToken( p, end, token );
+        if( next == 0 ) break;
+        const string name( token, next );
+        if( scfOrbital && !IsNum( name ) ) continue;
+        p = SkipLine( SkipLine( next, end ), end );
+        const char* values = p;
+        for( int i = 0; i != numPoints && p; ++i ) p = NextToken( p, end, token );
+        if( p == 0 ) break;
+        t41Data.AddSection( tag + ' ' + name, values, p );
+    }
+}
+
+//------------------------------------------------------------------------------
 bool OBT41Format::ReadSCFOrbitalGrid( istream& is, OBT41Data& t41Data ) const
 {
     //find next tag starting with 'SCF'
@@ -491,12 +571,13 @@ bool OBT41Format::ReadSCFOrbitalGrid( istream& is, OBT41Data& t41Data ) const
     // read grid values
     const string label = scf + ' ' + buf; cout << label << endl;
     const int numPoints = t41Data.GetNumberOfPoints();
-    vector< double > grid( numPoints );
     eol( is );
     if( !is ) return false;
+    vtkSmartPointer< vtkDoubleArray > grid( NewGridArray( numPoints ) );
+    double* values = grid->GetPointer( 0 );
     for( int i = 0; i != numPoints; ++i )
     {
-        is >> grid[ i ];
+        is >> values[ i ];
     }
     t41Data.SetValues( label, grid );
     return true;
@@ -517,9 +598,10 @@ bool OBT41Format::ReadSCFGrid( istream& is, OBT41Data& t41Data ) const
     if( !is ) return false;
     // read grid data
     const int numPoints = t41Data.GetNumberOfPoints();
-    vector< double > grid( numPoints );
+    vtkSmartPointer< vtkDoubleArray > grid( NewGridArray( numPoints ) );
+    double* values = grid->GetPointer( 0 );
     int i = 0;
-    for( ; i != numPoints; ++i ) is >> grid[ i ];
+    for( ; i != numPoints; ++i ) is >> values[ i ];
     t41Data.SetValues( label, grid );
     return true;   
 }
@@ -538,9 +620,10 @@ bool OBT41Format::ReadSumFragGrid( istream& is, OBT41Data& t41Data ) const
     eol( is );
     if( !is ) return false;
     const int numPoints = t41Data.GetNumberOfPoints();
-    vector< double > grid( numPoints );
+    vtkSmartPointer< vtkDoubleArray > grid( NewGridArray( numPoints ) );
+    double* values = grid->GetPointer( 0 );
     int i = 0;
-    for( ; i != numPoints; ++i ) is >> grid[ i ];
+    for( ; i != numPoints; ++i ) is >> values[ i ];
     t41Data.SetValues( label, grid );
     return true;
 }
@@ -0,0 +1,147 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <algorithm>
+
+// VTK
+#include <vtkImageData.h>
+#include <vtkPolyData.h>
+#include <vtkAppendPolyData.h>
+#include <vtkCleanPolyData.h>
+
+#include "OutOfCoreGrid.h"
+#include "System.h"
+#include "ParallelMarchingCubes.h"
+
+//------------------------------------------------------------------------------
+OutOfCoreGrid::OutOfCoreGrid( const int dims[ 3 ],
+                              const double origin[ 3 ],
+                              const double spacing[ 3 ] ) :
+    fileName_( GetTemporaryFileName() ), file_( 0 ), numSlabs_( 0 )
+{
+    for( int i = 0; i != 3; ++i )
+    {
+        dims_[ i ] = dims[ i ];
+        origin_[ i ] = origin[ i ];
+        spacing_[ i ] = spacing[ i ];
+    }
+    if( fileName_.size() ) file_ = std::fopen( fileName_.c_str(), "w+b" );
+}
+
+//------------------------------------------------------------------------------
+OutOfCoreGrid::~OutOfCoreGrid()
+{
+    if( file_ == 0 ) return;
+    std::fclose( file_ );
+    DeleteFile( fileName_ );
+}
+
+//------------------------------------------------------------------------------
+bool OutOfCoreGrid::AppendSlabs( const float* values, int numSlabs )
+{
+    if( file_ == 0 || numSlabs_ + numSlabs > dims_[ 2 ] ) return false;
+    const size_t n = size_t( numSlabs ) * dims_[ 0 ] * dims_[ 1 ];
+    if( std::fwrite( values, sizeof( float ), n, file_ ) != n ) return false;
+    numSlabs_ += numSlabs;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool OutOfCoreGrid::ExtractIsoSurfaces( const std::vector< double >& values,
+                                        int slabsPerTile,
+                                        std::vector< vtkSmartPointer< vtkPolyData > >& surfaces )
+{
+    surfaces.clear();
+    if( file_ == 0 || numSlabs_ != dims_[ 2 ] || numSlabs_ < 2 ) return false;
+    if( std::fflush( file_ ) != 0 || std::fseek( file_, 0, SEEK_SET ) != 0 ) return false;
+    slabsPerTile = std::max( slabsPerTile, 1 );
+    const size_t sliceSize = size_t( dims_[ 0 ] ) * dims_[ 1 ];
+
+    std::vector< vtkSmartPointer< vtkAppendPolyData > > append;
+    for( std::vector< double >::size_type v = 0; v != values.size(); ++v )
+    {
+        append.push_back( vtkAppendPolyData::New() );
+        append.back()->Delete();
+    }
+    // last slab of previous tile, replicated as the first slab of the next
+    // tile to generate the triangles of the cells between the two tiles
+    std::vector< float > lastSlab;
+    int slab = 0; // next slab to read from file
+    while( slab < numSlabs_ )
+    {
+        const int n = std::min( slabsPerTile, numSlabs_ - slab );
+        const int first = slab == 0 ? 0 : slab - 1;
+        const int tileSlabs = slab - first + n;
+        vtkSmartPointer< vtkImageData > tile( vtkImageData::New() );
+        tile->Delete();
+        tile->SetDimensions( dims_[ 0 ], dims_[ 1 ], tileSlabs );
+        tile->SetOrigin( origin_[ 0 ], origin_[ 1 ], origin_[ 2 ] + first * spacing_[ 2 ] );
+        tile->SetSpacing( spacing_[ 0 ], spacing_[ 1 ], spacing_[ 2 ] );
+        tile->SetScalarTypeToFloat();
+        tile->SetNumberOfScalarComponents( 1 );
+        tile->AllocateScalars();
+        float* tileValues = static_cast< float* >( tile->GetScalarPointer() );
+        if( !lastSlab.empty() )
+        {
+            std::copy( lastSlab.begin(), lastSlab.end(), tileValues );
+            tileValues += sliceSize;
+        }
+        if( std::fread( tileValues, sizeof( float ), n * sliceSize, file_ ) != n * sliceSize ) return false;
+        slab += n;
+        lastSlab.assign( tileValues + ( n - 1 ) * sliceSize, tileValues + n * sliceSize );
+        if( tileSlabs < 2 ) continue;
+        // all the surfaces are extracted with a single pass over the tile; the
+        // extracted poly data do not reference the tile released at the next
+        // iteration
+        std::vector< vtkSmartPointer< vtkPolyData > > tileSurfaces;
+        if( !::ExtractIsoSurfaces( tile, values, tileSurfaces ) ) return false;
+        for( std::vector< double >::size_type v = 0; v != values.size(); ++v )
+        {
+            append[ v ]->AddInput( tileSurfaces[ v ] );
+        }
+    }
+
+    // vertices on the slabs shared by two tiles are computed twice from the
+    // same values: merge them with a tolerance small enough to only catch
+    // round-off differences caused by the different tile origins
+    const double tolerance =
+        1.0e-4 * std::min( spacing_[ 0 ], std::min( spacing_[ 1 ], spacing_[ 2 ] ) );
+    for( std::vector< double >::size_type v = 0; v != values.size(); ++v )
+    {
+        vtkSmartPointer< vtkCleanPolyData > clean( vtkCleanPolyData::New() );
+        clean->Delete();
+        clean->SetInputConnection( append[ v ]->GetOutputPort() );
+        clean->ToleranceIsAbsoluteOn();
+        clean->SetAbsoluteTolerance( tolerance );
+        clean->ConvertPolysToLinesOff();
+        clean->ConvertLinesToPointsOff();
+        clean->Update();
+        vtkSmartPointer< vtkPolyData > surface( vtkPolyData::New() );
+        surface->Delete();
+        surface->DeepCopy( clean->GetOutput() );
+        surfaces.push_back( surface );
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef OUTOFCOREGRID_H_
+#define OUTOFCOREGRID_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// VTK
+#include <vtkSmartPointer.h>
+
+class vtkPolyData;
+
+/// Regular grid of float values stored in a temporary file instead of memory.
+/// The grid is written one group of z slabs at a time, in increasing z order,
+/// and read back sequentially one tile of slabs at a time to extract
+/// isosurfaces: only one tile is resident in memory at any time.
+/// The temporary file is deleted when the object is destroyed.
+class OutOfCoreGrid
+{
+public:
+    /// Constructor: creates the temporary file; use IsOpen() to check for errors.
+    /// @param dims number of grid points along x, y and z
+    /// @param origin position of the first grid point
+    /// @param spacing distance between grid points along x, y and z
+    OutOfCoreGrid( const int dims[ 3 ], const double origin[ 3 ], const double spacing[ 3 ] );
+    /// Destructor: closes and deletes the temporary file.
+    ~OutOfCoreGrid();
+    /// Returns true if the temporary file was successfully created.
+    bool IsOpen() const { return file_ != 0; }
+    /// Returns the number of z slabs written so far.
+    int GetNumberOfSlabs() const { return numSlabs_; }
+    /// Appends numSlabs z slabs, x varying fastest, to the grid.
+    /// Returns false in case of write error.
+    bool AppendSlabs( const float* values, int numSlabs );
+    /// Extracts one isosurface per value from the complete grid.
+    /// Surfaces are computed with marching cubes on tiles of slabsPerTile
+    /// slabs, all the surfaces with a single pass over each tile; consecutive
+    /// tiles share one slab and the duplicated vertices on the shared slabs
+    /// are merged.
+    /// Returns false in case of read error or if the grid is not complete.
+    bool ExtractIsoSurfaces( const std::vector< double >& values,
+                             int slabsPerTile,
+                             std::vector< vtkSmartPointer< vtkPolyData > >& surfaces );
+private:
+    /// Temporary file path.
+    std::string fileName_;
+    /// Temporary file.
+    FILE* file_;
+    /// Number of grid points along x, y and z.
+    int dims_[ 3 ];
+    /// Position of first grid point.
+    double origin_[ 3 ];
+    /// Grid spacing.
+    double spacing_[ 3 ];
+    /// Number of z slabs written.
+    int numSlabs_;
+    /// Disable copy constructor.
+    OutOfCoreGrid( const OutOfCoreGrid& );
+    /// Disable assignment.
+    OutOfCoreGrid& operator=( const OutOfCoreGrid& );
+};
+
+#endif /*OUTOFCOREGRID_H_*/
@@ -0,0 +1,808 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// VTK
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkCellArray.h>
+#include <vtkPointData.h>
+
+#include "ParallelMarchingCubes.h"
+
+namespace
+{
+    /// Max number of triangles generated in a cell: a cell has 12 edges and
+    /// each polygon with n vertices generates n - 2 triangles.
+    const int MAX_CELL_TRIANGLES = 10;
+
+    /// Corner c of a cell is at ( c & 1, ( c >> 1 ) & 1, ( c >> 2 ) & 1 ).
+    /// Edges 0-3 are parallel to x, 4-7 to y and 8-11 to z.
+    const int EDGE_CORNERS[ 12 ][ 2 ] = { { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },
+                                          { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+                                          { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+
+    /// Corners of the six cell faces, in cyclic order.
+    const int FACE_CORNERS[ 6 ][ 4 ] = { { 0, 2, 6, 4 }, { 1, 3, 7, 5 },
+                                         { 0, 1, 5, 4 }, { 2, 3, 7, 6 },
+                                         { 0, 1, 3, 2 }, { 4, 5, 7, 6 } };
+
+    /// Outward normals of the six cell faces.
+    const int FACE_NORMALS[ 6 ][ 3 ] = { { -1, 0, 0 }, { 1, 0, 0 },
+                                         { 0, -1, 0 }, { 0, 1, 0 },
+                                         { 0, 0, -1 }, { 0, 0, 1 } };
+
+    //--------------------------------------------------------------------------
+    /// Returns the edge connecting two corners.
+    int Edge( int c0, int c1 )
+    {
+        for( int e = 0; e != 12; ++e )
+        {
+            if( ( EDGE_CORNERS[ e ][ 0 ] == c0 && EDGE_CORNERS[ e ][ 1 ] == c1 ) ||
+                ( EDGE_CORNERS[ e ][ 0 ] == c1 && EDGE_CORNERS[ e ][ 1 ] == c0 ) ) return e;
+        }
+        assert( false && "Not an edge" );
+        return -1;
+    }
+
+    //--------------------------------------------------------------------------
+    /// Triangulation of the 256 cell cases; bit c of the case index is set if
+    /// the value at corner c is greater than or equal to the isovalue.
+    /// The surface crosses each face along segments separating the corners
+    /// above the value from the ones below; segments are oriented with the
+    /// corners above the value on the same side and joined into closed
+    /// polygons through the edges shared by two faces, polygons are then
+    /// triangulated as fans. Triangles are counterclockwise as seen from the
+    /// side of the values below the isovalue.
+    struct CaseTable
+    {
+        /// Number of triangles of each case.
+        int numTriangles[ 256 ];
+        /// Edges crossed by the vertices of each triangle.
+        int edges[ 256 ][ 3 * MAX_CELL_TRIANGLES ];
+        /// Constructor: generates the table.
+        CaseTable()
+        {
+            // order face corners counterclockwise as seen from outside the cell
+            int faces[ 6 ][ 4 ];
+            for( int f = 0; f != 6; ++f )
+            {
+                int p[ 3 ][ 3 ];
+                for( int c = 0; c != 3; ++c )
+                {
+                    const int corner = FACE_CORNERS[ f ][ c ];
+                    p[ c ][ 0 ] = corner & 1;
+                    p[ c ][ 1 ] = ( corner >> 1 ) & 1;
+                    p[ c ][ 2 ] = ( corner >> 2 ) & 1;
+                }
+                const int u[ 3 ] = { p[ 1 ][ 0 ] - p[ 0 ][ 0 ], p[ 1 ][ 1 ] - p[ 0 ][ 1 ], p[ 1 ][ 2 ] - p[ 0 ][ 2 ] };
+                const int v[ 3 ] = { p[ 2 ][ 0 ] - p[ 1 ][ 0 ], p[ 2 ][ 1 ] - p[ 1 ][ 1 ], p[ 2 ][ 2 ] - p[ 1 ][ 2 ] };
+                const int n[ 3 ] = { u[ 1 ] * v[ 2 ] - u[ 2 ] * v[ 1 ],
+                                     u[ 2 ] * v[ 0 ] - u[ 0 ] * v[ 2 ],
+                                     u[ 0 ] * v[ 1 ] - u[ 1 ] * v[ 0 ] };
+                const bool ccw = n[ 0 ] * FACE_NORMALS[ f ][ 0 ] +
+                                 n[ 1 ] * FACE_NORMALS[ f ][ 1 ] +
+                                 n[ 2 ] * FACE_NORMALS[ f ][ 2 ] > 0;
+                for( int c = 0; c != 4; ++c ) faces[ f ][ c ] = FACE_CORNERS[ f ][ ccw ? c : 3 - c ];
+            }
+            for( int index = 0; index != 256; ++index )
+            {
+                // next[ e ]: edge following edge e in the polygon
+                int next[ 12 ];
+                std::fill( next, next + 12, -1 );
+                for( int f = 0; f != 6; ++f )
+                {
+                    const int* q = faces[ f ];
+                    for( int c = 0; c != 4; ++c )
+                    {
+                        const bool above0 = ( index >> q[ c ] ) & 1;
+                        const bool above1 = ( index >> q[ ( c + 1 ) % 4 ] ) & 1;
+                        if( above0 || !above1 ) continue;
+                        // start of a sequence of corners above the value: find the end
+                        int last = ( c + 1 ) % 4;
+                        while( ( index >> q[ ( last + 1 ) % 4 ] ) & 1 ) last = ( last + 1 ) % 4;
+                        next[ Edge( q[ c ], q[ ( c + 1 ) % 4 ] ) ] = Edge( q[ last ], q[ ( last + 1 ) % 4 ] );
+                    }
+                }
+                numTriangles[ index ] = 0;
+                bool visited[ 12 ] = { false, false, false, false, false, false,
+                                       false, false, false, false, false, false };
+                for( int e = 0; e != 12; ++e )
+                {
+                    if( next[ e ] < 0 || visited[ e ] ) continue;
+                    int polygon[ 12 ];
+                    int size = 0;
+                    for( int p = e; !visited[ p ]; p = next[ p ] )
+                    {
+                        visited[ p ] = true;
+                        polygon[ size++ ] = p;
+                    }
+                    for( int t = 1; t < size - 1; ++t )
+                    {
+                        int* tri = edges[ index ] + 3 * numTriangles[ index ]++;
+                        tri[ 0 ] = polygon[ 0 ];
+                        tri[ 1 ] = polygon[ t ];
+                        tri[ 2 ] = polygon[ t + 1 ];
+                    }
+                }
+                assert( numTriangles[ index ] <= MAX_CELL_TRIANGLES );
+            }
+        }
+    };
+
+    /// Case table, generated at startup.
+    const CaseTable CASES;
+
+    //--------------------------------------------------------------------------
+    /// Vertices on the x and y edges of a grid layer: pairs of edge index
+    /// ( i + nx * j for x edges, nx * ny + i + nx * j for y edges ) and vertex
+    /// id, sorted by edge index.
+    typedef std::vector< std::pair< int, int > > Seam;
+
+    //--------------------------------------------------------------------------
+    /// Part of the surface generated by a single slab; vertex ids are local
+    /// to the slab.
+    struct SlabMesh
+    {
+        /// Vertex coordinates.
+        std::vector< float > points;
+        /// Vertex normals.
+        std::vector< float > normals;
+        /// Vertex ids of each triangle.
+        std::vector< int > triangles;
+        /// Vertices on the x and y edges of the first grid layer of the slab.
+        Seam bottomSeam;
+        /// Vertices on the x and y edges of the last grid layer.
+        Seam topSeam;
+        /// Ids of the vertices in the merged mesh.
+        std::vector< int > globalIds;
+    };
+
+    //--------------------------------------------------------------------------
+    /// Ids of the vertices on the edges of the cell layer being processed,
+    /// for one isovalue.
+    /// Tables are not cleared between layers: vertex ids increase during the
+    /// extraction and an entry is valid only if not lower than the number of
+    /// vertices generated before the first layer which could have written it.
+    /// Tables only cover the window of grid points [ x0, x0 + width ) x
+    /// [ y0, y0 + height ) containing the cells visited by the slab.
+    struct LayerEdges
+    {
+        /// First grid point of the window along x.
+        int x0;
+        /// First grid point of the window along y.
+        int y0;
+        /// Number of grid points of the window along x.
+        int width;
+        /// Number of grid points of the window along y.
+        int height;
+        /// x edges followed by y edges of the lower grid layer.
+        std::vector< int > lower;
+        /// x edges followed by y edges of the upper grid layer.
+        std::vector< int > upper;
+        /// z edges between the two grid layers.
+        std::vector< int > z;
+        /// First valid id of the lower layer.
+        int lowerFirst;
+        /// First valid id of the upper layer and of the z edges.
+        int upperFirst;
+    };
+
+    //--------------------------------------------------------------------------
+    /// Collects the valid entries ( not lower than first ) of the x and y
+    /// edge table of a grid layer with nx * ny points.
+    void CollectSeam( const std::vector< int >& layer, int first, const LayerEdges& edges,
+                      int nx, int ny, Seam& seam )
+    {
+        seam.clear();
+        const int windowSize = edges.width * edges.height;
+        for( int e = 0; e != int( layer.size() ); ++e )
+        {
+            if( layer[ e ] < first ) continue;
+            const int local = e < windowSize ? e : e - windowSize;
+            const int i = edges.x0 + local % edges.width;
+            const int j = edges.y0 + local / edges.width;
+            seam.push_back( std::make_pair( ( e < windowSize ? 0 : nx * ny ) + i + nx * j, layer[ e ] ) );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// Blocks of cells to visit; null to visit all the cells.
+    struct ActiveBlocks
+    {
+        /// Indices ( x + numBlocksX * y ) of the active blocks of each z layer
+        /// of blocks.
+        const std::vector< std::vector< int > >* layers;
+        /// Number of blocks along x.
+        int numBlocksX;
+    };
+
+    //--------------------------------------------------------------------------
+    /// Extracts the surfaces from the cells in a range of z cell layers;
+    /// the values of each cell are read once for all the isovalues.
+    template < class T >
+    class SlabExtractor
+    {
+    public:
+        SlabExtractor( const T* values, const int dims[ 3 ], const double origin[ 3 ],
+                       const double spacing[ 3 ], const std::vector< double >& isoValues,
+                       const ActiveBlocks* activeBlocks ) :
+            values_( values ), isoValues_( isoValues ), activeBlocks_( activeBlocks ),
+            nx_( dims[ 0 ] ), ny_( dims[ 1 ] ), nz_( dims[ 2 ] ),
+            sliceSize_( dims[ 0 ] * dims[ 1 ] )
+        {
+            for( int i = 0; i != 3; ++i )
+            {
+                origin_[ i ] = origin[ i ];
+                spacing_[ i ] = spacing[ i ];
+            }
+        }
+        /// Extracts the surfaces from cell layers [ firstLayer, endLayer );
+        /// meshes[ v ] receives the surface of isovalue v.
+        void Extract( int firstLayer, int endLayer, std::vector< SlabMesh* >& meshes ) const
+        {
+            const int numValues = int( isoValues_.size() );
+            int window[ 4 ];
+            if( !GetWindow( firstLayer, endLayer, window ) ) return;
+            const int width = window[ 1 ] - window[ 0 ] + 1;
+            const int height = window[ 3 ] - window[ 2 ] + 1;
+            std::vector< LayerEdges > edges( numValues );
+            for( int v = 0; v != numValues; ++v )
+            {
+                edges[ v ].x0 = window[ 0 ];
+                edges[ v ].y0 = window[ 2 ];
+                edges[ v ].width = width;
+                edges[ v ].height = height;
+                edges[ v ].lower.assign( 2 * width * height, -1 );
+                edges[ v ].upper.assign( 2 * width * height, -1 );
+                edges[ v ].z.assign( width * height, -1 );
+                edges[ v ].lowerFirst = 0;
+            }
+            for( int k = firstLayer; k != endLayer; ++k )
+            {
+                for( int v = 0; v != numValues; ++v )
+                {
+                    edges[ v ].upperFirst = int( meshes[ v ]->points.size() / 3 );
+                }
+                if( activeBlocks_ == 0 ) ExtractCells( 0, nx_ - 1, 0, ny_ - 1, k, edges, meshes );
+                else
+                {
+                    const int b = IsoSurfaceIndex::BLOCK_SIZE;
+                    const std::vector< int >& blocks = ( *activeBlocks_->layers )[ k / b ];
+                    for( std::vector< int >::const_iterator i = blocks.begin(); i != blocks.end(); ++i )
+                    {
+                        const int bx = *i % activeBlocks_->numBlocksX;
+                        const int by = *i / activeBlocks_->numBlocksX;
+                        ExtractCells( bx * b, std::min( ( bx + 1 ) * b, nx_ - 1 ),
+                                      by * b, std::min( ( by + 1 ) * b, ny_ - 1 ),
+                                      k, edges, meshes );
+                    }
+                }
+                for( int v = 0; v != numValues; ++v )
+                {
+                    LayerEdges& e = edges[ v ];
+                    if( k == firstLayer ) CollectSeam( e.lower, 0, e, nx_, ny_, meshes[ v ]->bottomSeam );
+                    e.lower.swap( e.upper );
+                    e.lowerFirst = e.upperFirst;
+                }
+            }
+            for( int v = 0; v != numValues; ++v )
+            {
+                CollectSeam( edges[ v ].lower, edges[ v ].lowerFirst, edges[ v ], nx_, ny_,
+                             meshes[ v ]->topSeam );
+            }
+        }
+    private:
+        /// Computes the window of grid points containing the cells visited in
+        /// cell layers [ firstLayer, endLayer ): min and max point index along
+        /// x followed by min and max along y; the whole layer if all the cells
+        /// are visited. Returns false if no cell is visited.
+        bool GetWindow( int firstLayer, int endLayer, int window[ 4 ] ) const
+        {
+            if( activeBlocks_ == 0 )
+            {
+                window[ 0 ] = 0;
+                window[ 1 ] = nx_ - 1;
+                window[ 2 ] = 0;
+                window[ 3 ] = ny_ - 1;
+                return true;
+            }
+            const int b = IsoSurfaceIndex::BLOCK_SIZE;
+            window[ 0 ] = nx_;
+            window[ 1 ] = -1;
+            window[ 2 ] = ny_;
+            window[ 3 ] = -1;
+            for( int layer = firstLayer / b; layer <= ( endLayer - 1 ) / b; ++layer )
+            {
+                const std::vector< int >& blocks = ( *activeBlocks_->layers )[ layer ];
+                for( std::vector< int >::const_iterator i = blocks.begin(); i != blocks.end(); ++i )
+                {
+                    const int bx = *i % activeBlocks_->numBlocksX;
+                    const int by = *i / activeBlocks_->numBlocksX;
+                    window[ 0 ] = std::min( window[ 0 ], bx * b );
+                    window[ 1 ] = std::max( window[ 1 ], std::min( ( bx + 1 ) * b, nx_ - 1 ) );
+                    window[ 2 ] = std::min( window[ 2 ], by * b );
+                    window[ 3 ] = std::max( window[ 3 ], std::min( ( by + 1 ) * b, ny_ - 1 ) );
+                }
+            }
+            return window[ 1 ] >= 0;
+        }
+        /// Extracts the surfaces from the cells [ i0, i1 ) x [ j0, j1 ) of
+        /// cell layer k.
+        void ExtractCells( int i0, int i1, int j0, int j1, int k,
+                           std::vector< LayerEdges >& edges,
+                           std::vector< SlabMesh* >& meshes ) const
+        {
+            const int numValues = int( isoValues_.size() );
+            for( int j = j0; j < j1; ++j )
+            {
+                for( int i = i0; i < i1; ++i )
+                {
+                    const T* p = values_ + i + nx_ * ( j + ny_ * size_t( k ) );
+                    const T c[ 8 ] = { p[ 0 ], p[ 1 ], p[ nx_ ], p[ nx_ + 1 ],
+                                       p[ sliceSize_ ], p[ sliceSize_ + 1 ],
+                                       p[ sliceSize_ + nx_ ], p[ sliceSize_ + nx_ + 1 ] };
+                    const T cmin = *std::min_element( c, c + 8 );
+                    const T cmax = *std::max_element( c, c + 8 );
+                    for( int v = 0; v != numValues; ++v )
+                    {
+                        // cells not containing the isovalue generate no triangles
+                        if( cmax < isoValues_[ v ] || cmin >= isoValues_[ v ] ) continue;
+                        int index = 0;
+                        for( int corner = 0; corner != 8; ++corner )
+                        {
+                            if( c[ corner ] >= isoValues_[ v ] ) index |= 1 << corner;
+                        }
+                        const int* cellEdges = CASES.edges[ index ];
+                        for( int t = 0; t != 3 * CASES.numTriangles[ index ]; ++t )
+                        {
+                            meshes[ v ]->triangles.push_back(
+                                Vertex( cellEdges[ t ], i, j, k, c, isoValues_[ v ],
+                                        edges[ v ], *meshes[ v ] ) );
+                        }
+                    }
+                }
+            }
+        }
+        /// Returns the id of the vertex on edge e of cell ( i, j, k ), creating
+        /// the vertex if it doesn't exist yet.
+        int Vertex( int e, int i, int j, int k, const T c[ 8 ], double value,
+                    LayerEdges& edges, SlabMesh& mesh ) const
+        {
+            int* id = 0;
+            int first = edges.upperFirst;
+            // indices in the window
+            const int wi = i - edges.x0;
+            const int wj = j - edges.y0;
+            const int w = edges.width;
+            if( e < 8 )
+            {
+                std::vector< int >& layer = e & 2 ? edges.upper : edges.lower;
+                if( !( e & 2 ) ) first = edges.lowerFirst;
+                id = e < 4 ? &layer[ wi + w * ( wj + ( e & 1 ) ) ]
+                           : &layer[ w * edges.height + wi + ( e & 1 ) + w * wj ];
+            }
+            else id = &edges.z[ wi + ( e & 1 ) + w * ( wj + ( ( e >> 1 ) & 1 ) ) ];
+            if( *id >= first ) return *id;
+            *id = int( mesh.points.size() / 3 );
+            const int c0 = EDGE_CORNERS[ e ][ 0 ];
+            const int c1 = EDGE_CORNERS[ e ][ 1 ];
+            const double t = ( value - c[ c0 ] ) / ( double( c[ c1 ] ) - c[ c0 ] );
+            const int p0[ 3 ] = { i + ( c0 & 1 ), j + ( ( c0 >> 1 ) & 1 ), k + ( c0 >> 2 ) };
+            const int p1[ 3 ] = { i + ( c1 & 1 ), j + ( ( c1 >> 1 ) & 1 ), k + ( c1 >> 2 ) };
+            double g0[ 3 ];
+            double g1[ 3 ];
+            Gradient( p0, g0 );
+            Gradient( p1, g1 );
+            double n[ 3 ];
+            for( int a = 0; a != 3; ++a )
+            {
+                mesh.points.push_back( float( origin_[ a ] + spacing_[ a ] * ( p0[ a ] + t * ( p1[ a ] - p0[ a ] ) ) ) );
+                // normals point towards decreasing values
+                n[ a ] = -( g0[ a ] + t * ( g1[ a ] - g0[ a ] ) );
+            }
+            const double l = std::sqrt( n[ 0 ] * n[ 0 ] + n[ 1 ] * n[ 1 ] + n[ 2 ] * n[ 2 ] );
+            for( int a = 0; a != 3; ++a ) mesh.normals.push_back( float( l > 0. ? n[ a ] / l : 0. ) );
+            return *id;
+        }
+        /// Computes the gradient at a grid point with central differences,
+        /// one sided differences on the grid boundary.
+        void Gradient( const int p[ 3 ], double g[ 3 ] ) const
+        {
+            const int n[ 3 ] = { nx_, ny_, nz_ };
+            const size_t stride[ 3 ] = { 1, size_t( nx_ ), size_t( sliceSize_ ) };
+            const T* v = values_ + p[ 0 ] + stride[ 1 ] * p[ 1 ] + stride[ 2 ] * p[ 2 ];
+            for( int a = 0; a != 3; ++a )
+            {
+                const bool first = p[ a ] == 0;
+                const bool last = p[ a ] == n[ a ] - 1;
+                const T v0 = first ? v[ 0 ] : *( v - stride[ a ] );
+                const T v1 = last ? v[ 0 ] : v[ stride[ a ] ];
+                const int steps = ( first || last ) ? 1 : 2;
+                g[ a ] = ( double( v1 ) - v0 ) / ( steps * spacing_[ a ] );
+            }
+        }
+        const T* values_;
+        const std::vector< double >& isoValues_;
+        const ActiveBlocks* activeBlocks_;
+        double origin_[ 3 ];
+        double spacing_[ 3 ];
+        int nx_;
+        int ny_;
+        int nz_;
+        int sliceSize_;
+    };
+
+    //--------------------------------------------------------------------------
+    /// Extracts the surfaces in parallel, one slab of cell layers per task;
+    /// slabs[ v ][ s ] receives the part of surface v generated by slab s.
+    template < class T >
+    void ExtractSlabs( const T* values, const int dims[ 3 ], const double origin[ 3 ],
+                       const double spacing[ 3 ], const std::vector< double >& isoValues,
+                       const ActiveBlocks* activeBlocks,
+                       std::vector< std::vector< SlabMesh > >& slabs )
+    {
+        const int cellLayers = dims[ 2 ] - 1;
+        int numSlabs = 1;
+#ifdef _OPENMP
+        numSlabs = std::max( 1, std::min( cellLayers, 4 * omp_get_max_threads() ) );
+#endif
+        slabs.assign( isoValues.size(), std::vector< SlabMesh >( numSlabs ) );
+        const SlabExtractor< T > extractor( values, dims, origin, spacing, isoValues, activeBlocks );
+#ifdef _OPENMP
+#pragma omp parallel for schedule( dynamic, 1 )
+#endif
+        for( int s = 0; s < numSlabs; ++s )
+        {
+            std::vector< SlabMesh* > meshes( isoValues.size() );
+            for( std::vector< SlabMesh* >::size_type v = 0; v != meshes.size(); ++v )
+            {
+                meshes[ v ] = &slabs[ v ][ s ];
+            }
+            extractor.Extract( int( ( long long )( cellLayers ) * s / numSlabs ),
+                               int( ( long long )( cellLayers ) * ( s + 1 ) / numSlabs ),
+                               meshes );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// Merges the parts of a surface generated by the slabs into a new poly data.
+    vtkPolyData* MergeSlabs( std::vector< SlabMesh >& slabs )
+    {
+        const int numSlabs = int( slabs.size() );
+
+        // assign merged ids: vertices on the first layer of a slab are replaced
+        // by the same vertices generated by the previous slab
+        std::vector< int > pointOffsets( numSlabs + 1, 0 );
+        std::vector< int > triangleOffsets( numSlabs + 1, 0 );
+        for( int s = 0; s != numSlabs; ++s )
+        {
+            SlabMesh& m = slabs[ s ];
+            const int numPoints = int( m.points.size() / 3 );
+            m.globalIds.assign( numPoints, 0 );
+            if( s > 0 )
+            {
+                for( Seam::const_iterator i = m.bottomSeam.begin(); i != m.bottomSeam.end(); ++i )
+                {
+                    m.globalIds[ i->second ] = -1;
+                }
+            }
+            int id = pointOffsets[ s ];
+            for( int p = 0; p != numPoints; ++p )
+            {
+                if( m.globalIds[ p ] == 0 ) m.globalIds[ p ] = id++;
+            }
+            pointOffsets[ s + 1 ] = id;
+            triangleOffsets[ s + 1 ] = triangleOffsets[ s ] + int( m.triangles.size() / 3 );
+        }
+        for( int s = 1; s < numSlabs; ++s )
+        {
+            // both seams are sorted by edge index
+            const Seam& bottom = slabs[ s ].bottomSeam;
+            const Seam& top = slabs[ s - 1 ].topSeam;
+            Seam::const_iterator t = top.begin();
+            for( Seam::const_iterator b = bottom.begin(); b != bottom.end(); ++b )
+            {
+                while( t != top.end() && t->first < b->first ) ++t;
+                assert( t != top.end() && t->first == b->first );
+                slabs[ s ].globalIds[ b->second ] = slabs[ s - 1 ].globalIds[ t->second ];
+            }
+        }
+
+        // copy into arrays allocated with the final size
+        const int numPoints = pointOffsets[ numSlabs ];
+        const int numTriangles = triangleOffsets[ numSlabs ];
+        vtkSmartPointer< vtkFloatArray > coordinates( vtkFloatArray::New() );
+        coordinates->Delete();
+        coordinates->SetNumberOfComponents( 3 );
+        coordinates->SetNumberOfTuples( numPoints );
+        vtkSmartPointer< vtkFloatArray > normals( vtkFloatArray::New() );
+        normals->Delete();
+        normals->SetName( "Normals" );
+        normals->SetNumberOfComponents( 3 );
+        normals->SetNumberOfTuples( numPoints );
+        vtkSmartPointer< vtkIdTypeArray > cells( vtkIdTypeArray::New() );
+        cells->Delete();
+        cells->SetNumberOfValues( 4 * vtkIdType( numTriangles ) );
+        float* coordinatesPtr = coordinates->GetPointer( 0 );
+        float* normalsPtr = normals->GetPointer( 0 );
+        vtkIdType* cellsPtr = cells->GetPointer( 0 );
+#ifdef _OPENMP
+#pragma omp parallel for schedule( dynamic, 1 )
+#endif
+        for( int s = 0; s < numSlabs; ++s )
+        {
+            const SlabMesh& m = slabs[ s ];
+            const int firstNew = pointOffsets[ s ];
+            for( int p = 0; p != int( m.globalIds.size() ); ++p )
+            {
+                const int id = m.globalIds[ p ];
+                if( id < firstNew ) continue; // merged with a vertex of the previous slab
+                std::copy( &m.points[ 3 * p ], &m.points[ 3 * p ] + 3, coordinatesPtr + 3 * id );
+                std::copy( &m.normals[ 3 * p ], &m.normals[ 3 * p ] + 3, normalsPtr + 3 * id );
+            }
+            vtkIdType* cell = cellsPtr + 4 * vtkIdType( triangleOffsets[ s ] );
+            for( std::vector< int >::size_type t = 0; t != m.triangles.size(); t += 3, cell += 4 )
+            {
+                cell[ 0 ] = 3;
+                cell[ 1 ] = m.globalIds[ m.triangles[ t     ] ];
+                cell[ 2 ] = m.globalIds[ m.triangles[ t + 1 ] ];
+                cell[ 3 ] = m.globalIds[ m.triangles[ t + 2 ] ];
+            }
+        }
+
+        vtkSmartPointer< vtkPoints > points( vtkPoints::New() );
+        points->Delete();
+        points->SetData( coordinates );
+        vtkSmartPointer< vtkCellArray > polys( vtkCellArray::New() );
+        polys->Delete();
+        polys->SetCells( numTriangles, cells );
+        vtkPolyData* pd = vtkPolyData::New();
+        pd->SetPoints( points );
+        pd->SetPolys( polys );
+        pd->GetPointData()->SetNormals( normals );
+        return pd;
+    }
+
+    //--------------------------------------------------------------------------
+    /// Returns the grid itself if its scalars are float or double values with
+    /// a single component; otherwise returns a new grid with the same geometry
+    /// and the first scalar component converted to float, the component used
+    /// by vtkMarchingCubes. Returns null if the grid has no scalars.
+    vtkSmartPointer< vtkImageData > ToSupportedGrid( vtkImageData* grid )
+    {
+        assert( grid );
+        const int type = grid->GetScalarType();
+        if( grid->GetNumberOfScalarComponents() == 1 && ( type == VTK_FLOAT || type == VTK_DOUBLE ) )
+        {
+            return grid;
+        }
+        vtkDataArray* scalars = grid->GetPointData()->GetScalars();
+        if( scalars == 0 ) return 0;
+        vtkSmartPointer< vtkImageData > converted( vtkImageData::New() );
+        converted->Delete();
+        converted->CopyStructure( grid );
+        converted->SetScalarTypeToFloat();
+        converted->SetNumberOfScalarComponents( 1 );
+        converted->AllocateScalars();
+        float* values = static_cast< float* >( converted->GetScalarPointer() );
+        const vtkIdType n = scalars->GetNumberOfTuples();
+        for( vtkIdType i = 0; i != n; ++i ) values[ i ] = float( scalars->GetComponent( i, 0 ) );
+        return converted;
+    }
+
+    //--------------------------------------------------------------------------
+    /// Extracts the surfaces from the active blocks of a grid, or from the
+    /// whole grid if activeBlocks is null.
+    bool ExtractGridIsoSurfaces( vtkImageData* inputGrid,
+                                 const std::vector< double >& values,
+                                 const ActiveBlocks* activeBlocks,
+                                 std::vector< vtkSmartPointer< vtkPolyData > >& surfaces )
+    {
+        assert( inputGrid );
+        surfaces.clear();
+        const vtkSmartPointer< vtkImageData > grid = ToSupportedGrid( inputGrid );
+        if( grid == 0 ) return false;
+        int dims[ 3 ];
+        double origin[ 3 ];
+        double spacing[ 3 ];
+        grid->GetDimensions( dims );
+        grid->GetOrigin( origin );
+        grid->GetSpacing( spacing );
+        std::vector< std::vector< SlabMesh > > slabs( values.size() );
+        if( dims[ 0 ] > 1 && dims[ 1 ] > 1 && dims[ 2 ] > 1 )
+        {
+            switch( grid->GetScalarType() )
+            {
+            case VTK_FLOAT: ExtractSlabs( static_cast< const float* >( grid->GetScalarPointer() ),
+                                          dims, origin, spacing, values, activeBlocks, slabs );
+                            break;
+            case VTK_DOUBLE: ExtractSlabs( static_cast< const double* >( grid->GetScalarPointer() ),
+                                           dims, origin, spacing, values, activeBlocks, slabs );
+                             break;
+            default: return false;
+            }
+        }
+        for( std::vector< double >::size_type v = 0; v != values.size(); ++v )
+        {
+            vtkSmartPointer< vtkPolyData > pd( MergeSlabs( slabs[ v ] ) );
+            pd->Delete();
+            surfaces.push_back( pd );
+            std::vector< SlabMesh >().swap( slabs[ v ] ); // release memory
+        }
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    /// Computes the range of the values at the cell corners of each block.
+    template < class T >
+    void ComputeBlockRanges( const T* values, const int dims[ 3 ], const int numBlocks[ 3 ],
+                             std::vector< IsoSurfaceIndex::BlockRange >& blocks )
+    {
+        const int b = IsoSurfaceIndex::BLOCK_SIZE;
+        const int blocksPerLayer = numBlocks[ 0 ] * numBlocks[ 1 ];
+        const int n = blocksPerLayer * numBlocks[ 2 ];
+        const size_t sliceSize = size_t( dims[ 0 ] ) * dims[ 1 ];
+        blocks.resize( n );
+#ifdef _OPENMP
+#pragma omp parallel for schedule( dynamic, 16 )
+#endif
+        for( int block = 0; block < n; ++block )
+        {
+            const int first[ 3 ] = { b * ( block % numBlocks[ 0 ] ),
+                                     b * ( ( block % blocksPerLayer ) / numBlocks[ 0 ] ),
+                                     b * ( block / blocksPerLayer ) };
+            // last grid point of the block: blocks share the points on their faces
+            int last[ 3 ];
+            for( int a = 0; a != 3; ++a ) last[ a ] = std::min( first[ a ] + b, dims[ a ] - 1 );
+            T minValue = values[ first[ 0 ] + dims[ 0 ] * first[ 1 ] + sliceSize * first[ 2 ] ];
+            T maxValue = minValue;
+            for( int k = first[ 2 ]; k <= last[ 2 ]; ++k )
+            {
+                for( int j = first[ 1 ]; j <= last[ 1 ]; ++j )
+                {
+                    const T* row = values + dims[ 0 ] * size_t( j ) + sliceSize * k;
+                    for( int i = first[ 0 ]; i <= last[ 0 ]; ++i )
+                    {
+                        minValue = std::min( minValue, row[ i ] );
+                        maxValue = std::max( maxValue, row[ i ] );
+                    }
+                }
+            }
+            blocks[ block ].min = minValue;
+            blocks[ block ].max = maxValue;
+            blocks[ block ].block = block;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+bool IsoSurfaceIndex::Build( vtkImageData* inputGrid )
+{
+    assert( inputGrid );
+    Clear();
+    // the index keeps the converted grid, if any
+    const vtkSmartPointer< vtkImageData > grid = ToSupportedGrid( inputGrid );
+    if( grid == 0 ) return false;
+    int dims[ 3 ];
+    grid->GetDimensions( dims );
+    for( int i = 0; i != 3; ++i )
+    {
+        numBlocks_[ i ] = dims[ i ] > 1 ? ( dims[ i ] - 2 ) / BLOCK_SIZE + 1 : 0;
+    }
+    switch( grid->GetScalarType() )
+    {
+    case VTK_FLOAT: ComputeBlockRanges( static_cast< const float* >( grid->GetScalarPointer() ),
+                                        dims, numBlocks_, blocks_ );
+                    break;
+    case VTK_DOUBLE: ComputeBlockRanges( static_cast< const double* >( grid->GetScalarPointer() ),
+                                         dims, numBlocks_, blocks_ );
+                     break;
+    default: Clear();
+             return false;
+    }
+    std::sort( blocks_.begin(), blocks_.end() );
+    grid_ = grid;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void IsoSurfaceIndex::Clear()
+{
+    grid_ = 0;
+    std::vector< BlockRange >().swap( blocks_ );
+    numBlocks_[ 0 ] = numBlocks_[ 1 ] = numBlocks_[ 2 ] = 0;
+}
+
+//------------------------------------------------------------------------------
+void IsoSurfaceIndex::GetActiveBlocks( const std::vector< double >& values,
+                                       std::vector< std::vector< int > >& layers ) const
+{
+    const int blocksPerLayer = numBlocks_[ 0 ] * numBlocks_[ 1 ];
+    std::vector< char > active( blocks_.size(), 0 );
+    for( std::vector< double >::const_iterator v = values.begin(); v != values.end(); ++v )
+    {
+        // candidates: blocks whose minimum is lower than the value
+        BlockRange key;
+        key.min = *v;
+        const std::vector< BlockRange >::const_iterator end =
+            std::lower_bound( blocks_.begin(), blocks_.end(), key );
+        for( std::vector< BlockRange >::const_iterator b = blocks_.begin(); b != end; ++b )
+        {
+            if( b->max >= *v ) active[ b->block ] = 1;
+        }
+    }
+    layers.assign( numBlocks_[ 2 ], std::vector< int >() );
+    for( int b = 0; b != int( active.size() ); ++b )
+    {
+        if( active[ b ] ) layers[ b / blocksPerLayer ].push_back( b % blocksPerLayer );
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ExtractIsoSurfaces( vtkImageData* grid,
+                         const std::vector< double >& values,
+                         std::vector< vtkSmartPointer< vtkPolyData > >& surfaces )
+{
+    return ExtractGridIsoSurfaces( grid, values, 0, surfaces );
+}
+
+//------------------------------------------------------------------------------
+bool ExtractIsoSurfaces( const IsoSurfaceIndex& index,
+                         const std::vector< double >& values,
+                         std::vector< vtkSmartPointer< vtkPolyData > >& surfaces )
+{
+    surfaces.clear();
+    if( index.GetGrid() == 0 ) return false;
+    std::vector< std::vector< int > > layers;
+    index.GetActiveBlocks( values, layers );
+    int numBlocks[ 3 ];
+    index.GetNumberOfBlocks( numBlocks );
+    const ActiveBlocks activeBlocks = { &layers, numBlocks[ 0 ] };
+    return ExtractGridIsoSurfaces( index.GetGrid(), values, &activeBlocks, surfaces );
+}
+
+//------------------------------------------------------------------------------
+vtkPolyData* ExtractIsoSurface( vtkImageData* grid, double value )
+{
+    std::vector< vtkSmartPointer< vtkPolyData > > surfaces;
+    if( !ExtractIsoSurfaces( grid, std::vector< double >( 1, value ), surfaces ) ) return 0;
+    vtkPolyData* pd = surfaces.front();
+    pd->Register( 0 ); // ownership transferred to caller
+    return pd;
+}
@@ -0,0 +1,127 @@
+#ifndef PARALLELMARCHINGCUBES_H_
+#define PARALLELMARCHINGCUBES_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <vector>
+
+// VTK
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+
+class vtkPolyData;
+
+/// Extracts an isosurface from a regular grid with marching cubes, in parallel.
+/// The grid is split into z slabs processed by separate OpenMP threads; each
+/// grid edge crossed by the surface generates a single vertex shared by all
+/// the triangles using it, vertices on the seams between slabs are generated
+/// by both slabs and merged.
+/// Vertex normals are computed from the grid gradient (central differences)
+/// interpolated along the edges and point towards decreasing values as in
+/// vtkMarchingCubes.
+/// The surface is triangulated with a case table generated from the cube faces:
+/// on faces with two diagonally opposite corners above the isovalue the corners
+/// above the value are separated, since the choice only depends on the face
+/// the surfaces generated in adjacent cells always match.
+/// Scalars of other types are converted to float before the extraction; with
+/// multiple components only the first one is used, as in vtkMarchingCubes.
+/// @param grid grid with scalars
+/// @param value isovalue
+/// @return new vtkPolyData owned by the caller with points, normals and
+/// triangles, all stored in arrays allocated once with the final size;
+/// null if the grid has no scalars.
+vtkPolyData* ExtractIsoSurface( vtkImageData* grid, double value );
+
+/// Extracts one isosurface per value with a single traversal of the grid: the
+/// values of each cell are read once and cells whose value range contains
+/// none of the isovalues are skipped, see ExtractIsoSurface.
+/// @param grid grid with scalars
+/// @param values isovalues
+/// @param surfaces returned surfaces, one per isovalue in the same order
+/// @return false if the grid has no scalars.
+bool ExtractIsoSurfaces( vtkImageData* grid,
+                         const std::vector< double >& values,
+                         std::vector< vtkSmartPointer< vtkPolyData > >& surfaces );
+
+/// Min/max index of the blocks of cells of a grid, used to extract isosurfaces
+/// at different values from the same grid without visiting all the cells.
+/// The grid is split into blocks of BLOCK_SIZE^3 cells and the range of the
+/// values at the cell corners of each block is stored; blocks are sorted by
+/// minimum value (span space): the blocks which can contain an isovalue are
+/// found with a binary search among the minima followed by a check of the
+/// maxima of the candidates, and only their cells are visited.
+/// The index keeps a reference to the grid, whose values must not change.
+class IsoSurfaceIndex
+{
+public:
+    /// Number of cells along each side of a block.
+    enum { BLOCK_SIZE = 8 };
+    /// Range of the values of a block.
+    struct BlockRange
+    {
+        double min;
+        double max;
+        /// Block index: x + numBlocksX * ( y + numBlocksY * z ).
+        int block;
+        /// Order by minimum value.
+        bool operator<( const BlockRange& r ) const { return min < r.min; }
+    };
+    /// Default constructor: no grid indexed.
+    IsoSurfaceIndex() { numBlocks_[ 0 ] = numBlocks_[ 1 ] = numBlocks_[ 2 ] = 0; }
+    /// Builds the index of a grid, in parallel; scalars other than float or
+    /// double are converted to float and the index keeps the converted grid.
+    /// Returns false if the grid has no scalars.
+    bool Build( vtkImageData* grid );
+    /// Releases the grid and the index.
+    void Clear();
+    /// Returns the indexed grid, null if no grid is indexed.
+    vtkImageData* GetGrid() const { return grid_; }
+    /// Returns the number of blocks along x, y and z.
+    void GetNumberOfBlocks( int n[ 3 ] ) const
+    {
+        n[ 0 ] = numBlocks_[ 0 ]; n[ 1 ] = numBlocks_[ 1 ]; n[ 2 ] = numBlocks_[ 2 ];
+    }
+    /// Returns the blocks which contain at least one of the values: for each
+    /// z layer of blocks the sorted indices ( x + numBlocksX * y ) of the blocks.
+    void GetActiveBlocks( const std::vector< double >& values,
+                          std::vector< std::vector< int > >& layers ) const;
+private:
+    /// Indexed grid.
+    vtkSmartPointer< vtkImageData > grid_;
+    /// Number of blocks along x, y and z.
+    int numBlocks_[ 3 ];
+    /// Block ranges sorted by minimum value.
+    std::vector< BlockRange > blocks_;
+};
+
+/// Extracts one isosurface per value from an indexed grid with a single
+/// traversal of the blocks whose range contains at least one of the values,
+/// see ExtractIsoSurfaces.
+/// @return false if no grid is indexed.
+bool ExtractIsoSurfaces( const IsoSurfaceIndex& index,
+                         const std::vector< double >& values,
+                         std::vector< vtkSmartPointer< vtkPolyData > >& surfaces );
+
+#endif /*PARALLELMARCHINGCUBES_H_*/
@@ -0,0 +1,288 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "SASField.h"
+#include "UniformGrid.h"
+
+namespace
+{
+    /// Number of z slabs processed by each thread at a time when splatting.
+    const int SLABS_PER_TILE = 4;
+
+    /// Atom sphere stored into the uniform grid used to find the closest spheres.
+    struct SASSphere
+    {
+        double center[ 3 ];
+        double radius;
+    };
+
+    typedef void ( *ProgressCallback )( int completedStep, int totalSteps, void* cbackData );
+
+    //--------------------------------------------------------------------------
+    /// Returns true if computation has to be stopped.
+    inline bool Stopped( const volatile bool* stop ) { return stop && *stop; }
+
+    //--------------------------------------------------------------------------
+    /// Square.
+    inline double Sq( double v ) { return v * v; }
+
+    //--------------------------------------------------------------------------
+    /// Sphere equation: squared distance from center minus squared radius.
+    inline double Sphere( const double center[ 3 ], double radius, const double point[ 3 ] )
+    {
+        return Sq( point[ 0 ] - center[ 0 ] ) + Sq( point[ 1 ] - center[ 1 ] ) +
+               Sq( point[ 2 ] - center[ 2 ] ) - Sq( radius );
+    }
+
+    //--------------------------------------------------------------------------
+    /// Invokes the progress callback from the master thread only: the callback
+    /// is usually updating the GUI.
+    inline void Progress( ProgressCallback progressCBack, int completed, int totalSteps,
+                          void* cbackData )
+    {
+#ifdef _OPENMP
+        if( progressCBack && omp_get_thread_num() == 0 ) progressCBack( completed, totalSteps, cbackData );
+#else
+        if( progressCBack ) progressCBack( completed, totalSteps, cbackData );
+#endif
+    }
+
+    //--------------------------------------------------------------------------
+    /// Computes the field from the closest spheres of each grid point.
+    /// Spheres are stored into a uniform grid with cell size equal to the
+    /// max sphere diameter: each grid point only needs to be tested against
+    /// the spheres in the cell containing the point and in the neighboring
+    /// cells, all the other spheres are at a distance greater than any radius.
+    /// The grid is padded by one cell on each side to always have at least
+    /// two cells per axis and to contain all the sampled points.
+    /// Points with no sphere in the neighboring cells are set to farValue.
+    void ComputeFromClosestSpheres( const std::vector< SASSphere >& spheres,
+                                    double maxRadius,
+                                    const double origin[ 3 ],
+                                    double step,
+                                    const int dims[ 3 ],
+                                    double farValue,
+                                    float* values,
+                                    const volatile bool* stop,
+                                    ProgressCallback progressCBack,
+                                    void* cbackData )
+    {
+        const int nx = dims[ 0 ];
+        const int ny = dims[ 1 ];
+        const int nz = dims[ 2 ];
+        const double cellSize = std::max( 2. * maxRadius, step );
+        typedef UniformGrid< SASSphere > SphereGrid;
+        typedef SphereGrid::ProximityIterator< SASSphere > SphereIterator;
+        SphereGrid sphereGrid( float( cellSize ),
+                               float( origin[ 0 ] - cellSize ),
+                               float( origin[ 1 ] - cellSize ),
+                               float( origin[ 2 ] - cellSize ),
+                               float( origin[ 0 ] + nx * step + cellSize ),
+                               float( origin[ 1 ] + ny * step + cellSize ),
+                               float( origin[ 2 ] + nz * step + cellSize ) );
+        for( std::vector< SASSphere >::const_iterator s = spheres.begin(); s != spheres.end(); ++s )
+        {
+            sphereGrid.Add( *s, float( s->center[ 0 ] ), float( s->center[ 1 ] ), float( s->center[ 2 ] ) );
+        }
+
+        const int totalSteps = nx * ny * nz;
+        int completedSlabs = 0;
+        // one z slab per iteration: each thread writes a contiguous range of values
+#ifdef _OPENMP
+#pragma omp parallel for schedule( dynamic, 1 )
+#endif
+        for( int k = 0; k < nz; ++k )
+        {
+            if( Stopped( stop ) ) continue;
+            float* slab = values + size_t( k ) * nx * ny;
+            double point[ 3 ];
+            point[ 2 ] = origin[ 2 ] + k * step;
+            for( int j = 0; j != ny ; ++j )
+            {
+                point[ 1 ] = origin[ 1 ] + j * step;
+                for( int i = 0; i != nx; ++i )
+                {
+                    point[ 0 ] = origin[ 0 ] + i * step;
+                    SphereIterator s = sphereGrid.Begin( float( point[ 0 ] ), float( point[ 1 ] ),
+                                                         float( point[ 2 ] ), 0.f );
+                    const SphereIterator end = sphereGrid.End( s );
+                    double minValue = farValue;
+                    for( ; s != end; ++s )
+                    {
+                        minValue = std::min( minValue, Sphere( s->center, s->radius, point ) );
+                    }
+                    slab[ i + nx * j ] = float( minValue );
+                }
+            }
+            int completed = 0;
+#ifdef _OPENMP
+#pragma omp critical( sas_field_progress )
+#endif
+            completed = ++completedSlabs;
+            Progress( progressCBack, completed * nx * ny, totalSteps, cbackData );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// Computes the field by splatting the spheres into the grid: each sphere
+    /// writes its value into the grid points inside the sphere inflated by a
+    /// band two grid steps wide, keeping the minimum value; all the other
+    /// points are set to farValue.
+    /// The end points of the cell edges crossed by the zero isosurface are all
+    /// within the band, hence the surface is the same as the one generated by
+    /// ComputeFromClosestSpheres; the cost depends on the number of spheres
+    /// and on the sphere volume, not on the size of the grid.
+    /// The z slabs are split into tiles processed in parallel: each sphere is
+    /// assigned to all the tiles overlapped by its inflated sphere and each
+    /// thread only writes the slabs of its own tiles.
+    void SplatSpheres( const std::vector< SASSphere >& spheres,
+                       const double origin[ 3 ],
+                       double step,
+                       const int dims[ 3 ],
+                       double farValue,
+                       float* values,
+                       const volatile bool* stop,
+                       ProgressCallback progressCBack,
+                       void* cbackData )
+    {
+        const int nx = dims[ 0 ];
+        const int ny = dims[ 1 ];
+        const int nz = dims[ 2 ];
+        const size_t sliceSize = size_t( nx ) * ny;
+        const double band = 2. * step;
+        const int numTiles = ( nz + SLABS_PER_TILE - 1 ) / SLABS_PER_TILE;
+        std::vector< std::vector< int > > tileSpheres( numTiles );
+        for( int s = 0; s != int( spheres.size() ); ++s )
+        {
+            const double r = spheres[ s ].radius + band;
+            const double z = spheres[ s ].center[ 2 ] - origin[ 2 ];
+            const int k0 = std::max( 0, int( std::ceil( ( z - r ) / step ) ) );
+            const int k1 = std::min( nz - 1, int( std::floor( ( z + r ) / step ) ) );
+            if( k0 > k1 ) continue;
+            for( int t = k0 / SLABS_PER_TILE; t <= k1 / SLABS_PER_TILE; ++t ) tileSpheres[ t ].push_back( s );
+        }
+
+        const int totalSteps = nx * ny * nz;
+        int completedSlabs = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule( dynamic, 1 )
+#endif
+        for( int t = 0; t < numTiles; ++t )
+        {
+            if( Stopped( stop ) ) continue;
+            const int firstSlab = t * SLABS_PER_TILE;
+            const int endSlab = std::min( nz, firstSlab + SLABS_PER_TILE );
+            std::fill( values + firstSlab * sliceSize, values + endSlab * sliceSize, float( farValue ) );
+            for( std::vector< int >::const_iterator s = tileSpheres[ t ].begin();
+                 s != tileSpheres[ t ].end(); ++s )
+            {
+                const double* c = spheres[ *s ].center;
+                const double radius = spheres[ *s ].radius;
+                const double r = radius + band;
+                const int k0 = std::max( firstSlab, int( std::ceil( ( c[ 2 ] - r - origin[ 2 ] ) / step ) ) );
+                const int k1 = std::min( endSlab - 1, int( std::floor( ( c[ 2 ] + r - origin[ 2 ] ) / step ) ) );
+                double point[ 3 ];
+                for( int k = k0; k <= k1; ++k )
+                {
+                    point[ 2 ] = origin[ 2 ] + k * step;
+                    const double rz2 = Sq( r ) - Sq( point[ 2 ] - c[ 2 ] );
+                    if( rz2 < 0. ) continue;
+                    const double ry = std::sqrt( rz2 );
+                    const int j0 = std::max( 0, int( std::ceil( ( c[ 1 ] - ry - origin[ 1 ] ) / step ) ) );
+                    const int j1 = std::min( ny - 1, int( std::floor( ( c[ 1 ] + ry - origin[ 1 ] ) / step ) ) );
+                    for( int j = j0; j <= j1; ++j )
+                    {
+                        point[ 1 ] = origin[ 1 ] + j * step;
+                        const double ryz2 = rz2 - Sq( point[ 1 ] - c[ 1 ] );
+                        if( ryz2 < 0. ) continue;
+                        const double rx = std::sqrt( ryz2 );
+                        const int i0 = std::max( 0, int( std::ceil( ( c[ 0 ] - rx - origin[ 0 ] ) / step ) ) );
+                        const int i1 = std::min( nx - 1, int( std::floor( ( c[ 0 ] + rx - origin[ 0 ] ) / step ) ) );
+                        float* row = values + k * sliceSize + size_t( j ) * nx;
+                        for( int i = i0; i <= i1; ++i )
+                        {
+                            point[ 0 ] = origin[ 0 ] + i * step;
+                            row[ i ] = std::min( row[ i ], float( Sphere( c, radius, point ) ) );
+                        }
+                    }
+                }
+            }
+            int completed = 0;
+#ifdef _OPENMP
+#pragma omp critical( sas_field_progress )
+#endif
+            completed = ( completedSlabs += endSlab - firstSlab );
+            Progress( progressCBack, completed * nx * ny, totalSteps, cbackData );
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ComputeSASField( const std::vector< double >& centers,
+                      const std::vector< double >& radii,
+                      const double origin[ 3 ],
+                      double step,
+                      const int dims[ 3 ],
+                      bool splatSpheres,
+                      float* values,
+                      const volatile bool* stop,
+                      void ( *progressCBack )( int completedStep,
+                                               int totalSteps,
+                                               void* cbackData ),
+                      void* cbackData )
+{
+    assert( step > 0. );
+    assert( centers.size() == 3 * radii.size() );
+    std::vector< SASSphere > spheres( radii.size() );
+    double maxRadius = 0.;
+    for( std::vector< SASSphere >::size_type s = 0; s != spheres.size(); ++s )
+    {
+        std::copy( &centers[ 3 * s ], &centers[ 3 * s ] + 3, spheres[ s ].center );
+        spheres[ s ].radius = radii[ s ];
+        maxRadius = std::max( maxRadius, radii[ s ] );
+    }
+    // value of the points far from all the spheres: outside of all the
+    // spheres, the exact value is only required near the surface
+    const double farValue = Sq( std::max( 2. * maxRadius, step ) );
+    if( progressCBack ) progressCBack( 0, dims[ 0 ] * dims[ 1 ] * dims[ 2 ], cbackData );
+    if( splatSpheres )
+    {
+        SplatSpheres( spheres, origin, step, dims, farValue, values, stop, progressCBack, cbackData );
+    }
+    else
+    {
+        ComputeFromClosestSpheres( spheres, maxRadius, origin, step, dims, farValue, values,
+                                   stop, progressCBack, cbackData );
+    }
+    return !Stopped( stop );
+}
@@ -0,0 +1,71 @@
+#ifndef SASFIELD_H_
+#define SASFIELD_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <vector>
+
+/// Computes the field used to extract the solvent accessible surface of a set
+/// of atom spheres with marching cubes: the value at each grid point is the
+/// minimum over the spheres of squared distance from the center minus squared
+/// radius, the surface is the zero level set.
+/// The exact value is only computed where needed to extract the surface;
+/// points far from all the spheres are set to the squared max sphere
+/// diameter. Two methods are available, both parallelized with OpenMP over
+/// z slabs:
+/// - closest spheres: each grid point is tested against the spheres in the
+///   neighboring cells of a uniform grid with cell size equal to the max
+///   sphere diameter; the cost depends on the size of the grid;
+/// - sphere splatting: each sphere writes its value into the grid points
+///   inside the sphere inflated by a band two grid steps wide; the cost depends
+///   on the number of spheres and on the sphere volume. The end points of the
+///   cell edges crossed by the surface are all within the band, hence the
+///   surface is the same as the one generated by the closest spheres method.
+/// @param centers sphere centers: x, y, z of each sphere
+/// @param radii sphere radii, already inflated by the probe radius
+/// @param origin position of the first grid point
+/// @param step grid spacing
+/// @param dims number of grid points along x, y and z
+/// @param splatSpheres if true the field is computed by splatting the spheres,
+///        from the closest spheres otherwise
+/// @param values output: dims[ 0 ] * dims[ 1 ] * dims[ 2 ] values, x varying fastest
+/// @param stop if not null the computation is stopped as soon as *stop is true
+/// @param progressCBack progress callback
+/// @param cbackData data passed to progressCBack
+/// @return false if the computation was stopped.
+bool ComputeSASField( const std::vector< double >& centers,
+                      const std::vector< double >& radii,
+                      const double origin[ 3 ],
+                      double step,
+                      const int dims[ 3 ],
+                      bool splatSpheres,
+                      float* values,
+                      const volatile bool* stop = 0,
+                      void ( *progressCBack )( int completedStep,
+                                               int totalSteps,
+                                               void* cbackData ) = 0,
+                      void* cbackData = 0 );
+
+#endif /*SASFIELD_H_*/
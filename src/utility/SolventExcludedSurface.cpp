@@ -0,0 +1,339 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <cassert>
+
+// VTK
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkPolyData.h>
+#include <vtkMarchingCubes.h>
+
+#include "SolventExcludedSurface.h"
+
+namespace
+{
+    /// Value of the grid points with no accessible point.
+    const float FAR_VALUE = std::numeric_limits< float >::max();
+
+    /// Number of progress steps: one per computation phase.
+    enum { SPLAT, EDT_X, EDT_Y, EDT_Z, FIELD, SURFACE, NUM_PHASES };
+
+    /// Number of z slabs processed by each thread at a time when splatting.
+    const int SLABS_PER_TILE = 4;
+
+    //--------------------------------------------------------------------------
+    /// Returns true if computation has to be stopped.
+    inline bool Stopped( const volatile bool* stop ) { return stop && *stop; }
+
+    //--------------------------------------------------------------------------
+    /// Computes min over p of ( q - p )^2 + f[ p ] for each q in [0, n) and
+    /// stores the value in d[ q ] and the minimizing p in arg[ q ]: lower envelope
+    /// of parabolas as in P. Felzenszwalb, D. Huttenlocher, "Distance Transforms of
+    /// Sampled Functions". Entries equal to FAR_VALUE are skipped; if all entries
+    /// are FAR_VALUE d is set to FAR_VALUE and arg to -1.
+    /// v and z are scratch buffers of size n and n + 1.
+    void DistanceTransform1D( const float* f, int n, float* d, int* arg, int* v, double* z )
+    {
+        int k = -1;
+        for( int q = 0; q != n; ++q )
+        {
+            if( f[ q ] == FAR_VALUE ) continue;
+            if( k < 0 )
+            {
+                k = 0;
+                v[ 0 ] = q;
+                z[ 0 ] = -std::numeric_limits< double >::max();
+                z[ 1 ] = std::numeric_limits< double >::max();
+                continue;
+            }
+            double s = 0.;
+            while( true )
+            {
+                const int p = v[ k ];
+                s = ( ( double( f[ q ] ) + double( q ) * q ) - ( double( f[ p ] ) + double( p ) * p ) )
+                    / ( 2. * ( q - p ) );
+                if( s > z[ k ] ) break;
+                --k; // z[ 0 ] is -inf: k never goes below zero
+            }
+            ++k;
+            v[ k ] = q;
+            z[ k ] = s;
+            z[ k + 1 ] = std::numeric_limits< double >::max();
+        }
+        if( k < 0 )
+        {
+            std::fill( d, d + n, FAR_VALUE );
+            std::fill( arg, arg + n, -1 );
+            return;
+        }
+        int j = 0;
+        for( int q = 0; q != n; ++q )
+        {
+            while( z[ j + 1 ] < q ) ++j;
+            const int p = v[ j ];
+            d[ q ] = float( double( q - p ) * ( q - p ) + f[ p ] );
+            arg[ q ] = p;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// Squared distance transform along one axis of the grid: for each line
+    /// parallel to the axis the squared distances in dist are updated and each
+    /// point takes the feature (nearest accessible point) of the point
+    /// minimizing the distance.
+    /// @param dims grid size
+    /// @param axis 0 = x, 1 = y, 2 = z
+    void DistanceTransformAxis( const int dims[ 3 ], int axis, float* dist, int* feature )
+    {
+        const int n = dims[ axis ];
+        const int stride = axis == 0 ? 1 : ( axis == 1 ? dims[ 0 ] : dims[ 0 ] * dims[ 1 ] );
+        // lines are identified by the coordinates along the other two axes
+        const int a0 = axis == 0 ? 1 : 0;
+        const int a1 = axis == 2 ? 1 : 2;
+        const int numLines = dims[ a0 ] * dims[ a1 ];
+        const int strides[ 3 ] = { 1, dims[ 0 ], dims[ 0 ] * dims[ 1 ] };
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            std::vector< float > f( n );
+            std::vector< float > d( n );
+            std::vector< int > arg( n );
+            std::vector< int > lineFeature( n );
+            std::vector< int > v( n );
+            std::vector< double > z( n + 1 );
+#ifdef _OPENMP
+#pragma omp for schedule( static )
+#endif
+            for( int l = 0; l < numLines; ++l )
+            {
+                const int i0 = l % dims[ a0 ];
+                const int i1 = l / dims[ a0 ];
+                const size_t start = size_t( i0 ) * strides[ a0 ] + size_t( i1 ) * strides[ a1 ];
+                for( int q = 0; q != n; ++q )
+                {
+                    f[ q ] = dist[ start + size_t( q ) * stride ];
+                    lineFeature[ q ] = feature[ start + size_t( q ) * stride ];
+                }
+                DistanceTransform1D( &f[ 0 ], n, &d[ 0 ], &arg[ 0 ], &v[ 0 ], &z[ 0 ] );
+                for( int q = 0; q != n; ++q )
+                {
+                    dist[ start + size_t( q ) * stride ] = d[ q ];
+                    feature[ start + size_t( q ) * stride ] = arg[ q ] < 0 ? -1 : lineFeature[ arg[ q ] ];
+                }
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+vtkPolyData* ComputeSolventExcludedSurface( const std::vector< double >& centers,
+                                            const std::vector< double >& radii,
+                                            double probeRadius,
+                                            double step,
+                                            const volatile bool* stop,
+                                            void ( *progressCBack )( int completedStep,
+                                                                     int totalSteps,
+                                                                     void* cbackData ),
+                                            void* cbackData )
+{
+    assert( step > 0. );
+    assert( centers.size() == 3 * radii.size() );
+    const int numSpheres = int( radii.size() );
+    if( numSpheres == 0 ) return 0;
+    if( progressCBack ) progressCBack( SPLAT, NUM_PHASES, cbackData );
+
+    // the grid points of the cell edges crossed by the surface and their
+    // nearest accessible points are all within a band of two grid steps
+    // around the accessible surface
+    const double band = 2. * step;
+    double bounds[ 6 ] = { std::numeric_limits< double >::max(), -std::numeric_limits< double >::max(),
+                           std::numeric_limits< double >::max(), -std::numeric_limits< double >::max(),
+                           std::numeric_limits< double >::max(), -std::numeric_limits< double >::max() };
+    for( int s = 0; s != numSpheres; ++s )
+    {
+        const double r = radii[ s ] + probeRadius + band;
+        for( int a = 0; a != 3; ++a )
+        {
+            bounds[ 2 * a ] = std::min( bounds[ 2 * a ], centers[ 3 * s + a ] - r );
+            bounds[ 2 * a + 1 ] = std::max( bounds[ 2 * a + 1 ], centers[ 3 * s + a ] + r );
+        }
+    }
+    const double origin[ 3 ] = { bounds[ 0 ], bounds[ 2 ], bounds[ 4 ] };
+    int dims[ 3 ];
+    for( int a = 0; a != 3; ++a )
+    {
+        dims[ a ] = int( std::ceil( ( bounds[ 2 * a + 1 ] - bounds[ 2 * a ] ) / step ) ) + 1;
+    }
+    const int nx = dims[ 0 ];
+    const int ny = dims[ 1 ];
+    const int nz = dims[ 2 ];
+    const size_t sliceSize = size_t( nx ) * ny;
+    const size_t numPoints = sliceSize * nz;
+
+    // 1) signed distance from the accessible surface: min over the spheres
+    //    of distance from center minus inflated radius; points farther than
+    //    band from all the spheres are left to FAR_VALUE
+    std::vector< float > sasDistance( numPoints );
+    const int numTiles = ( nz + SLABS_PER_TILE - 1 ) / SLABS_PER_TILE;
+    std::vector< std::vector< int > > tileSpheres( numTiles );
+    for( int s = 0; s != numSpheres; ++s )
+    {
+        const double r = radii[ s ] + probeRadius + band;
+        const double z = centers[ 3 * s + 2 ] - origin[ 2 ];
+        const int k0 = std::max( 0, int( std::ceil( ( z - r ) / step ) ) );
+        const int k1 = std::min( nz - 1, int( std::floor( ( z + r ) / step ) ) );
+        if( k0 > k1 ) continue;
+        for( int t = k0 / SLABS_PER_TILE; t <= k1 / SLABS_PER_TILE; ++t ) tileSpheres[ t ].push_back( s );
+    }
+#ifdef _OPENMP
+#pragma omp parallel for schedule( dynamic, 1 )
+#endif
+    for( int t = 0; t < numTiles; ++t )
+    {
+        if( Stopped( stop ) ) continue;
+        const int firstSlab = t * SLABS_PER_TILE;
+        const int endSlab = std::min( nz, firstSlab + SLABS_PER_TILE );
+        std::fill( sasDistance.begin() + firstSlab * sliceSize,
+                   sasDistance.begin() + endSlab * sliceSize, FAR_VALUE );
+        for( std::vector< int >::const_iterator s = tileSpheres[ t ].begin();
+             s != tileSpheres[ t ].end(); ++s )
+        {
+            const double* c = &centers[ 3 * *s ];
+            const double radius = radii[ *s ] + probeRadius;
+            const double r = radius + band;
+            const int k0 = std::max( firstSlab, int( std::ceil( ( c[ 2 ] - r - origin[ 2 ] ) / step ) ) );
+            const int k1 = std::min( endSlab - 1, int( std::floor( ( c[ 2 ] + r - origin[ 2 ] ) / step ) ) );
+            for( int k = k0; k <= k1; ++k )
+            {
+                const double dz = origin[ 2 ] + k * step - c[ 2 ];
+                const double rz2 = r * r - dz * dz;
+                if( rz2 < 0. ) continue;
+                const double ry = std::sqrt( rz2 );
+                const int j0 = std::max( 0, int( std::ceil( ( c[ 1 ] - ry - origin[ 1 ] ) / step ) ) );
+                const int j1 = std::min( ny - 1, int( std::floor( ( c[ 1 ] + ry - origin[ 1 ] ) / step ) ) );
+                for( int j = j0; j <= j1; ++j )
+                {
+                    const double dy = origin[ 1 ] + j * step - c[ 1 ];
+                    const double ryz2 = rz2 - dy * dy;
+                    if( ryz2 < 0. ) continue;
+                    const double rx = std::sqrt( ryz2 );
+                    const int i0 = std::max( 0, int( std::ceil( ( c[ 0 ] - rx - origin[ 0 ] ) / step ) ) );
+                    const int i1 = std::min( nx - 1, int( std::floor( ( c[ 0 ] + rx - origin[ 0 ] ) / step ) ) );
+                    float* row = &sasDistance[ k * sliceSize + size_t( j ) * nx ];
+                    for( int i = i0; i <= i1; ++i )
+                    {
+                        const double dx = origin[ 0 ] + i * step - c[ 0 ];
+                        const float d = float( std::sqrt( dx * dx + dy * dy + dz * dz ) - radius );
+                        row[ i ] = std::min( row[ i ], d );
+                    }
+                }
+            }
+        }
+    }
+    if( Stopped( stop ) ) return 0;
+
+    // 2) nearest accessible grid point, in grid steps
+    std::vector< float > sqDist( numPoints );
+    std::vector< int > feature( numPoints );
+#ifdef _OPENMP
+#pragma omp parallel for schedule( static )
+#endif
+    for( int k = 0; k < nz; ++k )
+    {
+        const size_t begin = k * sliceSize;
+        for( size_t p = begin; p != begin + sliceSize; ++p )
+        {
+            const bool accessible = sasDistance[ p ] >= 0.f;
+            sqDist[ p ] = accessible ? 0.f : FAR_VALUE;
+            feature[ p ] = accessible ? int( p ) : -1;
+        }
+    }
+    for( int axis = 0; axis != 3; ++axis )
+    {
+        if( progressCBack ) progressCBack( EDT_X + axis, NUM_PHASES, cbackData );
+        DistanceTransformAxis( dims, axis, &sqDist[ 0 ], &feature[ 0 ] );
+        if( Stopped( stop ) ) return 0;
+    }
+
+    // 3) field: distance from the accessible region minus probe radius,
+    //    positive inside the surface so that the vtkMarchingCubes normals,
+    //    pointing towards decreasing values, face outwards; the distance from
+    //    the nearest accessible grid point is corrected with the distance
+    //    between that point and the accessible surface
+    if( progressCBack ) progressCBack( FIELD, NUM_PHASES, cbackData );
+    vtkSmartPointer< vtkImageData > grid( vtkImageData::New() );
+    grid->Delete();
+    grid->SetDimensions( nx, ny, nz );
+    grid->SetSpacing( step, step, step );
+    grid->SetOrigin( origin[ 0 ], origin[ 1 ], origin[ 2 ] );
+    grid->SetScalarTypeToFloat();
+    grid->SetNumberOfScalarComponents( 1 );
+    grid->AllocateScalars();
+    float* field = static_cast< float* >( grid->GetScalarPointer() );
+    const float p = float( probeRadius );
+#ifdef _OPENMP
+#pragma omp parallel for schedule( static )
+#endif
+    for( int k = 0; k < nz; ++k )
+    {
+        const size_t begin = k * sliceSize;
+        for( size_t i = begin; i != begin + sliceSize; ++i )
+        {
+            if( sasDistance[ i ] >= 0.f )
+            {
+                field[ i ] = -p - std::min( sasDistance[ i ], float( band ) );
+            }
+            else if( feature[ i ] < 0 ) field[ i ] = p + float( band );
+            else
+            {
+                const float offset = std::min( sasDistance[ feature[ i ] ], float( band ) );
+                const float d = float( std::sqrt( double( sqDist[ i ] ) ) * step ) - offset;
+                field[ i ] = std::max( d, 0.f ) - p;
+            }
+        }
+    }
+    std::vector< float >().swap( sasDistance );
+    std::vector< float >().swap( sqDist );
+    std::vector< int >().swap( feature );
+    if( Stopped( stop ) ) return 0;
+
+    // 4) surface
+    if( progressCBack ) progressCBack( SURFACE, NUM_PHASES, cbackData );
+    vtkSmartPointer< vtkMarchingCubes > mc( vtkMarchingCubes::New() );
+    mc->Delete();
+    mc->SetInput( grid );
+    mc->ComputeNormalsOn();
+    mc->SetValue( 0, 0. );
+    mc->Update();
+    vtkPolyData* pd = vtkPolyData::New();
+    pd->DeepCopy( mc->GetOutput() );
+    if( progressCBack ) progressCBack( NUM_PHASES, NUM_PHASES, cbackData );
+    return pd;
+}
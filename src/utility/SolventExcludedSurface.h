@@ -0,0 +1,63 @@
+#ifndef SOLVENTEXCLUDEDSURFACE_H_
+#define SOLVENTEXCLUDEDSURFACE_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <vector>
+
+class vtkPolyData;
+
+/// Computes the solvent excluded (Connolly) surface of a set of atom spheres,
+/// without running any external program.
+/// The surface is extracted with marching cubes from a grid field computed in
+/// three steps, all parallelized with OpenMP:
+/// -# signed distance from the solvent accessible surface, i.e. the union of
+///    the spheres inflated by the probe radius, computed by splatting the
+///    spheres into the grid;
+/// -# nearest accessible (outside all the inflated spheres) grid point of each
+///    grid point, computed with a separable exact Euclidean distance transform;
+/// -# distance from the accessible region minus probe radius, positive inside:
+///    the surface is the boundary of the region covered by probes placed on
+///    accessible points.
+/// @param centers sphere centers: x, y, z of each sphere
+/// @param radii sphere radii
+/// @param probeRadius probe radius; zero generates the Van der Waals surface
+/// @param step grid spacing
+/// @param stop if not null the computation is stopped as soon as *stop is true
+/// @param progressCBack progress callback
+/// @param cbackData data passed to progressCBack
+/// @return new vtkPolyData owned by the caller with points, outward normals
+/// and triangles; null if the computation was stopped or there are no spheres.
+vtkPolyData* ComputeSolventExcludedSurface( const std::vector< double >& centers,
+                                            const std::vector< double >& radii,
+                                            double probeRadius,
+                                            double step,
+                                            const volatile bool* stop = 0,
+                                            void ( *progressCBack )( int completedStep,
+                                                                     int totalSteps,
+                                                                     void* cbackData ) = 0,
+                                            void* cbackData = 0 );
+
+#endif /*SOLVENTEXCLUDEDSURFACE_H_*/
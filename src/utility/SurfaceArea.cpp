@@ -0,0 +1,317 @@
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "SurfaceArea.h"
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+
+    /// Number of neighbors tested at a time against a dot: the test is
+    /// branch free within a block to allow for vectorization.
+    const int NEIGHBOR_BLOCK = 8;
+
+    /// Number of spheres processed per progress step.
+    const int SPHERES_PER_STEP = 256;
+
+    //--------------------------------------------------------------------------
+    /// Returns true if computation has to be stopped.
+    inline bool Stopped( const volatile bool* stop ) { return stop && *stop; }
+
+    //--------------------------------------------------------------------------
+    /// Generates n dots evenly distributed on the unit sphere along a
+    /// golden section spiral.
+    void GenerateDots( int n, std::vector< float >& x, std::vector< float >& y,
+                       std::vector< float >& z )
+    {
+        x.resize( n );
+        y.resize( n );
+        z.resize( n );
+        const double inc = PI * ( 3. - std::sqrt( 5. ) );
+        const double off = 2. / n;
+        for( int k = 0; k != n; ++k )
+        {
+            const double yk = k * off - 1. + 0.5 * off;
+            const double r = std::sqrt( std::max( 0., 1. - yk * yk ) );
+            const double phi = k * inc;
+            x[ k ] = float( r * std::cos( phi ) );
+            y[ k ] = float( yk );
+            z[ k ] = float( r * std::sin( phi ) );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// Cell list: sphere indices sorted by cell; the spheres in cell c are
+    /// spheres[ cellStart[ c ] ] ... spheres[ cellStart[ c + 1 ] - 1 ].
+    struct CellList
+    {
+        double origin[ 3 ];
+        double cellSize;
+        int dims[ 3 ];
+        std::vector< int > cellStart;
+        std::vector< int > spheres;
+        /// Returns the cell index along one axis.
+        int CellCoord( double v, int axis ) const
+        {
+            const int c = int( ( v - origin[ axis ] ) / cellSize );
+            return std::min( std::max( c, 0 ), dims[ axis ] - 1 );
+        }
+        /// Returns the 1D cell index.
+        int Cell( int i, int j, int k ) const
+        {
+            return i + dims[ 0 ] * ( j + dims[ 1 ] * k );
+        }
+    };
+
+    //--------------------------------------------------------------------------
+    /// Builds a cell list with counting sort.
+    void BuildCellList( const std::vector< double >& centers, double cellSize, CellList& cl )
+    {
+        const int n = int( centers.size() / 3 );
+        double bmin[ 3 ] = { centers[ 0 ], centers[ 1 ], centers[ 2 ] };
+        double bmax[ 3 ] = { centers[ 0 ], centers[ 1 ], centers[ 2 ] };
+        for( int s = 1; s < n; ++s )
+        {
+            for( int a = 0; a != 3; ++a )
+            {
+                bmin[ a ] = std::min( bmin[ a ], centers[ 3 * s + a ] );
+                bmax[ a ] = std::max( bmax[ a ], centers[ 3 * s + a ] );
+            }
+        }
+        cl.cellSize = cellSize;
+        for( int a = 0; a != 3; ++a )
+        {
+            cl.origin[ a ] = bmin[ a ];
+            cl.dims[ a ] = int( ( bmax[ a ] - bmin[ a ] ) / cellSize ) + 1;
+        }
+        const int numCells = cl.dims[ 0 ] * cl.dims[ 1 ] * cl.dims[ 2 ];
+        std::vector< int > cell( n );
+        cl.cellStart.assign( numCells + 1, 0 );
+        for( int s = 0; s != n; ++s )
+        {
+            cell[ s ] = cl.Cell( cl.CellCoord( centers[ 3 * s     ], 0 ),
+                                 cl.CellCoord( centers[ 3 * s + 1 ], 1 ),
+                                 cl.CellCoord( centers[ 3 * s + 2 ], 2 ) );
+            ++cl.cellStart[ cell[ s ] + 1 ];
+        }
+        for( int c = 0; c != numCells; ++c ) cl.cellStart[ c + 1 ] += cl.cellStart[ c ];
+        std::vector< int > next( cl.cellStart.begin(), cl.cellStart.end() - 1 );
+        cl.spheres.resize( n );
+        for( int s = 0; s != n; ++s ) cl.spheres[ next[ cell[ s ] ]++ ] = s;
+    }
+
+    //--------------------------------------------------------------------------
+    /// Neighbors of a sphere: centers relative to the sphere center and
+    /// squared inflated radii, stored as separate arrays padded to a multiple
+    /// of NEIGHBOR_BLOCK with entries that never bury a dot.
+    struct Neighbors
+    {
+        std::vector< float > x, y, z, r2;
+        std::vector< std::pair< float, int > > order; // scratch: sort by distance
+        int size; // number of neighbors, without padding
+    };
+
+    //--------------------------------------------------------------------------
+    /// Collects the spheres intersecting sphere s, closest first: the closest
+    /// spheres are the most likely to bury a dot.
+    void CollectNeighbors( int s,
+                           const std::vector< double >& centers,
+                           const std::vector< double >& inflatedRadii,
+                           const CellList& cl,
+                           Neighbors& nb )
+    {
+        const double* c = &centers[ 3 * s ];
+        const double r = inflatedRadii[ s ];
+        const int ci = cl.CellCoord( c[ 0 ], 0 );
+        const int cj = cl.CellCoord( c[ 1 ], 1 );
+        const int ck = cl.CellCoord( c[ 2 ], 2 );
+        nb.order.clear();
+        for( int k = std::max( ck - 1, 0 ); k <= std::min( ck + 1, cl.dims[ 2 ] - 1 ); ++k )
+        {
+            for( int j = std::max( cj - 1, 0 ); j <= std::min( cj + 1, cl.dims[ 1 ] - 1 ); ++j )
+            {
+                for( int i = std::max( ci - 1, 0 ); i <= std::min( ci + 1, cl.dims[ 0 ] - 1 ); ++i )
+                {
+                    const int cell = cl.Cell( i, j, k );
+                    for( int e = cl.cellStart[ cell ]; e != cl.cellStart[ cell + 1 ]; ++e )
+                    {
+                        const int t = cl.spheres[ e ];
+                        if( t == s ) continue;
+                        const double* tc = &centers[ 3 * t ];
+                        const double dx = tc[ 0 ] - c[ 0 ];
+                        const double dy = tc[ 1 ] - c[ 1 ];
+                        const double dz = tc[ 2 ] - c[ 2 ];
+                        const double d2 = dx * dx + dy * dy + dz * dz;
+                        const double rr = r + inflatedRadii[ t ];
+                        if( d2 < rr * rr ) nb.order.push_back( std::make_pair( float( d2 ), t ) );
+                    }
+                }
+            }
+        }
+        std::sort( nb.order.begin(), nb.order.end() );
+        nb.size = int( nb.order.size() );
+        const int padded = ( ( nb.size + NEIGHBOR_BLOCK - 1 ) / NEIGHBOR_BLOCK ) * NEIGHBOR_BLOCK;
+        nb.x.assign( padded, 0.f );
+        nb.y.assign( padded, 0.f );
+        nb.z.assign( padded, 0.f );
+        nb.r2.assign( padded, -1.f ); // padding: no dot is at a negative squared distance
+        for( int n = 0; n != nb.size; ++n )
+        {
+            const int t = nb.order[ n ].second;
+            nb.x[ n ] = float( centers[ 3 * t     ] - c[ 0 ] );
+            nb.y[ n ] = float( centers[ 3 * t + 1 ] - c[ 1 ] );
+            nb.z[ n ] = float( centers[ 3 * t + 2 ] - c[ 2 ] );
+            nb.r2[ n ] = float( inflatedRadii[ t ] * inflatedRadii[ t ] );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// Returns true if the dot, relative to the sphere center, is inside any of
+    /// the neighbors in [first, first + NEIGHBOR_BLOCK).
+    inline bool BuriedInBlock( const Neighbors& nb, int first, float px, float py, float pz )
+    {
+        const float* x = &nb.x[ first ];
+        const float* y = &nb.y[ first ];
+        const float* z = &nb.z[ first ];
+        const float* r2 = &nb.r2[ first ];
+        int buried = 0;
+        for( int n = 0; n < NEIGHBOR_BLOCK; ++n )
+        {
+            const float dx = px - x[ n ];
+            const float dy = py - y[ n ];
+            const float dz = pz - z[ n ];
+            buried |= dx * dx + dy * dy + dz * dz < r2[ n ];
+        }
+        return buried != 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+double ComputeAccessibleSurfaceAreas( const std::vector< double >& centers,
+                                      const std::vector< double >& radii,
+                                      double probeRadius,
+                                      int dotsPerSphere,
+                                      std::vector< double >& areas,
+                                      const volatile bool* stop,
+                                      void ( *progressCBack )( int completedStep,
+                                                               int totalSteps,
+                                                               void* cbackData ),
+                                      void* cbackData )
+{
+    assert( centers.size() == 3 * radii.size() );
+    assert( dotsPerSphere > 0 );
+    const int numSpheres = int( radii.size() );
+    areas.assign( numSpheres, 0. );
+    if( numSpheres == 0 ) return 0.;
+
+    std::vector< double > inflatedRadii( numSpheres );
+    double maxRadius = 0.;
+    // volume contributions are computed w.r.t. the centroid: the total volume
+    // does not depend on the reference point, round-off errors do
+    double centroid[ 3 ] = { 0., 0., 0. };
+    for( int s = 0; s != numSpheres; ++s )
+    {
+        inflatedRadii[ s ] = radii[ s ] + probeRadius;
+        maxRadius = std::max( maxRadius, inflatedRadii[ s ] );
+        for( int a = 0; a != 3; ++a ) centroid[ a ] += centers[ 3 * s + a ] / numSpheres;
+    }
+    CellList cl;
+    BuildCellList( centers, std::max( 2. * maxRadius, 1.e-3 ), cl );
+    std::vector< float > dx, dy, dz;
+    GenerateDots( dotsPerSphere, dx, dy, dz );
+
+    const int totalSteps = ( numSpheres + SPHERES_PER_STEP - 1 ) / SPHERES_PER_STEP;
+    int completedSteps = 0;
+    double volume = 0.;
+    if( progressCBack ) progressCBack( 0, totalSteps, cbackData );
+#ifdef _OPENMP
+#pragma omp parallel reduction( + : volume )
+#endif
+    {
+        Neighbors nb;
+#ifdef _OPENMP
+#pragma omp for schedule( dynamic, 1 )
+#endif
+        for( int step = 0; step < totalSteps; ++step )
+        {
+            if( Stopped( stop ) ) continue;
+            const int end = std::min( ( step + 1 ) * SPHERES_PER_STEP, numSpheres );
+            for( int s = step * SPHERES_PER_STEP; s != end; ++s )
+            {
+                CollectNeighbors( s, centers, inflatedRadii, cl, nb );
+                const float r = float( inflatedRadii[ s ] );
+                const double* c = &centers[ 3 * s ];
+                const double rc[ 3 ] = { c[ 0 ] - centroid[ 0 ],
+                                         c[ 1 ] - centroid[ 1 ],
+                                         c[ 2 ] - centroid[ 2 ] };
+                int accessible = 0;
+                double flux = 0.; // sum of ( dot - centroid ) . normal over accessible dots
+                int lastBlock = 0; // block of the last neighbor which buried a dot
+                for( int d = 0; d != dotsPerSphere; ++d )
+                {
+                    const float px = r * dx[ d ];
+                    const float py = r * dy[ d ];
+                    const float pz = r * dz[ d ];
+                    // adjacent dots are usually buried by the same neighbor
+                    bool buried = nb.size && BuriedInBlock( nb, lastBlock, px, py, pz );
+                    for( int b = 0; !buried && b < nb.size; b += NEIGHBOR_BLOCK )
+                    {
+                        if( b == lastBlock ) continue;
+                        if( BuriedInBlock( nb, b, px, py, pz ) )
+                        {
+                            buried = true;
+                            lastBlock = b;
+                        }
+                    }
+                    if( buried ) continue;
+                    ++accessible;
+                    flux += r + rc[ 0 ] * dx[ d ] + rc[ 1 ] * dy[ d ] + rc[ 2 ] * dz[ d ];
+                }
+                const double dotArea = 4. * PI * double( r ) * r / dotsPerSphere;
+                areas[ s ] = accessible * dotArea;
+                volume += flux * dotArea / 3.;
+            }
+            int completed = 0;
+#ifdef _OPENMP
+#pragma omp critical( surface_area_progress )
+#endif
+            completed = ++completedSteps;
+#ifdef _OPENMP
+            if( progressCBack && omp_get_thread_num() == 0 ) progressCBack( completed, totalSteps, cbackData );
+#else
+            if( progressCBack ) progressCBack( completed, totalSteps, cbackData );
+#endif
+        }
+    }
+    return volume;
+}
@@ -0,0 +1,60 @@
+#ifndef SURFACEAREA_H_
+#define SURFACEAREA_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// STD
+#include <vector>
+
+/// Computes the solvent accessible area of each sphere in a set of atom
+/// spheres and the volume enclosed by the solvent accessible surface with the
+/// Shrake-Rupley dot method: each sphere, inflated by the probe radius, is
+/// sampled with dotsPerSphere evenly distributed dots and the area of the
+/// sphere is scaled by the fraction of dots not buried in any other inflated
+/// sphere. The volume is computed applying the divergence theorem to the
+/// accessible dots.
+/// Neighbor spheres are found through a cell list with cell size equal to the
+/// max inflated sphere diameter; spheres are processed in parallel with OpenMP.
+/// @param centers sphere centers: x, y, z of each sphere
+/// @param radii sphere radii
+/// @param probeRadius probe radius; zero computes Van der Waals areas
+/// @param dotsPerSphere number of dots used to sample each sphere
+/// @param areas returned accessible area of each sphere
+/// @param stop if not null the computation is stopped as soon as *stop is true
+/// @param progressCBack progress callback
+/// @param cbackData data passed to progressCBack
+/// @return volume enclosed by the accessible surface; if the computation is
+/// stopped the returned values are not valid.
+double ComputeAccessibleSurfaceAreas( const std::vector< double >& centers,
+                                      const std::vector< double >& radii,
+                                      double probeRadius,
+                                      int dotsPerSphere,
+                                      std::vector< double >& areas,
+                                      const volatile bool* stop = 0,
+                                      void ( *progressCBack )( int completedStep,
+                                                               int totalSteps,
+                                                               void* cbackData ) = 0,
+                                      void* cbackData = 0 );
+
+#endif /*SURFACEAREA_H_*/
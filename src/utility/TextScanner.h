@@ -0,0 +1,158 @@
+#ifndef TEXTSCANNER_H_
+#define TEXTSCANNER_H_
+//
+// Molekel - Molecular Visualization Program
+// Copyright (C) 2006, 2007, 2008, 2009 Swiss National Supercomputing Centre (CSCS)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+// $Author$
+// $Date$
+// $Revision$
+//
+
+// Functions to parse numbers from text held in memory, e.g. in memory mapped
+// files, without any locale, stream or allocation overhead.
+// All the functions take a [p, end) character range, do not require the text
+// to be null terminated and are safe to call concurrently from multiple threads.
+
+// STD
+#include <cmath>
+#include <cstring>
+
+/// Returns pointer to first character in [p, end) which is not a space, tab or
+/// carriage return; newlines are not skipped.
+inline const char* SkipBlanks( const char* p, const char* end )
+{
+    while( p != end && ( *p == ' ' || *p == '\t' || *p == '\r' ) ) ++p;
+    return p;
+}
+
+/// Returns pointer to first character in [p, end) which is not a space, tab,
+/// carriage return or newline.
+inline const char* SkipWhitespace( const char* p, const char* end )
+{
+    while( p != end && ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ) ) ++p;
+    return p;
+}
+
+/// Returns pointer to the character following the next newline or end if no
+/// newline is found.
+inline const char* SkipLine( const char* p, const char* end )
+{
+    const char* nl = static_cast< const char* >( std::memchr( p, '\n', end - p ) );
+    return nl ? nl + 1 : end;
+}
+
+/// Returns pointer to the next newline or end if no newline is found.
+inline const char* FindLineEnd( const char* p, const char* end )
+{
+    const char* nl = static_cast< const char* >( std::memchr( p, '\n', end - p ) );
+    return nl ? nl : end;
+}
+
+/// Parses an integer after skipping blanks.
+/// Returns pointer to the character following the number or null if no
+/// number is found.
+inline const char* ScanInt( const char* p, const char* end, int& value )
+{
+    p = SkipBlanks( p, end );
+    bool negative = false;
+    if( p != end && ( *p == '-' || *p == '+' ) ) negative = *p++ == '-';
+    if( p == end || *p < '0' || *p > '9' ) return 0;
+    int v = 0;
+    while( p != end && *p >= '0' && *p <= '9' ) v = 10 * v + ( *p++ - '0' );
+    value = negative ? -v : v;
+    return p;
+}
+
+/// Parses a floating point number in fixed or exponential notation after
+/// skipping blanks; 'e', 'E', 'd' and 'D' are all accepted as exponent markers.
+/// The result is correctly rounded for numbers with up to 15 significant
+/// digits and exponents within [-22, 22], which covers the output of printf
+/// with the usual formats; at most 19 significant digits are read.
+/// Returns pointer to the character following the number or null if no
+/// number is found.
+inline const char* ScanDouble( const char* p, const char* end, double& value )
+{
+    static const double POW10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                     1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                     1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    p = SkipBlanks( p, end );
+    bool negative = false;
+    if( p != end && ( *p == '-' || *p == '+' ) ) negative = *p++ == '-';
+    unsigned long long mantissa = 0;
+    int digits = 0;   // significant digits stored in mantissa
+    int exponent = 0; // decimal exponent of mantissa
+    bool found = false;
+    for( ; p != end && *p >= '0' && *p <= '9'; ++p )
+    {
+        found = true;
+        if( digits < 19 )
+        {
+            mantissa = 10 * mantissa + ( *p - '0' );
+            if( mantissa ) ++digits;
+        }
+        else ++exponent;
+    }
+    if( p != end && *p == '.' )
+    {
+        for( ++p; p != end && *p >= '0' && *p <= '9'; ++p )
+        {
+            found = true;
+            if( digits < 19 )
+            {
+                mantissa = 10 * mantissa + ( *p - '0' );
+                if( mantissa ) ++digits;
+                --exponent;
+            }
+        }
+    }
+    if( !found ) return 0;
+    if( p != end && ( *p == 'e' || *p == 'E' || *p == 'd' || *p == 'D' ) )
+    {
+        int e = 0;
+        const char* n = ScanInt( p + 1, end, e );
+        // a blank after the marker is not part of the number
+        if( n && p[ 1 ] != ' ' && p[ 1 ] != '\t' )
+        {
+            exponent += e;
+            p = n;
+        }
+    }
+    double v = double( mantissa );
+    if( exponent < 0 )
+    {
+        v = exponent >= -22 ? v / POW10[ -exponent ] : v * std::pow( 10.0, exponent );
+    }
+    else if( exponent > 0 )
+    {
+        v = exponent <= 22 ? v * POW10[ exponent ] : v * std::pow( 10.0, exponent );
+    }
+    value = negative ? -v : v;
+    return p;
+}
+
+/// Parses a floating point number after skipping blanks, see ScanDouble.
+inline const char* ScanFloat( const char* p, const char* end, float& value )
+{
+    double v = 0.;
+    p = ScanDouble( p, end, v );
+    if( p ) value = float( v );
+    return p;
+}
+
+#endif /*TEXTSCANNER_H_*/
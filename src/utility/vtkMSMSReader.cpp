@@ -19,22 +19,29 @@
 // 
 
 //STD
-#include <iostream>
-#include <fstream>
-#include <string>
-#include <sstream>
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // VTK
 #include <vtkCellArray.h>
 #include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
 #include <vtkInformation.h>
 #include <vtkInformationVector.h>
+#include <vtkIntArray.h>
 #include <vtkObjectFactory.h>
 #include <vtkPointData.h>
+#include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
 
 #include "vtkMSMSReader.h"
+#include "MappedFile.h"
+#include "TextScanner.h"
 
 using namespace std;
 
@@ -44,6 +51,156 @@ vtkCxxRevisionMacro( vtkMSMSReader, " $Revision$ ");
 //------------------------------------------------------------------------------
 vtkStandardNewMacro( vtkMSMSReader );
 
+namespace
+{
+    /// Block of whole lines parsed by a single thread.
+    struct Chunk
+    {
+        /// First character.
+        const char* begin;
+        /// One past the last character.
+        const char* end;
+        /// Index of first data line in chunk.
+        int firstLine;
+        /// Number of data lines in chunk.
+        int numLines;
+        /// Data line index of first line with errors, -1 if no errors.
+        int errorLine;
+        Chunk() : begin( 0 ), end( 0 ), firstLine( 0 ), numLines( 0 ), errorLine( -1 ) {}
+    };
+
+    /// Minimum number of bytes per chunk, smaller files are parsed by one thread.
+    const size_t MIN_CHUNK_SIZE = 1 << 18;
+
+    /// Returns true if line contains data i.e. it is neither blank nor a comment.
+    inline bool IsDataLine( const char* p, const char* lineEnd )
+    {
+        p = SkipBlanks( p, lineEnd );
+        return p != lineEnd && *p != '#';
+    }
+
+    /// Reads the header line (first data line) and returns
+    /// pointer to the first line after the header or null in case of error.
+    /// MSMS headers are: number of elements, number of spheres, density, probe radius.
+    const char* ReadHeader( const char* p, const char* end, int& count )
+    {
+        while( p != end && !IsDataLine( p, FindLineEnd( p, end ) ) ) p = SkipLine( p, end );
+        if( p == end || !ScanInt( p, end, count ) || count < 0 ) return 0;
+        return SkipLine( p, end );
+    }
+
+    /// Splits [begin, end) into chunks of whole lines and computes the index of
+    /// the first data line of each chunk.
+    /// Returns the total number of data lines.
+    int SplitLines( const char* begin, const char* end, vector< Chunk >& chunks )
+    {
+        int numChunks = 1;
+#ifdef _OPENMP
+        numChunks = int( min( size_t( 4 * omp_get_max_threads() ),
+                              size_t( end - begin ) / MIN_CHUNK_SIZE + 1 ) );
+#endif
+        chunks.assign( numChunks, Chunk() );
+        const size_t chunkSize = ( end - begin ) / numChunks + 1;
+        const char* p = begin;
+        for( int c = 0; c != numChunks; ++c )
+        {
+            chunks[ c ].begin = p;
+            if( size_t( end - p ) > chunkSize ) p = SkipLine( p + chunkSize, end );
+            else p = end;
+            chunks[ c ].end = p;
+        }
+#ifdef _OPENMP
+        #pragma omp parallel for schedule( dynamic )
+#endif
+        for( int c = 0; c < numChunks; ++c )
+        {
+            Chunk& chunk = chunks[ c ];
+            for( const char* l = chunk.begin; l != chunk.end; )
+            {
+                const char* lineEnd = FindLineEnd( l, chunk.end );
+                if( IsDataLine( l, lineEnd ) ) ++chunk.numLines;
+                l = lineEnd == chunk.end ? lineEnd : lineEnd + 1;
+            }
+        }
+        int numLines = 0;
+        for( int c = 0; c != numChunks; ++c )
+        {
+            chunks[ c ].firstLine = numLines;
+            numLines += chunks[ c ].numLines;
+        }
+        return numLines;
+    }
+
+    /// Parses .vert data lines: x y z nx ny nz face sphere type [atom name].
+    /// MSMS sphere ids are one based and are stored as zero based indices.
+    void ParseVertices( Chunk& chunk, float* points, float* normals, int* spheres )
+    {
+        int line = chunk.firstLine;
+        for( const char* l = chunk.begin; l != chunk.end; )
+        {
+            const char* lineEnd = FindLineEnd( l, chunk.end );
+            if( IsDataLine( l, lineEnd ) )
+            {
+                const char* p = l;
+                for( int i = 0; i != 3 && p; ++i ) p = ScanFloat( p, lineEnd, points[ 3 * line + i ] );
+                for( int i = 0; i != 3 && p; ++i ) p = ScanFloat( p, lineEnd, normals[ 3 * line + i ] );
+                int faceId = 0;
+                if( p ) p = ScanInt( p, lineEnd, faceId );
+                if( p ) p = ScanInt( p, lineEnd, spheres[ line ] );
+                if( !p )
+                {
+                    chunk.errorLine = line;
+                    return;
+                }
+                --spheres[ line ];
+                ++line;
+            }
+            l = lineEnd == chunk.end ? lineEnd : lineEnd + 1;
+        }
+    }
+
+    /// Parses .face data lines: v1 v2 v3 type face and stores each triangle as
+    /// 3 v1-1 v2-1 v3-1 in the cell array.
+    void ParseFaces( Chunk& chunk, int numVertices, vtkIdType* cells )
+    {
+        int line = chunk.firstLine;
+        for( const char* l = chunk.begin; l != chunk.end; )
+        {
+            const char* lineEnd = FindLineEnd( l, chunk.end );
+            if( IsDataLine( l, lineEnd ) )
+            {
+                const char* p = l;
+                vtkIdType* cell = cells + 4 * line;
+                cell[ 0 ] = 3;
+                for( int i = 1; i != 4 && p; ++i )
+                {
+                    int v = 0;
+                    p = ScanInt( p, lineEnd, v );
+                    if( v < 1 || v > numVertices ) p = 0;
+                    cell[ i ] = v - 1; // convert to zero based index
+                }
+                if( !p )
+                {
+                    chunk.errorLine = line;
+                    return;
+                }
+                ++line;
+            }
+            l = lineEnd == chunk.end ? lineEnd : lineEnd + 1;
+        }
+    }
+
+    /// Returns data line index of first error or -1 if no error found.
+    int FirstError( const vector< Chunk >& chunks )
+    {
+        for( vector< Chunk >::const_iterator i = chunks.begin(); i != chunks.end(); ++i )
+        {
+            if( i->errorLine >= 0 ) return i->errorLine;
+        }
+        return -1;
+    }
+}
+
 //------------------------------------------------------------------------------
 vtkMSMSReader::vtkMSMSReader()
 {
@@ -68,10 +225,10 @@ int vtkMSMSReader::RequestData( vtkInformation *vtkNotUsed( request ),
         return 0;
     }
 
-    // open vert file
-    ifstream vert_in( ( fileName_ + ".vert" ).c_str() );
+    // map vert file
+    const MappedFile vert( fileName_ + ".vert" );
 
-    if(!vert_in )
+    if( !vert.IsMapped() )
     {
         vtkErrorMacro( << "File " << ( fileName_ + ".vert" ).c_str() << " not found" );
         return 0;
@@ -79,56 +236,59 @@ int vtkMSMSReader::RequestData( vtkInformation *vtkNotUsed( request ),
 
     vtkDebugMacro( << "Reading .vert file" );
 
-    // intialize some structures to store the file contents in
-    vtkSmartPointer< vtkPoints > points( vtkPoints::New() ); // vertices
+    // read vert header and preallocate arrays from vertex count
+    int numVertices = 0;
+    const char* vertData = ReadHeader( vert.Begin(), vert.End(), numVertices );
+    if( !vertData )
+    {
+        vtkErrorMacro( << "Invalid header in file " << ( fileName_ + ".vert" ).c_str() );
+        return 0;
+    }
+    vtkSmartPointer< vtkFloatArray > coordinates( vtkFloatArray::New() ); // vertices
+    coordinates->Delete();
+    coordinates->SetNumberOfComponents( 3 );
+    coordinates->SetNumberOfTuples( numVertices );
     vtkSmartPointer< vtkFloatArray > normals( vtkFloatArray::New() ); // normals
+    normals->Delete();
     normals->SetNumberOfComponents( 3 );
-    vtkSmartPointer< vtkCellArray > polys( vtkCellArray::New() ); // triangles
+    normals->SetNumberOfTuples( numVertices );
+    vtkSmartPointer< vtkIntArray > spheres( vtkIntArray::New() ); // closest spheres
+    spheres->Delete();
+    spheres->SetName( GetClosestSphereArrayName() );
+    spheres->SetNumberOfTuples( numVertices );
 
-    // read vert header
-    int numVertices = 0;
-    int numSpheres = 0;
-    double density = 0.;
-    double probeRadius = 0;
-    string lineBuffer;
-    istringstream line;
-    getline( vert_in, lineBuffer ); // 1st
-    getline( vert_in, lineBuffer ); // 2nd
-    getline( vert_in, lineBuffer ); // 3rd
-    line.str( lineBuffer );
-
-    line >> numVertices >> numSpheres >> density >> probeRadius;
-
-    while( vert_in )
-    {
-        getline( vert_in, lineBuffer );
-        if( lineBuffer.size() == 0 || lineBuffer[ 0 ] == '#' ) continue;
-        istringstream line;
-        line.str( lineBuffer );
-        double xyz[ 3 ]  = { 0., 0., 0. };
-        double nxyz[ 3 ] = { 0., 0., 0. };
-        int faceId;
-        int closestSphereId;
-        int type;
-        string atomName;
-        line >> xyz[ 0 ] >> xyz[ 1 ] >> xyz[ 2 ] >> nxyz[ 0 ] >> nxyz[ 1 ] >> nxyz[ 2 ] >> faceId
-             >> closestSphereId >> type;
-//printf( "%f\t%f\t%f\t%f\t%f\t%f\t%d\t%d\t%d\n", xyz[ 0 ], xyz[ 1 ], xyz[ 2 ], nxyz[ 0 ], nxyz[ 1 ], nxyz[ 2 ],
-//                                        faceId, closestSphereId, type );
-        if( line ) line >> atomName;
-        points->InsertNextPoint( xyz );
-        normals->InsertNextTuple( nxyz );
-    }
-
-    // done reading vertex information
-    vert_in.close();
-
-    // read faces
-
-    // open face file
-    ifstream face_in( ( fileName_ + ".face" ).c_str() );
-
-    if(!face_in )
+    vector< Chunk > chunks;
+    const int numVertLines = SplitLines( vertData, vert.End(), chunks );
+    if( numVertLines != numVertices )
+    {
+        vtkWarningMacro( << "Header of file " << ( fileName_ + ".vert" ).c_str() << " reports "
+                         << numVertices << " vertices, " << numVertLines << " found" );
+        numVertices = numVertLines;
+        coordinates->SetNumberOfTuples( numVertices );
+        normals->SetNumberOfTuples( numVertices );
+        spheres->SetNumberOfTuples( numVertices );
+    }
+    float* coordinatesPtr = coordinates->GetPointer( 0 );
+    float* normalsPtr = normals->GetPointer( 0 );
+    int* spheresPtr = spheres->GetPointer( 0 );
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic )
+#endif
+    for( int c = 0; c < int( chunks.size() ); ++c )
+    {
+        ParseVertices( chunks[ c ], coordinatesPtr, normalsPtr, spheresPtr );
+    }
+    if( FirstError( chunks ) >= 0 )
+    {
+        vtkErrorMacro( << "Error reading vertex " << FirstError( chunks ) + 1 << " from file "
+                       << ( fileName_ + ".vert" ).c_str() );
+        return 0;
+    }
+
+    // map face file
+    const MappedFile face( fileName_ + ".face" );
+
+    if( !face.IsMapped() )
     {
         vtkErrorMacro(<< "File " << ( fileName_ + ".face" ).c_str() << " not found" );
         return 0;
@@ -136,49 +296,53 @@ int vtkMSMSReader::RequestData( vtkInformation *vtkNotUsed( request ),
 
     vtkDebugMacro( << "Reading .face file" );
 
-    // read face header
-
+    // read face header and preallocate connectivity from face count:
+    // each triangle is stored as (3, v1, v2, v3)
     int numFaces = 0;
-    getline( face_in, lineBuffer ); // 1st
-    getline( face_in, lineBuffer ); // 2nd
-    getline( face_in, lineBuffer ); // 3rd
-    istringstream line2;
-    line2.str( lineBuffer );
-    line2 >> numFaces>> numSpheres >> density >> probeRadius;
-
-//printf( "\n\n=============================================================\n\n" );
-    output->SetPoints( points );
-    while( face_in )
-    {
-        getline( face_in, lineBuffer );
-        if( lineBuffer.size() == 0 || lineBuffer[ 0 ] == '#' ) continue;
-        istringstream line;
-        line.str( lineBuffer );
-        int triangle[ 3 ]  = { 0, 0, 0 };
-        int faceId;
-        int type;
-        line >> triangle[ 0 ] >> triangle[ 1 ] >> triangle[ 2 ] >> type >> faceId;
-        --triangle[ 0 ]; // convert to zero based index
-        --triangle[ 1 ]; // convert to zero based index
-        --triangle[ 2 ]; // convert to zero based index
-        polys->InsertNextCell( 0 );
-        polys->InsertCellPoint( triangle[ 0 ] );
-        polys->InsertCellPoint( triangle[ 1 ] );
-        polys->InsertCellPoint( triangle[ 2 ] );
-        polys->UpdateCellCount( 3 );
- //printf( "%d\t%d\t%d\t%d\t%d\n", triangle[ 0 ], triangle[ 1 ], triangle[ 2 ], type, faceId );
-    }
-
-    // done
-    //polys->UpdateCellCount( numFaces * 3 );
-
-    face_in.close();
+    const char* faceData = ReadHeader( face.Begin(), face.End(), numFaces );
+    if( !faceData )
+    {
+        vtkErrorMacro( << "Invalid header in file " << ( fileName_ + ".face" ).c_str() );
+        return 0;
+    }
+    vtkSmartPointer< vtkIdTypeArray > cells( vtkIdTypeArray::New() );
+    cells->Delete();
+    cells->SetNumberOfValues( 4 * vtkIdType( numFaces ) );
+
+    const int numFaceLines = SplitLines( faceData, face.End(), chunks );
+    if( numFaceLines != numFaces )
+    {
+        vtkWarningMacro( << "Header of file " << ( fileName_ + ".face" ).c_str() << " reports "
+                         << numFaces << " faces, " << numFaceLines << " found" );
+        numFaces = numFaceLines;
+        cells->SetNumberOfValues( 4 * vtkIdType( numFaces ) );
+    }
+    vtkIdType* cellsPtr = cells->GetPointer( 0 );
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic )
+#endif
+    for( int c = 0; c < int( chunks.size() ); ++c )
+    {
+        ParseFaces( chunks[ c ], numVertices, cellsPtr );
+    }
+    if( FirstError( chunks ) >= 0 )
+    {
+        vtkErrorMacro( << "Error reading face " << FirstError( chunks ) + 1 << " from file "
+                       << ( fileName_ + ".face" ).c_str() );
+        return 0;
+    }
 
     vtkDebugMacro( << "Copying file data into the output" );
+    vtkSmartPointer< vtkPoints > points( vtkPoints::New() );
+    points->Delete();
+    points->SetData( coordinates );
+    vtkSmartPointer< vtkCellArray > polys( vtkCellArray::New() ); // triangles
+    polys->Delete();
+    polys->SetCells( numFaces, cells );
     output->SetPoints( points );
     output->SetPolys( polys );
     output->GetPointData()->SetNormals( normals );
-    output->Squeeze();
+    output->GetPointData()->AddArray( spheres );
     return 1;
 }
 
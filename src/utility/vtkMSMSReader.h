@@ -33,6 +33,10 @@
 /// MSMS output is composed of two files:
 /// - <out file>.face faces
 /// - <in file>.vert verices + normals
+/// Both files are memory mapped and parsed in parallel; the output contains
+/// points, normals, triangles and, in a point data array named
+/// GetClosestSphereArrayName(), the zero based index of the sphere (i.e. atom)
+/// closest to each vertex.
 class vtkMSMSReader : public vtkPolyDataAlgorithm
 {
 public:
@@ -46,6 +50,8 @@ public:
     const std::string& GetFileName() const { return fileName_; }
     /// Sets file name.
     void SetFileName( const std::string& fname   ) { fileName_ = fname; }
+    /// Returns name of point data array with closest sphere indices.
+    static const char* GetClosestSphereArrayName() { return "ClosestSphere"; }
 private:
     /// Input file name.
     std::string fileName_;
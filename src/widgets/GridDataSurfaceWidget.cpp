@@ -34,11 +34,18 @@
 #include <QSpinBox>
 #include <QColorDialog>
 #include <QPushButton>
+#include <QSlider>
 
 #include "../MolekelMolecule.h"
 #include "GridDataSurfaceWidget.h"
 #include "../utility/RAII.h"
 
+namespace
+{
+    /// Number of isosurface value slider steps.
+    const int VALUE_SLIDER_STEPS = 1000;
+}
+
 //------------------------------------------------------------------------------
 GridDataSurfaceWidget::GridDataSurfaceWidget( QWidget* parent )
     : QWidget( parent ), mol_( 0 ),  updatingGUI_( false )
@@ -79,6 +86,11 @@ GridDataSurfaceWidget::GridDataSurfaceWidget( QWidget* parent )
              this, SLOT( ValueChangedSlot( double ) ) );
     valueLayout->addWidget( valueSpinBox_ );
     mainLayout->addItem( valueLayout );
+    valueSlider_ = new QSlider( Qt::Horizontal );
+    valueSlider_->setRange( 0, VALUE_SLIDER_STEPS );
+    connect( valueSlider_, SIGNAL( valueChanged( int ) ),
+             this, SLOT( ValueSliderChangedSlot( int ) ) );
+    mainLayout->addWidget( valueSlider_ );
 
     // grid list
     QHBoxLayout* gridsLayout = new QHBoxLayout;
@@ -195,6 +207,7 @@ void GridDataSurfaceWidget::UpdateGUI()
     valueSpinBox_->setRange( minValue, maxValue );
     valueSpinBox_->setSingleStep( ( maxValue - minValue ) / 50 );
     valueSpinBox_->setValue( ( minValue + maxValue ) / 2 );
+    UpdateValueSlider();
 
     stepMulSpinBox_->setRange( 1, std::min( std::min( numSteps[ 0 ], numSteps[ 1 ] ),
                                                 std::min( numSteps[ 0 ], numSteps[ 2 ] ) ) );
@@ -253,6 +266,7 @@ void GridDataSurfaceWidget::SurfaceChangedSlot( int index  )
     const double minValue = mol_->GetGridDataMin( label );
     const double maxValue = mol_->GetGridDataMax( label );
     valueSpinBox_->setRange( minValue, maxValue );
+    UpdateValueSlider();
 
     minMaxLabel_->setText( tr( "(%1, %2)" ).arg( minValue ).arg( maxValue ) );
 
@@ -272,10 +286,32 @@ void GridDataSurfaceWidget::SurfaceChangedSlot( int index  )
 //------------------------------------------------------------------------------
 void GridDataSurfaceWidget::ValueChangedSlot( double v  )
 {
+    UpdateValueSlider();
     if( updatingGUI_  ) return;
     emit ValueChanged( v );
 }
 
+//------------------------------------------------------------------------------
+void GridDataSurfaceWidget::ValueSliderChangedSlot( int p )
+{
+    if( updatingGUI_ ) return;
+    const double minValue = valueSpinBox_->minimum();
+    const double maxValue = valueSpinBox_->maximum();
+    valueSpinBox_->setValue( minValue + ( maxValue - minValue ) * p / VALUE_SLIDER_STEPS );
+}
+
+//------------------------------------------------------------------------------
+void GridDataSurfaceWidget::UpdateValueSlider()
+{
+    const bool updating = updatingGUI_;
+    ResourceHandler< bool > rh( updatingGUI_, true, updating );
+    const double minValue = valueSpinBox_->minimum();
+    const double maxValue = valueSpinBox_->maximum();
+    if( maxValue <= minValue ) return;
+    const double p = ( valueSpinBox_->value() - minValue ) / ( maxValue - minValue );
+    valueSlider_->setValue( int( p * VALUE_SLIDER_STEPS + 0.5 ) );
+}
+
 //------------------------------------------------------------------------------
 void GridDataSurfaceWidget::StepMultiplierChangedSlot( int v  )
 {
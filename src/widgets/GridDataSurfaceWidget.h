@@ -40,6 +40,7 @@ class QComboBox;
 class QLabel;
 class QDoubleSpinBox;
 class QSpinBox;
+class QSlider;
 
 
 //-------------------------------------
@@ -54,6 +55,7 @@ class QSpinBox;
 //  ---------------------------------
 //        ____ __
 // Value |____|^v|
+//  ---------[]---------------------
 //                  ____ __
 // Step Multiplier |____|^v|
 //                  ___________ _
@@ -82,6 +84,8 @@ private slots:
     void RenderingStyleChangedSlot( int );
     /// Emits a ValueChanged signal.
     void ValueChangedSlot( double  );
+    /// Sets the isosurface value from the slider position.
+    void ValueSliderChangedSlot( int );
     /// Emits a StepMultipllierChanged signal.
     void StepMultiplierChangedSlot( int );
     /// Emits a SurfaceChanged signal.
@@ -128,10 +132,15 @@ private:
     void SetColor( const QColor& );
     /// Set color from r, g, b floats/
     void SetColor( float r, float g, float b );
+    /// Moves the slider to the position matching the isosurface value.
+    void UpdateValueSlider();
     /// Reference to molecule.
     MolekelMolecule* mol_;
     /// Isosurface value.
     QDoubleSpinBox* valueSpinBox_;
+    /// Isosurface value slider, spanning the spin box range: dragging the
+    /// slider with real-time update enabled reuses the grid already computed.
+    QSlider* valueSlider_;
     /// Step multiplier value.
     QSpinBox* stepMulSpinBox_;
     /// Rendering style.
@@ -22,7 +22,9 @@
 // $Revision$
 //
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <limits>
 
 // QT
@@ -38,6 +40,7 @@
 #include <QHeaderView>
 #include <QStringList>
 #include <QDoubleSpinBox>
+#include <QSpinBox>
 #include <QMessageBox>
 #include <QCheckBox>
 #include <QComboBox>
@@ -50,6 +53,15 @@
 #include "MoleculeElDensSurfaceWidget.h"
 #include "../utility/RAII.h"
 
+namespace
+{
+    /// Number of isosurface value slider steps.
+    const int VALUE_SLIDER_STEPS = 1000;
+    /// Decimal logarithm of the isosurface values at the two slider ends.
+    const double VALUE_SLIDER_MIN_EXP = -4.0;
+    const double VALUE_SLIDER_MAX_EXP = 0.0;
+}
+
 const QString MoleculeElDensSurfaceWidget::POSITIVE_ORBITAL_COLOR_KEY = 
 	"gui/eldens_surface_widget/positive_orbital_color";
 const QString MoleculeElDensSurfaceWidget::NEGATIVE_ORBITAL_COLOR_KEY = 
@@ -75,6 +87,12 @@ const QString MoleculeElDensSurfaceWidget::NODAL_SURFACE_KEY =
 	"gui/eldens_surface_widget/nodal_surface";
 const QString MoleculeElDensSurfaceWidget::STEP_SIZE_KEY = 
 	"gui/eldens_surface_widget/stepsize";
+const QString MoleculeElDensSurfaceWidget::COARSE_STEP_KEY = 
+	"gui/eldens_surface_widget/coarse_step";
+const QString MoleculeElDensSurfaceWidget::DOUBLE_PRECISION_KEY = 
+	"gui/eldens_surface_widget/double_precision";
+const QString MoleculeElDensSurfaceWidget::MEMORY_BUDGET_KEY = 
+	"gui/eldens_surface_widget/memory_budget";
 
 #ifdef PERSISTENT_ISOBBOX
 const QString MoleculeElDensSurfaceWidget::BBOX_DX_KEY = 
@@ -159,6 +177,13 @@ void MoleculeElDensSurfaceWidget::CreateGUI()
     valueLayout->setSpacing( 40 );
     valueLayout->addWidget( valueLabel );
     valueLayout->addWidget( valueSpinBox_ );
+    valueSlider_ = new QSlider( Qt::Horizontal );
+    valueSlider_->setRange( 0, VALUE_SLIDER_STEPS );
+    UpdateValueSlider();
+    connect( valueSlider_, SIGNAL( valueChanged( int ) ),
+             this, SLOT( ValueSliderChangedSlot( int ) ) );
+    connect( valueSpinBox_, SIGNAL( valueChanged( double ) ),
+             this, SLOT( UpdateValueSlider() ) );
 
     // Check boxes for sign and nodal surface
     signCheckBox_ = new QCheckBox( "Use both signs" );
@@ -270,6 +295,41 @@ void MoleculeElDensSurfaceWidget::CreateGUI()
     stepSizeLayout->addWidget( stepSizeLabel );
     stepSizeLayout->addWidget( stepSizeSpinBox_ );
 
+    // Grid computation options
+    QGridLayout* gridOptionsLayout = new QGridLayout;
+    coarseStepSpinBox_ = new QSpinBox;
+    coarseStepSpinBox_->setRange( 1, 8 );
+    coarseStepSpinBox_->setSpecialValueText( tr( "Off" ) );
+    coarseStepSpinBox_->setValue( s.value( COARSE_STEP_KEY, 1 ).toInt() );
+    coarseStepSpinBox_->setToolTip( tr( "Approximate: the grid is first evaluated every n steps and "
+                                         "refined only near the isosurface;\n"
+                                         "features smaller than half a coarse cell can be missed" ) );
+    connect( coarseStepSpinBox_, SIGNAL( valueChanged( int ) ),
+             this, SLOT( GridOptionsChangedSlot() ) );
+    gridOptionsLayout->addWidget( new QLabel( tr( "Adaptive coarse step" ) ), 0, 0 );
+    gridOptionsLayout->addWidget( coarseStepSpinBox_, 0, 1 );
+    doublePrecisionCheckBox_ = new QCheckBox( tr( "Double precision" ) );
+    checked = Qt::CheckState( s.value( DOUBLE_PRECISION_KEY, Qt::Unchecked ).toInt() );
+    doublePrecisionCheckBox_->setCheckState( checked );
+    doublePrecisionCheckBox_->setToolTip( tr( "Store grid values as double instead of float: "
+                                               "grids take twice the memory" ) );
+    connect( doublePrecisionCheckBox_, SIGNAL( stateChanged( int ) ),
+             this, SLOT( GridOptionsChangedSlot() ) );
+    gridOptionsLayout->addWidget( doublePrecisionCheckBox_, 1, 0, 1, 2 );
+    memoryBudgetSpinBox_ = new QSpinBox;
+    memoryBudgetSpinBox_->setRange( 0, 65536 );
+    memoryBudgetSpinBox_->setSingleStep( 64 );
+    memoryBudgetSpinBox_->setSuffix( " MB" );
+    memoryBudgetSpinBox_->setSpecialValueText( tr( "Unlimited" ) );
+    memoryBudgetSpinBox_->setValue( s.value( MEMORY_BUDGET_KEY, 0 ).toInt() );
+    memoryBudgetSpinBox_->setToolTip( tr( "Larger grids are computed in tiles stored in a temporary file; "
+                                           "the grid is not kept to change the isovalue" ) );
+    connect( memoryBudgetSpinBox_, SIGNAL( valueChanged( int ) ),
+             this, SLOT( GridOptionsChangedSlot() ) );
+    gridOptionsLayout->addWidget( new QLabel( tr( "Grid memory budget" ) ), 2, 0 );
+    gridOptionsLayout->addWidget( memoryBudgetSpinBox_, 2, 1 );
+    FoldableWidget* gridOptionsGroup = new FoldableWidget( gridOptionsLayout, "Grid Computation" );
+
     // Bounding box
     QGroupBox* bboxFrame = new QGroupBox;
     bboxFrame->setTitle( tr( "Bounding Box" ) );
@@ -371,9 +431,11 @@ void MoleculeElDensSurfaceWidget::CreateGUI()
     /// Fill layout
     mainLayout->addWidget( table_ );
     mainLayout->addItem( valueLayout );
+    mainLayout->addWidget( valueSlider_ );
     mainLayout->addItem( checkBoxesLayout );
     mainLayout->addItem( stepSizeLayout );
     mainLayout->addItem( bboxStepsLayout );
+    mainLayout->addWidget( gridOptionsGroup );
     mainLayout->addItem( renderingStyleLayout );
 
     /// Assign layout to this widget
@@ -818,5 +880,50 @@ void MoleculeElDensSurfaceWidget::NodalSurfaceSlot( int state )
 	emit ValuesChanged();
 }
 
+//------------------------------------------------------------------------------
+void MoleculeElDensSurfaceWidget::GridOptionsChangedSlot()
+{
+	QSettings s;
+	s.setValue( COARSE_STEP_KEY, coarseStepSpinBox_->value() );
+	s.setValue( DOUBLE_PRECISION_KEY, int( doublePrecisionCheckBox_->checkState() ) );
+	s.setValue( MEMORY_BUDGET_KEY, memoryBudgetSpinBox_->value() );
+}
+
+//------------------------------------------------------------------------------
+int MoleculeElDensSurfaceWidget::GetIsoGridCoarseStep() const
+{
+    return coarseStepSpinBox_->value();
+}
+
+//------------------------------------------------------------------------------
+bool MoleculeElDensSurfaceWidget::GetDoublePrecisionGrids() const
+{
+    return doublePrecisionCheckBox_->checkState() == Qt::Checked;
+}
+
+//------------------------------------------------------------------------------
+size_t MoleculeElDensSurfaceWidget::GetGridMemoryBudget() const
+{
+    return size_t( memoryBudgetSpinBox_->value() ) * 1024 * 1024;
+}
 
+//------------------------------------------------------------------------------
+void MoleculeElDensSurfaceWidget::ValueSliderChangedSlot( int p )
+{
+    if( updatingGUI_ ) return;
+    const double e = VALUE_SLIDER_MIN_EXP +
+        ( VALUE_SLIDER_MAX_EXP - VALUE_SLIDER_MIN_EXP ) * p / VALUE_SLIDER_STEPS;
+    valueSpinBox_->setValue( std::pow( 10.0, e ) );
+}
 
+//------------------------------------------------------------------------------
+void MoleculeElDensSurfaceWidget::UpdateValueSlider()
+{
+    const bool updating = updatingGUI_;
+    ResourceHandler< bool > rh( updatingGUI_, true, updating );
+    const double v = valueSpinBox_->value();
+    if( v <= 0. ) { valueSlider_->setValue( 0 ); return; }
+    const double p = ( std::log10( v ) - VALUE_SLIDER_MIN_EXP ) /
+                     ( VALUE_SLIDER_MAX_EXP - VALUE_SLIDER_MIN_EXP );
+    valueSlider_->setValue( int( std::min( 1.0, std::max( 0.0, p ) ) * VALUE_SLIDER_STEPS + 0.5 ) );
+}
@@ -34,10 +34,12 @@ class QTableWidget;
 class QTableWidgetItem;
 class QLineEdit;
 class QDoubleSpinBox;
+class QSpinBox;
 class QCheckBox;
 class QComboBox;
 class QColor;
 class QLabel;
+class QSlider;
 
 //--------------------------------
 // _______________________________
@@ -93,6 +95,12 @@ private slots:
     /// Called when 'Nodal surface' check box toggled. Emits
     /// a ValuesChanged signal.
     void NodalSurfaceSlot( int );
+    /// Sets the isosurface value from the slider position.
+    void ValueSliderChangedSlot( int );
+    /// Moves the slider to the position matching the isosurface value.
+    void UpdateValueSlider();
+    /// Saves the grid computation options.
+    void GridOptionsChangedSlot();
     
 signals:
     /// Emitted whenever an orbital in the cell is selected.
@@ -146,6 +154,12 @@ public:
     bool GetSteps( int steps[ 3 ] ) const;
     /// Returns bounding box size.
     bool GetBBoxSize( double bboxSize[ 3 ] ) const;
+    /// Returns the initial step of the adaptive grid evaluation, 1 if disabled.
+    int GetIsoGridCoarseStep() const;
+    /// Returns true if grids have to be computed with double precision scalars.
+    bool GetDoublePrecisionGrids() const;
+    /// Returns the grid memory budget in bytes, zero if unlimited.
+    size_t GetGridMemoryBudget() const;
     /// Sets current rendering style.
     void SetRenderingStyle( MolekelMolecule::RenderingStyle rs );
     /// Sets current transparency for density matrix.
@@ -186,6 +200,9 @@ private:
     QTableWidget* table_;
     /// Isosurface value.
     QDoubleSpinBox* valueSpinBox_;
+    /// Isosurface value slider with logarithmic scale: dragging the slider
+    /// with real-time update enabled reuses the grid already computed.
+    QSlider* valueSlider_;
     /// Bounding box size along x axis.
     QDoubleSpinBox* dxSpinBox_;
     /// Bounding box size along y axis.
@@ -222,6 +239,12 @@ private:
     QDoubleSpinBox* posTransparencyWidget_;
     /// Nodal surface transparency slider.
     QDoubleSpinBox* nodTransparencyWidget_;
+    /// Initial step of the adaptive grid evaluation.
+    QSpinBox* coarseStepSpinBox_;
+    /// Double precision grids.
+    QCheckBox* doublePrecisionCheckBox_;
+    /// Grid memory budget in MB.
+    QSpinBox* memoryBudgetSpinBox_;
     /// Set to true when UI is being updated Update/CreateGUI to
     /// avoid executing code in slot methods.
     bool updatingGUI_;
@@ -247,6 +270,9 @@ private:
     static const QString BOTH_SIGNS_KEY;
     static const QString NODAL_SURFACE_KEY;
     static const QString STEP_SIZE_KEY;
+    static const QString COARSE_STEP_KEY;
+    static const QString DOUBLE_PRECISION_KEY;
+    static const QString MEMORY_BUDGET_KEY;
 #ifdef PERSISTENT_ISOBBOX
     static const QString BBOX_DX_KEY;
     static const QString BBOX_DY_KEY;
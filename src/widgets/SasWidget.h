@@ -30,6 +30,12 @@
 #include <QGridLayout>
 #include <QLabel>
 #include <QCheckBox>
+#include <QSpinBox>
+#include <QTableWidget>
+#include <QTableWidgetItem>
+#include <QHeaderView>
+#include <QStringList>
+#include <vector>
 
 #include "../MolekelMolecule.h"
 #include "../utility/RAII.h"
@@ -46,9 +52,21 @@
 //                   ______ __
 // Step             |______|^v| (spin box)
 //
+// [ ] Sphere splatting
+//
 //                   _______ _
 // Rendering Style  |_______|v|
 //
+//                   ______ __
+// Dots per atom    |______|^v| (spin box)
+//
+// [ ] All frames
+//
+// Area: <area> Volume: <volume>
+//  _______________________________________
+// | Residue/Atom/Frame | Area | (Volume)  |
+// |____________________|______|___________|
+//
 //-----------------------------------------
 //
 /// GUI widget for specifying SAS parameters.
@@ -97,6 +115,11 @@ public:
                                        stepSpinBox_( 0 ),
                                        renderingStyleComboBox_( 0 ),
                                        mepCheckBox_( 0 ),
+                                       splattingCheckBox_( 0 ),
+                                       dotsSpinBox_( 0 ),
+                                       allFramesCheckBox_( 0 ),
+                                       measuresLabel_( 0 ),
+                                       measuresTable_( 0 ),
                                        updatingGUI_( false )
 
     {
@@ -132,6 +155,30 @@ public:
         renderingStyleComboBox_->addItem( "Transparent Solid", int( MolekelMolecule::TRANSPARENT_SOLID ) );
         mainLayout->addWidget( new QLabel( "Rendering style" ), 3, 0 );
         mainLayout->addWidget( renderingStyleComboBox_, 3, 1 );
+        // sphere splatting
+        splattingCheckBox_ = new QCheckBox( "Sphere splatting" );
+        splattingCheckBox_->setCheckState( m->GetSASSphereSplatting() ? Qt::Checked : Qt::Unchecked );
+        mainLayout->addWidget( splattingCheckBox_, 4, 0 );
+        // surface area and volume
+        dotsSpinBox_ = new QSpinBox;
+        dotsSpinBox_->setMinimum( 10 );
+        dotsSpinBox_->setMaximum( 10000 );
+        dotsSpinBox_->setValue( 100 );
+        dotsSpinBox_->setSingleStep( 10 );
+        mainLayout->addWidget( new QLabel( "Dots per atom" ), 5, 0 );
+        mainLayout->addWidget( dotsSpinBox_, 5, 1 );
+        allFramesCheckBox_ = new QCheckBox( "All frames" );
+        allFramesCheckBox_->setCheckState( Qt::Unchecked );
+        allFramesCheckBox_->setEnabled( m->GetNumberOfFrames() > 1 );
+        mainLayout->addWidget( allFramesCheckBox_, 6, 0 );
+        measuresLabel_ = new QLabel;
+        mainLayout->addWidget( measuresLabel_, 7, 0, 1, 2 );
+        measuresTable_ = new QTableWidget;
+        measuresTable_->setEditTriggers( QAbstractItemView::NoEditTriggers );
+        measuresTable_->setAlternatingRowColors( true );
+        measuresTable_->verticalHeader()->hide();
+        measuresTable_->setEnabled( false );
+        mainLayout->addWidget( measuresTable_, 8, 0, 1, 2 );
         setLayout( mainLayout );
 
         // connect signals to slots
@@ -160,6 +207,55 @@ public:
     void SetMolecule( MolekelMolecule* m ) { mol_ = m; }
     /// Returns true if compute MEP checkbox is checked.
     bool ComputeMep() const { return mepCheckBox_->checkState() == Qt::Checked; }
+    /// Returns true if sphere splatting checkbox is checked.
+    bool SphereSplatting() const { return splattingCheckBox_->checkState() == Qt::Checked; }
+    /// Returns number of dots per atom used to compute areas.
+    int GetDotsPerAtom() const { return dotsSpinBox_->value(); }
+    /// Returns true if areas have to be computed for all the frames.
+    bool AllFrames() const { return allFramesCheckBox_->checkState() == Qt::Checked; }
+    /// Displays computed areas and volumes: residue areas or, if not available,
+    /// atom areas for a single frame; area and volume of each frame for
+    /// multiple frames.
+    void SetMeasures( const std::vector< MolekelMolecule::SASMeasures >& m )
+    {
+        measuresTable_->clear();
+        measuresTable_->setRowCount( 0 );
+        measuresTable_->setEnabled( !m.empty() );
+        measuresLabel_->clear();
+        if( m.empty() ) return;
+        QStringList labels;
+        if( m.size() > 1 )
+        {
+            measuresLabel_->setText( QString( "%1 frames" ).arg( m.size() ) );
+            labels << "Frame" << "Area" << "Volume";
+            measuresTable_->setColumnCount( 3 );
+            measuresTable_->setHorizontalHeaderLabels( labels );
+            measuresTable_->setRowCount( int( m.size() ) );
+            for( int f = 0; f != int( m.size() ); ++f )
+            {
+                measuresTable_->setItem( f, 0, new QTableWidgetItem( QString( "%1" ).arg( f + 1 ) ) );
+                measuresTable_->setItem( f, 1, new QTableWidgetItem( QString( "%1" ).arg( m[ f ].area ) ) );
+                measuresTable_->setItem( f, 2, new QTableWidgetItem( QString( "%1" ).arg( m[ f ].volume ) ) );
+            }
+            return;
+        }
+        measuresLabel_->setText( QString( "Area: %1  Volume: %2" ).arg( m[ 0 ].area )
+                                                                 .arg( m[ 0 ].volume ) );
+        measuresTable_->setColumnCount( 2 );
+        const bool residues = !m[ 0 ].residueLabels.empty();
+        labels << ( residues ? "Residue" : "Atom" ) << "Area";
+        measuresTable_->setHorizontalHeaderLabels( labels );
+        const int rows = int( residues ? m[ 0 ].residueAreas.size() : m[ 0 ].atomAreas.size() );
+        measuresTable_->setRowCount( rows );
+        for( int r = 0; r != rows; ++r )
+        {
+            const QString label = residues ? QString( m[ 0 ].residueLabels[ r ].c_str() ) :
+                                             QString( "%1" ).arg( r + 1 );
+            const double area = residues ? m[ 0 ].residueAreas[ r ] : m[ 0 ].atomAreas[ r ];
+            measuresTable_->setItem( r, 0, new QTableWidgetItem( label ) );
+            measuresTable_->setItem( r, 1, new QTableWidgetItem( QString( "%1" ).arg( area ) ) );
+        }
+    }
     /// Sets the current rendering style.
     void SetRenderingStyle( MolekelMolecule::RenderingStyle rs )
     {
@@ -178,6 +274,16 @@ private:
     QComboBox* renderingStyleComboBox_;
     /// MEP
     QCheckBox* mepCheckBox_;
+    /// Sphere splatting.
+    QCheckBox* splattingCheckBox_;
+    /// Dots per atom.
+    QSpinBox* dotsSpinBox_;
+    /// Compute areas for all frames.
+    QCheckBox* allFramesCheckBox_;
+    /// Total area and volume.
+    QLabel* measuresLabel_;
+    /// Per residue, atom or frame areas.
+    QTableWidget* measuresTable_;
     /// Internal variable used to detect from within slots when UI is being updated.
     bool updatingGUI_;
 };
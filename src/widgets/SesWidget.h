@@ -54,6 +54,7 @@
 //
 //  --[ ]Use MSMS------------------------
 // |                                     |
+// | [ ] Run MSMS executable             |
 // | MSMS Path                           |
 // |  ___________________   ___________  |
 // | |___________________| |_Select..._| |
@@ -135,6 +136,7 @@ public:
                                        mepCheckBox_( 0 ),
                                        msmsGroupBox_( 0 ),
                                        msmsPathLineEdit_( 0 ),
+                                       msmsExecutableCheckBox_( 0 ),
                                        updatingGUI_( false )
 
     {
@@ -172,6 +174,10 @@ public:
         msmsGroupBox_->setCheckable( true );
         msmsGroupBox_->setChecked( true );
         QVBoxLayout* msmsLayout = new QVBoxLayout;
+        // surface computed in process unless the MSMS executable is explicitly requested
+        msmsExecutableCheckBox_ = new QCheckBox( "Run MSMS executable" );
+        msmsExecutableCheckBox_->setCheckState( m->GetInProcessSESMS() ? Qt::Unchecked : Qt::Checked );
+        msmsLayout->addWidget( msmsExecutableCheckBox_ );
         msmsLayout->addWidget( new QLabel( "MSMS Executable" ) );
         QHBoxLayout* msmsPathLayout = new QHBoxLayout;
         msmsPathLineEdit_ = new QLineEdit;
@@ -225,6 +231,12 @@ public:
     bool UseMSMS() const { return msmsGroupBox_->isChecked(); }
     /// Returns MSMS file path.
     QString GetMSMSFilePath() const { return msmsPathLineEdit_->text(); }
+    /// Returns true if the MSMS executable has to be run instead of computing
+    /// the surface in process.
+    bool RunMSMSExecutable() const
+    {
+        return msmsExecutableCheckBox_->checkState() == Qt::Checked;
+    }
     /// Sets the current rendering style.
     void SetRenderingStyle( MolekelMolecule::RenderingStyle rs )
     {
@@ -247,6 +259,8 @@ private:
     QGroupBox* msmsGroupBox_;
     /// MSMS executable path.
     QLineEdit* msmsPathLineEdit_;
+    /// Run MSMS executable.
+    QCheckBox* msmsExecutableCheckBox_;
     /// Internal variable used to detect from within slots when UI is being updated.
     bool updatingGUI_;
 };